@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <furi.h>
+#include <furi_hal.h>
 #include <gui/gui.h>
 #include <gui/view_dispatcher.h>
 #include <gui/view.h>
@@ -28,19 +29,30 @@ static int32_t js_run(void* context);
 #define IMPORT_CONSOLE_LOG 7
 #define IMPORT_CONSOLE_WARN 8
 #define IMPORT_FS_OPEN_SYNC 9
+#define IMPORT_HOST_BATCH 10
 
 // A function exported by VM to for the host to call
 const mvm_VMExportID MAIN = 1;
 /* Use when needed
 const mvm_VMExportID INIT = 2;
 */
-
-mvm_TeError resolveImport(mvm_HostFunctionID id, void*, mvm_TfHostFunction* out);
-mvm_TeError flipper_furi_delay_ms(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
+#ifdef JS_BENCH
+// Optional export, only in builds with JS_BENCH defined. If present, it is
+// called repeatedly after "main" and the calls per second are logged, to
+// measure the host-to-VM call overhead.
+const mvm_VMExportID BENCH = 3;
+#define BENCH_CALL_COUNT 10000
+#endif
+
+mvm_TeError resolveImport(mvm_HostFunctionID id, void*, mvm_TsHostFunctionInfo* out);
+#ifdef JS_BENCH
+static void js_bench(mvm_VM* vm, mvm_Value func);
+#endif
+mvm_TeError flipper_furi_delay_ms(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args);
 mvm_TeError flipper_canvas_stop(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
-mvm_TeError flipper_canvas_set_font(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
-mvm_TeError flipper_canvas_draw_str(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
-mvm_TeError flipper_canvas_draw_str_aligned(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
+mvm_TeError flipper_canvas_set_font(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args);
+mvm_TeError flipper_canvas_draw_str(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args);
+mvm_TeError flipper_canvas_draw_str_aligned(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args);
 mvm_TeError console_clear(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
 mvm_TeError console_log(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
 mvm_TeError console_warn(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
@@ -181,7 +193,7 @@ static int32_t js_run(void* context) {
     mvm_Value result;
 
     // Restore the VM from the snapshot
-    err = mvm_restore(&vm, fileBuff, fileSize, NULL, resolveImport);
+    err = mvm_restoreEx(&vm, fileBuff, fileSize, NULL, resolveImport);
     if (err != MVM_E_SUCCESS) {
         FURI_LOG_E(TAG, "Error with restore: %d", err);
         return err;
@@ -201,12 +213,52 @@ static int32_t js_run(void* context) {
         return err;
     }
 
+#ifdef JS_BENCH
+    // Run the benchmark, if the script exports one
+    mvm_Value bench;
+    if (mvm_resolveExports(vm, &BENCH, &bench, 1) == MVM_E_SUCCESS) {
+        js_bench(vm, bench);
+    }
+#endif
+
     // Clean up
     mvm_runGC(vm, true);
 
     return 0;
 }
 
+#ifdef JS_BENCH
+static void js_bench(mvm_VM* vm, mvm_Value func) {
+    mvm_TsPreparedCall call;
+    mvm_Value result;
+    mvm_TeError err;
+
+    err = mvm_prepareCall(vm, func, 0, &call);
+    if (err != MVM_E_SUCCESS) {
+        FURI_LOG_E(TAG, "Error with bench: %d", err);
+        return;
+    }
+
+    // Keep the stack between calls so that each call doesn't allocate it
+    mvm_setStackResident(vm, true);
+    uint32_t start = furi_get_tick();
+    for (uint32_t i = 0; i < BENCH_CALL_COUNT; i++) {
+        err = mvm_callPrepared(vm, &call, &result, NULL);
+        if (err != MVM_E_SUCCESS) break;
+    }
+    uint32_t ticks = furi_get_tick() - start;
+    mvm_setStackResident(vm, false);
+
+    if (err != MVM_E_SUCCESS) {
+        FURI_LOG_E(TAG, "Error with bench: %d", err);
+        return;
+    }
+    if (ticks == 0) ticks = 1;
+    FURI_LOG_I(TAG, "bench: %lu calls/s",
+        (uint32_t)((uint64_t)BENCH_CALL_COUNT * furi_kernel_get_tick_frequency() / ticks));
+}
+#endif // JS_BENCH
+
 int32_t js_app() {
     JSRtThread* jsThread = malloc(sizeof(JSRtThread));
 
@@ -316,44 +368,74 @@ void fatalError(void* vm, int e) {
 }
 
 /*
- * This function is called by `mvm_restore` to search for host functions
+ * Timestamp used by the VM to measure garbage collection pauses (see
+ * MVM_GC_TIMER_FUNCTION in application.fam). This is the Cortex-M cycle
+ * counter, so the pause times in mvm_TsMemoryStats are in CPU cycles
+ * (furi_hal_cortex_instructions_per_microsecond() per microsecond).
+ */
+uint32_t js_gc_timer(void) {
+    return furi_hal_cortex_timer_get(0).start;
+}
+
+/*
+ * This function is called by `mvm_restoreEx` to search for host functions
  * imported by the VM based on their ID. Given an ID, it needs to pass back
  * a pointer to the corresponding C function to be used by the VM.
+ *
+ * The host functions in this file don't call back into the VM, so they're
+ * registered as leaf functions, which the VM can call more cheaply. The batch
+ * function is not a leaf, since it calls the other host functions through
+ * the VM.
  */
-mvm_TeError resolveImport(mvm_HostFunctionID funcID, void* context, mvm_TfHostFunction* out) {
+mvm_TeError resolveImport(mvm_HostFunctionID funcID, void* context, mvm_TsHostFunctionInfo* out) {
     UNUSED(context);
     if (funcID == IMPORT_FLIPPER_FURI_DELAY_MS) {
-        *out = flipper_furi_delay_ms;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->signature = "i";
+        out->typedHostFunction = flipper_furi_delay_ms;
     } else if (funcID == IMPORT_FLIPPER_CANVAS_SET_FONT) {
-        *out = flipper_canvas_set_font;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->signature = "i";
+        out->typedHostFunction = flipper_canvas_set_font;
         return MVM_E_SUCCESS;
     } else if (funcID == IMPORT_FLIPPER_CANVAS_DRAW_STR) {
-        *out = flipper_canvas_draw_str;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->signature = "iiS";
+        out->typedHostFunction = flipper_canvas_draw_str;
         return MVM_E_SUCCESS;
     } else if (funcID == IMPORT_FLIPPER_CANVAS_DRAW_STR_ALIGNED) {
-        *out = flipper_canvas_draw_str_aligned;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->signature = "iiiiS";
+        out->typedHostFunction = flipper_canvas_draw_str_aligned;
     } else if (funcID == IMPORT_CONSOLE_LOG) {
-      *out = console_log;
+      out->flags = MVM_HOST_FUNCTION_LEAF;
+      out->hostFunction = console_log;
       return MVM_E_SUCCESS;
     } else if (funcID == IMPORT_CONSOLE_CLEAR) {
-        *out = console_clear;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->hostFunction = console_clear;
         return MVM_E_SUCCESS;
     } else if (funcID == IMPORT_CONSOLE_WARN) {
-        *out = console_warn;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->hostFunction = console_warn;
         return MVM_E_SUCCESS;
     } else if (funcID == IMPORT_FS_OPEN_SYNC) {
-        *out = fs_open_sync;
+        out->flags = MVM_HOST_FUNCTION_LEAF;
+        out->hostFunction = fs_open_sync;
+        return MVM_E_SUCCESS;
+    } else if (funcID == IMPORT_HOST_BATCH) {
+        out->hostFunction = mvm_hostBatch;
         return MVM_E_SUCCESS;
     }
     return MVM_E_UNRESOLVED_IMPORT;
 }
 
-mvm_TeError flipper_furi_delay_ms(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+mvm_TeError flipper_furi_delay_ms(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args) {
+    UNUSED(vm);
     UNUSED(funcID);
     UNUSED(result);
-    furi_assert(argCount == 1);
     FURI_LOG_I(TAG, "delay_ms()");
-    furi_delay_ms((int32_t)mvm_toInt32(vm, args[0]));
+    furi_delay_ms(args[0].int32);
     return MVM_E_SUCCESS;
 }
 
@@ -368,39 +450,39 @@ mvm_TeError flipper_canvas_stop(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value
     return MVM_E_SUCCESS;
 }
 
-mvm_TeError flipper_canvas_set_font(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+mvm_TeError flipper_canvas_set_font(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args) {
+    UNUSED(vm);
     UNUSED(funcID);
     UNUSED(result);
-    furi_assert(argCount == 1);
     FURI_LOG_I(TAG, "canvas_set_font()");
     // display->cEvent = CSetFont;
-    display->font = mvm_toInt32(vm, args[0]);
+    display->font = args[0].int32;
     // display->cEvent = CNone;
     return MVM_E_SUCCESS;
 }
 
-mvm_TeError flipper_canvas_draw_str(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+mvm_TeError flipper_canvas_draw_str(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args) {
+    UNUSED(vm);
     UNUSED(funcID);
     UNUSED(result);
-    furi_assert(argCount == 3);
     FURI_LOG_I(TAG, "canvas_draw_str()");
-    display->x = (int32_t)mvm_toInt32(vm, args[0]);
-    display->y = (int32_t)mvm_toInt32(vm, args[1]);
-    display->str = (const char*)mvm_toStringUtf8(vm, args[2], NULL);
+    display->x = args[0].int32;
+    display->y = args[1].int32;
+    display->str = args[2].str;
     display->cEvent = CDrawStr;
     return MVM_E_SUCCESS;
 }
 
-mvm_TeError flipper_canvas_draw_str_aligned(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+mvm_TeError flipper_canvas_draw_str_aligned(mvm_VM* vm, mvm_HostFunctionID funcID, mvm_Value* result, const mvm_TuHostArg* args) {
+    UNUSED(vm);
     UNUSED(funcID);
     UNUSED(result);
-    furi_assert(argCount == 5);
     FURI_LOG_I(TAG, "canvas_draw_str_aligned()");
-    display->x = (int32_t)mvm_toInt32(vm, args[0]);
-    display->y = (int32_t)mvm_toInt32(vm, args[1]);
-    display->horizontal = (int32_t)mvm_toInt32(vm, args[2]);
-    display->vertical = (int32_t)mvm_toInt32(vm, args[3]);
-    display->str = (const char*)mvm_toStringUtf8(vm, args[4], NULL);
+    display->x = args[0].int32;
+    display->y = args[1].int32;
+    display->horizontal = args[2].int32;
+    display->vertical = args[3].int32;
+    display->str = args[4].str;
     display->cEvent = CDrawStrAli;
     return MVM_E_SUCCESS;
 }
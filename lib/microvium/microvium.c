@@ -504,6 +504,32 @@ typedef enum vm_TeOpcodeEx4 {
   VM_OP4_END
 } vm_TeOpcodeEx4;
 
+// Fused instructions (superinstructions), which the verifier writes over common
+// instruction sequences in the RAM copy of the bytecode when
+// MVM_FUSE_INSTRUCTIONS is enabled. They never appear in a bytecode image. Each
+// is encoded as the reserved opcode `VM_OP1_RESERVED_VIRTUAL_NEW` followed by
+// the 8-bit vm_TeFusedOpcode and its operands, padded to the same size as the
+// sequence it replaces so that the addresses of other instructions don't change.
+typedef enum vm_TeFusedOpcode {
+  // LOAD_VAR_1 + LOAD_SMALL_LITERAL (integer) + ADD
+  VM_FUSED_LOAD_VAR_ADD_LITERAL   = 0x00, // (+ 4-bit variable index, 4-bit vm_TeSmallLiteralValue)
+  // LOAD_ARG_1 + LOAD_LITERAL + OBJECT_GET_1
+  VM_FUSED_LOAD_ARG_GET_LITERAL   = 0x01, // (+ 8-bit arg index + 16-bit property key)
+  // NUM_OP comparison + BRANCH_1. The comparisons are in the same order as in
+  // vm_TeNumberOp.
+  VM_FUSED_LESS_THAN_BRANCH       = 0x02, // (+ 8-bit signed offset)
+  VM_FUSED_GREATER_THAN_BRANCH    = 0x03, // (+ 8-bit signed offset)
+  VM_FUSED_LESS_EQUAL_BRANCH      = 0x04, // (+ 8-bit signed offset)
+  VM_FUSED_GREATER_EQUAL_BRANCH   = 0x05, // (+ 8-bit signed offset)
+  // NUM_OP comparison + BRANCH_2
+  VM_FUSED_LESS_THAN_BRANCH_2     = 0x06, // (+ 16-bit signed offset)
+  VM_FUSED_GREATER_THAN_BRANCH_2  = 0x07, // (+ 16-bit signed offset)
+  VM_FUSED_LESS_EQUAL_BRANCH_2    = 0x08, // (+ 16-bit signed offset)
+  VM_FUSED_GREATER_EQUAL_BRANCH_2 = 0x09, // (+ 16-bit signed offset)
+
+  VM_FUSED_END
+} vm_TeFusedOpcode;
+
 
 // Number operations. These are operations which take one or two arguments from
 // the stack and coerce them to numbers. Each of these will have two
@@ -584,6 +610,19 @@ typedef enum vm_TeSmallLiteralValue {
 #define MVM_STACK_SIZE 256
 #endif
 
+#ifndef MVM_MAX_STACK_SIZE
+#define MVM_MAX_STACK_SIZE MVM_STACK_SIZE
+#endif
+
+#if MVM_MAX_STACK_SIZE < MVM_STACK_SIZE
+#error MVM_MAX_STACK_SIZE must be at least MVM_STACK_SIZE
+#endif
+
+// Catch targets are saved on the stack as Int14 word offsets
+#if MVM_MAX_STACK_SIZE > 0x3FFE
+#error MVM_MAX_STACK_SIZE must be at most 0x3FFE
+#endif
+
 #ifndef MVM_ALLOCATION_BUCKET_SIZE
 #define MVM_ALLOCATION_BUCKET_SIZE 256
 #endif
@@ -608,6 +647,94 @@ typedef enum vm_TeSmallLiteralValue {
 #define MVM_DONT_TRUST_BYTECODE 1
 #endif
 
+#ifndef MVM_VERIFY_BYTECODE
+#define MVM_VERIFY_BYTECODE 0
+#endif
+
+#ifndef MVM_GAS_COUNTER_AMORTIZED
+#define MVM_GAS_COUNTER_AMORTIZED 0
+#endif
+
+#ifndef MVM_FUSE_INSTRUCTIONS
+#define MVM_FUSE_INSTRUCTIONS 0
+#endif
+
+#if MVM_FUSE_INSTRUCTIONS && !MVM_VERIFY_BYTECODE
+#error MVM_FUSE_INSTRUCTIONS requires MVM_VERIFY_BYTECODE
+#endif
+
+#ifndef MVM_FUSE_IN_PLACE
+#define MVM_FUSE_IN_PLACE 0
+#endif
+
+#if MVM_FUSE_IN_PLACE && MVM_CODE_CACHE
+#error MVM_FUSE_IN_PLACE cannot be used with MVM_CODE_CACHE
+#endif
+
+#ifndef MVM_INLINE_CACHE
+#define MVM_INLINE_CACHE 0
+#endif
+
+#ifndef MVM_INLINE_CACHE_SIZE
+#define MVM_INLINE_CACHE_SIZE 16
+#endif
+
+#if MVM_INLINE_CACHE && (MVM_INLINE_CACHE_SIZE & (MVM_INLINE_CACHE_SIZE - 1))
+#error MVM_INLINE_CACHE_SIZE must be a power of 2
+#endif
+
+#ifndef MVM_CALL_TARGET_CACHE
+#define MVM_CALL_TARGET_CACHE 0
+#endif
+
+#ifndef MVM_SCOPE_CACHE
+#define MVM_SCOPE_CACHE 0
+#endif
+
+#ifndef MVM_SCOPE_CACHE_SIZE
+#define MVM_SCOPE_CACHE_SIZE 8
+#endif
+
+#if MVM_SCOPE_CACHE && (MVM_SCOPE_CACHE_SIZE & (MVM_SCOPE_CACHE_SIZE - 1))
+#error MVM_SCOPE_CACHE_SIZE must be a power of 2
+#endif
+
+#ifndef MVM_TAIL_CALLS
+#define MVM_TAIL_CALLS 0
+#endif
+
+#ifndef MVM_LEAF_HOST_FUNCTIONS
+#define MVM_LEAF_HOST_FUNCTIONS 0
+#endif
+
+#ifndef MVM_HOST_FUNCTION_SIGNATURES
+#define MVM_HOST_FUNCTION_SIGNATURES 0
+#endif
+
+#ifndef MVM_HOST_SIGNATURE_MAX_ARGS
+#define MVM_HOST_SIGNATURE_MAX_ARGS 8
+#endif
+
+#ifndef MVM_CALL_TARGET_CACHE_SIZE
+#define MVM_CALL_TARGET_CACHE_SIZE 8
+#endif
+
+#if MVM_CALL_TARGET_CACHE && (MVM_CALL_TARGET_CACHE_SIZE & (MVM_CALL_TARGET_CACHE_SIZE - 1))
+#error MVM_CALL_TARGET_CACHE_SIZE must be a power of 2
+#endif
+
+#ifndef MVM_OBJECT_SHAPES
+#define MVM_OBJECT_SHAPES 0
+#endif
+
+#ifndef MVM_SHARED_SHAPE_LIMIT
+#define MVM_SHARED_SHAPE_LIMIT 64
+#endif
+
+#if MVM_GAS_COUNTER_AMORTIZED && !defined(MVM_GAS_COUNTER)
+#error MVM_GAS_COUNTER_AMORTIZED requires MVM_GAS_COUNTER
+#endif
+
 #ifndef MVM_VERY_EXPENSIVE_MEMORY_CHECKS
 #define MVM_VERY_EXPENSIVE_MEMORY_CHECKS 0
 #endif
@@ -660,6 +787,82 @@ typedef enum vm_TeSmallLiteralValue {
 #define MVM_CASE(value) case value
 #endif
 
+#ifndef MVM_COMPUTED_GOTO_DISPATCH
+#define MVM_COMPUTED_GOTO_DISPATCH 0
+#endif
+
+#if MVM_COMPUTED_GOTO_DISPATCH && !defined(__GNUC__)
+#error "MVM_COMPUTED_GOTO_DISPATCH requires a compiler that supports labels as values (GCC or Clang)"
+#endif
+
+// When MVM_COMPUTED_GOTO_DISPATCH is enabled, the port file is expected to
+// define MVM_CASE in terms of this, so that each case in the interpreter is
+// also a label that can be used in a dispatch table. The labels are marked as
+// unused because the same MVM_CASE macro is used for switch statements that
+// don't have a dispatch table.
+#define MVM_COMPUTED_GOTO_LABEL(value) LBL_##value
+#define MVM_COMPUTED_GOTO_CASE(value) MVM_COMPUTED_GOTO_LABEL(value): __attribute__((unused)) case value
+
+#ifndef MVM_CODE_CACHE
+#define MVM_CODE_CACHE 0
+#endif
+
+#ifndef MVM_CODE_CACHE_BUDGET
+#define MVM_CODE_CACHE_BUDGET 4096
+#endif
+
+#if MVM_CODE_CACHE && !MVM_COMPUTED_GOTO_DISPATCH
+#error MVM_CODE_CACHE requires MVM_COMPUTED_GOTO_DISPATCH
+#endif
+
+#if MVM_CODE_CACHE && !MVM_VERIFY_BYTECODE
+#error MVM_CODE_CACHE requires MVM_VERIFY_BYTECODE
+#endif
+
+#ifndef MVM_GC_NURSERY
+#define MVM_GC_NURSERY 0
+#endif
+
+#ifndef MVM_GC_NURSERY_SIZE
+#define MVM_GC_NURSERY_SIZE 256
+#endif
+
+#ifndef MVM_GC_REMEMBERED_SET_SIZE
+#define MVM_GC_REMEMBERED_SET_SIZE 16
+#endif
+
+#if MVM_GC_NURSERY && (MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE)
+// The nursery is identified by heap offset, which is the ShortPtr encoding only
+// when MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE are disabled
+#error MVM_GC_NURSERY requires MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE to be 0
+#endif
+
+#ifndef MVM_GC_INCREMENTAL
+#define MVM_GC_INCREMENTAL 0
+#endif
+
+#ifndef MVM_GC_INCREMENTAL_START
+#define MVM_GC_INCREMENTAL_START (MVM_MAX_HEAP_SIZE / 2)
+#endif
+
+#ifndef MVM_GC_INCREMENTAL_SLICE_SIZE
+#define MVM_GC_INCREMENTAL_SLICE_SIZE 256
+#endif
+
+#if MVM_GC_INCREMENTAL && (MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE)
+// Tospace is placed after fromspace in the heap offset space, which is the
+// ShortPtr encoding only when these are disabled
+#error MVM_GC_INCREMENTAL requires MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE to be 0
+#endif
+
+#if MVM_GC_INCREMENTAL && MVM_GC_NURSERY
+#error MVM_GC_INCREMENTAL and MVM_GC_NURSERY cannot be used together
+#endif
+
+#ifndef MVM_GC_TIMER
+#define MVM_GC_TIMER() 0
+#endif
+
 #ifndef MVM_INCLUDE_SNAPSHOT_CAPABILITY
 #define MVM_INCLUDE_SNAPSHOT_CAPABILITY 1
 #endif
@@ -710,6 +913,18 @@ typedef enum vm_TeSmallLiteralValue {
   #endif
 #endif
 
+#ifndef MVM_USE_HEAP_ARENA
+#define MVM_USE_HEAP_ARENA 0
+#endif
+
+#if MVM_USE_HEAP_ARENA && (MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE)
+#error MVM_USE_HEAP_ARENA requires MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE to be 0
+#endif
+
+#if MVM_USE_HEAP_ARENA && (MVM_GC_NURSERY || MVM_GC_INCREMENTAL)
+#error MVM_USE_HEAP_ARENA cannot be used with MVM_GC_NURSERY or MVM_GC_INCREMENTAL
+#endif
+
 #ifndef MVM_MALLOC
 #define MVM_MALLOC(size) malloc(size)
 #endif
@@ -1199,7 +1414,7 @@ typedef enum TeTypeCode {
 
   TC_REF_CLASS              = 0x9, // TsClass
   TC_REF_VIRTUAL            = 0xA, // Reserved: TsVirtual
-  TC_REF_RESERVED_1         = 0xB, // Reserved
+  TC_REF_SHAPED_OBJECT      = 0xB, // TsShapedObject - Object with its keys in a shared shape (see MVM_OBJECT_SHAPES)
   TC_REF_PROPERTY_LIST      = 0xC, // TsPropertyList - Object represented as linked list of properties
   TC_REF_ARRAY              = 0xD, // TsArray
   TC_REF_FIXED_LENGTH_ARRAY = 0xE, // TsFixedLengthArray
@@ -1365,6 +1580,46 @@ typedef struct TsPropertyCell /* extends TsPropertyList */ {
   Value value;
 } TsPropertyCell;
 
+#if MVM_OBJECT_SHAPES
+/**
+ * An object (TC_REF_SHAPED_OBJECT) that only stores the values of its
+ * properties. The keys and the prototype are in its shape, which is shared with
+ * other objects that were created with the same prototype and had the same
+ * properties added in the same order. The value at index `i` is the property
+ * with the key at index `i` in the shape.
+ *
+ * As with TsPropertyList, a new property is added by appending a cell (a
+ * TsShapedObject with a single value) to the `dpNext` chain, and the GC
+ * compacts the chain into the head allocation. Shaped objects are only created
+ * at runtime, so they're always in RAM.
+ */
+typedef struct TsShapedObject {
+  DynamicPtr dpNext; // TsShapedObject* or VM_VALUE_NULL, containing further appended values
+  ShortPtr spShape; // Note: the shape is only meaningful on the first in the list
+  /*
+  Followed by the property values to the end of the allocated size
+   */
+} TsShapedObject;
+
+/**
+ * A shape is a TC_REF_FIXED_LENGTH_ARRAY with the following slots, followed by
+ * the keys of the properties (TC_VAL_INT14 or TC_REF_INTERNED_STRING).
+ *
+ * Shapes form a tree. The roots have no keys and are in a linked list starting
+ * at `vm->shapeRoots`, one for each prototype. Each child shape (transition)
+ * has the keys of its parent plus one more.
+ */
+typedef enum vm_TeShapeSlot {
+  VM_SHAPE_PROTO = 0,
+  // The first transition from this shape, or VM_VALUE_NULL if there are none,
+  // or VM_VALUE_DELETED if the shape isn't in the shape tree
+  VM_SHAPE_FIRST_CHILD = 1,
+  // The next transition from the same parent (or the next root shape)
+  VM_SHAPE_NEXT_SIBLING = 2,
+  VM_SHAPE_KEYS = 3,
+} vm_TeShapeSlot;
+#endif // MVM_OBJECT_SHAPES
+
 /**
  * A TsClosure (TC_REF_CLOSURE) is a function-like (callable) container that is
  * overloaded to represent both closures and/or their variable environments.
@@ -1457,10 +1712,145 @@ typedef struct TsBucket {
   /* ...data */
 } TsBucket;
 
-typedef struct TsBreakpoint {
-  struct TsBreakpoint* next;
-  int bytecodeAddress;
-} TsBreakpoint;
+#if MVM_USE_HEAP_ARENA
+// Each half of the heap arena (see MVM_USE_HEAP_ARENA) holds one bucket with
+// room for the whole heap, rounded up so that the second half is aligned
+#define HEAP_ARENA_SEMISPACE_SIZE ((sizeof (TsBucket) + MVM_MAX_HEAP_SIZE + sizeof (void*) - 1) & ~(sizeof (void*) - 1))
+#define HEAP_ARENA_SIZE (2 * HEAP_ARENA_SEMISPACE_SIZE)
+#endif // MVM_USE_HEAP_ARENA
+
+#if !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA
+// The bucket index (see vm_indexBucket) divides heap offsets and native
+// addresses into chunks of this many bytes (as a power of 2)
+#define BUCKET_INDEX_CHUNK_SHIFT 8
+
+#if MVM_GC_INCREMENTAL
+// An incremental collection puts tospace after fromspace, and the heap then
+// starts where tospace did, so heap offsets move through the whole 16-bit
+// range. But the heap only spans up to 2 * MVM_MAX_HEAP_SIZE of it at a time
+// (fromspace and tospace), plus the partial chunks at either end, so the
+// offset index wraps around at a power of 2 that covers that span.
+#define BUCKET_INDEX_HEAP_CHUNKS (((2 * MVM_MAX_HEAP_SIZE) >> BUCKET_INDEX_CHUNK_SHIFT) + 2)
+#if BUCKET_INDEX_HEAP_CHUNKS <= 4
+#define BUCKET_INDEX_OFFSET_CHUNKS 4
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 8
+#define BUCKET_INDEX_OFFSET_CHUNKS 8
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 16
+#define BUCKET_INDEX_OFFSET_CHUNKS 16
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 32
+#define BUCKET_INDEX_OFFSET_CHUNKS 32
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 64
+#define BUCKET_INDEX_OFFSET_CHUNKS 64
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 128
+#define BUCKET_INDEX_OFFSET_CHUNKS 128
+#else
+#define BUCKET_INDEX_OFFSET_CHUNKS 256
+#endif
+#define BUCKET_INDEX_OFFSET_SLOT(chunk) ((chunk) & (BUCKET_INDEX_OFFSET_CHUNKS - 1))
+#else
+// Heap offsets are less than MVM_MAX_HEAP_SIZE
+#define BUCKET_INDEX_HEAP_CHUNKS ((MVM_MAX_HEAP_SIZE >> BUCKET_INDEX_CHUNK_SHIFT) + 1)
+#define BUCKET_INDEX_OFFSET_CHUNKS BUCKET_INDEX_HEAP_CHUNKS
+#define BUCKET_INDEX_OFFSET_SLOT(chunk) (chunk)
+#endif
+
+// Address chunks are hashed into a table of this many entries (a power of 2),
+// with room for the chunks that the bucket headers and spare capacity add
+#if BUCKET_INDEX_HEAP_CHUNKS <= 8
+#define BUCKET_INDEX_ADDRESS_CHUNKS 16
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 32
+#define BUCKET_INDEX_ADDRESS_CHUNKS 64
+#elif BUCKET_INDEX_HEAP_CHUNKS <= 128
+#define BUCKET_INDEX_ADDRESS_CHUNKS 256
+#else
+#define BUCKET_INDEX_ADDRESS_CHUNKS 512
+#endif
+#endif // !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA
+
+#if MVM_CODE_CACHE
+// A pre-decoded instruction in the code cache (see MVM_CODE_CACHE). Executing
+// it is equivalent to the decoding steps in `vm_call`, up to the point where
+// the instruction handler is dispatched.
+typedef struct vm_TsDecodedInstruction {
+  // Instruction handler in `vm_call`, or NULL if not decoded yet
+  const void* handler;
+  uint16_t reg1;
+  uint8_t reg3;
+  // Number of bytes consumed by the decoding, and VM_DECODED_POP_REG2
+  uint8_t lengthAndFlags;
+} vm_TsDecodedInstruction;
+
+#define VM_DECODED_LENGTH_MASK 0x0F
+// Flag to pop the first operand into reg2 before dispatching
+#define VM_DECODED_POP_REG2 0x80
+
+typedef struct vm_TsCodeCacheEntry {
+  // Next entry in order of most recent use
+  struct vm_TsCodeCacheEntry* next;
+  // Entry point of the function
+  LongPtr lpCode;
+  // Number of bytes of code reachable from the entry point. Zero if the
+  // function can't be cached, so that it isn't measured again on every call.
+  uint16_t codeSize;
+  // One slot for each byte of code (only the slots at the start of an
+  // instruction are used)
+  vm_TsDecodedInstruction* instructions;
+} vm_TsCodeCacheEntry;
+#endif // MVM_CODE_CACHE
+
+#if MVM_INLINE_CACHE
+// Flag on vm_TsInlineCacheEntry: the property was found on a prototype
+#define VM_IC_INHERITED 1
+// Flag on vm_TsInlineCacheEntry: the prototype chain passes through RAM, so
+// the entry is only valid until the next property is added to any object
+#define VM_IC_CHECK_EPOCH 2
+// Flag on vm_TsInlineCacheEntry: the property is an own property of a shaped
+// object, so the entry also applies to other objects with the same shape
+#define VM_IC_SHAPE 4
+
+// Where a property access instruction last found its property (see
+// MVM_INLINE_CACHE)
+typedef struct vm_TsInlineCacheEntry {
+  // Bytecode offset of the OBJECT_GET_1 or OBJECT_SET_1 instruction, or 0 if
+  // the entry is empty
+  uint16_t site;
+  Value propertyName;
+  // The object on which the property was found, or the prototype of the object
+  // if the property is inherited (VM_IC_INHERITED)
+  Value object;
+  uint16_t epoch;
+  uint8_t flags;
+  #if MVM_OBJECT_SHAPES
+  // If VM_IC_SHAPE is set, the shape of the object and the index of the value
+  uint16_t index;
+  Value shape;
+  #endif
+  // The value slot of the property
+  LongPtr lpSlot;
+} vm_TsInlineCacheEntry;
+#endif // MVM_INLINE_CACHE
+
+#if MVM_CALL_TARGET_CACHE
+// A decoded function header (see MVM_CALL_TARGET_CACHE)
+typedef struct vm_TsCallTargetCacheEntry {
+  // Bytecode offset of the function (or continuation), or 0 if the entry is
+  // empty
+  uint16_t offset;
+  // Stack space needed to call the function, in words
+  uint16_t requiredStackWords;
+} vm_TsCallTargetCacheEntry;
+#endif // MVM_CALL_TARGET_CACHE
+
+#if MVM_SCOPE_CACHE
+// The location of a variable in an outer scope (see MVM_SCOPE_CACHE)
+typedef struct vm_TsScopeCacheEntry {
+  // The closure register when the variable was accessed, or 0 if the entry is
+  // empty (0 is never a valid pointer to an allocation)
+  Value closure;
+  uint16_t varIndex;
+  LongPtr lpSlot;
+} vm_TsScopeCacheEntry;
+#endif // MVM_SCOPE_CACHE
 
 /*
   Minimum size:
@@ -1484,13 +1874,28 @@ struct mvm_VM {
   TsBucket* pLastBucket;
   // End of the capacity of the last bucket of GC memory
   uint16_t* pLastBucketEndCapacity;
+  #if !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA
+  // Bucket index for ShortPtr_decode and ShortPtr_encode (see vm_indexBucket)
+  TsBucket* bucketOffsetIndex[BUCKET_INDEX_OFFSET_CHUNKS];
+  TsBucket* bucketAddressIndex[BUCKET_INDEX_ADDRESS_CHUNKS];
+  #endif
+  #if MVM_USE_HEAP_ARENA
+  // Memory that the heap buckets are laid out in (see MVM_USE_HEAP_ARENA)
+  void* pHeapArena;
+  #endif
   // Handles - values to treat as GC roots
   mvm_Handle* gc_handles;
 
   void* context;
 
   #if MVM_INCLUDE_DEBUG_CAPABILITY
-  TsBreakpoint* pBreakpoints;
+  // One bit for each byte of bytecode, set if there is a breakpoint at that
+  // address. Allocated when the first breakpoint is set, and freed when the
+  // last is removed, so the interpreter only needs to check this pointer to
+  // know whether there are any breakpoints at all.
+  uint8_t* pBreakpointBitmap;
+  uint16_t breakpointCount; // Number of bits set in pBreakpointBitmap
+  bool breakOnEveryInstruction; // Breakpoint at address -1
   mvm_TfBreakpointCallback breakpointCallback;
   #endif // MVM_INCLUDE_DEBUG_CAPABILITY
 
@@ -1498,8 +1903,133 @@ struct mvm_VM {
   int32_t stopAfterNInstructions; // Set to -1 to disable
   #endif // MVM_GAS_COUNTER
 
+  #if MVM_VERIFY_BYTECODE
+  // Bitmap with a bit for each 2-byte word of the ROM section, set if a
+  // function (or continuation) entry at that address has been verified
+  uint8_t* pVerifiedFunctions;
+  // Bounds of the ROM section that pVerifiedFunctions covers, cached so that
+  // the check on each call doesn't need to read the bytecode header
+  uint16_t verifiedRomStart;
+  uint16_t verifiedRomSize;
+  // Greatest stack depth reached by the async catch block, or 0xFFFF if there
+  // is no valid async catch block
+  uint16_t asyncCatchBlockMaxDepth;
+  #endif // MVM_VERIFY_BYTECODE
+
+  #if MVM_FUSE_INSTRUCTIONS
+  // RAM copy of the constant part of the bytecode image (everything before the
+  // globals), containing fused instructions. `lpBytecode` points to this copy,
+  // or to the original image if there wasn't enough memory to copy it. With
+  // MVM_FUSE_IN_PLACE, this is the host's image itself and isn't freed.
+  uint8_t* pFusedBytecode;
+  LongPtr lpOriginalBytecode;
+  uint16_t fusedInstructionCount;
+  #endif // MVM_FUSE_INSTRUCTIONS
+
+  #if MVM_CODE_CACHE
+  // Pre-decoded functions, most recently used first
+  vm_TsCodeCacheEntry* pCodeCache;
+  // Bytes allocated to the code cache, up to MVM_CODE_CACHE_BUDGET
+  size_t codeCacheSize;
+  #endif // MVM_CODE_CACHE
+
+  #if MVM_INLINE_CACHE
+  // Table of MVM_INLINE_CACHE_SIZE entries, indexed by a hash of the bytecode
+  // offset of the property access, or NULL if not allocated yet. Cleared by the
+  // GC, since it holds pointers to allocations.
+  vm_TsInlineCacheEntry* pInlineCache;
+  // Incremented whenever a property is added to an object
+  uint16_t inlineCacheEpoch;
+  #endif // MVM_INLINE_CACHE
+
+  #if MVM_CALL_TARGET_CACHE
+  // Indexed by the function offset. The bytecode doesn't change, so the entries
+  // never need to be invalidated.
+  vm_TsCallTargetCacheEntry callTargetCache[MVM_CALL_TARGET_CACHE_SIZE];
+  #endif // MVM_CALL_TARGET_CACHE
+
+  #if MVM_SCOPE_CACHE
+  // Indexed by a hash of the closure and variable index. Cleared by the GC,
+  // since the scopes move.
+  vm_TsScopeCacheEntry scopeCache[MVM_SCOPE_CACHE_SIZE];
+  #endif // MVM_SCOPE_CACHE
+
+  #if MVM_OBJECT_SHAPES
+  // Root shapes (one per prototype), linked through VM_SHAPE_NEXT_SIBLING. The
+  // shape tree is a GC root, so shapes are shared across collections.
+  Value shapeRoots;
+  // Number of non-root shapes in the shape tree
+  uint16_t sharedShapeCount;
+  #endif // MVM_OBJECT_SHAPES
+
   uint16_t heapSizeUsedAfterLastGC;
   uint16_t stackHighWaterMark;
+
+  #if MVM_GC_NURSERY
+  // Heap offset where the nursery (allocations since the last collection) starts
+  uint16_t nurseryStart;
+  // Slots in the old generation that the write barrier has seen being assigned
+  // a pointer into the nursery. These are extra roots for a minor collection.
+  Value* rememberedSet[MVM_GC_REMEMBERED_SET_SIZE];
+  uint16_t rememberedCount;
+  // Set if the remembered set was full, so the next minor collection must
+  // search the whole old generation for pointers into the nursery
+  bool rememberedSetOverflowed;
+  #endif // MVM_GC_NURSERY
+
+  #if MVM_GC_INCREMENTAL
+  // State of the incremental collection in progress, or NULL if there isn't one
+  struct gc_TsGCCollectionState* pIncrementalGC;
+  // Allocations at or after this heap offset may still contain pointers into
+  // fromspace (0xFFFF if there's no incremental collection in progress)
+  uint16_t gcScanOffset;
+  // Heap offset of the first bucket. An incremental collection leaves the heap
+  // after where fromspace was, so this isn't 0 until the next full collection.
+  uint16_t heapStart;
+  #endif // MVM_GC_INCREMENTAL
+
+  // Collection statistics (see mvm_TsMemoryStats)
+  uint32_t gcCount;
+  uint32_t minorGCCount;
+  uint32_t lastGCBytesCopied;
+  uint32_t totalGCBytesCopied;
+  uint32_t lastGCPauseTime;
+  uint32_t totalGCPauseTime;
+  uint32_t maxGCPauseTime;
+  #if MVM_GC_INCREMENTAL
+  uint16_t lastGCSliceWork;
+  uint16_t maxGCSliceWork;
+  #endif
+  uint32_t heapBucketCount;
+  uint32_t totalMallocSize;
+
+  // See mvm_setHeapGrowthPolicy
+  mvm_TsHeapGrowthPolicy heapGrowthPolicy;
+
+  // Number of times the stack has been allocated (see mvm_setStackResident)
+  uint32_t stackAllocationCount;
+  // If true, the stack is kept allocated when the VM is idle
+  bool stackResident;
+  // Number of host functions currently being called. The stack can't be moved
+  // (grown) while this is non-zero, since the host holds pointers into it.
+  uint8_t activeHostCallCount;
+  // The stack can grow up to this size in bytes (see mvm_setMaxStackSize)
+  uint16_t maxStackSize;
+
+  #if MVM_LEAF_HOST_FUNCTIONS
+  // mvm_TeHostFunctionFlags for each resolved import, located after the globals
+  uint8_t* pImportFlags;
+  #endif // MVM_LEAF_HOST_FUNCTIONS
+
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  // Signature of each resolved import, or NULL, located after the import table
+  const char** pImportSignatures;
+  #endif // MVM_HOST_FUNCTION_SIGNATURES
+
+  #if MVM_LEAF_HOST_FUNCTIONS && MVM_SAFE_MODE
+  // True while a leaf host function is running, to catch it calling the VM
+  bool inLeafHostFunction;
+  #endif
   uint16_t heapHighWaterMark;
 
   #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
@@ -1611,6 +2141,13 @@ typedef struct vm_TsRegisters { // 28 B on 32-bit machine
 struct vm_TsStack {
   // Allocate registers along with the stack, because these are needed at the same time (i.e. while the VM is active)
   vm_TsRegisters reg;
+  // Size in bytes of the stack memory that follows. This is MVM_STACK_SIZE
+  // initially, but the stack may grow up to `vm->maxStackSize`.
+  uint16_t capacity;
+  // The stack can be used up to here without growing it or raising the
+  // high-water mark, so checking for stack space below this is a single
+  // comparison (see REQUIRE_STACK_SPACE).
+  uint16_t* pCheckedLimit;
   // Note: the stack grows upwards (towards higher addresses)
   // ... (stack memory) ...
 };
@@ -1646,6 +2183,28 @@ typedef struct gc_TsGCCollectionState {
   TsBucket* firstBucket;
   TsBucket* lastBucket;
   uint16_t* lastBucketEndCapacity;
+  // Pointers below this heap offset are not collected (0 for a full collection)
+  uint16_t nurseryStart;
+  #if MVM_GC_INCREMENTAL
+  // An incremental collection puts tospace after fromspace rather than
+  // overlapping it, so that the program can use the heap between slices. This
+  // is the heap offset where tospace starts (0 for a full collection).
+  uint16_t toSpaceStart;
+  uint16_t fromSpaceSize;
+  // Bucket space given to the program since the collection started
+  uint16_t allocatedSize;
+  // Position of the Cheney scan. A large container can be scanned over several
+  // slices, so this can be part way through one.
+  TsBucket* scanBucket;
+  uint16_t* scanPtr;
+  uint16_t* scanSlotsEnd;
+  uint16_t* scanNext;
+  // Start of the allocation that scanPtr is in (or scanPtr if it's between allocations)
+  uint16_t* scanAllocation;
+  // One bit per tospace word, marking allocations that have been scanned ahead
+  // of the Cheney scan because the program accessed them (see gc_scanOnAccess)
+  uint8_t* scannedOnAccess;
+  #endif // MVM_GC_INCREMENTAL
 } gc_TsGCCollectionState;
 
 typedef struct mvm_TsCallStackFrame {
@@ -1681,8 +2240,18 @@ typedef struct mvm_TsHeapAllocationInfo {
 #define VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS 4
 
 static inline mvm_HostFunctionID vm_getHostFunctionId(VM*vm, uint16_t hostFunctionIndex);
+static inline TeError vm_callHostFunction(VM* vm, uint16_t importIndex, Value* pResult, Value* pArgs, uint8_t argCount);
+#if MVM_HOST_FUNCTION_SIGNATURES
+static TeError vm_callTypedHostFunction(VM* vm, mvm_TfTypedHostFunction hostFunction, const char* signature, mvm_HostFunctionID hostFunctionID, Value* pResult, Value* pArgs, uint8_t argCount);
+static bool vm_isValidHostSignature(const char* signature);
+#endif
 static TeError vm_createStackAndRegisters(VM* vm);
+static TeError vm_call(VM* vm, Value targetFunc, uint16_t functionOffset, Value* out_result, Value* args, uint8_t argCount);
+static void vm_initRegisters(VM* vm, vm_TsStack* stack);
+static bool vm_releaseIdleStack(VM* vm);
 static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t sizeRequiredInWords);
+static TeError vm_growStack(VM* vm, uint16_t sizeRequiredInWords);
+static void vm_rebaseRegisters(vm_TsRegisters* reg, vm_TsStack* oldStack, vm_TsStack* newStack);
 static Value vm_convertToString(VM* vm, Value value);
 static Value vm_concat(VM* vm, Value* left, Value* right);
 static TeTypeCode deepTypeOf(VM* vm, Value value);
@@ -1691,7 +2260,24 @@ static int32_t vm_readInt32(VM* vm, TeTypeCode type, Value value);
 static TeError vm_resolveExport(VM* vm, mvm_VMExportID id, Value* result);
 static inline mvm_TfHostFunction* vm_getResolvedImports(VM* vm);
 static void gc_createNextBucket(VM* vm, uint16_t bucketSize, uint16_t minBucketSize);
+static uint16_t gc_nextBucketSize(VM* vm);
+static void vm_indexBucket(VM* vm, TsBucket* bucket, uint16_t* pEndCapacity);
+static void vm_rebuildBucketIndex(VM* vm);
 static void gc_freeGCMemory(VM* vm);
+#if MVM_GC_NURSERY
+static uint16_t getHeapSize(VM* vm);
+static void gc_collectNursery(VM* vm);
+static void gc_rememberSlot(VM* vm, Value* pSlot);
+#endif // MVM_GC_NURSERY
+#if MVM_GC_INCREMENTAL
+static void gc_scanOnAccess(VM* vm, uint16_t offsetInHeap, uint16_t* p);
+static void gc_clearNewAllocation(uint16_t* p);
+static void gc_finishIncremental(VM* vm);
+static void gc_recordPause(VM* vm, uint32_t startTime);
+#define VM_HEAP_START(vm) ((vm)->heapStart)
+#else
+#define VM_HEAP_START(vm) 0
+#endif // MVM_GC_INCREMENTAL
 static Value vm_allocString(VM* vm, size_t sizeBytes, void** data);
 static TeError toPropertyName(VM* vm, Value* value);
 static void toInternedString(VM* vm, Value* pValue);
@@ -1724,6 +2310,7 @@ static uint16_t getSectionSize(VM* vm, mvm_TeBytecodeSection section);
 static Value vm_intToStr(VM* vm, int32_t i);
 static Value vm_newStringFromCStrNT(VM* vm, const char* s);
 static TeError vm_validatePortFileMacros(MVM_LONG_PTR_TYPE lpBytecode, mvm_TsBytecodeHeader* pHeader, void* context);
+static TeError vm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport, mvm_TfResolveImportEx resolveImportEx);
 static LongPtr vm_toStringUtf8_long(VM* vm, Value value, size_t* out_sizeBytes);
 static LongPtr vm_findScopedVariable(VM* vm, uint16_t index);
 static inline Value vm_readScopedFromThisClosure(VM* vm, uint16_t varIndex);
@@ -1763,6 +2350,29 @@ static Value vm_newArray(VM* vm, uint16_t capacity);
 static void vm_arrayPush(VM* vm, Value* pvArr, Value* pvItem);
 static void growArray(VM* vm, Value* pvArr, uint16_t newLength, uint16_t newCapacity);
 
+#if MVM_VERIFY_BYTECODE
+static TeError vm_verifyBytecode(VM* vm);
+static inline bool vm_isFunctionVerified(VM* vm, uint16_t offset);
+static TeError vm_verifyFunctionOnCall(VM* vm, uint16_t offset);
+#endif // MVM_VERIFY_BYTECODE
+
+#if MVM_CODE_CACHE
+static vm_TsCodeCacheEntry* vm_codeCacheFind(VM* vm, LongPtr lpProgramCounter);
+static vm_TsCodeCacheEntry* vm_codeCacheEnter(VM* vm, uint16_t functionOffset);
+static void vm_codeCacheDecode(LongPtr lpInstruction, vm_TsDecodedInstruction* pInstruction, const void* const* const* dispatchTables);
+static void vm_codeCacheFree(VM* vm);
+#endif // MVM_CODE_CACHE
+
+#if MVM_INLINE_CACHE
+static bool vm_inlineCacheGet(VM* vm, uint16_t site, Value objectValue, Value propertyName, Value* out_value);
+static bool vm_inlineCacheSet(VM* vm, uint16_t site, Value objectValue, Value propertyName, Value value);
+static void vm_inlineCacheClear(VM* vm);
+#endif // MVM_INLINE_CACHE
+
+#if MVM_OBJECT_SHAPES
+static Value vm_newShapedObject(VM* vm, Value* pProto);
+#endif // MVM_OBJECT_SHAPES
+
 #if MVM_SUPPORT_FLOAT
 MVM_FLOAT64 mvm_toFloat64(mvm_VM* vm, Value value);
 #endif // MVM_SUPPORT_FLOAT
@@ -1840,7 +2450,7 @@ static const uint8_t typeByTC[TC_END] = {
   VM_T_SYMBOL,      /* TC_REF_SYMBOL             */
   VM_T_CLASS,       /* TC_REF_CLASS              */
   VM_T_END,         /* TC_REF_VIRTUAL            */
-  VM_T_END,         /* TC_REF_RESERVED_1         */
+  VM_T_OBJECT,      /* TC_REF_SHAPED_OBJECT      */
   VM_T_OBJECT,      /* TC_REF_PROPERTY_LIST      */
   VM_T_ARRAY,       /* TC_REF_ARRAY              */
   VM_T_ARRAY,       /* TC_REF_FIXED_LENGTH_ARRAY */
@@ -1865,7 +2475,18 @@ static const uint8_t typeByTC[TC_END] = {
 static int32_t mvm_float64ToInt32(MVM_FLOAT64 value);
 #endif
 
-#if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+#if MVM_VERY_EXPENSIVE_MEMORY_CHECKS && MVM_GC_NURSERY
+  #define VM_POTENTIAL_GC_POINT(vm) do { \
+    gc_collectNursery(vm); \
+    VM_EXEC_SAFE_MODE(vm->gc_potentialCycleNumber++;) \
+  } while (0)
+#elif MVM_VERY_EXPENSIVE_MEMORY_CHECKS && MVM_GC_INCREMENTAL
+  // Small slices, so that the program runs in between as much as possible
+  #define VM_POTENTIAL_GC_POINT(vm) do { \
+    mvm_runGCSlice(vm, 16); \
+    VM_EXEC_SAFE_MODE(vm->gc_potentialCycleNumber++;) \
+  } while (0)
+#elif MVM_VERY_EXPENSIVE_MEMORY_CHECKS
   #define VM_POTENTIAL_GC_POINT(vm) do { \
     mvm_runGC(vm, false); \
     VM_EXEC_SAFE_MODE(vm->gc_potentialCycleNumber++;) \
@@ -1876,6 +2497,22 @@ static int32_t mvm_float64ToInt32(MVM_FLOAT64 value);
   } while (0)
 #endif
 
+#if MVM_GC_NURSERY
+// Write barrier for the nursery. Must be used after storing a value into a slot
+// of a heap allocation that may already be in the old generation, so that a
+// minor collection can find the pointers from the old generation into the
+// nursery. The slot must not be on the stack or in the globals.
+static inline void vm_writeBarrier(VM* vm, Value* pSlot) {
+  Value value = *pSlot;
+  if (Value_isShortPtr(value) && (value >= vm->nurseryStart)) {
+    gc_rememberSlot(vm, pSlot);
+  }
+}
+#define VM_WRITE_BARRIER(vm, pSlot) vm_writeBarrier(vm, pSlot)
+#else
+#define VM_WRITE_BARRIER(vm, pSlot)
+#endif // MVM_GC_NURSERY
+
 // MVM_LOCAL declares a local variable whose value would become invalidated if
 // the GC performs a cycle. All access to the local should use MVM_GET_LOCAL AND
 // MVM_SET_LOCAL. This only needs to be used for pointer values or values that
@@ -1930,9 +2567,17 @@ static int32_t mvm_float64ToInt32(MVM_FLOAT64 value);
 #include "math.h"
 #endif
 
+// With computed-goto dispatch, GCC assumes that any `goto *` can reach any
+// instruction handler, so it can't see that the handler-local variables are
+// always initialized first.
+#if MVM_COMPUTED_GOTO_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
 /**
  * Public API to call into the VM to run the given function with the given
- * arguments (also contains the run loop).
+ * arguments.
  *
  * Control returns from `mvm_call` either when it hits an error or when it
  * executes a RETURN instruction within the called function.
@@ -1940,8 +2585,29 @@ static int32_t mvm_float64ToInt32(MVM_FLOAT64 value);
  * If the return code is MVM_E_UNCAUGHT_EXCEPTION then `out_result` points to the exception.
  */
 TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8_t argCount) {
+  // 126 is the maximum because we also push the `this` value implicitly
+  if (argCount > (AF_ARG_COUNT_MASK - 1)) {
+    CODE_COVERAGE_ERROR_PATH(220); // Not hit
+    return MVM_E_TOO_MANY_ARGUMENTS;
+  } else {
+    CODE_COVERAGE(15); // Hit
+  }
+
+  return vm_call(vm, targetFunc, 0, out_result, args, argCount);
+}
+
+/**
+ * The body of `mvm_call` and `mvm_callPrepared` (also contains the run loop).
+ *
+ * If `functionOffset` is non-zero, it's the bytecode offset of the function
+ * that `targetFunc` resolves to (see mvm_prepareCall), and the call goes
+ * straight to the function without resolving and dispatching on the target.
+ *
+ * The caller checks that `argCount` is in range.
+ */
+static TeError vm_call(VM* vm, Value targetFunc, uint16_t functionOffset, Value* out_result, Value* args, uint8_t argCount) {
   /*
-  Note: when microvium calls the host, only `mvm_call` is on the call stack.
+  Note: when microvium calls the host, only `vm_call` is on the call stack.
   This is for the objective of being lightweight. Each stack frame in an
   embedded environment can be quite expensive in terms of memory because of all
   the general-purpose registers that need to be preserved.
@@ -2034,11 +2700,59 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
     reg->pCatchTarget = temp ? pStackPointer + temp : NULL; \
   } while (false)
 
+  // Sets `err` according to whether there is space for the given number of
+  // words on the stack. If there isn't, the stack is grown, which may move it,
+  // so pointers into the stack (other than the registers) need to be
+  // calculated again afterward.
+  #define REQUIRE_STACK_SPACE(sizeRequiredInWords) do { \
+    if (pStackPointer + (sizeRequiredInWords) <= vm->stack->pCheckedLimit) { \
+      err = MVM_E_SUCCESS; \
+    } else { \
+      FLUSH_REGISTER_CACHE(); \
+      err = vm_requireStackSpace(vm, reg->pStackPointer, (sizeRequiredInWords)); \
+      reg = &vm->stack->reg; \
+      CACHE_REGISTERS(); \
+    } \
+  } while (false)
+
   // Reinterpret reg1 as 8-bit signed
   #define SIGN_EXTEND_REG_1() reg1 = (uint16_t)((int16_t)((int8_t)reg1))
 
   #define INSTRUCTION_RESERVED() VM_ASSERT(vm, false)
 
+  // Jump directly to the handler for `tag` using the given dispatch table,
+  // bypassing the switch that follows (see MVM_COMPUTED_GOTO_DISPATCH). The
+  // tag must already be known to be within the bounds of the table.
+  #if MVM_COMPUTED_GOTO_DISPATCH
+    #define VM_DISPATCH(table, tag) goto *table[tag]
+    #define L(value) &&MVM_COMPUTED_GOTO_LABEL(value)
+  #else
+    #define VM_DISPATCH(table, tag)
+  #endif
+
+  // Charge the gas for the straight-line block that ends at the current
+  // program counter, and start a new block (see MVM_GAS_COUNTER_AMORTIZED).
+  // The number of instructions in the block is approximated by its size in
+  // bytes.
+  #if MVM_GAS_COUNTER_AMORTIZED
+    #define GAS_CHARGE_BLOCK() do { \
+      if (vm->stopAfterNInstructions >= 0) { \
+        int32_t gasUsed = (int32_t)LongPtr_sub(lpProgramCounter, lpGasBlockStart); \
+        if ((vm->stopAfterNInstructions == 0) || (gasUsed > vm->stopAfterNInstructions)) { \
+          vm->stopAfterNInstructions = 0; \
+          err = MVM_E_INSTRUCTION_COUNT_REACHED; \
+          goto SUB_EXIT; \
+        } \
+        vm->stopAfterNInstructions -= gasUsed; \
+      } \
+      lpGasBlockStart = lpProgramCounter; \
+    } while (false)
+    #define GAS_START_BLOCK() lpGasBlockStart = lpProgramCounter
+  #else
+    #define GAS_CHARGE_BLOCK()
+    #define GAS_START_BLOCK()
+  #endif
+
   // ------------------------------ Common Variables --------------------------
 
   VM_SAFE_CHECK_NOT_NULL(vm);
@@ -2068,12 +2782,113 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
   uint16_t* globals;
   vm_TsRegisters* reg;
   vm_TsRegisters registerValuesAtEntry;
+  vm_TsStack* stackAtEntry; // The stack may move if it grows
 
-  #if MVM_DONT_TRUST_BYTECODE
+  #if MVM_DONT_TRUST_BYTECODE && !MVM_VERIFY_BYTECODE
     LongPtr maxProgramCounter;
     LongPtr minProgramCounter = getBytecodeSection(vm, BCS_ROM, &maxProgramCounter);
   #endif
 
+  #if MVM_GAS_COUNTER_AMORTIZED
+    // Start of the straight-line block of bytecode that hasn't been charged yet
+    LongPtr lpGasBlockStart;
+  #endif
+
+  #if MVM_CODE_CACHE
+    // Code cache entry for the function being executed, if any. This needs to
+    // be looked up again whenever the cache may have changed (i.e. after a
+    // call to the host, which may call back into the VM).
+    vm_TsCodeCacheEntry* pCodeCacheEntry = NULL;
+  #endif
+
+  #if MVM_COMPUTED_GOTO_DISPATCH
+    // Dispatch tables, indexed by opcode. Each table has an entry for every
+    // value the index can hold at the point of dispatch (a 4-bit nibble in all
+    // cases except Ex-4, which is range-checked), with unused or reserved
+    // opcodes going to SUB_INVALID_INSTRUCTION.
+
+    static const void* const opDispatchTable[16] = {
+      L(VM_OP_LOAD_SMALL_LITERAL), L(VM_OP_LOAD_VAR_1), L(VM_OP_LOAD_SCOPED_1),
+      L(VM_OP_LOAD_ARG_1), L(VM_OP_CALL_1), L(VM_OP_FIXED_ARRAY_NEW_1),
+      L(VM_OP_EXTENDED_1), L(VM_OP_EXTENDED_2), L(VM_OP_EXTENDED_3),
+      L(VM_OP_CALL_5), L(VM_OP_STORE_VAR_1), L(VM_OP_STORE_SCOPED_1),
+      L(VM_OP_ARRAY_GET_1), L(VM_OP_ARRAY_SET_1), L(VM_OP_NUM_OP),
+      L(VM_OP_BIT_OP),
+    };
+
+    static const void* const op1DispatchTable[16] = {
+      L(VM_OP1_RETURN), L(VM_OP1_THROW), L(VM_OP1_CLOSURE_NEW), L(VM_OP1_NEW),
+      #if MVM_FUSE_INSTRUCTIONS
+      L(VM_OP1_RESERVED_VIRTUAL_NEW), // Fused instructions
+      #else
+      &&SUB_INVALID_INSTRUCTION, // VM_OP1_RESERVED_VIRTUAL_NEW
+      #endif
+      L(VM_OP1_SCOPE_NEW), L(VM_OP1_TYPE_CODE_OF), L(VM_OP1_POP),
+      L(VM_OP1_TYPEOF), L(VM_OP1_OBJECT_NEW), L(VM_OP1_LOGICAL_NOT),
+      L(VM_OP1_OBJECT_GET_1), L(VM_OP1_ADD), L(VM_OP1_EQUAL),
+      L(VM_OP1_NOT_EQUAL), L(VM_OP1_OBJECT_SET_1),
+    };
+
+    static const void* const op2DispatchTable[16] = {
+      L(VM_OP2_BRANCH_1), L(VM_OP2_STORE_ARG), L(VM_OP2_STORE_SCOPED_2),
+      L(VM_OP2_STORE_VAR_2),
+      &&SUB_INVALID_INSTRUCTION, // VM_OP2_ARRAY_GET_2_RESERVED
+      &&SUB_INVALID_INSTRUCTION, // VM_OP2_ARRAY_SET_2_RESERVED
+      L(VM_OP2_JUMP_1), L(VM_OP2_CALL_HOST), L(VM_OP2_CALL_3),
+      L(VM_OP2_CALL_6), L(VM_OP2_LOAD_SCOPED_2), L(VM_OP2_LOAD_VAR_2),
+      L(VM_OP2_LOAD_ARG_2), L(VM_OP2_EXTENDED_4), L(VM_OP2_ARRAY_NEW),
+      L(VM_OP2_FIXED_ARRAY_NEW_2),
+    };
+
+    static const void* const op3DispatchTable[16] = {
+      L(VM_OP3_POP_N), L(VM_OP3_SCOPE_DISCARD), L(VM_OP3_SCOPE_CLONE),
+      L(VM_OP3_AWAIT), L(VM_OP3_AWAIT_CALL), L(VM_OP3_ASYNC_RESUME),
+      &&SUB_INVALID_INSTRUCTION, // VM_OP3_RESERVED_3
+      L(VM_OP3_JUMP_2), L(VM_OP3_LOAD_LITERAL), L(VM_OP3_LOAD_GLOBAL_3),
+      L(VM_OP3_LOAD_SCOPED_3), L(VM_OP3_BRANCH_2), L(VM_OP3_STORE_GLOBAL_3),
+      L(VM_OP3_STORE_SCOPED_3), L(VM_OP3_OBJECT_GET_2), L(VM_OP3_OBJECT_SET_2),
+    };
+
+    static const void* const op4DispatchTable[VM_OP4_END] = {
+      L(VM_OP4_START_TRY), L(VM_OP4_END_TRY), L(VM_OP4_OBJECT_KEYS),
+      L(VM_OP4_UINT8_ARRAY_NEW), L(VM_OP4_CLASS_CREATE),
+      L(VM_OP4_TYPE_CODE_OF), L(VM_OP4_LOAD_REG_CLOSURE),
+      L(VM_OP4_SCOPE_PUSH), L(VM_OP4_SCOPE_POP), L(VM_OP4_SCOPE_SAVE),
+      L(VM_OP4_ASYNC_START), L(VM_OP4_ASYNC_RETURN), L(VM_OP4_ENQUEUE_JOB),
+      L(VM_OP4_ASYNC_COMPLETE),
+    };
+
+    static const void* const numOpDispatchTable[16] = {
+      L(VM_NUM_OP_LESS_THAN), L(VM_NUM_OP_GREATER_THAN),
+      L(VM_NUM_OP_LESS_EQUAL), L(VM_NUM_OP_GREATER_EQUAL),
+      L(VM_NUM_OP_ADD_NUM), L(VM_NUM_OP_SUBTRACT), L(VM_NUM_OP_MULTIPLY),
+      L(VM_NUM_OP_DIVIDE), L(VM_NUM_OP_DIVIDE_AND_TRUNC),
+      L(VM_NUM_OP_REMAINDER), L(VM_NUM_OP_POWER), L(VM_NUM_OP_NEGATE),
+      L(VM_NUM_OP_UNARY_PLUS),
+      &&SUB_INVALID_INSTRUCTION, &&SUB_INVALID_INSTRUCTION,
+      &&SUB_INVALID_INSTRUCTION,
+    };
+
+    static const void* const bitOpDispatchTable[16] = {
+      L(VM_BIT_OP_SHR_ARITHMETIC), L(VM_BIT_OP_SHR_LOGICAL), L(VM_BIT_OP_SHL),
+      L(VM_BIT_OP_OR), L(VM_BIT_OP_AND), L(VM_BIT_OP_XOR), L(VM_BIT_OP_NOT),
+      &&SUB_INVALID_INSTRUCTION, &&SUB_INVALID_INSTRUCTION,
+      &&SUB_INVALID_INSTRUCTION, &&SUB_INVALID_INSTRUCTION,
+      &&SUB_INVALID_INSTRUCTION, &&SUB_INVALID_INSTRUCTION,
+      &&SUB_INVALID_INSTRUCTION, &&SUB_INVALID_INSTRUCTION,
+      &&SUB_INVALID_INSTRUCTION,
+    };
+
+    #if MVM_CODE_CACHE
+    // Tables for the opcode groups that vm_codeCacheDecode decodes through
+    static const void* const* const codeCacheDispatchTables[4] = {
+      opDispatchTable, op1DispatchTable, op2DispatchTable, op3DispatchTable,
+    };
+    #endif
+
+    #undef L
+  #endif // MVM_COMPUTED_GOTO_DISPATCH
+
   // Note: these initial values are not actually used, but some compilers give a
   // warning if you omit them.
   pFrameBase = 0;
@@ -2089,6 +2904,11 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
 
   CODE_COVERAGE(4); // Hit
 
+  #if MVM_LEAF_HOST_FUNCTIONS && MVM_SAFE_MODE
+  // Host functions registered as leaf functions must not call back into the VM
+  VM_ASSERT(vm, !vm->inLeafHostFunction);
+  #endif
+
   // Create the call stack if it doesn't exist
   if (!vm->stack) {
     CODE_COVERAGE(230); // Hit
@@ -2104,6 +2924,7 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
   reg = &vm->stack->reg;
 
   registerValuesAtEntry = *reg;
+  stackAtEntry = vm->stack;
 
   // Because we're coming from C-land, any exceptions that happen during
   // mvm_call should register as host errors
@@ -2111,18 +2932,13 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
 
   // Copy the state of the VM registers into the logical variables for quick access
   CACHE_REGISTERS();
+  GAS_START_BLOCK();
 
   // ---------------------- Push host arguments to the stack ------------------
 
-  // 126 is the maximum because we also push the `this` value implicitly
-  if (argCount > (AF_ARG_COUNT_MASK - 1)) {
-    CODE_COVERAGE_ERROR_PATH(220); // Not hit
-    return MVM_E_TOO_MANY_ARGUMENTS;
-  } else {
-    CODE_COVERAGE(15); // Hit
-  }
+  VM_ASSERT(vm, argCount <= (AF_ARG_COUNT_MASK - 1));
 
-  err = vm_requireStackSpace(vm, pStackPointer, argCount + 2); // +1 for `this`, +1 for class if needed
+  REQUIRE_STACK_SPACE(argCount + 2); // +1 for `this`, +1 for class if needed
   if (err != MVM_E_SUCCESS) goto SUB_EXIT;
 
   PUSH(targetFunc); // class or function
@@ -2147,6 +2963,18 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
   // ---------------------------- Call target function ------------------------
 
   reg1 /* argCountAndFlags */ = (argCount + 1) | AF_PUSHED_FUNCTION | AF_CALLED_FROM_HOST; // +1 for the `this` value
+
+  if (functionOffset) {
+    CODE_COVERAGE_UNTESTED(853); // Not hit
+    // mvm_prepareCall has already resolved the target to a bytecode function,
+    // so this can skip the type dispatch and go straight to what SUB_CALL does
+    // for a bytecode function
+    reg->cpsCallback = VM_VALUE_UNDEFINED;
+    reg2 = functionOffset;
+    reg3 = VM_VALUE_UNDEFINED;
+    goto SUB_CALL_BYTECODE_FUNC;
+  }
+
   reg2 /* target */ = vm_resolveIndirections(vm, targetFunc);
   reg3 /* cpsCallback */ = VM_VALUE_UNDEFINED;
 
@@ -2199,7 +3027,7 @@ SUB_DO_NEXT_INSTRUCTION:
 
   VM_ASSERT(vm, reg->usingCachedRegisters);
 
-  #ifdef MVM_GAS_COUNTER
+  #if defined(MVM_GAS_COUNTER) && !MVM_GAS_COUNTER_AMORTIZED
   if (vm->stopAfterNInstructions >= 0) {
     CODE_COVERAGE(650); // Hit
     if (vm->stopAfterNInstructions == 0) {
@@ -2214,7 +3042,7 @@ SUB_DO_NEXT_INSTRUCTION:
   #endif
 
   // Check we're within range
-  #if MVM_DONT_TRUST_BYTECODE
+  #if MVM_DONT_TRUST_BYTECODE && !MVM_VERIFY_BYTECODE
   if ((lpProgramCounter < minProgramCounter) || (lpProgramCounter >= maxProgramCounter)) {
     VM_INVALID_BYTECODE(vm);
   }
@@ -2222,23 +3050,41 @@ SUB_DO_NEXT_INSTRUCTION:
 
   // Check breakpoints
   #if MVM_INCLUDE_DEBUG_CAPABILITY
-    if (vm->pBreakpoints) {
-      TsBreakpoint* pBreakpoint = vm->pBreakpoints;
+    if (vm->pBreakpointBitmap) {
       uint16_t currentBytecodeAddress = LongPtr_sub(lpProgramCounter, vm->lpBytecode);
-      do {
-        if ((pBreakpoint->bytecodeAddress == -1) || (pBreakpoint->bytecodeAddress == (int)currentBytecodeAddress)) {
-          FLUSH_REGISTER_CACHE();
-          mvm_TfBreakpointCallback breakpointCallback = vm->breakpointCallback;
-          if (breakpointCallback)
-            breakpointCallback(vm, currentBytecodeAddress);
-          CACHE_REGISTERS();
-          break;
-        }
-        pBreakpoint = pBreakpoint->next;
-      } while (pBreakpoint);
+      if (vm->breakOnEveryInstruction ||
+        (vm->pBreakpointBitmap[currentBytecodeAddress >> 3] & (1 << (currentBytecodeAddress & 7)))
+      ) {
+        FLUSH_REGISTER_CACHE();
+        mvm_TfBreakpointCallback breakpointCallback = vm->breakpointCallback;
+        if (breakpointCallback)
+          breakpointCallback(vm, currentBytecodeAddress);
+        CACHE_REGISTERS();
+      }
     }
   #endif // MVM_INCLUDE_DEBUG_CAPABILITY
 
+  #if MVM_CODE_CACHE
+  if (pCodeCacheEntry) {
+    reg3 = (uint16_t)LongPtr_sub(lpProgramCounter, pCodeCacheEntry->lpCode);
+    if (reg3 < pCodeCacheEntry->codeSize) {
+      CODE_COVERAGE(767); // Not hit
+      vm_TsDecodedInstruction* pInstruction = &pCodeCacheEntry->instructions[reg3];
+      if (!pInstruction->handler) {
+        CODE_COVERAGE(768); // Not hit
+        vm_codeCacheDecode(lpProgramCounter, pInstruction, codeCacheDispatchTables);
+      }
+      reg1 = pInstruction->reg1;
+      reg3 = pInstruction->reg3;
+      lpProgramCounter = LongPtr_add(lpProgramCounter, pInstruction->lengthAndFlags & VM_DECODED_LENGTH_MASK);
+      if (pInstruction->lengthAndFlags & VM_DECODED_POP_REG2) {
+        reg2 = POP();
+      }
+      goto *pInstruction->handler;
+    }
+  }
+  #endif // MVM_CODE_CACHE
+
   // Instruction bytes are divided into two nibbles
   READ_PGM_1(reg3);
   reg1 = reg3 & 0xF; // Primary opcode
@@ -2252,6 +3098,7 @@ SUB_DO_NEXT_INSTRUCTION:
   }
 
   VM_ASSERT(vm, reg3 < VM_OP_END);
+  VM_DISPATCH(opDispatchTable, reg3);
   MVM_SWITCH(reg3, (VM_OP_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
@@ -2264,7 +3111,7 @@ SUB_DO_NEXT_INSTRUCTION:
       CODE_COVERAGE(60); // Hit
       TABLE_COVERAGE(reg1, smallLiteralsSize, 448); // Hit 11/12
 
-      #if MVM_DONT_TRUST_BYTECODE
+      #if MVM_DONT_TRUST_BYTECODE && !MVM_VERIFY_BYTECODE
       if (reg1 >= smallLiteralsSize) {
         err = vm_newError(vm, MVM_E_INVALID_BYTECODE);
         goto SUB_EXIT;
@@ -2419,6 +3266,7 @@ SUB_DO_NEXT_INSTRUCTION:
       // It would be an illegal operation to write to a closure variable stored in ROM
       VM_BYTECODE_ASSERT(vm, lpVar == LongPtr_new(pVar));
       *pVar = reg2;
+      VM_WRITE_BARRIER(vm, pVar);
       goto SUB_TAIL_POP_0_PUSH_0;
     }
 
@@ -2458,6 +3306,7 @@ SUB_DO_NEXT_INSTRUCTION:
       // These indexes should be compiler-generated, so they should never be out of range
       VM_ASSERT(vm, reg1 < (vm_getAllocationSize(regP1) >> 1));
       regP1[reg1] = reg2;
+      VM_WRITE_BARRIER(vm, &regP1[reg1]);
       goto SUB_TAIL_POP_0_PUSH_0;
     }
 
@@ -2577,6 +3426,7 @@ SUB_OP_BIT_OP: {
   }
 
   VM_ASSERT(vm, reg3 < VM_BIT_OP_END);
+  VM_DISPATCH(bitOpDispatchTable, reg3);
   MVM_SWITCH (reg3, (VM_BIT_OP_END - 1)) {
     MVM_CASE(VM_BIT_OP_SHR_ARITHMETIC): {
       CODE_COVERAGE(93); // Hit
@@ -2660,6 +3510,7 @@ SUB_OP_EXTENDED_1: {
   reg3 = reg1;
 
   VM_ASSERT(vm, reg3 <= VM_OP1_END);
+  VM_DISPATCH(op1DispatchTable, reg3);
   MVM_SWITCH (reg3, VM_OP1_END - 1) {
 
 /* ------------------------------------------------------------------------- */
@@ -2784,11 +3635,17 @@ SUB_OP_EXTENDED_1: {
     MVM_CASE (VM_OP1_OBJECT_NEW): {
       CODE_COVERAGE(112); // Hit
       FLUSH_REGISTER_CACHE();
+      #if MVM_OBJECT_SHAPES
+      Value proto = VM_VALUE_NULL;
+      reg1 = vm_newShapedObject(vm, &proto);
+      CACHE_REGISTERS();
+      #else
       TsPropertyList* pObject = GC_ALLOCATE_TYPE(vm, TsPropertyList, TC_REF_PROPERTY_LIST);
       CACHE_REGISTERS();
       reg1 = ShortPtr_encode(vm, pObject);
       pObject->dpNext = VM_VALUE_NULL;
       pObject->dpProto = VM_VALUE_NULL;
+      #endif
       goto SUB_TAIL_POP_0_PUSH_REG1;
     }
 
@@ -2814,6 +3671,19 @@ SUB_OP_EXTENDED_1: {
 
     MVM_CASE (VM_OP1_OBJECT_GET_1): {
       CODE_COVERAGE(114); // Hit
+    #if MVM_FUSE_INSTRUCTIONS
+    SUB_OP_OBJECT_GET_1:
+    #endif
+      #if MVM_INLINE_CACHE
+      // The site is identified by the address of the last byte of the
+      // instruction (which may be a fused instruction)
+      reg3 /* site */ = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode) - 1;
+      if (vm_inlineCacheGet(vm, reg3, pStackPointer[-2], pStackPointer[-1], &pStackPointer[-2])) {
+        CODE_COVERAGE(775); // Not hit
+        goto SUB_TAIL_POP_1_PUSH_0;
+      }
+      CODE_COVERAGE(776); // Not hit
+      #endif
       FLUSH_REGISTER_CACHE();
       err = getProperty(vm, reg->pStackPointer - 2, reg->pStackPointer - 1, reg->pStackPointer - 2);
       CACHE_REGISTERS();
@@ -2830,6 +3700,9 @@ SUB_OP_EXTENDED_1: {
 
     MVM_CASE (VM_OP1_ADD): {
       CODE_COVERAGE(115); // Hit
+    #if MVM_FUSE_INSTRUCTIONS
+    SUB_OP_ADD:
+    #endif
       reg1 = pStackPointer[-2];
       reg2 = pStackPointer[-1];
 
@@ -2924,6 +3797,14 @@ SUB_OP_EXTENDED_1: {
 
     MVM_CASE (VM_OP1_OBJECT_SET_1): {
       CODE_COVERAGE(124); // Hit
+      #if MVM_INLINE_CACHE
+      reg3 /* site */ = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode) - 1;
+      if (vm_inlineCacheSet(vm, reg3, pStackPointer[-3], pStackPointer[-2], pStackPointer[-1])) {
+        CODE_COVERAGE(777); // Not hit
+        goto SUB_TAIL_POP_3_PUSH_0;
+      }
+      CODE_COVERAGE(778); // Not hit
+      #endif
       FLUSH_REGISTER_CACHE();
       err = setProperty(vm, reg->pStackPointer - 3, reg->pStackPointer - 2, reg->pStackPointer - 1);
       CACHE_REGISTERS();
@@ -2936,6 +3817,20 @@ SUB_OP_EXTENDED_1: {
       goto SUB_TAIL_POP_3_PUSH_0;
     }
 
+/* ------------------------------------------------------------------------- */
+/*                      VM_OP1_RESERVED_VIRTUAL_NEW                          */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+  #if MVM_FUSE_INSTRUCTIONS
+    // The reserved opcode is used as the prefix for fused instructions
+    MVM_CASE (VM_OP1_RESERVED_VIRTUAL_NEW): {
+      CODE_COVERAGE_UNTESTED(754); // Not hit
+      goto SUB_OP_FUSED;
+    }
+  #endif
+
   } // End of VM_OP_EXTENDED_1 switch
 
   // All cases should jump to whatever tail they intend. Nothing should get here
@@ -2943,53 +3838,227 @@ SUB_OP_EXTENDED_1: {
 
 } // End of SUB_OP_EXTENDED_1
 
+#if MVM_FUSE_INSTRUCTIONS
+/* ------------------------------------------------------------------------- */
+/*                              SUB_OP_FUSED                                 */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/*                                                                           */
+/*   Fused instructions only appear in the RAM copy of the bytecode, where   */
+/*   the verifier has written them over the sequences they replace (see      */
+/*   vm_TeFusedOpcode).                                                      */
+/* ------------------------------------------------------------------------- */
+SUB_OP_FUSED: {
+  READ_PGM_1(reg3); // vm_TeFusedOpcode
 
+  VM_ASSERT(vm, reg3 < VM_FUSED_END);
+  MVM_SWITCH (reg3, (VM_FUSED_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
-/*                             SUB_THROW                                     */
+/*                       VM_FUSED_LOAD_VAR_ADD_LITERAL                       */
 /*   Expects:                                                                */
-/*     reg1: The exception value                                             */
+/*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-SUB_THROW: {
-  // Find the closest catch block
-  regP1 = reg->pCatchTarget;
+    MVM_CASE (VM_FUSED_LOAD_VAR_ADD_LITERAL): {
+      CODE_COVERAGE_UNTESTED(755); // Not hit
+      READ_PGM_1(reg2); // Variable index and small literal
 
-  // If none, it's an uncaught exception
-  if (regP1 == NULL) {
-    CODE_COVERAGE(208); // Hit
+      reg1 = pStackPointer[-(reg2 >> 4) - 1];
+      if (reg1 == VM_VALUE_DELETED) {
+        CODE_COVERAGE_ERROR_PATH(756); // Not hit
+        err = vm_newError(vm, MVM_E_TDZ_ERROR);
+        goto SUB_EXIT;
+      }
+      // The verifier only fuses the integer literals
+      reg2 = smallLiterals[reg2 & 0xF];
+      VM_ASSERT(vm, Value_isVirtualInt14(reg2));
+
+      if (Value_isVirtualInt14(reg1)) {
+        CODE_COVERAGE_UNTESTED(757); // Not hit
+        // The literal is small, so the sum can't overflow an int16
+        int16_t sum = VirtualInt14_decode(vm, reg1) + VirtualInt14_decode(vm, reg2);
+        if ((sum >= VM_MIN_INT14) && (sum <= VM_MAX_INT14)) {
+          reg1 = VirtualInt14_encode(vm, sum);
+          goto SUB_TAIL_POP_0_PUSH_REG1;
+        }
+      }
 
-    if (out_result) {
-      *out_result = reg1;
+      // Otherwise fall back to the general-purpose addition
+      CODE_COVERAGE_UNTESTED(758); // Not hit
+      PUSH(reg1);
+      PUSH(reg2);
+      goto SUB_OP_ADD;
     }
-    err = MVM_E_UNCAUGHT_EXCEPTION;
-    goto SUB_EXIT;
-  } else {
-    CODE_COVERAGE(209); // Hit
-  }
 
-  VM_ASSERT(vm, Value_isVirtualInt14(regP1[0]));
-
-  VM_ASSERT(vm, pStackPointer >= getBottomOfStack(vm->stack));
-  VM_ASSERT(vm, pStackPointer < getTopOfStackSpace(vm->stack));
+/* ------------------------------------------------------------------------- */
+/*                       VM_FUSED_LOAD_ARG_GET_LITERAL                       */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
 
-  // Unwind the stack. regP1 is the stack pointer address we want to land up at
-  while (pFrameBase > regP1) {
-    CODE_COVERAGE(211); // Hit
+    MVM_CASE (VM_FUSED_LOAD_ARG_GET_LITERAL): {
+      CODE_COVERAGE_UNTESTED(759); // Not hit
+      READ_PGM_1(reg1); // Arg index
+      READ_PGM_2(reg2); // Property key
 
-    // Near the beginning of mvm_call, we set `catchTarget` to NULL
-    // (and then restore at the end), which should direct exceptions through
-    // the path of "uncaught exception" above, so no frame here should ever
-    // be a host frame.
-    VM_ASSERT(vm, !(reg->argCountAndFlags & AF_CALLED_FROM_HOST));
+      reg3 /* argCountAndFlags */ = reg->argCountAndFlags;
+      if (reg1 /* argIndex */ < (reg3 & AF_ARG_COUNT_MASK) /* argCount */) {
+        CODE_COVERAGE_UNTESTED(760); // Not hit
+        reg1 = reg->pArgs[reg1];
+      } else {
+        CODE_COVERAGE_UNTESTED(761); // Not hit
+        reg1 = VM_VALUE_UNDEFINED;
+      }
 
-    // In the current frame structure, the size of the preceding frame is
-    // saved 4 words ahead of the frame base
-    pStackPointer = pFrameBase;
-    POP_REGISTERS();
-  }
+      // The object and key are on the stack in case of a GC collection
+      PUSH(reg1);
+      PUSH(reg2);
+      goto SUB_OP_OBJECT_GET_1;
+    }
 
-  pStackPointer = regP1;
+/* ------------------------------------------------------------------------- */
+/*                VM_FUSED_LESS_THAN_BRANCH (and other comparisons)          */
+/*   Expects:                                                                */
+/*     reg3: vm_TeFusedOpcode                                                */
+/*                                                                           */
+/*   Branches directly on the result of the comparison, instead of pushing   */
+/*   a boolean for the branch instruction to pop and test.                   */
+/* ------------------------------------------------------------------------- */
+
+    MVM_CASE (VM_FUSED_LESS_THAN_BRANCH):
+    MVM_CASE (VM_FUSED_GREATER_THAN_BRANCH):
+    MVM_CASE (VM_FUSED_LESS_EQUAL_BRANCH):
+    MVM_CASE (VM_FUSED_GREATER_EQUAL_BRANCH): {
+      CODE_COVERAGE_UNTESTED(762); // Not hit
+      READ_PGM_1(reg1);
+      reg1 = (uint16_t)(int16_t)(int8_t)reg1; // Sign extend the branch offset
+      goto SUB_FUSED_COMPARE_BRANCH;
+    }
+
+    MVM_CASE (VM_FUSED_LESS_THAN_BRANCH_2):
+    MVM_CASE (VM_FUSED_GREATER_THAN_BRANCH_2):
+    MVM_CASE (VM_FUSED_LESS_EQUAL_BRANCH_2):
+    MVM_CASE (VM_FUSED_GREATER_EQUAL_BRANCH_2): {
+      CODE_COVERAGE_UNTESTED(805); // Not hit
+      READ_PGM_2(reg1); // Branch offset
+      goto SUB_FUSED_COMPARE_BRANCH;
+    }
+
+  } // End of vm_TeFusedOpcode switch
+
+  // All cases should jump to whatever tail they intend. Nothing should get here
+  VM_ASSERT_UNREACHABLE(vm);
+} // End of SUB_OP_FUSED
+
+/* ------------------------------------------------------------------------- */
+/*                         SUB_FUSED_COMPARE_BRANCH                          */
+/*   Expects:                                                                */
+/*     reg1: signed branch offset                                            */
+/*     reg3: one of the fused compare-and-branch opcodes                     */
+/* ------------------------------------------------------------------------- */
+SUB_FUSED_COMPARE_BRANCH: {
+  // The comparison (VM_NUM_OP_LESS_THAN to VM_NUM_OP_GREATER_EQUAL)
+  reg3 = (reg3 - VM_FUSED_LESS_THAN_BRANCH) & 3;
+
+  Value right = POP();
+  Value left = POP();
+  int32_t leftI;
+  int32_t rightI;
+
+  if (Value_isVirtualInt14(left) && Value_isVirtualInt14(right)) {
+    CODE_COVERAGE_UNTESTED(763); // Not hit
+    // The int14 encoding preserves ordering when compared as int16
+    leftI = (int16_t)left;
+    rightI = (int16_t)right;
+  } else {
+    // Same semantics as the NUM_OP comparisons
+    CODE_COVERAGE_UNTESTED(764); // Not hit
+    leftI = 0;
+    rightI = 0;
+    bool isInt32 = (toInt32Internal(vm, left, &leftI) == MVM_E_SUCCESS);
+    isInt32 = (toInt32Internal(vm, right, &rightI) == MVM_E_SUCCESS) && isInt32;
+    #if MVM_SUPPORT_FLOAT
+    if (!isInt32) {
+      MVM_FLOAT64 leftF = mvm_toFloat64(vm, left);
+      MVM_FLOAT64 rightF = mvm_toFloat64(vm, right);
+      switch (reg3) {
+        case VM_NUM_OP_LESS_THAN: reg2 = leftF < rightF; break;
+        case VM_NUM_OP_GREATER_THAN: reg2 = leftF > rightF; break;
+        case VM_NUM_OP_LESS_EQUAL: reg2 = leftF <= rightF; break;
+        default: reg2 = leftF >= rightF; break;
+      }
+      goto SUB_FUSED_BRANCH;
+    }
+    #endif // MVM_SUPPORT_FLOAT
+  }
+
+  switch (reg3) {
+    case VM_NUM_OP_LESS_THAN: reg2 = leftI < rightI; break;
+    case VM_NUM_OP_GREATER_THAN: reg2 = leftI > rightI; break;
+    case VM_NUM_OP_LESS_EQUAL: reg2 = leftI <= rightI; break;
+    default: reg2 = leftI >= rightI; break;
+  }
+
+#if MVM_SUPPORT_FLOAT
+SUB_FUSED_BRANCH:
+#endif
+  GAS_CHARGE_BLOCK();
+  if (reg2) {
+    lpProgramCounter = LongPtr_add(lpProgramCounter, (int16_t)reg1);
+    GAS_START_BLOCK();
+  }
+  goto SUB_TAIL_POP_0_PUSH_0;
+} // End of SUB_FUSED_COMPARE_BRANCH
+#endif // MVM_FUSE_INSTRUCTIONS
+
+
+
+/* ------------------------------------------------------------------------- */
+/*                             SUB_THROW                                     */
+/*   Expects:                                                                */
+/*     reg1: The exception value                                             */
+/* ------------------------------------------------------------------------- */
+
+SUB_THROW: {
+  // Find the closest catch block
+  regP1 = reg->pCatchTarget;
+
+  // If none, it's an uncaught exception
+  if (regP1 == NULL) {
+    CODE_COVERAGE(208); // Hit
+
+    if (out_result) {
+      *out_result = reg1;
+    }
+    err = MVM_E_UNCAUGHT_EXCEPTION;
+    goto SUB_EXIT;
+  } else {
+    CODE_COVERAGE(209); // Hit
+  }
+
+  VM_ASSERT(vm, Value_isVirtualInt14(regP1[0]));
+
+  VM_ASSERT(vm, pStackPointer >= getBottomOfStack(vm->stack));
+  VM_ASSERT(vm, pStackPointer < getTopOfStackSpace(vm->stack));
+
+  // Unwind the stack. regP1 is the stack pointer address we want to land up at
+  while (pFrameBase > regP1) {
+    CODE_COVERAGE(211); // Hit
+
+    // Near the beginning of vm_call, we set `catchTarget` to NULL
+    // (and then restore at the end), which should direct exceptions through
+    // the path of "uncaught exception" above, so no frame here should ever
+    // be a host frame.
+    VM_ASSERT(vm, !(reg->argCountAndFlags & AF_CALLED_FROM_HOST));
+
+    // In the current frame structure, the size of the preceding frame is
+    // saved 4 words ahead of the frame base
+    pStackPointer = pFrameBase;
+    POP_REGISTERS();
+  }
+
+  pStackPointer = regP1;
 
   // The next catch target is the outer one.
   UNWIND_CATCH_TARGET();
@@ -2998,6 +4067,10 @@ SUB_THROW: {
   reg2 = pStackPointer[1];
   VM_ASSERT(vm, Value_isBytecodeMappedPtrOrWellKnown(reg2));
   lpProgramCounter = LongPtr_add(vm->lpBytecode, reg2 & ~1);
+  GAS_START_BLOCK();
+  #if MVM_CODE_CACHE
+  pCodeCacheEntry = vm_codeCacheFind(vm, lpProgramCounter);
+  #endif
 
   // Push the exception to the stack for the catch block to use
   goto SUB_TAIL_POP_0_PUSH_REG1;
@@ -3029,6 +4102,27 @@ SUB_OP_NUM_OP: {
   int32_t reg1I = 0;
   int32_t reg2I = 0;
 
+  // Fast path for comparisons, addition, subtraction and multiplication of two
+  // int14 operands, which covers most loop counters and coordinate math. The
+  // result can't overflow an int32, so this skips the conversions and overflow
+  // checks of the general path. Note: these are the first operations in
+  // vm_TeNumberOp.
+  if ((reg1 <= VM_NUM_OP_MULTIPLY) && Value_isVirtualInt14(reg2) && Value_isVirtualInt14(pStackPointer[-1])) {
+    CODE_COVERAGE(804); // Not hit
+    int16_t left = VirtualInt14_decode(vm, POP());
+    int16_t right = VirtualInt14_decode(vm, reg2);
+    switch (reg1) {
+      case VM_NUM_OP_LESS_THAN: reg1 = left < right; goto SUB_TAIL_PUSH_REG1_BOOL;
+      case VM_NUM_OP_GREATER_THAN: reg1 = left > right; goto SUB_TAIL_PUSH_REG1_BOOL;
+      case VM_NUM_OP_LESS_EQUAL: reg1 = left <= right; goto SUB_TAIL_PUSH_REG1_BOOL;
+      case VM_NUM_OP_GREATER_EQUAL: reg1 = left >= right; goto SUB_TAIL_PUSH_REG1_BOOL;
+      case VM_NUM_OP_ADD_NUM: reg1I = (int32_t)left + right; break;
+      case VM_NUM_OP_SUBTRACT: reg1I = (int32_t)left - right; break;
+      default: reg1I = (int32_t)left * right; break; // VM_NUM_OP_MULTIPLY
+    }
+    goto SUB_NUM_OP_INT32_RESULT;
+  }
+
   reg3 = reg1;
 
   // If it's a binary operator, then we pop a second operand
@@ -3061,6 +4155,7 @@ SUB_OP_NUM_OP: {
   }
 
   VM_ASSERT(vm, reg3 < VM_NUM_OP_END);
+  VM_DISPATCH(numOpDispatchTable, reg3);
   MVM_SWITCH (reg3, (VM_NUM_OP_END - 1)) {
     MVM_CASE(VM_NUM_OP_LESS_THAN): {
       CODE_COVERAGE(78); // Hit
@@ -3201,6 +4296,7 @@ SUB_OP_NUM_OP: {
     }
   } // End of switch vm_TeNumberOp for int32
 
+SUB_NUM_OP_INT32_RESULT:
   // Convert the result from a 32-bit integer
   if ((reg1I >= VM_MIN_INT14) && (reg1I <= VM_MAX_INT14)) {
     CODE_COVERAGE(103); // Hit
@@ -3238,6 +4334,7 @@ SUB_OP_EXTENDED_2: {
   }
 
   VM_ASSERT(vm, reg3 < VM_OP2_END);
+  VM_DISPATCH(op2DispatchTable, reg3);
   MVM_SWITCH (reg3, (VM_OP2_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
@@ -3493,6 +4590,7 @@ SUB_OP_EXTENDED_3: {
   }
 
   VM_ASSERT(vm, reg3 < VM_OP3_END);
+  VM_DISPATCH(op3DispatchTable, reg3);
   MVM_SWITCH (reg3, (VM_OP3_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
@@ -3809,6 +4907,12 @@ SUB_OP_EXTENDED_3: {
 /*     reg1: The Ex-4 instruction opcode                                     */
 /* ------------------------------------------------------------------------- */
 SUB_OP_EXTENDED_4: {
+  #if MVM_COMPUTED_GOTO_DISPATCH
+    // Unlike the other opcode groups, the Ex-4 opcode is a full byte so it
+    // needs a range check before indexing the dispatch table
+    if (reg1 >= VM_OP4_END) goto SUB_INVALID_INSTRUCTION;
+  #endif
+  VM_DISPATCH(op4DispatchTable, reg1);
   MVM_SWITCH(reg1, (VM_NUM_OP4_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
@@ -4144,7 +5248,9 @@ SUB_AWAIT: {
   regP2 = &regP2[2]; // Skip continuation pointer and callback slot
   TABLE_COVERAGE(regP1 < pStackPointer ? 1 : 0, 2, 687); // Hit 2/2
   while (regP1 < pStackPointer) {
-    *regP2++ = *regP1++;
+    *regP2 = *regP1++;
+    VM_WRITE_BARRIER(vm, regP2);
+    regP2++;
   }
 
   // Unwind the exception stack
@@ -4269,6 +5375,7 @@ SUB_ASYNC_COMPLETE: {
     // Mark the promise as settled
     pPromise[VM_OIS_PROMISE_STATUS] = reg2 == VM_VALUE_TRUE ? VM_PROMISE_STATUS_RESOLVED : VM_PROMISE_STATUS_REJECTED;
     pPromise[VM_OIS_PROMISE_OUT] = reg3; // Note: need to assign this before vm_scheduleContinuation to avoid GC issues
+    VM_WRITE_BARRIER(vm, &pPromise[VM_OIS_PROMISE_OUT]);
 
     tc = deepTypeOf(vm, callbackList);
     if (tc == TC_VAL_UNDEFINED) {
@@ -4316,8 +5423,10 @@ SUB_ASYNC_COMPLETE: {
 /* ------------------------------------------------------------------------- */
 SUB_BRANCH_COMMON: {
   CODE_COVERAGE(160); // Hit
+  GAS_CHARGE_BLOCK();
   if (mvm_toBool(vm, reg2)) {
     lpProgramCounter = LongPtr_add(lpProgramCounter, (int16_t)reg1);
+    GAS_START_BLOCK();
   }
   goto SUB_TAIL_POP_0_PUSH_0;
 }
@@ -4329,7 +5438,9 @@ SUB_BRANCH_COMMON: {
 /* ------------------------------------------------------------------------- */
 SUB_JUMP_COMMON: {
   CODE_COVERAGE(161); // Hit
+  GAS_CHARGE_BLOCK();
   lpProgramCounter = LongPtr_add(lpProgramCounter, (int16_t)reg1);
+  GAS_START_BLOCK();
   goto SUB_TAIL_POP_0_PUSH_0;
 }
 
@@ -4345,6 +5456,8 @@ SUB_JUMP_COMMON: {
 SUB_RETURN: {
   CODE_COVERAGE(105); // Hit
 
+  GAS_CHARGE_BLOCK();
+
   // Pop variables
   pStackPointer = pFrameBase;
 
@@ -4353,6 +5466,10 @@ SUB_RETURN: {
 
   // Restore caller state
   POP_REGISTERS();
+  GAS_START_BLOCK();
+  #if MVM_CODE_CACHE
+  pCodeCacheEntry = vm_codeCacheFind(vm, lpProgramCounter);
+  #endif
 
   // If the catch target isn't earlier than the stack pointer then possibly the
   // catch blocks weren't unwound properly (e.g. the compiler didn't generate
@@ -4522,6 +5639,11 @@ SUB_NEW: {
     ) {
       reg2 /* internalSlotCount */ = VirtualInt14_decode(vm, regP2[VM_OIS_PROTO_SLOT_COUNT]);
     }
+  #if MVM_OBJECT_SHAPES
+  } else if (tc == TC_REF_SHAPED_OBJECT) {
+    // Shaped objects don't have prototype slots
+    CODE_COVERAGE_UNTESTED(789); // Not hit
+  #endif
   } else if (tc == TC_VAL_NULL) {
     CODE_COVERAGE_UNTESTED(724); // Not hit
   } else {
@@ -4530,6 +5652,15 @@ SUB_NEW: {
     goto SUB_EXIT;
   }
 
+  #if MVM_OBJECT_SHAPES
+  // Instances without internal slots are shaped objects
+  if (!reg2 /* internalSlotCount */) {
+    CODE_COVERAGE(788); // Not hit
+    regP1[1] /* this */ = vm_newShapedObject(vm, &regP1[1] /* prototype */);
+    goto SUB_NEW_INSTANCE_CREATED;
+  }
+  #endif
+
   Value* pObject = mvm_allocate(vm, sizeof(TsPropertyList) + reg2 * sizeof(Value), TC_REF_PROPERTY_LIST);
   Value* p = pObject;
   *p++ = VM_VALUE_NULL; // dpNext
@@ -4551,6 +5682,9 @@ SUB_NEW: {
 
   regP1[1] /* this */ = ShortPtr_encode(vm, pObject);
 
+#if MVM_OBJECT_SHAPES
+SUB_NEW_INSTANCE_CREATED:
+#endif
   CACHE_REGISTERS();
 
   if (err != MVM_E_SUCCESS) goto SUB_EXIT;
@@ -4636,15 +5770,30 @@ SUB_CALL_HOST_COMMON: {
   Value* pResult = pStackPointer++;
   *pResult = VM_VALUE_UNDEFINED;
 
+  VM_ASSERT(vm, reg2 < vm_getResolvedImportCount(vm));
+  uint16_t saveArgCountAndFlags;
+
+  #if MVM_LEAF_HOST_FUNCTIONS
+  if (vm->pImportFlags[reg2] & MVM_HOST_FUNCTION_LEAF) {
+    CODE_COVERAGE_UNTESTED(823); // Not hit
+    // A leaf function doesn't call back into the VM, so the machine state
+    // can't change under it and none of the bookkeeping below is needed. The
+    // registers are still flushed because the host may allocate, and the GC
+    // reads the stack through them.
+    FLUSH_REGISTER_CACHE();
+    VM_EXEC_SAFE_MODE(vm->inLeafHostFunction = true;)
+    err = vm_callHostFunction(vm, reg2, pResult, pResult - reg3, (uint8_t)reg3);
+    VM_EXEC_SAFE_MODE(vm->inLeafHostFunction = false;)
+    CACHE_REGISTERS();
+    goto SUB_CALL_HOST_RESULT;
+  }
+  #endif // MVM_LEAF_HOST_FUNCTIONS
+
   // The function `mvm_asyncStart` needs to know the state of the callee flag
   // AF_VOID_CALLED, but we need to save the original state to restore later.
-  uint16_t saveArgCountAndFlags = reg->argCountAndFlags;
+  saveArgCountAndFlags = reg->argCountAndFlags;
   reg->argCountAndFlags = reg1;
 
-  VM_ASSERT(vm, reg2 < vm_getResolvedImportCount(vm));
-  mvm_TfHostFunction hostFunction = vm_getResolvedImports(vm)[reg2];
-  mvm_HostFunctionID hostFunctionID = vm_getHostFunctionId(vm, reg2);
-
   FLUSH_REGISTER_CACHE();
 
   /*
@@ -4672,8 +5821,11 @@ SUB_CALL_HOST_COMMON: {
 
   regP1 /* pArgs */ = reg->pStackPointer - reg3 - 1;
 
-  // Call the host function
-  err = hostFunction(vm, hostFunctionID, pResult, regP1, (uint8_t)reg3);
+  // Call the host function. The stack must not move while the host has
+  // `pResult` and `pArgs`, even if the host calls back into the VM.
+  vm->activeHostCallCount++;
+  err = vm_callHostFunction(vm, reg2, pResult, regP1, (uint8_t)reg3);
+  vm->activeHostCallCount--;
 
   #if (MVM_SAFE_MODE)
     VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
@@ -4705,9 +5857,17 @@ SUB_CALL_HOST_COMMON: {
 
   CACHE_REGISTERS();
 
+  #if MVM_CODE_CACHE
+  // The host may have called back into the VM and evicted the current entry
+  pCodeCacheEntry = vm_codeCacheFind(vm, lpProgramCounter);
+  #endif
+
   // Restore caller argCountAndFlags
   reg->argCountAndFlags = saveArgCountAndFlags;
 
+#if MVM_LEAF_HOST_FUNCTIONS
+SUB_CALL_HOST_RESULT:
+#endif
   // Represents an exception thrown by the host function that wasn't caught by
   // the host. The pResult should reference the exception object.
   if (err == MVM_E_UNCAUGHT_EXCEPTION) {
@@ -4746,11 +5906,41 @@ SUB_CALL_HOST_COMMON: {
 SUB_CALL_BYTECODE_FUNC: {
   CODE_COVERAGE(163); // Hit
 
-  regP1 /* pArgs */ = pStackPointer - (reg1 & AF_ARG_COUNT_MASK);
+  GAS_CHARGE_BLOCK();
+
+  #if MVM_VERIFY_BYTECODE
+    // Functions that weren't reachable from the roots at load time are
+    // verified the first time they're called
+    if (!vm_isFunctionVerified(vm, reg2)) {
+      CODE_COVERAGE_UNTESTED(752); // Not hit
+      err = vm_verifyFunctionOnCall(vm, reg2);
+      if (err != MVM_E_SUCCESS) {
+        CODE_COVERAGE_ERROR_PATH(753); // Not hit
+        goto SUB_EXIT;
+      }
+    }
+  #endif
+
   regLP1 /* lpReturnAddress */ = lpProgramCounter;
 
   // Move PC to point to new function code
   lpProgramCounter = LongPtr_add(vm->lpBytecode, reg2);
+  GAS_START_BLOCK();
+  #if MVM_CODE_CACHE
+  pCodeCacheEntry = vm_codeCacheEnter(vm, reg2);
+  #endif
+
+  #if MVM_CALL_TARGET_CACHE
+    // Function entries are 4-byte aligned
+    vm_TsCallTargetCacheEntry* pCallTarget = &vm->callTargetCache[(reg2 >> 2) & (MVM_CALL_TARGET_CACHE_SIZE - 1)];
+    if (pCallTarget->offset == reg2) {
+      CODE_COVERAGE_UNTESTED(820); // Not hit
+      reg2 /* requiredStackWords */ = pCallTarget->requiredStackWords;
+      goto SUB_CALL_BYTECODE_FUNC_CHECK_STACK;
+    }
+    CODE_COVERAGE_UNTESTED(821); // Not hit
+    pCallTarget->offset = reg2;
+  #endif
 
   reg2 /* function header */ = LongPtr_read2_aligned(LongPtr_add(lpProgramCounter, -2));
 
@@ -4770,12 +5960,74 @@ SUB_CALL_BYTECODE_FUNC: {
   reg2 /* requiredFrameSizeWords */ += VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS;
   // The +5 is for various temporaries that `mvm_call` pushes to the stack, and
   // the result slot if we call the host
-  err = vm_requireStackSpace(vm, pStackPointer, reg2 /* requiredFrameSizeWords */ + 5);
+  reg2 /* requiredStackWords */ += 5;
+  #if MVM_CALL_TARGET_CACHE
+    pCallTarget->requiredStackWords = reg2;
+  #endif
+
+#if MVM_CALL_TARGET_CACHE
+SUB_CALL_BYTECODE_FUNC_CHECK_STACK:
+#endif
+  REQUIRE_STACK_SPACE(reg2 /* requiredStackWords */);
   if (err != MVM_E_SUCCESS) {
     CODE_COVERAGE_ERROR_PATH(226); // Not hit
     goto SUB_EXIT;
   }
 
+  #if MVM_TAIL_CALLS
+    // If the caller returns the result directly (the call is followed by
+    // RETURN), the callee can replace the caller's frame instead of pushing a
+    // new one, and return directly to the caller's caller. This doesn't apply
+    // to calls from the host (which don't have a calling frame), to void calls
+    // (whose RETURN doesn't return the call result), or inside a `try` block in
+    // the caller. Tail calls are also disabled while there are breakpoints, so
+    // that the debugger sees every frame and every RETURN.
+    if ((LongPtr_read1(regLP1 /* lpReturnAddress */) == ((VM_OP_EXTENDED_1 << 4) | VM_OP1_RETURN)) &&
+      !(reg1 & (AF_CALLED_FROM_HOST | AF_VOID_CALLED)) &&
+      (!reg->pCatchTarget || (reg->pCatchTarget < reg->pArgs))
+      #if MVM_INCLUDE_DEBUG_CAPABILITY
+      && !vm->pBreakpointBitmap
+      #endif
+    ) {
+      CODE_COVERAGE_UNTESTED(822); // Not hit
+      VM_ASSERT(vm, VM_FRAME_BOUNDARY_VERSION == 2);
+      VM_ASSERT(vm, reg->pArgs + (reg->argCountAndFlags & AF_ARG_COUNT_MASK) + VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS == pFrameBase);
+
+      // The callee returns the same way as the caller would have: to the same
+      // return address, popping the same function reference (if any), etc.
+      // Only the argument count is the callee's.
+      reg1 = (reg1 & AF_ARG_COUNT_MASK) | (reg->argCountAndFlags & ~AF_ARG_COUNT_MASK);
+
+      // The caller's saved registers. The first word is the size of the frame
+      // below, relative to where it's saved, so it's adjusted for the new
+      // position.
+      uint16_t savedRegisters[VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS];
+      memcpy(savedRegisters, pFrameBase - VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS, sizeof savedRegisters);
+
+      // Move the callee arguments over the caller arguments. This also discards
+      // the function reference pushed for the callee, if any.
+      regP2 /* source */ = pStackPointer - (reg1 & AF_ARG_COUNT_MASK);
+      regP1 /* pArgs */ = reg->pArgs;
+      memmove(regP1, regP2, (reg1 & AF_ARG_COUNT_MASK) * 2);
+      pStackPointer = regP1 + (reg1 & AF_ARG_COUNT_MASK);
+
+      savedRegisters[0] += (uint16_t)((uint8_t*)pStackPointer - (uint8_t*)(pFrameBase - VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS));
+      memcpy(pStackPointer, savedRegisters, sizeof savedRegisters);
+      pStackPointer += VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS;
+
+      // Set up new frame
+      pFrameBase = pStackPointer;
+      reg->argCountAndFlags = reg1;
+      reg->closure = reg3;
+      reg->pArgs = regP1;
+
+      goto SUB_TAIL_POP_0_PUSH_0;
+    }
+  #endif // MVM_TAIL_CALLS
+
+  // Note: after REQUIRE_STACK_SPACE, since the stack may have moved
+  regP1 /* pArgs */ = pStackPointer - (reg1 & AF_ARG_COUNT_MASK);
+
   // Save old registers to the stack
   PUSH_REGISTERS(regLP1);
 
@@ -4804,58 +6056,61 @@ SUB_NUM_OP_FLOAT64: {
   MVM_FLOAT64 reg2F = mvm_toFloat64(vm, reg2);
 
   VM_ASSERT(vm, reg3 < VM_NUM_OP_END);
+  // Note: plain `case` rather than MVM_CASE because these values are already
+  // used as dispatch labels by the int32 switch in SUB_OP_NUM_OP, and labels
+  // must be unique within `vm_call` (see MVM_COMPUTED_GOTO_DISPATCH).
   MVM_SWITCH (reg3, (VM_NUM_OP_END - 1)) {
-    MVM_CASE(VM_NUM_OP_LESS_THAN): {
+    case VM_NUM_OP_LESS_THAN: {
       CODE_COVERAGE(449); // Hit
       reg1 = reg1F < reg2F;
       goto SUB_TAIL_PUSH_REG1_BOOL;
     }
-    MVM_CASE(VM_NUM_OP_GREATER_THAN): {
+    case VM_NUM_OP_GREATER_THAN: {
       CODE_COVERAGE(450); // Hit
       reg1 = reg1F > reg2F;
       goto SUB_TAIL_PUSH_REG1_BOOL;
     }
-    MVM_CASE(VM_NUM_OP_LESS_EQUAL): {
+    case VM_NUM_OP_LESS_EQUAL: {
       CODE_COVERAGE(451); // Hit
       reg1 = reg1F <= reg2F;
       goto SUB_TAIL_PUSH_REG1_BOOL;
     }
-    MVM_CASE(VM_NUM_OP_GREATER_EQUAL): {
+    case VM_NUM_OP_GREATER_EQUAL: {
       CODE_COVERAGE(452); // Hit
       reg1 = reg1F >= reg2F;
       goto SUB_TAIL_PUSH_REG1_BOOL;
     }
-    MVM_CASE(VM_NUM_OP_ADD_NUM): {
+    case VM_NUM_OP_ADD_NUM: {
       CODE_COVERAGE(453); // Hit
       reg1F = reg1F + reg2F;
       break;
     }
-    MVM_CASE(VM_NUM_OP_SUBTRACT): {
+    case VM_NUM_OP_SUBTRACT: {
       CODE_COVERAGE(454); // Hit
       reg1F = reg1F - reg2F;
       break;
     }
-    MVM_CASE(VM_NUM_OP_MULTIPLY): {
+    case VM_NUM_OP_MULTIPLY: {
       CODE_COVERAGE(455); // Hit
       reg1F = reg1F * reg2F;
       break;
     }
-    MVM_CASE(VM_NUM_OP_DIVIDE): {
+    case VM_NUM_OP_DIVIDE: {
       CODE_COVERAGE(456); // Hit
       reg1F = reg1F / reg2F;
       break;
     }
-    MVM_CASE(VM_NUM_OP_DIVIDE_AND_TRUNC): {
+    case VM_NUM_OP_DIVIDE_AND_TRUNC: {
       CODE_COVERAGE(457); // Hit
       reg1F = mvm_float64ToInt32((reg1F / reg2F));
       break;
     }
-    MVM_CASE(VM_NUM_OP_REMAINDER): {
+    case VM_NUM_OP_REMAINDER: {
       CODE_COVERAGE(458); // Hit
       reg1F = fmod(reg1F, reg2F);
       break;
     }
-    MVM_CASE(VM_NUM_OP_POWER): {
+    case VM_NUM_OP_POWER: {
       CODE_COVERAGE(459); // Hit
       if (!isfinite(reg2F) && ((reg1F == 1.0) || (reg1F == -1.0))) {
         reg1 = VM_VALUE_NAN;
@@ -4864,12 +6119,12 @@ SUB_NUM_OP_FLOAT64: {
       reg1F = pow(reg1F, reg2F);
       break;
     }
-    MVM_CASE(VM_NUM_OP_NEGATE): {
+    case VM_NUM_OP_NEGATE: {
       CODE_COVERAGE(460); // Hit
       reg1F = -reg2F;
       break;
     }
-    MVM_CASE(VM_NUM_OP_UNARY_PLUS): {
+    case VM_NUM_OP_UNARY_PLUS: {
       CODE_COVERAGE(461); // Hit
       reg1F = reg2F;
       break;
@@ -4929,6 +6184,15 @@ SUB_TAIL_POP_0_PUSH_0:
   if (err != MVM_E_SUCCESS) goto SUB_EXIT;
   goto SUB_DO_NEXT_INSTRUCTION;
 
+#if MVM_COMPUTED_GOTO_DISPATCH
+// Target of the dispatch tables for opcodes that are reserved or out of range
+SUB_INVALID_INSTRUCTION:
+  CODE_COVERAGE_ERROR_PATH(748); // Not hit
+  VM_INVALID_BYTECODE(vm);
+  err = vm_newError(vm, MVM_E_INVALID_BYTECODE);
+  goto SUB_EXIT;
+#endif // MVM_COMPUTED_GOTO_DISPATCH
+
 SUB_EXIT:
   CODE_COVERAGE(165); // Hit
 
@@ -4949,6 +6213,11 @@ SUB_EXIT:
   // stack.
   registerValuesAtEntry.jobQueue = reg->jobQueue; // Except the job queue needs to be preserved
   registerValuesAtEntry.closure = reg->closure; // And the closure may point to the GC so it may change physical value if there are garbage collections during the call.
+  if (vm->stack != stackAtEntry) {
+    CODE_COVERAGE_UNTESTED(813); // Not hit
+    // The stack grew during the call
+    vm_rebaseRegisters(&registerValuesAtEntry, stackAtEntry, vm->stack);
+  }
   *reg = registerValuesAtEntry;
 
   // If the stack is empty, we can free it. It may not be empty if this is a
@@ -4956,12 +6225,23 @@ SUB_EXIT:
   if (reg->pStackPointer == getBottomOfStack(vm->stack)) {
     CODE_COVERAGE(222); // Hit
 
-    vm_free(vm, vm->stack);
-    vm->stack = NULL;
+    if (vm->stackResident) {
+      CODE_COVERAGE_UNTESTED(806); // Not hit
+      // Keep the stack for the next call, but in the same state as a freshly
+      // allocated one (e.g. a job queue left over from an error is dropped
+      // either way)
+      vm_initRegisters(vm, vm->stack);
+    } else {
+      vm_free(vm, vm->stack);
+      vm->stack = NULL;
+    }
   }
 
   return err;
-} // End of mvm_call
+} // End of vm_call
+#if MVM_COMPUTED_GOTO_DISPATCH
+#pragma GCC diagnostic pop
+#endif
 
 /**
  * Creates a new array of length 0 and the given capacity and initializes the
@@ -4983,6 +6263,7 @@ static Value vm_newArray(VM* vm, uint16_t capacity) {
     result = vm_pop(vm);
     arr = ShortPtr_decode(vm, result); // Invalidated
     arr->dpData = ShortPtr_encode(vm, pData);
+    VM_WRITE_BARRIER(vm, &arr->dpData);
     uint16_t* p = pData;
     uint16_t n = capacity;
     while (n--)
@@ -5033,6 +6314,7 @@ static void vm_arrayPush(VM* vm, Value* pvArr, Value* pvItem) {
   pArr = ShortPtr_decode(vm, *pvArr); // May have moved
   uint16_t* pData = ShortPtr_decode(vm, pArr->dpData);
   pData[length] = *pvItem;
+  VM_WRITE_BARRIER(vm, &pData[length]);
   pArr->viLength = VirtualInt14_encode(vm, length + 1);
 }
 
@@ -5083,6 +6365,38 @@ static uint16_t* vm_scopePushOrNew(VM* vm, int slotCount, bool captureParent) {
   return newScope;
 }
 
+TeError mvm_prepareCall(VM* vm, Value targetFunc, uint8_t argCount, mvm_TsPreparedCall* out_call) {
+  CODE_COVERAGE_UNTESTED(854); // Not hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  // 126 is the maximum because mvm_call also pushes the `this` value
+  if (argCount > (AF_ARG_COUNT_MASK - 1)) {
+    CODE_COVERAGE_ERROR_PATH(855); // Not hit
+    return MVM_E_TOO_MANY_ARGUMENTS;
+  }
+
+  out_call->target = targetFunc;
+  out_call->argCount = argCount;
+  out_call->functionOffset = 0;
+
+  // Functions are in ROM, so their offset doesn't change. Other targets (e.g.
+  // closures) are resolved on each call, like in mvm_call.
+  Value target = vm_resolveIndirections(vm, targetFunc);
+  if (deepTypeOf(vm, target) == TC_REF_FUNCTION) {
+    CODE_COVERAGE_UNTESTED(856); // Not hit
+    VM_ASSERT(vm, DynamicPtr_isRomPtr(vm, target));
+    out_call->functionOffset = target & 0xFFFE;
+  }
+
+  return MVM_E_SUCCESS;
+}
+
+TeError mvm_callPrepared(VM* vm, const mvm_TsPreparedCall* call, Value* out_result, Value* args) {
+  CODE_COVERAGE_UNTESTED(857); // Not hit
+  // The argument count was checked by mvm_prepareCall
+  return vm_call(vm, call->target, call->functionOffset, out_result, args, call->argCount);
+}
+
 /**
  * Same as mvm_call but takes a `thisValue`. I expect this to be the less common
  * case, so I've separated it out to avoid the interface complexity of passing a
@@ -5241,9 +6555,26 @@ static bool DynamicPtr_isRomPtr(VM* vm, DynamicPtr dp) {
 }
 #endif // MVM_SAFE_MODE
 
-TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport) {
+TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize, void* context, mvm_TfResolveImport resolveImport) {
+  CODE_COVERAGE(3); // Hit
+  return vm_restore(result, lpBytecode, bytecodeSize, context, resolveImport, NULL);
+}
+
+TeError mvm_restoreEx(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize, void* context, mvm_TfResolveImportEx resolveImport) {
+  CODE_COVERAGE_UNTESTED(824); // Not hit
+  return vm_restore(result, lpBytecode, bytecodeSize, context, NULL, resolveImport);
+}
+
+// Exactly one of `resolveImport` and `resolveImportEx` is non-null
+static TeError vm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport, mvm_TfResolveImportEx resolveImportEx) {
   // Note: these are declared here because some compilers give warnings when "goto" bypasses some variable declarations
   mvm_TfHostFunction* resolvedImports;
+  #if MVM_LEAF_HOST_FUNCTIONS
+  uint8_t* pImportFlags;
+  #endif
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  const char** pImportSignatures;
+  #endif
   uint16_t importTableOffset;
   LongPtr lpImportTableStart;
   LongPtr lpImportTableEnd;
@@ -5252,8 +6583,6 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   uint16_t initialHeapOffset;
   uint16_t initialHeapSize;
 
-  CODE_COVERAGE(3); // Hit
-
   if (MVM_PORT_VERSION != MVM_EXPECTED_PORT_FILE_VERSION) {
     return MVM_E_PORT_FILE_VERSION_MISMATCH;
   }
@@ -5325,6 +6654,12 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   size_t allocationSize = sizeof(mvm_VM) +
     sizeof(mvm_TfHostFunction) * importCount +  // Import table
     globalsSize; // Globals
+  #if MVM_LEAF_HOST_FUNCTIONS
+  allocationSize += importCount; // Import flags
+  #endif
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  allocationSize += sizeof(const char*) * importCount; // Import signatures
+  #endif
   vm = (VM*)MVM_CONTEXTUAL_MALLOC(allocationSize, context);
   if (!vm) {
     CODE_COVERAGE_ERROR_PATH(139); // Not hit
@@ -5338,7 +6673,20 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   resolvedImports = vm_getResolvedImports(vm);
   vm->context = context;
   vm->lpBytecode = lpBytecode;
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  vm->pImportSignatures = (const char**)(resolvedImports + importCount);
+  pImportSignatures = vm->pImportSignatures;
+  vm->globals = (void*)(pImportSignatures + importCount);
+  #else
   vm->globals = (void*)(resolvedImports + importCount);
+  #endif
+  #if MVM_LEAF_HOST_FUNCTIONS
+  vm->pImportFlags = (uint8_t*)vm->globals + globalsSize;
+  pImportFlags = vm->pImportFlags;
+  #endif
+  vm->maxStackSize = MVM_MAX_STACK_SIZE;
+  mvm_setHeapGrowthPolicy(vm, NULL);
+  vm->totalMallocSize = allocationSize;
   #ifdef MVM_GAS_COUNTER
   vm->stopAfterNInstructions = -1;
   #endif
@@ -5353,12 +6701,35 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
     CODE_COVERAGE(431); // Hit
     mvm_HostFunctionID hostFunctionID = READ_FIELD_2(lpImportTableEntry, vm_TsImportTableEntry, hostFunctionID);
     lpImportTableEntry = LongPtr_add(lpImportTableEntry, sizeof (vm_TsImportTableEntry));
-    mvm_TfHostFunction handler = NULL;
-    err = resolveImport(hostFunctionID, context, &handler);
+    mvm_TsHostFunctionInfo info;
+    memset(&info, 0, sizeof info);
+    if (resolveImportEx) {
+      CODE_COVERAGE_UNTESTED(825); // Not hit
+      err = resolveImportEx(hostFunctionID, context, &info);
+    } else {
+      CODE_COVERAGE(826); // Hit
+      err = resolveImport(hostFunctionID, context, &info.hostFunction);
+    }
     if (err != MVM_E_SUCCESS) {
       CODE_COVERAGE_ERROR_PATH(432); // Not hit
       goto SUB_EXIT;
     }
+    mvm_TfHostFunction handler = info.hostFunction;
+    if (info.signature) {
+      CODE_COVERAGE_UNTESTED(837); // Not hit
+      #if MVM_HOST_FUNCTION_SIGNATURES
+      if (!vm_isValidHostSignature(info.signature)) {
+        err = MVM_E_INVALID_HOST_FUNCTION_SIGNATURE;
+        goto SUB_EXIT;
+      }
+      // Stored in the same table, and cast back when called (going through
+      // `void (*)(void)` to show the cast is intentional)
+      handler = (mvm_TfHostFunction)(void (*)(void))info.typedHostFunction;
+      #else
+      err = MVM_E_INVALID_HOST_FUNCTION_SIGNATURE;
+      goto SUB_EXIT;
+      #endif
+    }
     if (!handler) {
       CODE_COVERAGE_ERROR_PATH(433); // Not hit
       err = MVM_E_UNRESOLVED_IMPORT;
@@ -5367,19 +6738,80 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
       CODE_COVERAGE(434); // Hit
     }
     *resolvedImport++ = handler;
+    #if MVM_LEAF_HOST_FUNCTIONS
+    #if MVM_HOST_CALL_BATCHING
+    // The batch function calls other host functions through the VM, so it must
+    // never take the leaf path (see mvm_hostBatch)
+    if (handler == mvm_hostBatch) {
+      CODE_COVERAGE_UNTESTED(922); // Not hit
+      info.flags &= ~MVM_HOST_FUNCTION_LEAF;
+    }
+    #endif
+    *pImportFlags++ = info.flags;
+    #endif
+    #if MVM_HOST_FUNCTION_SIGNATURES
+    *pImportSignatures++ = info.signature;
+    #endif
   }
 
   // The GC is empty to start
   gc_freeGCMemory(vm);
 
+  #if MVM_USE_HEAP_ARENA
+  // Reserve the whole heap up front
+  vm->pHeapArena = vm_malloc(vm, HEAP_ARENA_SIZE);
+  if (!vm->pHeapArena) {
+    CODE_COVERAGE_ERROR_PATH(917); // Not hit
+    err = MVM_E_MALLOC_FAIL;
+    goto SUB_EXIT;
+  }
+  #endif
+
   // Initialize data
   memcpy_long(vm->globals, getBytecodeSection(vm, BCS_GLOBALS, NULL), globalsSize);
 
+  #if MVM_FUSE_INSTRUCTIONS
+  vm->lpOriginalBytecode = lpBytecode;
+  #if MVM_FUSE_IN_PLACE
+  // The host's image is writable (see MVM_FUSE_IN_PLACE). Each function is
+  // fused after it has been verified, so the verifier still reads the original
+  // code of the functions that it hasn't reached yet.
+  CODE_COVERAGE_UNTESTED(923); // Not hit
+  vm->pFusedBytecode = (uint8_t*)LongPtr_truncate(vm, lpBytecode);
+  #else
+  // The verifier fuses instructions in a RAM copy of the constant part of the
+  // image. If there isn't enough memory for the copy, the VM just executes the
+  // original bytecode in place, without fusion.
+  vm->pFusedBytecode = vm_malloc(vm, header.sectionOffsets[BCS_GLOBALS]);
+  if (vm->pFusedBytecode) {
+    CODE_COVERAGE(765); // Not hit
+    memcpy_long(vm->pFusedBytecode, lpBytecode, header.sectionOffsets[BCS_GLOBALS]);
+    vm->lpBytecode = LongPtr_new(vm->pFusedBytecode);
+  } else {
+    CODE_COVERAGE_UNTESTED(766); // Not hit
+  }
+  #endif // MVM_FUSE_IN_PLACE
+  #endif // MVM_FUSE_INSTRUCTIONS
+
+  #if MVM_VERIFY_BYTECODE
+  err = vm_verifyBytecode(vm);
+  if (err != MVM_E_SUCCESS) {
+    CODE_COVERAGE_ERROR_PATH(751); // Not hit
+    goto SUB_EXIT;
+  }
+  #endif
+
   // Initialize heap
   initialHeapOffset = header.sectionOffsets[BCS_HEAP];
   initialHeapSize = bytecodeSize - initialHeapOffset;
   vm->heapSizeUsedAfterLastGC = initialHeapSize;
   vm->heapHighWaterMark = initialHeapSize;
+  #if MVM_GC_NURSERY
+  vm->nurseryStart = initialHeapSize;
+  #endif
+  #if MVM_OBJECT_SHAPES
+  vm->shapeRoots = VM_VALUE_NULL;
+  #endif
 
   if (initialHeapSize) {
     CODE_COVERAGE(435); // Hit
@@ -5423,6 +6855,15 @@ SUB_EXIT:
     CODE_COVERAGE_ERROR_PATH(437); // Not hit
     *result = NULL;
     if (vm) {
+      #if MVM_VERIFY_BYTECODE
+      vm_free(vm, vm->pVerifiedFunctions);
+      #endif
+      #if MVM_FUSE_INSTRUCTIONS && !MVM_FUSE_IN_PLACE
+      vm_free(vm, vm->pFusedBytecode);
+      #endif
+      #if MVM_USE_HEAP_ARENA
+      vm_free(vm, vm->pHeapArena);
+      #endif
       vm_free(vm, vm);
       vm = NULL;
     } else {
@@ -5435,1007 +6876,3224 @@ SUB_EXIT:
   return err;
 }
 
-static inline uint16_t getBytecodeSize(VM* vm) {
-  CODE_COVERAGE_UNTESTED(168); // Not hit
-  LongPtr lpBytecodeSize = LongPtr_add(vm->lpBytecode, OFFSETOF(mvm_TsBytecodeHeader, bytecodeSize));
-  return LongPtr_read2_aligned(lpBytecodeSize);
+#if MVM_VERIFY_BYTECODE
+/* -------------------------------------------------------------------------
+ *                            Bytecode Verifier
+ *
+ * Verifies bytecode functions by following their control flow, so that the
+ * interpreter doesn't need to check the program counter on every instruction
+ * (see MVM_VERIFY_BYTECODE).
+ *
+ * Each function is verified as a set of blocks. A block is an entry point into
+ * the function's code (the function entry, branch targets, catch targets and
+ * async resume points) together with the stack state at that point. The code
+ * from each block is walked linearly until it reaches a terminating
+ * instruction (e.g. RETURN or JUMP) or the start of another known block, in
+ * which case the stack state must agree.
+ *
+ * The stack state is the stack depth relative to the frame base, and the
+ * depth of the innermost catch target in the frame (catch targets occupy 2
+ * slots on the stack, so `END_TRY` can restore the depth statically).
+ * ------------------------------------------------------------------------- */
+
+// `tryBase` value for when there is no catch target in the current frame
+#define VERIFY_NO_TRY 0xFF
+// `catchParent` value for slots that have not held a catch target
+#define VERIFY_UNKNOWN_PARENT 0xFE
+
+typedef struct vm_TsVerifyBlock {
+  uint16_t offset; // Bytecode offset of the first instruction in the block
+  uint8_t depth; // Stack depth at the start of the block
+  uint8_t tryBase; // Stack depth of the innermost catch target, or VERIFY_NO_TRY
+  // True if the block is the code following an ASYNC_RESUME instruction at
+  // `offset - 3`, in which case `offset - 3` is a continuation entry point
+  bool isContinuation;
+} vm_TsVerifyBlock;
+
+typedef struct vm_TsVerifier {
+  VM* vm;
+
+  uint16_t romStart;
+  uint16_t romEnd;
+  uint16_t importCount;
+  uint16_t globalCount;
+  uint16_t shortCallCount;
+
+  // Bytecode offset of the function currently being verified
+  uint16_t functionOffset;
+  // The maximum stack depth declared by the header of the current function
+  uint8_t maxDepth;
+  // The greatest stack depth reached so far in the current function
+  uint8_t maxDepthReached;
+  // End of the furthest instruction reached so far in the current function
+  uint16_t codeEnd;
+
+  // The blocks of the current function. This list doubles as the worklist
+  // (blocks are processed in order) and the record of visited entry states.
+  vm_TsVerifyBlock* blocks;
+  uint16_t blockCount;
+  uint16_t blockCapacity;
+
+  // Bytecode offsets of functions that have been found but not yet verified
+  uint16_t* pendingFunctions;
+  uint16_t pendingCount;
+  uint16_t pendingCapacity;
+
+  #if MVM_FUSE_INSTRUCTIONS
+  // Writable copy of the bytecode to fuse instructions into, or NULL
+  uint8_t* pFusionImage;
+  // Offsets of instructions in the current function that start a sequence that
+  // can be fused (see vm_TeFusedOpcode)
+  uint16_t* fusionCandidates;
+  uint16_t fusionCandidateCount;
+  uint16_t fusionCandidateCapacity;
+  #endif // MVM_FUSE_INSTRUCTIONS
+
+  // For each stack slot that holds a catch target in the current function, the
+  // depth of the enclosing catch target (or VERIFY_NO_TRY)
+  uint8_t catchParent[256];
+} vm_TsVerifier;
+
+#define VERIFY(condition) do { if (!(condition)) return MVM_E_INVALID_BYTECODE; } while (false)
+
+// Makes room for at least one more item in one of the verifier's lists
+static TeError vm_verifyGrowList(vm_TsVerifier* v, void** pItems, uint16_t count, uint16_t* pCapacity, size_t itemSize) {
+  if (count < *pCapacity) {
+    return MVM_E_SUCCESS;
+  }
+  VERIFY(*pCapacity < 0x4000);
+  uint16_t newCapacity = *pCapacity ? *pCapacity * 2 : 8;
+  void* newItems = vm_malloc(v->vm, newCapacity * itemSize);
+  if (!newItems) return MVM_E_MALLOC_FAIL;
+  if (count) {
+    memcpy(newItems, *pItems, count * itemSize);
+  }
+  vm_free(v->vm, *pItems);
+  *pItems = newItems;
+  *pCapacity = newCapacity;
+  return MVM_E_SUCCESS;
 }
 
-static LongPtr getBytecodeSection(VM* vm, mvm_TeBytecodeSection id, LongPtr* out_end) {
-  CODE_COVERAGE(170); // Hit
-  LongPtr lpBytecode = vm->lpBytecode;
-  LongPtr lpSections = LongPtr_add(lpBytecode, OFFSETOF(mvm_TsBytecodeHeader, sectionOffsets));
-  LongPtr lpSection = LongPtr_add(lpSections, id * 2);
-  uint16_t offset = LongPtr_read2_aligned(lpSection);
-  LongPtr result = LongPtr_add(lpBytecode, offset);
-  if (out_end) {
-    CODE_COVERAGE(171); // Hit
-    uint16_t endOffset;
-    if (id == BCS_SECTION_COUNT - 1) {
-      endOffset = getBytecodeSize(vm);
-    } else {
-      LongPtr lpNextSection = LongPtr_add(lpSection, 2);
-      endOffset = LongPtr_read2_aligned(lpNextSection);
-    }
-    *out_end = LongPtr_add(lpBytecode, endOffset);
-  } else {
-    CODE_COVERAGE(172); // Hit
+static inline bool vm_isFunctionVerified(VM* vm, uint16_t offset) {
+  // Note: offsets before the ROM section wrap around to large values
+  uint16_t offsetInRom = (uint16_t)(offset - vm->verifiedRomStart);
+  if (offsetInRom >= vm->verifiedRomSize) {
+    return false;
   }
-  return result;
+  uint16_t index = offsetInRom >> 1;
+  return (vm->pVerifiedFunctions[index >> 3] >> (index & 7)) & 1;
 }
 
-static uint16_t getSectionSize(VM* vm, mvm_TeBytecodeSection section) {
-  CODE_COVERAGE(174); // Hit
-  uint16_t sectionStart = getSectionOffset(vm->lpBytecode, section);
-  uint16_t sectionEnd;
-  if (section == BCS_SECTION_COUNT - 1) {
-    CODE_COVERAGE_UNTESTED(175); // Not hit
-    sectionEnd = getBytecodeSize(vm);
-  } else {
-    CODE_COVERAGE(177); // Hit
-    VM_ASSERT(vm, section < BCS_SECTION_COUNT);
-    sectionEnd = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, section));
+static void vm_markFunctionVerified(VM* vm, uint16_t offset) {
+  uint16_t index = (offset - vm->verifiedRomStart) >> 1;
+  vm->pVerifiedFunctions[index >> 3] |= (uint8_t)(1 << (index & 7));
+}
+
+// Reads the allocation header of the function at the given bytecode offset, or
+// returns false if the offset is not the address of a function in ROM
+static bool vm_verifyReadFunctionHeader(vm_TsVerifier* v, uint16_t offset, uint16_t* out_header) {
+  if ((offset & 1) || (offset < v->romStart + 2) || (offset >= v->romEnd)) {
+    return false;
   }
-  VM_ASSERT(vm, sectionEnd >= sectionStart);
-  return sectionEnd - sectionStart;
+  uint16_t header = LongPtr_read2_aligned(LongPtr_add(v->vm->lpBytecode, offset - 2));
+  if (vm_getTypeCodeFromHeaderWord(header) != TC_REF_FUNCTION) {
+    return false;
+  }
+  *out_header = header;
+  return true;
 }
 
-/**
- * Called at startup to translate all the pointers that point to GC memory into
- * ShortPtr for efficiency and to maintain invariants assumed in other places in
- * the code.
- */
-static void loadPointers(VM* vm, uint8_t* heapStart) {
-  CODE_COVERAGE(178); // Hit
-  uint16_t n;
-  uint16_t v;
-  uint16_t* p;
+// Queues the function at the given bytecode offset for verification, if it
+// hasn't already been verified. Continuations are verified as part of their
+// containing function.
+static TeError vm_verifyAddFunction(vm_TsVerifier* v, uint16_t offset) {
+  uint16_t header;
+  VERIFY(vm_verifyReadFunctionHeader(v, offset, &header));
+  if (header & VM_FUNCTION_HEADER_CONTINUATION_FLAG) {
+    uint16_t backPointer = header & VM_FUNCTION_HEADER_BACK_POINTER_MASK;
+    VERIFY(backPointer * 4 <= offset);
+    offset = offset - backPointer * 4;
+    VERIFY(vm_verifyReadFunctionHeader(v, offset, &header));
+    VERIFY(!(header & VM_FUNCTION_HEADER_CONTINUATION_FLAG));
+  }
 
-  // Roots in global variables
-  uint16_t globalsSize = getSectionSize(vm, BCS_GLOBALS);
-  p = vm->globals;
-  n = globalsSize / 2;
-  TABLE_COVERAGE(n ? 1 : 0, 2, 179); // Hit 1/2
-  while (n--) {
-    v = *p;
-    if (Value_isShortPtr(v)) {
-      *p = ShortPtr_encode(vm, heapStart + v);
+  if (vm_isFunctionVerified(v->vm, offset)) {
+    return MVM_E_SUCCESS;
+  }
+  for (uint16_t i = 0; i < v->pendingCount; i++) {
+    if (v->pendingFunctions[i] == offset) {
+      return MVM_E_SUCCESS;
     }
-    p++;
   }
 
-  // Pointers in heap memory
-  p = (uint16_t*)heapStart;
-  VM_ASSERT(vm, vm->pLastBucketEndCapacity == vm->pLastBucket->pEndOfUsedSpace);
-  uint16_t* heapEnd = vm->pLastBucketEndCapacity;
-  while (p < heapEnd) {
-    CODE_COVERAGE(181); // Hit
-    uint16_t header = *p++;
-    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-    uint16_t words = (size + 1) / 2;
-    TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
+  TeError err = vm_verifyGrowList(v, (void**)&v->pendingFunctions, v->pendingCount, &v->pendingCapacity, sizeof (uint16_t));
+  if (err) return err;
+  v->pendingFunctions[v->pendingCount++] = offset;
+  return MVM_E_SUCCESS;
+}
 
-    if (tc < TC_REF_DIVIDER_CONTAINER_TYPES) { // Non-container types
-      CODE_COVERAGE(182); // Hit
-      p += words;
-      continue;
-    } // Else, container types
-    CODE_COVERAGE(183); // Hit
+// Queues any bytecode function referenced by the given value
+static TeError vm_verifyAddValue(vm_TsVerifier* v, Value value) {
+  if (!Value_isBytecodeMappedPtrOrWellKnown(value) || (value < VM_VALUE_WELLKNOWN_END)) {
+    return MVM_E_SUCCESS;
+  }
+  uint16_t offset = value & 0xFFFE;
+  uint16_t header;
+  if (!vm_verifyReadFunctionHeader(v, offset, &header)) {
+    // Not a function (e.g. a string or a handle to a global variable)
+    return MVM_E_SUCCESS;
+  }
+  return vm_verifyAddFunction(v, offset);
+}
 
-    while (words--) {
-      v = *p;
-      if (Value_isShortPtr(v)) {
-        *p = ShortPtr_encode(vm, heapStart + v);
-      }
-      p++;
+static int vm_verifyFindBlock(vm_TsVerifier* v, uint16_t offset) {
+  for (uint16_t i = 0; i < v->blockCount; i++) {
+    if (v->blocks[i].offset == offset) {
+      return i;
     }
   }
+  return -1;
 }
 
-void* mvm_getContext(VM* vm) {
-  return vm->context;
-}
+// Records a block entry point in the current function. If the block has
+// already been recorded then the stack state must be the same.
+static TeError vm_verifyAddBlock(vm_TsVerifier* v, int32_t offset, uint16_t depth, uint8_t tryBase, bool isContinuation) {
+  VERIFY((offset >= v->romStart) && (offset < v->romEnd));
+  VERIFY(depth <= v->maxDepth);
 
-// Note: mvm_free frees the VM, while vm_free is the counterpart to vm_malloc
-void mvm_free(VM* vm) {
-  CODE_COVERAGE(166); // Hit
+  int i = vm_verifyFindBlock(v, (uint16_t)offset);
+  if (i >= 0) {
+    VERIFY((v->blocks[i].depth == depth) && (v->blocks[i].tryBase == tryBase));
+    return MVM_E_SUCCESS;
+  }
 
-  gc_freeGCMemory(vm);
+  TeError err = vm_verifyGrowList(v, (void**)&v->blocks, v->blockCount, &v->blockCapacity, sizeof (vm_TsVerifyBlock));
+  if (err) return err;
 
-  // The stack may be allocated if `mvm_free` is called from the an error
-  // handler, right before terminating the thread or longjmp'ing out of the VM.
-  #if MVM_SAFE_MODE
-    if (vm->stack) {
-      // This at least zeros out the registers, so the machine will crash early if
-      // someone tries to the let it run after mvm_free
-      memset(vm->stack, 0, sizeof(*vm->stack));
-    }
-  #endif
-  // A compliant implementation of `free` will already check for null
-  vm_free(vm, vm->stack);
+  vm_TsVerifyBlock* block = &v->blocks[v->blockCount++];
+  block->offset = (uint16_t)offset;
+  block->depth = (uint8_t)depth;
+  block->tryBase = tryBase;
+  block->isContinuation = isContinuation;
+  return MVM_E_SUCCESS;
+}
 
-  VM_EXEC_SAFE_MODE(memset(vm, 0, sizeof(*vm)));
-  vm_free(vm, vm);
+// Records that the stack slot at `depth` holds a catch target whose enclosing
+// catch target is at `parent`.
+static TeError vm_verifySetCatchParent(vm_TsVerifier* v, uint16_t depth, uint8_t parent) {
+  VERIFY(depth < VERIFY_UNKNOWN_PARENT);
+  uint8_t existing = v->catchParent[depth];
+  VERIFY((existing == VERIFY_UNKNOWN_PARENT) || (existing == parent));
+  v->catchParent[depth] = parent;
+  return MVM_E_SUCCESS;
 }
 
-/**
- * @param sizeBytes Size in bytes of the allocation, *excluding* the header
- * @param typeCode The type code to insert into the header
- */
-MVM_HIDDEN void* mvm_allocate(VM* vm, uint16_t sizeBytes,  uint8_t /*TeTypeCode*/ typeCode) {
-  uint16_t* p;
-  uint16_t* end;
+#if MVM_FUSE_INSTRUCTIONS
+// Returns the vm_TeFusedOpcode that can replace the instruction sequence at the
+// given offset in the fusion image, or VM_FUSED_END if there is none
+static uint8_t vm_fuseMatch(vm_TsVerifier* v, uint16_t offset) {
+  uint8_t* p = &v->pFusionImage[offset];
+  uint16_t available = v->romEnd - offset;
 
-  if (sizeBytes >= (MAX_ALLOCATION_SIZE + 1)) {
-    CODE_COVERAGE_ERROR_PATH(353); // Not hit
-    MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
-  } else {
-    CODE_COVERAGE(354); // Hit
+  if ((available >= 3) &&
+    ((p[0] >> 4) == VM_OP_LOAD_VAR_1) &&
+    ((p[1] >> 4) == VM_OP_LOAD_SMALL_LITERAL) &&
+    ((p[1] & 0xF) >= VM_SLV_INT_MINUS_1) && ((p[1] & 0xF) <= VM_SLV_INT_5) &&
+    (p[2] == ((VM_OP_EXTENDED_1 << 4) | VM_OP1_ADD))
+  ) {
+    return VM_FUSED_LOAD_VAR_ADD_LITERAL;
   }
 
-  // If we happened to trigger a GC collection, we need to know that the
-  // registers are flushed, if they're allocated at all
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  if ((available >= 5) &&
+    ((p[0] >> 4) == VM_OP_LOAD_ARG_1) &&
+    (p[1] == ((VM_OP_EXTENDED_3 << 4) | VM_OP3_LOAD_LITERAL)) &&
+    (p[4] == ((VM_OP_EXTENDED_1 << 4) | VM_OP1_OBJECT_GET_1))
+  ) {
+    return VM_FUSED_LOAD_ARG_GET_LITERAL;
+  }
 
-  CODE_COVERAGE(184); // Hit
-  TsBucket* pBucket;
-  const uint16_t sizeIncludingHeader = (sizeBytes + 3) & 0xFFFE;
-  // + 2 bytes header, round up to 2-byte boundary
-  VM_ASSERT(vm, (sizeIncludingHeader & 1) == 0);
+  if ((available >= 3) &&
+    ((p[0] >> 4) == VM_OP_NUM_OP) &&
+    ((p[0] & 0xF) <= VM_NUM_OP_GREATER_EQUAL) &&
+    (p[1] == ((VM_OP_EXTENDED_2 << 4) | VM_OP2_BRANCH_1))
+  ) {
+    return VM_FUSED_LESS_THAN_BRANCH + (p[0] & 0xF);
+  }
 
-  // Minimum allocation size is 4 bytes, because that's the size of a
-  // tombstone. Note that nothing in code will attempt to allocate less,
-  // since even a 1-char string (+null terminator) is a 4-byte allocation.
-  VM_ASSERT(vm, sizeIncludingHeader >= 4);
+  if ((available >= 4) &&
+    ((p[0] >> 4) == VM_OP_NUM_OP) &&
+    ((p[0] & 0xF) <= VM_NUM_OP_GREATER_EQUAL) &&
+    (p[1] == ((VM_OP_EXTENDED_3 << 4) | VM_OP3_BRANCH_2))
+  ) {
+    return VM_FUSED_LESS_THAN_BRANCH_2 + (p[0] & 0xF);
+  }
 
-  VM_POTENTIAL_GC_POINT(vm);
+  return VM_FUSED_END;
+}
 
-RETRY:
-  pBucket = vm->pLastBucket;
-  if (!pBucket) {
-    CODE_COVERAGE(185); // Hit
-    goto GROW_HEAP_AND_RETRY;
-  }
-  p = pBucket->pEndOfUsedSpace;
-  end = (uint16_t*)((intptr_t)p + sizeIncludingHeader);
-  if (end > vm->pLastBucketEndCapacity) {
-    CODE_COVERAGE(186); // Hit
-    goto GROW_HEAP_AND_RETRY;
+// Records the instruction at the given offset if it starts a sequence that can
+// be fused. The decision is deferred until the whole function has been
+// verified, since only then are all the branch targets known.
+static TeError vm_fuseRecordCandidate(vm_TsVerifier* v, uint16_t offset) {
+  if (vm_fuseMatch(v, offset) == VM_FUSED_END) {
+    return MVM_E_SUCCESS;
   }
-  pBucket->pEndOfUsedSpace = end;
-
-  // Write header
-  *p++ = vm_makeHeaderWord(vm, (TeTypeCode)typeCode, sizeBytes);
+  TeError err = vm_verifyGrowList(v, (void**)&v->fusionCandidates, v->fusionCandidateCount, &v->fusionCandidateCapacity, sizeof (uint16_t));
+  if (err) return err;
+  v->fusionCandidates[v->fusionCandidateCount++] = offset;
+  return MVM_E_SUCCESS;
+}
 
-  return p;
+// Writes fused instructions over the candidate sequences of the code that has
+// just been verified. A sequence is only fused if no block (e.g. a branch
+// target) starts in the middle of it.
+static void vm_fuseCandidates(vm_TsVerifier* v) {
+  for (uint16_t i = 0; i < v->fusionCandidateCount; i++) {
+    uint16_t offset = v->fusionCandidates[i];
+    uint8_t* p = &v->pFusionImage[offset];
+
+    // Note: candidates can be recorded twice if blocks overlap, but the second
+    // time the sequence won't match because it's already been fused
+    uint8_t fusedOpcode = vm_fuseMatch(v, offset);
+    switch (fusedOpcode) {
+      case VM_FUSED_LOAD_VAR_ADD_LITERAL: {
+        if ((vm_verifyFindBlock(v, offset + 1) >= 0) || (vm_verifyFindBlock(v, offset + 2) >= 0)) {
+          continue;
+        }
+        // Variable index and literal
+        p[2] = (uint8_t)(((p[0] & 0xF) << 4) | (p[1] & 0xF));
+        break;
+      }
+      case VM_FUSED_LOAD_ARG_GET_LITERAL: {
+        if ((vm_verifyFindBlock(v, offset + 1) >= 0) || (vm_verifyFindBlock(v, offset + 4) >= 0)) {
+          continue;
+        }
+        // Property key (moved over the OBJECT_GET_1), then the arg index
+        p[4] = p[3];
+        p[3] = p[2];
+        p[2] = p[0] & 0xF;
+        break;
+      }
+      case VM_FUSED_LESS_THAN_BRANCH:
+      case VM_FUSED_GREATER_THAN_BRANCH:
+      case VM_FUSED_LESS_EQUAL_BRANCH:
+      case VM_FUSED_GREATER_EQUAL_BRANCH:
+      case VM_FUSED_LESS_THAN_BRANCH_2:
+      case VM_FUSED_GREATER_THAN_BRANCH_2:
+      case VM_FUSED_LESS_EQUAL_BRANCH_2:
+      case VM_FUSED_GREATER_EQUAL_BRANCH_2: {
+        if (vm_verifyFindBlock(v, offset + 1) >= 0) {
+          continue;
+        }
+        // The branch offset stays where it is, and is relative to the end of
+        // the sequence as before
+        break;
+      }
+      default:
+        continue;
+    }
 
-GROW_HEAP_AND_RETRY:
-  CODE_COVERAGE(187); // Hit
-  gc_createNextBucket(vm, MVM_ALLOCATION_BUCKET_SIZE, sizeIncludingHeader);
-  goto RETRY;
+    p[0] = (VM_OP_EXTENDED_1 << 4) | VM_OP1_RESERVED_VIRTUAL_NEW;
+    p[1] = fusedOpcode;
+    v->vm->fusedInstructionCount++;
+  }
 }
+#endif // MVM_FUSE_INSTRUCTIONS
 
-// Slow fallback for mvm_allocateWithConstantHeader
-static void* mvm_allocateWithConstantHeaderSlow(VM* vm, uint16_t header) {
-  CODE_COVERAGE(188); // Hit
+/**
+ * Verifies the code reachable from the given entry point, with the given
+ * initial stack state. The code is verified in the context of the current
+ * function (`v->functionOffset` and `v->maxDepth`).
+ */
+static TeError vm_verifyCode(vm_TsVerifier* v, uint16_t entry, uint8_t initialDepth) {
+  TeError err;
+  #if MVM_FUSE_INSTRUCTIONS
+  // Fused instructions are not valid bytecode, so code is verified against the
+  // original image, which is also what the fusion image was copied from
+  LongPtr lpBytecode = v->vm->lpOriginalBytecode;
+  #else
+  LongPtr lpBytecode = v->vm->lpBytecode;
+  #endif
 
-  // If we happened to trigger a GC collection, we need to know that the
-  // registers are flushed, if they're allocated at all
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+  v->blockCount = 0;
+  v->maxDepthReached = initialDepth;
+  v->codeEnd = entry;
+  memset(v->catchParent, VERIFY_UNKNOWN_PARENT, sizeof v->catchParent);
+  #if MVM_FUSE_INSTRUCTIONS
+  v->fusionCandidateCount = 0;
+  #endif
 
-  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-  TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
-  return mvm_allocate(vm, size, tc);
-}
+  err = vm_verifyAddBlock(v, entry, initialDepth, VERIFY_NO_TRY, false);
+  if (err) return err;
 
-/*
- * This function is like mvm_allocate except that it's optimized for
- * situations where:
- *
- *   1. The header can be precomputed to a C constant, rather than assembling it
- *      from the size and type
- *   2. The size is known to be a multiple of 2 and at least 2 bytes
- *
- * This is more efficient in some cases because it has fewer checks and
- * preprocessing to do. This function can probably be inlined in some cases.
- *
- * Note: the size is passed separately rather than computed from the header
- * because this function is optimized for cases where the size is known at
- * compile time (and even better if this function is inlined).
- *
- * WARNING: this does not initialize the data in the allocation.
- */
-static inline void* mvm_allocateWithConstantHeader(VM* vm, uint16_t header, uint16_t sizeIncludingHeader) {
-  CODE_COVERAGE(189); // Hit
+  for (uint16_t blockIndex = 0; blockIndex < v->blockCount; blockIndex++) {
+    uint16_t pc = v->blocks[blockIndex].offset;
+    uint16_t depth = v->blocks[blockIndex].depth;
+    uint8_t tryBase = v->blocks[blockIndex].tryBase;
 
-  uint16_t* p;
-  uint16_t* end;
+    // Walk linearly from the start of the block
+    while (true) {
+      // Running into another block ends this one
+      if (pc != v->blocks[blockIndex].offset) {
+        int other = vm_verifyFindBlock(v, pc);
+        if (other >= 0) {
+          VERIFY((v->blocks[other].depth == depth) && (v->blocks[other].tryBase == tryBase));
+          break;
+        }
+      }
 
-  // If we happened to trigger a GC collection, we need to know that the
-  // registers are flushed, if they're allocated at all
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+      #define VERIFY_READ_1(target) do { \
+        VERIFY(pc < v->romEnd); \
+        target = LongPtr_read1(LongPtr_add(lpBytecode, pc)); \
+        pc += 1; \
+      } while (false)
+
+      #define VERIFY_READ_2(target) do { \
+        VERIFY(pc + 1 < v->romEnd); \
+        target = LongPtr_read2_unaligned(LongPtr_add(lpBytecode, pc)); \
+        pc += 2; \
+      } while (false)
+
+      #define VERIFY_POP(n) do { VERIFY(depth >= (n)); depth -= (n); } while (false)
+
+      #define VERIFY_PUSH(n) do { \
+        depth += (n); \
+        VERIFY(depth <= v->maxDepth); \
+        if (depth > v->maxDepthReached) v->maxDepthReached = (uint8_t)depth; \
+      } while (false)
+
+      // Stack effect of a call, where the callee pops `argCount` arguments
+      // plus `extraPops` (the function, if it was pushed) and pushes the
+      // result unless it's a void call
+      #define VERIFY_CALL(argCountAndFlags, extraPops) do { \
+        VERIFY_POP(((argCountAndFlags) & AF_ARG_COUNT_MASK) + (extraPops)); \
+        if (!((argCountAndFlags) & AF_VOID_CALLED)) VERIFY_PUSH(1); \
+      } while (false)
+
+      uint8_t opcode;
+      uint16_t operand;
+      uint16_t operand2 = 0;
+      bool endOfBlock = false;
+
+      #if MVM_FUSE_INSTRUCTIONS
+      if (v->pFusionImage) {
+        err = vm_fuseRecordCandidate(v, pc);
+        if (err) return err;
+      }
+      #endif
 
-  VM_ASSERT(vm, sizeIncludingHeader % 2 == 0);
-  VM_ASSERT(vm, sizeIncludingHeader >= 4);
-  VM_ASSERT(vm, vm_getAllocationSizeExcludingHeaderFromHeaderWord(header) == sizeIncludingHeader - 2);
+      VERIFY_READ_1(opcode);
+      operand = opcode & 0xF;
+      opcode = opcode >> 4;
 
-  VM_POTENTIAL_GC_POINT(vm);
+      if (opcode >= VM_OP_DIVIDER_1) {
+        VERIFY_POP(1);
+      }
 
-  TsBucket* pBucket = vm->pLastBucket;
-  if (!pBucket) {
-    CODE_COVERAGE(190); // Hit
-    goto SLOW;
-  }
-  p = pBucket->pEndOfUsedSpace;
-  end = (uint16_t*)((intptr_t)p + sizeIncludingHeader);
-  if (end > vm->pLastBucketEndCapacity) {
-    CODE_COVERAGE(191); // Hit
-    goto SLOW;
-  }
+      switch (opcode) {
+        case VM_OP_LOAD_SMALL_LITERAL:
+          VERIFY(operand < smallLiteralsSize);
+          VERIFY_PUSH(1);
+          break;
 
-  pBucket->pEndOfUsedSpace = end;
-  *p++ = header;
-  return p;
+        case VM_OP_LOAD_VAR_1:
+          VERIFY(operand < depth);
+          VERIFY_PUSH(1);
+          break;
 
-SLOW:
-  CODE_COVERAGE(192); // Hit
-  return mvm_allocateWithConstantHeaderSlow(vm, header);
-}
+        case VM_OP_LOAD_SCOPED_1:
+        case VM_OP_LOAD_ARG_1:
+        case VM_OP_FIXED_ARRAY_NEW_1:
+          VERIFY_PUSH(1);
+          break;
 
-// Looks for a variable in the closure scope chain based on its index. Scope
-// records can be stored in ROM in some optimized cases, so this returns a long
-// pointer.
-static LongPtr vm_findScopedVariable(VM* vm, uint16_t varIndex) {
-  // Slots are 2 bytes
-  uint16_t offset = varIndex << 1;
-  Value scope = vm->stack->reg.closure;
-  while (true)
-  {
-    // The bytecode is corrupt or the compiler has a bug if we hit the bottom of
-    // the scope chain without finding the variable.
-    VM_ASSERT(vm, scope != VM_VALUE_DELETED);
+        case VM_OP_CALL_1:
+        SUB_VERIFY_CALL_SHORT: {
+          VERIFY(operand < v->shortCallCount);
+          LongPtr lpEntry = LongPtr_add(getBytecodeSection(v->vm, BCS_SHORT_CALL_TABLE, NULL), operand * sizeof (vm_TsShortCallTableEntry));
+          uint16_t target = LongPtr_read2_unaligned(lpEntry);
+          uint8_t argCountAndFlags = LongPtr_read1(LongPtr_add(lpEntry, 2));
+          if (target & 1) {
+            // Host function (see SUB_CALL_SHORT)
+            VERIFY(target < v->importCount);
+            VERIFY((argCountAndFlags & AF_ARG_COUNT_MASK) >= 1);
+          } else {
+            err = vm_verifyAddFunction(v, target >> 1);
+            if (err) return err;
+          }
+          VERIFY_CALL(argCountAndFlags, 0);
+          break;
+        }
 
-    LongPtr lpArr = DynamicPtr_decode_long(vm, scope);
-    uint16_t headerWord = readAllocationHeaderWord_long(lpArr);
-    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(headerWord) == TC_REF_CLOSURE);
-    uint16_t arraySize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-    if (offset < arraySize) {
-      return LongPtr_add(lpArr, offset);
-    } else {
-      offset -= arraySize;
-      // The reference to the parent is kept in the second slot
-      scope = LongPtr_read2_aligned(LongPtr_add(lpArr, arraySize - 2));
-    }
-  }
-}
+        case VM_OP_CALL_5:
+          VERIFY_READ_2(operand2);
+          err = vm_verifyAddFunction(v, operand2);
+          if (err) return err;
+          VERIFY_POP(operand);
+          VERIFY_PUSH(1);
+          break;
 
-// Read a scoped variable from the current closure. Assumes the current closure
-// is stored in RAM.
-static inline Value vm_readScopedFromThisClosure(VM* vm, uint16_t varIndex) {
-  CODE_COVERAGE(700); // Hit
-  Value* closure = ShortPtr_decode(vm, vm->stack->reg.closure);
-  Value* slot = &closure[varIndex];
-  VM_ASSERT(vm, slot == LongPtr_truncate(vm, vm_findScopedVariable(vm, varIndex)));
-  return *slot;
-}
+        case VM_OP_STORE_VAR_1:
+          VERIFY(operand < depth);
+          break;
 
-// Read a scoped variable from the current closure. Assumes the current closure
-// is stored in RAM.
-static inline void vm_writeScopedToThisClosure(VM* vm, uint16_t varIndex, Value value) {
-  CODE_COVERAGE(701); // Hit
-  Value* closure = ShortPtr_decode(vm, vm->stack->reg.closure);
-  Value* slot = &closure[varIndex];
-  VM_ASSERT(vm, slot == LongPtr_truncate(vm, vm_findScopedVariable(vm, varIndex)));
-  *slot = value;
-}
+        case VM_OP_STORE_SCOPED_1:
+          break;
 
-static inline void* getBucketDataBegin(TsBucket* bucket) {
-  CODE_COVERAGE(193); // Hit
-  return (void*)(bucket + 1);
-}
+        case VM_OP_ARRAY_GET_1:
+          VERIFY_PUSH(1);
+          break;
 
-/** The used heap size, excluding spare capacity in the last block, but
- * including any uncollected garbage. */
-static uint16_t getHeapSize(VM* vm) {
-  TsBucket* lastBucket = vm->pLastBucket;
-  if (lastBucket) {
-    CODE_COVERAGE(194); // Hit
-    return getBucketOffsetEnd(lastBucket);
-  } else {
-    CODE_COVERAGE(195); // Hit
-    return 0;
-  }
-}
+        case VM_OP_ARRAY_SET_1:
+          VERIFY_POP(1);
+          break;
 
-void mvm_getMemoryStats(VM* vm, mvm_TsMemoryStats* r) {
-  CODE_COVERAGE(627); // Hit
-  VM_ASSERT(NULL, vm != NULL);
-  VM_ASSERT(vm, r != NULL);
+        case VM_OP_NUM_OP:
+          VERIFY(operand < VM_NUM_OP_END);
+          if (operand < VM_NUM_OP_DIVIDER) {
+            VERIFY_POP(1);
+          }
+          VERIFY_PUSH(1);
+          break;
 
-  memset(r, 0, sizeof *r);
+        case VM_OP_BIT_OP:
+          VERIFY(operand < VM_BIT_OP_END);
+          if (operand < VM_BIT_OP_DIVIDER_2) {
+            VERIFY_POP(1);
+          }
+          VERIFY_PUSH(1);
+          break;
 
-  // Core size
-  r->coreSize = sizeof(VM);
-  r->fragmentCount++;
+        case VM_OP_EXTENDED_1:
+          switch (operand) {
+            case VM_OP1_RETURN:
+            case VM_OP1_THROW:
+              VERIFY_POP(1);
+              endOfBlock = true;
+              break;
+
+            case VM_OP1_CLOSURE_NEW:
+            case VM_OP1_TYPE_CODE_OF:
+            case VM_OP1_TYPEOF:
+            case VM_OP1_LOGICAL_NOT:
+              VERIFY_POP(1);
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP1_NEW:
+              VERIFY_READ_1(operand2);
+              // SUB_NEW locates the class using the full 8-bit operand
+              VERIFY(depth >= (operand2 & 0xFF) + 1);
+              VERIFY_CALL(operand2, 1);
+              break;
+
+            case VM_OP1_SCOPE_NEW:
+              VERIFY_READ_1(operand2);
+              break;
+
+            case VM_OP1_POP:
+              VERIFY_POP(1);
+              break;
+
+            case VM_OP1_OBJECT_NEW:
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP1_OBJECT_GET_1:
+            case VM_OP1_ADD:
+            case VM_OP1_EQUAL:
+            case VM_OP1_NOT_EQUAL:
+              VERIFY_POP(2);
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP1_OBJECT_SET_1:
+              VERIFY_POP(3);
+              break;
+
+            default:
+              return MVM_E_INVALID_BYTECODE;
+          }
+          break;
 
-  // Import table size
-  r->importTableSize = getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry) * sizeof(mvm_TfHostFunction);
+        case VM_OP_EXTENDED_2:
+          VERIFY_READ_1(operand2);
+          if (operand < VM_OP2_DIVIDER_1) {
+            VERIFY_POP(1);
+          }
+          switch (operand) {
+            case VM_OP2_BRANCH_1:
+              err = vm_verifyAddBlock(v, (int32_t)pc + (int8_t)operand2, depth, tryBase, false);
+              if (err) return err;
+              break;
+
+            case VM_OP2_STORE_ARG:
+            case VM_OP2_STORE_SCOPED_2:
+              break;
+
+            case VM_OP2_STORE_VAR_2:
+              VERIFY(operand2 < depth);
+              break;
+
+            case VM_OP2_JUMP_1:
+              err = vm_verifyAddBlock(v, (int32_t)pc + (int8_t)operand2, depth, tryBase, false);
+              if (err) return err;
+              endOfBlock = true;
+              break;
+
+            case VM_OP2_CALL_HOST: {
+              uint8_t importIndex;
+              VERIFY_READ_1(importIndex);
+              VERIFY(importIndex < v->importCount);
+              // The host calling convention excludes `this`, so it must be present
+              VERIFY((operand2 & AF_ARG_COUNT_MASK) >= 1);
+              VERIFY_CALL(operand2, 0);
+              break;
+            }
 
-  // Global variables size
-  r->globalVariablesSize = getSectionSize(vm, BCS_IMPORT_TABLE);
+            case VM_OP2_CALL_3:
+              VERIFY_CALL(operand2, 1);
+              break;
+
+            case VM_OP2_CALL_6:
+              operand = operand2;
+              goto SUB_VERIFY_CALL_SHORT;
+
+            case VM_OP2_LOAD_SCOPED_2:
+            case VM_OP2_ARRAY_NEW:
+            case VM_OP2_FIXED_ARRAY_NEW_2:
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP2_LOAD_VAR_2:
+              VERIFY(operand2 < depth);
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP2_EXTENDED_4:
+              switch (operand2) {
+                case VM_OP4_START_TRY: {
+                  uint16_t handler;
+                  VERIFY_READ_2(handler);
+                  // The catch target is stored as a bytecode-mapped pointer,
+                  // so the catch block must be 4-byte aligned (see SUB_THROW)
+                  VERIFY((handler & 3) == 1);
+                  // The exception is pushed after unwinding to the catch target
+                  err = vm_verifyAddBlock(v, handler & 0xFFFE, depth + 1, tryBase, false);
+                  if (err) return err;
+                  err = vm_verifySetCatchParent(v, depth, tryBase);
+                  if (err) return err;
+                  tryBase = (uint8_t)depth;
+                  VERIFY_PUSH(2);
+                  break;
+                }
+
+                case VM_OP4_END_TRY:
+                  VERIFY(tryBase != VERIFY_NO_TRY);
+                  VERIFY(depth >= tryBase + 2);
+                  depth = tryBase;
+                  tryBase = v->catchParent[tryBase];
+                  VERIFY(tryBase != VERIFY_UNKNOWN_PARENT);
+                  break;
+
+                case VM_OP4_OBJECT_KEYS:
+                case VM_OP4_UINT8_ARRAY_NEW:
+                case VM_OP4_TYPE_CODE_OF:
+                  VERIFY_POP(1);
+                  VERIFY_PUSH(1);
+                  break;
+
+                case VM_OP4_CLASS_CREATE:
+                  VERIFY_POP(2);
+                  VERIFY_PUSH(1);
+                  break;
+
+                case VM_OP4_LOAD_REG_CLOSURE:
+                case VM_OP4_SCOPE_SAVE:
+                  VERIFY_PUSH(1);
+                  break;
+
+                case VM_OP4_SCOPE_PUSH:
+                  VERIFY_READ_1(operand2);
+                  break;
+
+                case VM_OP4_SCOPE_POP:
+                case VM_OP4_ENQUEUE_JOB:
+                  break;
+
+                case VM_OP4_ASYNC_START:
+                  VERIFY_READ_1(operand2);
+                  // Must be the first instruction in the function
+                  VERIFY((depth == 0) && (tryBase == VERIFY_NO_TRY));
+                  // The async catch block runs in the frame of this function
+                  VERIFY(v->vm->asyncCatchBlockMaxDepth <= v->maxDepth);
+                  // Result slot at var[0] and the root catch target at var[1-2]
+                  err = vm_verifySetCatchParent(v, 1, VERIFY_NO_TRY);
+                  if (err) return err;
+                  tryBase = 1;
+                  VERIFY_PUSH(3);
+                  break;
+
+                case VM_OP4_ASYNC_RETURN:
+                  VERIFY_POP(1);
+                  // SUB_ASYNC_COMPLETE expects the result and success flag
+                  // above the root catch target
+                  VERIFY(v->maxDepth >= 3);
+                  endOfBlock = true;
+                  break;
+
+                case VM_OP4_ASYNC_COMPLETE:
+                  VERIFY(depth == 3);
+                  endOfBlock = true;
+                  break;
+
+                default:
+                  return MVM_E_INVALID_BYTECODE;
+              }
+              break;
+
+            default:
+              return MVM_E_INVALID_BYTECODE;
+          }
+          break;
 
-  r->stackHighWaterMark = vm->stackHighWaterMark;
+        case VM_OP_EXTENDED_3:
+          if (operand >= VM_OP3_DIVIDER_1) {
+            VERIFY_READ_2(operand2);
+          }
+          if (operand >= VM_OP3_DIVIDER_2) {
+            VERIFY_POP(1);
+          }
+          switch (operand) {
+            case VM_OP3_POP_N: {
+              uint8_t count;
+              VERIFY_READ_1(count);
+              VERIFY_POP(count);
+              break;
+            }
 
-  r->virtualHeapHighWaterMark = vm->heapHighWaterMark;
+            case VM_OP3_SCOPE_DISCARD:
+            case VM_OP3_SCOPE_CLONE:
+              break;
+
+            case VM_OP3_AWAIT: {
+              VERIFY_POP(1);
+              // The first 3 slots are the async result and root catch target
+              VERIFY(depth >= 3);
+
+              // See the await/resume bytecode structure in SUB_AWAIT
+              uint16_t resumePoint = (pc + 2 + 3) & 0xFFFC;
+              uint16_t header;
+              VERIFY(vm_verifyReadFunctionHeader(v, resumePoint, &header));
+              VERIFY(header & VM_FUNCTION_HEADER_CONTINUATION_FLAG);
+              VERIFY(resumePoint - (header & VM_FUNCTION_HEADER_BACK_POINTER_MASK) * 4 == v->functionOffset);
+
+              VERIFY(resumePoint + 2 < v->romEnd);
+              LongPtr lpResume = LongPtr_add(lpBytecode, resumePoint);
+              VERIFY(LongPtr_read1(lpResume) == ((VM_OP_EXTENDED_3 << 4) | VM_OP3_ASYNC_RESUME));
+              uint8_t slotCount = LongPtr_read1(LongPtr_add(lpResume, 1));
+              uint8_t catchTarget = LongPtr_read1(LongPtr_add(lpResume, 2));
+
+              // ASYNC_RESUME restores the stack that SUB_AWAIT saves
+              VERIFY(slotCount == depth - 3);
+              VERIFY((catchTarget <= depth) && (depth - catchTarget == tryBase));
+
+              // Execution resumes after the ASYNC_RESUME with the result pushed
+              err = vm_verifyAddBlock(v, resumePoint + 3, depth + 1, tryBase, true);
+              if (err) return err;
+              endOfBlock = true;
+              break;
+            }
 
-  // Running Parameters
-  vm_TsStack* stack = vm->stack;
-  if (stack) {
-    CODE_COVERAGE(628); // Hit
-    r->fragmentCount++;
-    vm_TsRegisters* reg = &stack->reg;
-    r->registersSize = sizeof *reg;
-    r->stackHeight = (uint8_t*)reg->pStackPointer - (uint8_t*)getBottomOfStack(vm->stack);
-    r->stackAllocatedCapacity = MVM_STACK_SIZE;
+            case VM_OP3_AWAIT_CALL:
+              VERIFY_READ_1(operand2);
+              VERIFY_CALL(operand2, 1);
+              break;
+
+            case VM_OP3_JUMP_2:
+              err = vm_verifyAddBlock(v, (int32_t)pc + (int16_t)operand2, depth, tryBase, false);
+              if (err) return err;
+              endOfBlock = true;
+              break;
+
+            case VM_OP3_LOAD_LITERAL:
+              err = vm_verifyAddValue(v, operand2);
+              if (err) return err;
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP3_LOAD_GLOBAL_3:
+              VERIFY(operand2 < v->globalCount);
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP3_LOAD_SCOPED_3:
+              VERIFY_PUSH(1);
+              break;
+
+            case VM_OP3_BRANCH_2:
+              err = vm_verifyAddBlock(v, (int32_t)pc + (int16_t)operand2, depth, tryBase, false);
+              if (err) return err;
+              break;
+
+            case VM_OP3_STORE_GLOBAL_3:
+              VERIFY(operand2 < v->globalCount);
+              break;
+
+            case VM_OP3_STORE_SCOPED_3:
+              break;
+
+            default:
+              // Includes ASYNC_RESUME, which is only valid at a resume point
+              return MVM_E_INVALID_BYTECODE;
+          }
+          break;
+
+        default:
+          return MVM_E_INVALID_BYTECODE;
+      }
+
+      #undef VERIFY_READ_1
+      #undef VERIFY_READ_2
+      #undef VERIFY_POP
+      #undef VERIFY_PUSH
+      #undef VERIFY_CALL
+
+      if (pc > v->codeEnd) v->codeEnd = pc;
+      if (endOfBlock) break;
+    }
   }
 
-  // Heap Stats
-  TsBucket* pLastBucket = vm->pLastBucket;
-  size_t heapOverheadSize = 0;
-  if (pLastBucket) {
-    CODE_COVERAGE(629); // Hit
-    TsBucket* b;
-    for (b = pLastBucket; b; b = b->prev) {
-      r->fragmentCount++;
-      heapOverheadSize += sizeof (TsBucket); // Extra space for bucket header
+  return MVM_E_SUCCESS;
+}
+
+static TeError vm_verifyFunction(vm_TsVerifier* v, uint16_t offset) {
+  TeError err;
+  uint16_t header;
+  VERIFY(vm_verifyReadFunctionHeader(v, offset, &header));
+
+  v->functionOffset = offset;
+  v->maxDepth = header & VM_FUNCTION_HEADER_STACK_HEIGHT_MASK;
+  err = vm_verifyCode(v, offset, 0);
+  if (err) return err;
+
+  #if MVM_FUSE_INSTRUCTIONS
+  if (v->pFusionImage) vm_fuseCandidates(v);
+  #endif
+
+  vm_markFunctionVerified(v->vm, offset);
+  // Continuations are only entered at the ASYNC_RESUME instruction
+  for (uint16_t i = 0; i < v->blockCount; i++) {
+    if (v->blocks[i].isContinuation) {
+      vm_markFunctionVerified(v->vm, v->blocks[i].offset - 3);
     }
-    r->virtualHeapUsed = getHeapSize(vm);
-    if (r->virtualHeapUsed > r->virtualHeapHighWaterMark)
-      r->virtualHeapHighWaterMark = r->virtualHeapUsed;
-    r->virtualHeapAllocatedCapacity = pLastBucket->offsetStart + (uint16_t)(uintptr_t)vm->pLastBucketEndCapacity - (uint16_t)(uintptr_t)getBucketDataBegin(pLastBucket);
   }
+  return MVM_E_SUCCESS;
+}
 
-  // Total size
-  r->totalSize =
-    r->coreSize +
-    r->importTableSize +
-    r->globalVariablesSize +
-    r->registersSize +
-    r->stackAllocatedCapacity +
-    r->virtualHeapAllocatedCapacity +
-    heapOverheadSize;
+static void vm_verifierInit(vm_TsVerifier* v, VM* vm) {
+  memset(v, 0, sizeof *v);
+  v->vm = vm;
+  v->romStart = getSectionOffset(vm->lpBytecode, BCS_ROM);
+  v->romEnd = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_ROM));
+  v->importCount = getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry);
+  v->globalCount = getSectionSize(vm, BCS_GLOBALS) / sizeof (Value);
+  v->shortCallCount = getSectionSize(vm, BCS_SHORT_CALL_TABLE) / sizeof (vm_TsShortCallTableEntry);
+  #if MVM_FUSE_INSTRUCTIONS
+  v->pFusionImage = vm->pFusedBytecode;
+  #endif
+}
+
+// Verifies all the pending functions, including those discovered along the way
+static TeError vm_verifierRun(vm_TsVerifier* v) {
+  TeError err = MVM_E_SUCCESS;
+  while (v->pendingCount) {
+    uint16_t offset = v->pendingFunctions[--v->pendingCount];
+    if (vm_isFunctionVerified(v->vm, offset)) continue;
+    err = vm_verifyFunction(v, offset);
+    if (err) break;
+  }
+  return err;
+}
+
+static void vm_verifierFree(vm_TsVerifier* v) {
+  VM* vm = v->vm;
+  vm_free(vm, v->blocks);
+  vm_free(vm, v->pendingFunctions);
+  #if MVM_FUSE_INSTRUCTIONS
+  vm_free(vm, v->fusionCandidates);
+  #endif
+  vm_free(vm, v);
 }
 
 /**
- * Expand the VM heap by allocating a new "bucket" of memory from the host.
- *
- * @param bucketSize The ideal size of the contents of the new bucket
- * @param minBucketSize The smallest the bucketSize can be reduced and still be valid
+ * Verifies the functions reachable from the bytecode roots (exports, builtins,
+ * the short-call table and initial values of globals), and the functions they
+ * reference statically. Called by `mvm_restore`.
  */
-static void gc_createNextBucket(VM* vm, uint16_t bucketSize, uint16_t minBucketSize) {
-  CODE_COVERAGE(7); // Hit
-  uint16_t heapSize = getHeapSize(vm);
-
-  if (bucketSize < minBucketSize) {
-    CODE_COVERAGE_UNTESTED(196); // Not hit
-    bucketSize = minBucketSize;
+static TeError vm_verifyBytecode(VM* vm) {
+  CODE_COVERAGE_UNTESTED(749); // Not hit
+  TeError err;
+  vm_TsVerifier* v = vm_malloc(vm, sizeof (vm_TsVerifier));
+  if (!v) return MVM_E_MALLOC_FAIL;
+  vm_verifierInit(v, vm);
+  vm->verifiedRomStart = v->romStart;
+  vm->verifiedRomSize = v->romEnd - v->romStart;
+
+  // One bit for each 2-byte word in ROM
+  uint16_t bitmapSize = ((v->romEnd - v->romStart) / 2 + 7) / 8 + 1;
+  vm->pVerifiedFunctions = vm_malloc(vm, bitmapSize);
+  if (!vm->pVerifiedFunctions) {
+    err = MVM_E_MALLOC_FAIL;
+    goto SUB_EXIT;
+  }
+  memset(vm->pVerifiedFunctions, 0, bitmapSize);
+
+  // The async catch block is a block of code that executes in the frame of an
+  // async function after an exception unwinds to the root catch target, so
+  // it's verified with the stack state at that point: the async result slot
+  // and the exception. It's bundled as a function, but is never called as one.
+  vm->asyncCatchBlockMaxDepth = 0xFFFF;
+  Value asyncCatchBlock = getBuiltin(vm, BIN_ASYNC_CATCH_BLOCK);
+  if (Value_isBytecodeMappedPtrOrWellKnown(asyncCatchBlock) && (asyncCatchBlock >= VM_VALUE_WELLKNOWN_END)) {
+    uint16_t offset = asyncCatchBlock & 0xFFFE;
+    uint16_t header;
+    if (!vm_verifyReadFunctionHeader(v, offset, &header)) {
+      err = MVM_E_INVALID_BYTECODE;
+      goto SUB_EXIT;
+    }
+    v->functionOffset = offset;
+    v->maxDepth = header & VM_FUNCTION_HEADER_STACK_HEIGHT_MASK;
+    err = vm_verifyCode(v, offset, 2);
+    if (err) goto SUB_EXIT;
+    vm->asyncCatchBlockMaxDepth = v->maxDepthReached;
+    vm_markFunctionVerified(vm, offset);
   }
 
-  VM_ASSERT(vm, minBucketSize <= bucketSize);
-
-  // If this tips us over the top of the heap, then we run a collection
-  if (heapSize + bucketSize > MVM_MAX_HEAP_SIZE) {
-    CODE_COVERAGE_UNTESTED(197); // Hit
-    mvm_runGC(vm, false);
-    heapSize = getHeapSize(vm);
+  // Exports
+  LongPtr lpExportTableEnd;
+  LongPtr lpExport = getBytecodeSection(vm, BCS_EXPORT_TABLE, &lpExportTableEnd);
+  while (lpExport < lpExportTableEnd) {
+    err = vm_verifyAddValue(v, READ_FIELD_2(lpExport, vm_TsExportTableEntry, exportValue));
+    if (err) goto SUB_EXIT;
+    lpExport = LongPtr_add(lpExport, sizeof (vm_TsExportTableEntry));
   }
 
-  // Can't fit?
-  if (heapSize + minBucketSize > MVM_MAX_HEAP_SIZE) {
-    CODE_COVERAGE_ERROR_PATH(5); // Not hit
-    MVM_FATAL_ERROR(vm, MVM_E_OUT_OF_MEMORY);
+  // Builtins (the async catch block has already been verified above)
+  LongPtr lpBuiltinsEnd;
+  LongPtr lpBuiltin = getBytecodeSection(vm, BCS_BUILTINS, &lpBuiltinsEnd);
+  while (lpBuiltin < lpBuiltinsEnd) {
+    err = vm_verifyAddValue(v, LongPtr_read2_aligned(lpBuiltin));
+    if (err) goto SUB_EXIT;
+    lpBuiltin = LongPtr_add(lpBuiltin, 2);
   }
 
-  // Can fit, but only by chopping the end off the new bucket?
-  if (heapSize + bucketSize > MVM_MAX_HEAP_SIZE) {
-    CODE_COVERAGE_UNTESTED(6); // Not hit
-    bucketSize = MVM_MAX_HEAP_SIZE - heapSize;
+  // Short-call table
+  for (uint16_t i = 0; i < v->shortCallCount; i++) {
+    LongPtr lpEntry = LongPtr_add(getBytecodeSection(vm, BCS_SHORT_CALL_TABLE, NULL), i * sizeof (vm_TsShortCallTableEntry));
+    uint16_t target = LongPtr_read2_unaligned(lpEntry);
+    if (!(target & 1)) {
+      err = vm_verifyAddFunction(v, target >> 1);
+      if (err) goto SUB_EXIT;
+    }
   }
 
-  size_t allocSize = sizeof (TsBucket) + bucketSize;
-  TsBucket* bucket = vm_malloc(vm, allocSize);
-  if (!bucket) {
-    CODE_COVERAGE_ERROR_PATH(198); // Not hit
-    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+  // Globals
+  for (uint16_t i = 0; i < v->globalCount; i++) {
+    err = vm_verifyAddValue(v, vm->globals[i]);
+    if (err) goto SUB_EXIT;
   }
-  #if MVM_SAFE_MODE
-    memset(bucket, 0x7E, allocSize);
+
+  err = vm_verifierRun(v);
+
+SUB_EXIT:
+  vm_verifierFree(v);
+  return err;
+}
+
+/**
+ * Verifies a function that was not reachable from the roots at load time (e.g.
+ * a function only referenced by the initial heap). Called by `vm_call` the
+ * first time the function is called.
+ */
+static TeError vm_verifyFunctionOnCall(VM* vm, uint16_t offset) {
+  CODE_COVERAGE_UNTESTED(750); // Not hit
+  TeError err;
+  vm_TsVerifier* v = vm_malloc(vm, sizeof (vm_TsVerifier));
+  if (!v) return MVM_E_MALLOC_FAIL;
+  vm_verifierInit(v, vm);
+
+  err = vm_verifyAddFunction(v, offset);
+  if (!err) err = vm_verifierRun(v);
+  // A continuation is verified as part of its containing function, so it may
+  // still be unverified if it isn't a resume point of that function
+  if (!err && !vm_isFunctionVerified(vm, offset)) err = MVM_E_INVALID_BYTECODE;
+
+  vm_verifierFree(v);
+  return err;
+}
+
+#if MVM_CODE_CACHE
+/**
+ * Returns the number of bytes spanned by the code reachable from the entry of
+ * the given (already verified) function, or 0 if it can't be determined. The
+ * functions don't have an allocation size, so the code cache uses this to
+ * know how many instructions to make room for.
+ */
+static uint16_t vm_verifyMeasureFunction(VM* vm, uint16_t offset) {
+  uint16_t size = 0;
+  uint16_t header;
+  vm_TsVerifier* v = vm_malloc(vm, sizeof (vm_TsVerifier));
+  if (!v) return 0;
+  vm_verifierInit(v, vm);
+  #if MVM_FUSE_INSTRUCTIONS
+  v->pFusionImage = NULL; // Already fused when the function was verified
   #endif
-  bucket->prev = vm->pLastBucket;
-  bucket->next = NULL;
-  bucket->pEndOfUsedSpace = getBucketDataBegin(bucket);
 
-  TABLE_COVERAGE(bucket->prev ? 1 : 0, 2, 11); // Hit 2/2
+  if (vm_verifyReadFunctionHeader(v, offset, &header)) {
+    v->functionOffset = offset;
+    v->maxDepth = header & VM_FUNCTION_HEADER_STACK_HEIGHT_MASK;
+    if (vm_verifyCode(v, offset, 0) == MVM_E_SUCCESS) {
+      size = v->codeEnd - offset;
+    }
+  }
 
-  // Note: we start the next bucket at the allocation cursor, not at what we
-  // previously called the end of the previous bucket
-  bucket->offsetStart = heapSize;
-  vm->pLastBucketEndCapacity = (uint16_t*)((intptr_t)bucket->pEndOfUsedSpace + bucketSize);
-  if (vm->pLastBucket) {
-    CODE_COVERAGE(199); // Hit
-    vm->pLastBucket->next = bucket;
-  } else {
-    CODE_COVERAGE(200); // Hit
+  vm_verifierFree(v);
+  return size;
+}
+#endif // MVM_CODE_CACHE
+
+#undef VERIFY
+#undef VERIFY_NO_TRY
+#undef VERIFY_UNKNOWN_PARENT
+#endif // MVM_VERIFY_BYTECODE
+
+#if MVM_CODE_CACHE
+static size_t vm_codeCacheEntrySize(uint16_t codeSize) {
+  return sizeof (vm_TsCodeCacheEntry) + (size_t)codeSize * sizeof (vm_TsDecodedInstruction);
+}
+
+/**
+ * Finds the code cache entry for the function containing the given program
+ * counter (or the function entry point, if it can't be cached), and marks it as
+ * the most recently used. Returns NULL if there isn't one.
+ */
+static vm_TsCodeCacheEntry* vm_codeCacheFind(VM* vm, LongPtr lpProgramCounter) {
+  vm_TsCodeCacheEntry** ppEntry = &vm->pCodeCache;
+  while (*ppEntry) {
+    vm_TsCodeCacheEntry* pEntry = *ppEntry;
+    uint16_t offset = (uint16_t)LongPtr_sub(lpProgramCounter, pEntry->lpCode);
+    if ((offset < pEntry->codeSize) || (offset == 0)) {
+      *ppEntry = pEntry->next;
+      pEntry->next = vm->pCodeCache;
+      vm->pCodeCache = pEntry;
+      return pEntry;
+    }
+    ppEntry = &pEntry->next;
   }
-  vm->pLastBucket = bucket;
+  return NULL;
 }
 
-static void gc_freeGCMemory(VM* vm) {
-  CODE_COVERAGE(10); // Hit
-  TABLE_COVERAGE(vm->pLastBucket ? 1 : 0, 2, 201); // Hit 2/2
-  while (vm->pLastBucket) {
-    CODE_COVERAGE(169); // Hit
-    TsBucket* prev = vm->pLastBucket->prev;
-    vm_free(vm, vm->pLastBucket);
-    TABLE_COVERAGE(prev ? 1 : 0, 2, 202); // Hit 1/2
-    vm->pLastBucket = prev;
+// Frees the least recently used entry in the code cache
+static void vm_codeCacheEvict(VM* vm) {
+  vm_TsCodeCacheEntry** ppEntry = &vm->pCodeCache;
+  VM_ASSERT(vm, *ppEntry);
+  while ((*ppEntry)->next) {
+    ppEntry = &(*ppEntry)->next;
   }
-  vm->pLastBucketEndCapacity = NULL;
+  vm->codeCacheSize -= vm_codeCacheEntrySize((*ppEntry)->codeSize);
+  vm_free(vm, *ppEntry);
+  *ppEntry = NULL;
 }
 
-#if MVM_INCLUDE_SNAPSHOT_CAPABILITY || (!MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE)
 /**
- * Given a pointer `ptr` into the heap, this returns the equivalent offset from
- * the start of the heap (0 meaning that `ptr` points to the beginning of the
- * heap).
- *
- * This is used in 2 places:
+ * Gets the code cache entry to use when calling the function at the given
+ * bytecode offset, adding it to the cache if necessary. Returns NULL if the
+ * function can't be cached, in which case it's executed directly from the
+ * bytecode.
  *
- *   1. On a 32-bit machine, this is used to get a 16-bit equivalent encoding for ShortPtr
- *   2. On any machine, this is used in serializePtr for creating snapshots
+ * Adding an entry may evict others, so any entry pointers held by the caller
+ * are invalidated.
  */
-static uint16_t pointerOffsetInHeap(VM* vm, TsBucket* pLastBucket, void* ptr) {
-  CODE_COVERAGE(203); // Hit
-  /*
-   * This algorithm iterates through the buckets in the heap backwards. Although
-   * this is technically linear cost, in reality I expect that the pointer will
-   * be found in the very first searched bucket almost all the time. This is
-   * because the GC compacts everything into a single bucket, and because the
-   * most recently bucket is also likely to be the most frequently accessed.
-   *
-   * See ShortPtr_decode for more description
-   */
-  TsBucket* bucket = pLastBucket;
-  while (bucket) {
-    // Note: using `<=` here because the pointer is permitted to point to the
-    // end of the heap.
-    if ((ptr >= (void*)bucket) && (ptr <= (void*)bucket->pEndOfUsedSpace)) {
-      CODE_COVERAGE(204); // Hit
-      uint16_t offsetInBucket = (uint16_t)((intptr_t)ptr - (intptr_t)getBucketDataBegin(bucket));
-      VM_ASSERT(vm, offsetInBucket < 0x8000);
-      uint16_t offsetInHeap = bucket->offsetStart + offsetInBucket;
-
-      // It isn't strictly necessary that all short pointers are 2-byte aligned,
-      // but it probably indicates a mistake somewhere if a short pointer is not
-      // 2-byte aligned, since `Value` cannot be a `ShortPtr` unless it's 2-byte
-      // aligned.
-      VM_ASSERT(vm, (offsetInHeap & 1) == 0);
+static vm_TsCodeCacheEntry* vm_codeCacheEnter(VM* vm, uint16_t functionOffset) {
+  LongPtr lpCode = LongPtr_add(vm->lpBytecode, functionOffset);
+  vm_TsCodeCacheEntry* pEntry = vm_codeCacheFind(vm, lpCode);
+  if (pEntry) {
+    CODE_COVERAGE(769); // Not hit
+    return pEntry;
+  }
+  CODE_COVERAGE(770); // Not hit
+
+  // Continuations are cached as part of their containing function, if at all
+  uint16_t header = LongPtr_read2_aligned(LongPtr_add(lpCode, -2));
+  if (header & VM_FUNCTION_HEADER_CONTINUATION_FLAG) {
+    CODE_COVERAGE_UNTESTED(771); // Not hit
+    return NULL;
+  }
 
-      VM_ASSERT(vm, offsetInHeap < getHeapSize(vm));
+  uint16_t codeSize = vm_verifyMeasureFunction(vm, functionOffset);
+  // A function that's too large for the budget gets an empty entry, so that
+  // it's not measured again on the next call
+  if (vm_codeCacheEntrySize(codeSize) > MVM_CODE_CACHE_BUDGET) {
+    CODE_COVERAGE_UNTESTED(772); // Not hit
+    codeSize = 0;
+  }
+  size_t entrySize = vm_codeCacheEntrySize(codeSize);
 
-      return offsetInHeap;
-    } else {
-      CODE_COVERAGE(205); // Hit
-    }
+  while (vm->pCodeCache && (vm->codeCacheSize + entrySize > MVM_CODE_CACHE_BUDGET)) {
+    CODE_COVERAGE(773); // Not hit
+    vm_codeCacheEvict(vm);
+  }
 
-    bucket = bucket->prev;
+  pEntry = vm_malloc(vm, entrySize);
+  if (!pEntry) {
+    CODE_COVERAGE_ERROR_PATH(774); // Not hit
+    return NULL;
   }
+  memset(pEntry, 0, entrySize);
+  pEntry->lpCode = lpCode;
+  pEntry->codeSize = codeSize;
+  pEntry->instructions = (vm_TsDecodedInstruction*)(pEntry + 1);
+  pEntry->next = vm->pCodeCache;
+  vm->pCodeCache = pEntry;
+  vm->codeCacheSize += entrySize;
 
-  // A failure here means we're trying to encode a pointer that doesn't map
-  // to something in GC memory, which is a mistake.
-  MVM_FATAL_ERROR(vm, MVM_E_UNEXPECTED);
-  return 0;
+  return pEntry;
 }
-#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY || (!MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE)
 
-// Encodes a bytecode offset as a Value
-static inline Value vm_encodeBytecodeOffsetAsPointer(VM* vm, uint16_t offset) {
-  // Only offsets with 4-byte alignment can be represented as VM values
-  VM_ASSERT(vm, offset & 0xFFFC);
-  // Bytecode pointers end in binary 01
-  return offset | 1;
-}
+/**
+ * Decodes the instruction at the given address into a code cache slot. This
+ * mirrors the decoding in `vm_call` for the primary opcode and, for the Ex-1,
+ * Ex-2 and Ex-3 groups, the secondary opcode and its parameter, so that the
+ * handler for the secondary opcode can be dispatched to directly. Any further
+ * operands are read by the handler itself, as usual.
+ */
+static void vm_codeCacheDecode(LongPtr lpInstruction, vm_TsDecodedInstruction* pInstruction, const void* const* const* dispatchTables) {
+  uint8_t opcode = LongPtr_read1(lpInstruction);
+  uint16_t reg1 = opcode & 0xF;
+  uint8_t reg3 = opcode >> 4;
+  uint8_t lengthAndFlags = 1;
+  const void* handler;
 
-#if MVM_NATIVE_POINTER_IS_16_BIT
-  static inline void* ShortPtr_decode(VM* vm, ShortPtr ptr) {
-    return (void*)ptr;
-  }
-  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
-    return (ShortPtr)ptr;
+  if (reg3 >= VM_OP_DIVIDER_1) {
+    lengthAndFlags |= VM_DECODED_POP_REG2;
   }
-  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
-    return (ShortPtr)ptr;
-  }
-#elif MVM_USE_SINGLE_RAM_PAGE
-  static inline void* ShortPtr_decode(VM* vm, ShortPtr ptr) {
-    /**
-     * Minor performance note:
-     *
-     * I think I recall that the ARM instruction set can inline 16-bit literal
-     * values but not 32-bit values. This is one of the reasons why this uses
-     * the "high bits" and not just some arbitrary pointer addition. Basically,
-     * I'm trying to make this as efficient as possible, since pointers are used
-     * everywhere
-     */
-    return (void*)(((intptr_t)MVM_RAM_PAGE_ADDR) | ptr);
-  }
-  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
-    VM_ASSERT(vm, ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR) <= 0xFFFF);
-    return (ShortPtr)(uintptr_t)ptr;
-  }
-  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
-    VM_ASSERT(gc->vm, ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR) <= 0xFFFF);
-    return (ShortPtr)(uintptr_t)ptr;
+
+  switch (reg3) {
+    case VM_OP_EXTENDED_1: {
+      reg3 = (uint8_t)reg1;
+      handler = dispatchTables[1][reg3];
+      break;
+    }
+    case VM_OP_EXTENDED_2: {
+      reg3 = (uint8_t)reg1;
+      reg1 = LongPtr_read1(LongPtr_add(lpInstruction, 1));
+      lengthAndFlags = 2;
+      if (reg3 < VM_OP2_DIVIDER_1) {
+        lengthAndFlags |= VM_DECODED_POP_REG2;
+      }
+      handler = dispatchTables[2][reg3];
+      break;
+    }
+    case VM_OP_EXTENDED_3: {
+      reg3 = (uint8_t)reg1;
+      if (reg3 >= VM_OP3_DIVIDER_1) {
+        reg1 = LongPtr_read2_unaligned(LongPtr_add(lpInstruction, 1));
+        lengthAndFlags = 3;
+      }
+      if (reg3 >= VM_OP3_DIVIDER_2) {
+        lengthAndFlags |= VM_DECODED_POP_REG2;
+      }
+      handler = dispatchTables[3][reg3];
+      break;
+    }
+    default: {
+      handler = dispatchTables[0][reg3];
+      break;
+    }
   }
-#else // !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE
-  static void* ShortPtr_decode(VM* vm, ShortPtr shortPtr) {
-    // It isn't strictly necessary that all short pointers are 2-byte aligned,
-    // but it probably indicates a mistake somewhere if a short pointer is not
-    // 2-byte aligned, since `Value` cannot be a `ShortPtr` unless it's 2-byte
-    // aligned. Among other things, this catches VM_VALUE_NULL.
-    VM_ASSERT(vm, (shortPtr & 1) == 0);
 
-    // The shortPtr is treated as an offset into the heap
-    uint16_t offsetInHeap = shortPtr;
-    VM_ASSERT(vm, offsetInHeap < getHeapSize(vm));
+  pInstruction->reg1 = reg1;
+  pInstruction->reg3 = reg3;
+  pInstruction->lengthAndFlags = lengthAndFlags;
+  pInstruction->handler = handler;
+}
 
-    /*
-    Note: this is a linear search through the buckets, but a redeeming factor is
-    that GC compacts the heap into a single bucket, so the number of buckets is
-    small at any one time. Also, most-recently-allocated data are likely to be
-    in the last bucket and accessed fastest. Also, the representation of the
-    function is only needed on more powerful platforms. For 16-bit platforms,
-    the implementation of ShortPtr_decode is a no-op.
-    */
+static void vm_codeCacheFree(VM* vm) {
+  vm_TsCodeCacheEntry* pEntry = vm->pCodeCache;
+  while (pEntry) {
+    vm_TsCodeCacheEntry* pNext = pEntry->next;
+    vm_free(vm, pEntry);
+    pEntry = pNext;
+  }
+  vm->pCodeCache = NULL;
+  vm->codeCacheSize = 0;
+}
+#endif // MVM_CODE_CACHE
 
-    TsBucket* bucket = vm->pLastBucket;
-    while (true) {
-      // All short pointers must map to some memory in a bucket, otherwise the pointer is corrupt
-      VM_ASSERT(vm, bucket != NULL);
+static inline uint16_t getBytecodeSize(VM* vm) {
+  CODE_COVERAGE_UNTESTED(168); // Not hit
+  LongPtr lpBytecodeSize = LongPtr_add(vm->lpBytecode, OFFSETOF(mvm_TsBytecodeHeader, bytecodeSize));
+  return LongPtr_read2_aligned(lpBytecodeSize);
+}
 
-      if (offsetInHeap >= bucket->offsetStart) {
-        uint16_t offsetInBucket = offsetInHeap - bucket->offsetStart;
-        void* result = (void*)((intptr_t)getBucketDataBegin(bucket) + offsetInBucket);
-        return result;
-      }
-      bucket = bucket->prev;
+static LongPtr getBytecodeSection(VM* vm, mvm_TeBytecodeSection id, LongPtr* out_end) {
+  CODE_COVERAGE(170); // Hit
+  LongPtr lpBytecode = vm->lpBytecode;
+  LongPtr lpSections = LongPtr_add(lpBytecode, OFFSETOF(mvm_TsBytecodeHeader, sectionOffsets));
+  LongPtr lpSection = LongPtr_add(lpSections, id * 2);
+  uint16_t offset = LongPtr_read2_aligned(lpSection);
+  LongPtr result = LongPtr_add(lpBytecode, offset);
+  if (out_end) {
+    CODE_COVERAGE(171); // Hit
+    uint16_t endOffset;
+    if (id == BCS_SECTION_COUNT - 1) {
+      endOffset = getBytecodeSize(vm);
+    } else {
+      LongPtr lpNextSection = LongPtr_add(lpSection, 2);
+      endOffset = LongPtr_read2_aligned(lpNextSection);
     }
+    *out_end = LongPtr_add(lpBytecode, endOffset);
+  } else {
+    CODE_COVERAGE(172); // Hit
   }
+  return result;
+}
 
-  /**
-   * Like ShortPtr_encode except conducted against an arbitrary bucket list.
-   *
-   * Used internally by ShortPtr_encode and ShortPtr_encodeInToSpace.
-   */
-  static inline ShortPtr ShortPtr_encode_generic(VM* vm, TsBucket* pLastBucket, void* ptr) {
-    return pointerOffsetInHeap(vm, pLastBucket, ptr);
+static uint16_t getSectionSize(VM* vm, mvm_TeBytecodeSection section) {
+  CODE_COVERAGE(174); // Hit
+  uint16_t sectionStart = getSectionOffset(vm->lpBytecode, section);
+  uint16_t sectionEnd;
+  if (section == BCS_SECTION_COUNT - 1) {
+    CODE_COVERAGE_UNTESTED(175); // Not hit
+    sectionEnd = getBytecodeSize(vm);
+  } else {
+    CODE_COVERAGE(177); // Hit
+    VM_ASSERT(vm, section < BCS_SECTION_COUNT);
+    sectionEnd = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, section));
   }
+  VM_ASSERT(vm, sectionEnd >= sectionStart);
+  return sectionEnd - sectionStart;
+}
 
-  // Encodes a pointer as pointing to a value in the current heap
-  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
-    return ShortPtr_encode_generic(vm, vm->pLastBucket, ptr);
+/**
+ * Called at startup to translate all the pointers that point to GC memory into
+ * ShortPtr for efficiency and to maintain invariants assumed in other places in
+ * the code.
+ */
+static void loadPointers(VM* vm, uint8_t* heapStart) {
+  CODE_COVERAGE(178); // Hit
+  uint16_t n;
+  uint16_t v;
+  uint16_t* p;
+
+  // Roots in global variables
+  uint16_t globalsSize = getSectionSize(vm, BCS_GLOBALS);
+  p = vm->globals;
+  n = globalsSize / 2;
+  TABLE_COVERAGE(n ? 1 : 0, 2, 179); // Hit 1/2
+  while (n--) {
+    v = *p;
+    if (Value_isShortPtr(v)) {
+      *p = ShortPtr_encode(vm, heapStart + v);
+    }
+    p++;
   }
 
-  // Encodes a pointer as pointing to a value in the _new_ heap (tospace) during
-  // an ongoing garbage collection.
-  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
-    return ShortPtr_encode_generic(gc->vm, gc->lastBucket, ptr);
+  // Pointers in heap memory
+  p = (uint16_t*)heapStart;
+  VM_ASSERT(vm, vm->pLastBucketEndCapacity == vm->pLastBucket->pEndOfUsedSpace);
+  uint16_t* heapEnd = vm->pLastBucketEndCapacity;
+  while (p < heapEnd) {
+    CODE_COVERAGE(181); // Hit
+    uint16_t header = *p++;
+    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+    uint16_t words = (size + 1) / 2;
+    TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
+
+    if (tc < TC_REF_DIVIDER_CONTAINER_TYPES) { // Non-container types
+      CODE_COVERAGE(182); // Hit
+      p += words;
+      continue;
+    } // Else, container types
+    CODE_COVERAGE(183); // Hit
+
+    while (words--) {
+      v = *p;
+      if (Value_isShortPtr(v)) {
+        *p = ShortPtr_encode(vm, heapStart + v);
+      }
+      p++;
+    }
   }
-#endif
+}
 
-static LongPtr BytecodeMappedPtr_decode_long(VM* vm, BytecodeMappedPtr ptr) {
-  CODE_COVERAGE(214); // Hit
+void* mvm_getContext(VM* vm) {
+  return vm->context;
+}
 
-  // BytecodeMappedPtr values are treated as offsets into a bytecode image if
-  // you zero the lowest 2 bits
-  uint16_t offsetInBytecode = ptr & 0xFFFC;
+// Note: mvm_free frees the VM, while vm_free is the counterpart to vm_malloc
+void mvm_free(VM* vm) {
+  CODE_COVERAGE(166); // Hit
 
-  LongPtr lpBytecode = vm->lpBytecode;
+  gc_freeGCMemory(vm);
 
-  // A BytecodeMappedPtr can either point to ROM or via a global variable to
-  // RAM. Here to discriminate the two, we're assuming the handles section comes
-  // first
-  VM_ASSERT(vm, BCS_ROM < BCS_GLOBALS);
-  uint16_t globalsOffset = getSectionOffset(lpBytecode, BCS_GLOBALS);
+  // The stack may be allocated if `mvm_free` is called from the an error
+  // handler, right before terminating the thread or longjmp'ing out of the VM.
+  #if MVM_SAFE_MODE
+    if (vm->stack) {
+      // This at least zeros out the registers, so the machine will crash early if
+      // someone tries to the let it run after mvm_free
+      memset(vm->stack, 0, sizeof(*vm->stack));
+    }
+  #endif
+  // A compliant implementation of `free` will already check for null
+  vm_free(vm, vm->stack);
 
-  if (offsetInBytecode < globalsOffset) { // Points to ROM section?
-    CODE_COVERAGE(215); // Hit
-    VM_ASSERT(vm, offsetInBytecode >= getSectionOffset(lpBytecode, BCS_ROM));
-    VM_ASSERT(vm, offsetInBytecode < getSectionOffset(lpBytecode, vm_sectionAfter(vm, BCS_ROM)));
-    VM_ASSERT(vm, (offsetInBytecode & 3) == 0);
+  #if MVM_INCLUDE_DEBUG_CAPABILITY
+  vm_free(vm, vm->pBreakpointBitmap);
+  #endif
 
-    // The pointer just references ROM
-    return LongPtr_add(lpBytecode, offsetInBytecode);
-  } else { // Else, must point to RAM via a global variable
-    CODE_COVERAGE(216); // Hit
-    VM_ASSERT(vm, offsetInBytecode >= getSectionOffset(lpBytecode, BCS_GLOBALS));
-    VM_ASSERT(vm, offsetInBytecode < getSectionOffset(lpBytecode, vm_sectionAfter(vm, BCS_GLOBALS)));
-    VM_ASSERT(vm, (offsetInBytecode & 3) == 0);
+  #if MVM_VERIFY_BYTECODE
+  vm_free(vm, vm->pVerifiedFunctions);
+  #endif
 
-    uint16_t offsetInGlobals = offsetInBytecode - globalsOffset;
-    Value handleValue = *(Value*)((intptr_t)vm->globals + offsetInGlobals);
+  #if MVM_FUSE_INSTRUCTIONS && !MVM_FUSE_IN_PLACE
+  vm_free(vm, vm->pFusedBytecode);
+  #endif
 
-    // Note: handle values can't be null, because handles are used to point from
-    // ROM to RAM and ROM will never change. So if the value in ROM was null
-    // then it will always be null and not need a handle. And if the value in
-    // ROM points to an allocation in RAM then that allocation is permanently
-    // reachable.
-    VM_ASSERT(vm, Value_isShortPtr(handleValue));
+  #if MVM_CODE_CACHE
+  vm_codeCacheFree(vm);
+  #endif
 
-    return LongPtr_new(ShortPtr_decode(vm, handleValue));
-  }
+  #if MVM_INLINE_CACHE
+  vm_free(vm, vm->pInlineCache);
+  #endif
+
+  VM_EXEC_SAFE_MODE(memset(vm, 0, sizeof(*vm)));
+  vm_free(vm, vm);
 }
 
-static LongPtr DynamicPtr_decode_long(VM* vm, DynamicPtr ptr) {
-  CODE_COVERAGE(217); // Hit
+/**
+ * @param sizeBytes Size in bytes of the allocation, *excluding* the header
+ * @param typeCode The type code to insert into the header
+ */
+MVM_HIDDEN void* mvm_allocate(VM* vm, uint16_t sizeBytes,  uint8_t /*TeTypeCode*/ typeCode) {
+  uint16_t* p;
+  uint16_t* end;
 
-  if (Value_isShortPtr(ptr))  {
-    CODE_COVERAGE(218); // Hit
-    return LongPtr_new(ShortPtr_decode(vm, ptr));
+  if (sizeBytes >= (MAX_ALLOCATION_SIZE + 1)) {
+    CODE_COVERAGE_ERROR_PATH(353); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
+  } else {
+    CODE_COVERAGE(354); // Hit
   }
 
-  if (ptr == VM_VALUE_NULL || ptr == VM_VALUE_UNDEFINED) {
-    CODE_COVERAGE(219); // Hit
-    return LongPtr_new(NULL);
-  }
-  CODE_COVERAGE(242); // Hit
+  // If we happened to trigger a GC collection, we need to know that the
+  // registers are flushed, if they're allocated at all
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
 
-  // This function is for decoding pointers, so if this isn't a pointer then
-  // there's a problem.
-  VM_ASSERT(vm, !Value_isVirtualInt14(ptr));
+  CODE_COVERAGE(184); // Hit
+  TsBucket* pBucket;
+  const uint16_t sizeIncludingHeader = (sizeBytes + 3) & 0xFFFE;
+  // + 2 bytes header, round up to 2-byte boundary
+  VM_ASSERT(vm, (sizeIncludingHeader & 1) == 0);
 
-  // At this point, it's not a short pointer, so it must be a bytecode-mapped
-  // pointer
-  VM_ASSERT(vm, Value_encodesBytecodeMappedPtr(ptr));
+  // Minimum allocation size is 4 bytes, because that's the size of a
+  // tombstone. Note that nothing in code will attempt to allocate less,
+  // since even a 1-char string (+null terminator) is a 4-byte allocation.
+  VM_ASSERT(vm, sizeIncludingHeader >= 4);
 
-  // I'm expecting this to be inlined by the compiler
-  return BytecodeMappedPtr_decode_long(vm, ptr);
-}
+  VM_POTENTIAL_GC_POINT(vm);
+
+RETRY:
+  pBucket = vm->pLastBucket;
+  if (!pBucket) {
+    CODE_COVERAGE(185); // Hit
+    goto GROW_HEAP_AND_RETRY;
+  }
+  p = pBucket->pEndOfUsedSpace;
+  end = (uint16_t*)((intptr_t)p + sizeIncludingHeader);
+  if (end > vm->pLastBucketEndCapacity) {
+    CODE_COVERAGE(186); // Hit
+    goto GROW_HEAP_AND_RETRY;
+  }
+  pBucket->pEndOfUsedSpace = end;
+
+  // Write header
+  *p++ = vm_makeHeaderWord(vm, (TeTypeCode)typeCode, sizeBytes);
+
+  #if MVM_GC_INCREMENTAL
+  if (vm->pIncrementalGC) {
+    CODE_COVERAGE_UNTESTED(880); // Not hit
+    gc_clearNewAllocation(p);
+  }
+  #endif
+
+  return p;
+
+GROW_HEAP_AND_RETRY:
+  CODE_COVERAGE(187); // Hit
+  #if MVM_GC_NURSERY
+  // Collect the nursery when it's full, rather than growing the heap
+  if (getHeapSize(vm) - vm->nurseryStart >= MVM_GC_NURSERY_SIZE) {
+    CODE_COVERAGE_UNTESTED(876); // Not hit
+    gc_collectNursery(vm);
+    goto RETRY;
+  }
+  #endif // MVM_GC_NURSERY
+  gc_createNextBucket(vm, gc_nextBucketSize(vm), sizeIncludingHeader);
+  goto RETRY;
+}
+
+// Slow fallback for mvm_allocateWithConstantHeader
+static void* mvm_allocateWithConstantHeaderSlow(VM* vm, uint16_t header) {
+  CODE_COVERAGE(188); // Hit
+
+  // If we happened to trigger a GC collection, we need to know that the
+  // registers are flushed, if they're allocated at all
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+  TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
+  return mvm_allocate(vm, size, tc);
+}
 
 /*
- * Decode a DynamicPtr when the target is known to live in natively-addressable
- * memory (i.e. heap memory). If the target might be in ROM, use
- * DynamicPtr_decode_long.
+ * This function is like mvm_allocate except that it's optimized for
+ * situations where:
+ *
+ *   1. The header can be precomputed to a C constant, rather than assembling it
+ *      from the size and type
+ *   2. The size is known to be a multiple of 2 and at least 2 bytes
+ *
+ * This is more efficient in some cases because it has fewer checks and
+ * preprocessing to do. This function can probably be inlined in some cases.
+ *
+ * Note: the size is passed separately rather than computed from the header
+ * because this function is optimized for cases where the size is known at
+ * compile time (and even better if this function is inlined).
+ *
+ * WARNING: this does not initialize the data in the allocation.
  */
-static void* DynamicPtr_decode_native(VM* vm, DynamicPtr ptr) {
-  CODE_COVERAGE(253); // Hit
-  LongPtr lp = DynamicPtr_decode_long(vm, ptr);
-  void* p = LongPtr_truncate(vm, lp);
-  // Assert that the resulting native pointer is equivalent to the long pointer.
-  // I.e. that we didn't lose anything in the truncation (i.e. that it doesn't
-  // point to ROM).
-  VM_ASSERT(vm, LongPtr_new(p) == lp);
+static inline void* mvm_allocateWithConstantHeader(VM* vm, uint16_t header, uint16_t sizeIncludingHeader) {
+  CODE_COVERAGE(189); // Hit
+
+  uint16_t* p;
+  uint16_t* end;
+
+  // If we happened to trigger a GC collection, we need to know that the
+  // registers are flushed, if they're allocated at all
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  VM_ASSERT(vm, sizeIncludingHeader % 2 == 0);
+  VM_ASSERT(vm, sizeIncludingHeader >= 4);
+  VM_ASSERT(vm, vm_getAllocationSizeExcludingHeaderFromHeaderWord(header) == sizeIncludingHeader - 2);
+
+  VM_POTENTIAL_GC_POINT(vm);
+
+  TsBucket* pBucket = vm->pLastBucket;
+  if (!pBucket) {
+    CODE_COVERAGE(190); // Hit
+    goto SLOW;
+  }
+  p = pBucket->pEndOfUsedSpace;
+  end = (uint16_t*)((intptr_t)p + sizeIncludingHeader);
+  if (end > vm->pLastBucketEndCapacity) {
+    CODE_COVERAGE(191); // Hit
+    goto SLOW;
+  }
+
+  pBucket->pEndOfUsedSpace = end;
+  *p++ = header;
+  #if MVM_GC_INCREMENTAL
+  if (vm->pIncrementalGC) {
+    CODE_COVERAGE_UNTESTED(881); // Not hit
+    gc_clearNewAllocation(p);
+  }
+  #endif
   return p;
+
+SLOW:
+  CODE_COVERAGE(192); // Hit
+  return mvm_allocateWithConstantHeaderSlow(vm, header);
 }
 
-// I'm using inline wrappers around the port macros because I want to add a
-// layer of type safety.
-static inline LongPtr LongPtr_new(void* p) {
-  CODE_COVERAGE(284); // Hit
-  return MVM_LONG_PTR_NEW(p);
+// Looks for a variable in the closure scope chain based on its index. Scope
+// records can be stored in ROM in some optimized cases, so this returns a long
+// pointer.
+static LongPtr vm_findScopedVariable(VM* vm, uint16_t varIndex) {
+  // Slots are 2 bytes
+  uint16_t offset = varIndex << 1;
+  Value scope = vm->stack->reg.closure;
+  #if MVM_SCOPE_CACHE
+  vm_TsScopeCacheEntry* pCacheEntry = NULL;
+  #endif
+  while (true)
+  {
+    // The bytecode is corrupt or the compiler has a bug if we hit the bottom of
+    // the scope chain without finding the variable.
+    VM_ASSERT(vm, scope != VM_VALUE_DELETED);
+
+    LongPtr lpArr = DynamicPtr_decode_long(vm, scope);
+    uint16_t headerWord = readAllocationHeaderWord_long(lpArr);
+    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(headerWord) == TC_REF_CLOSURE);
+    uint16_t arraySize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+    if (offset < arraySize) {
+      #if MVM_SCOPE_CACHE
+      if (pCacheEntry) {
+        CODE_COVERAGE_UNTESTED(851); // Not hit
+        pCacheEntry->closure = vm->stack->reg.closure;
+        pCacheEntry->varIndex = varIndex;
+        pCacheEntry->lpSlot = LongPtr_add(lpArr, offset);
+      }
+      #endif
+      return LongPtr_add(lpArr, offset);
+    } else {
+      #if MVM_SCOPE_CACHE
+      // The variable is in an outer scope. The scope chain of a closure doesn't
+      // change, and allocations only move during a GC, so the location found
+      // last time is still valid.
+      if (!pCacheEntry) {
+        Value closure = vm->stack->reg.closure;
+        pCacheEntry = &vm->scopeCache[((closure >> 1) ^ varIndex) & (MVM_SCOPE_CACHE_SIZE - 1)];
+        if ((pCacheEntry->closure == closure) && (pCacheEntry->varIndex == varIndex)) {
+          CODE_COVERAGE_UNTESTED(852); // Not hit
+          VM_ASSERT(vm, closure != 0);
+          return pCacheEntry->lpSlot;
+        }
+      }
+      #endif
+      offset -= arraySize;
+      // The reference to the parent is kept in the second slot
+      scope = LongPtr_read2_aligned(LongPtr_add(lpArr, arraySize - 2));
+    }
+  }
 }
-static inline void* LongPtr_truncate(VM* vm, LongPtr lp) {
-  CODE_COVERAGE(332); // Hit
-  void* result = MVM_LONG_PTR_TRUNCATE(lp);
-  VM_ASSERT(vm, lp == LongPtr_new(result));
-  return result;
+
+// Read a scoped variable from the current closure. Assumes the current closure
+// is stored in RAM.
+static inline Value vm_readScopedFromThisClosure(VM* vm, uint16_t varIndex) {
+  CODE_COVERAGE(700); // Hit
+  Value* closure = ShortPtr_decode(vm, vm->stack->reg.closure);
+  Value* slot = &closure[varIndex];
+  VM_ASSERT(vm, slot == LongPtr_truncate(vm, vm_findScopedVariable(vm, varIndex)));
+  return *slot;
 }
-static inline LongPtr LongPtr_add(LongPtr lp, int16_t offset) {
-  CODE_COVERAGE(333); // Hit
-  return MVM_LONG_PTR_ADD(lp, offset);
+
+// Read a scoped variable from the current closure. Assumes the current closure
+// is stored in RAM.
+static inline void vm_writeScopedToThisClosure(VM* vm, uint16_t varIndex, Value value) {
+  CODE_COVERAGE(701); // Hit
+  Value* closure = ShortPtr_decode(vm, vm->stack->reg.closure);
+  Value* slot = &closure[varIndex];
+  VM_ASSERT(vm, slot == LongPtr_truncate(vm, vm_findScopedVariable(vm, varIndex)));
+  *slot = value;
+  VM_WRITE_BARRIER(vm, slot);
 }
-static inline int16_t LongPtr_sub(LongPtr lp1, LongPtr lp2) {
-  CODE_COVERAGE(334); // Hit
-  return (int16_t)(MVM_LONG_PTR_SUB(lp1, lp2));
+
+static inline void* getBucketDataBegin(TsBucket* bucket) {
+  CODE_COVERAGE(193); // Hit
+  return (void*)(bucket + 1);
 }
-static inline uint8_t LongPtr_read1(LongPtr lp) {
-  CODE_COVERAGE(335); // Hit
-  return (uint8_t)(MVM_READ_LONG_PTR_1(lp));
+
+/** The used heap size, excluding spare capacity in the last block, but
+ * including any uncollected garbage. */
+static uint16_t getHeapSize(VM* vm) {
+  TsBucket* lastBucket = vm->pLastBucket;
+  if (lastBucket) {
+    CODE_COVERAGE(194); // Hit
+    return getBucketOffsetEnd(lastBucket);
+  } else {
+    CODE_COVERAGE(195); // Hit
+    return 0;
+  }
 }
-// Read a 16-bit value from a long pointer, if the target is 16-bit aligned
-static inline uint16_t LongPtr_read2_aligned(LongPtr lp) {
-  CODE_COVERAGE(336); // Hit
-  // Expect an even boundary. Weird things happen on some platforms if you try
-  // to read unaligned memory through aligned instructions.
-  VM_ASSERT(0, ((uint16_t)(uintptr_t)lp & 1) == 0);
-  return (uint16_t)(MVM_READ_LONG_PTR_2(lp));
+
+void mvm_getMemoryStats(VM* vm, mvm_TsMemoryStats* r) {
+  CODE_COVERAGE(627); // Hit
+  VM_ASSERT(NULL, vm != NULL);
+  VM_ASSERT(vm, r != NULL);
+
+  memset(r, 0, sizeof *r);
+
+  // Core size
+  r->coreSize = sizeof(VM);
+  r->fragmentCount++;
+
+  // Import table size
+  r->importTableSize = getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry) * sizeof(mvm_TfHostFunction);
+  #if MVM_LEAF_HOST_FUNCTIONS
+  r->importTableSize += getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry); // Import flags
+  #endif
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  r->importTableSize += getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry) * sizeof(const char*);
+  #endif
+
+  // Global variables size
+  r->globalVariablesSize = getSectionSize(vm, BCS_IMPORT_TABLE);
+
+  r->stackHighWaterMark = vm->stackHighWaterMark;
+
+  r->virtualHeapHighWaterMark = vm->heapHighWaterMark;
+
+  // Running Parameters
+  vm_TsStack* stack = vm->stack;
+  if (stack) {
+    CODE_COVERAGE(628); // Hit
+    r->fragmentCount++;
+    vm_TsRegisters* reg = &stack->reg;
+    r->registersSize = sizeof *reg;
+    r->stackHeight = (uint8_t*)reg->pStackPointer - (uint8_t*)getBottomOfStack(vm->stack);
+    r->stackAllocatedCapacity = stack->capacity;
+  }
+  r->stackAllocationCount = vm->stackAllocationCount;
+
+  // Heap Stats
+  TsBucket* pLastBucket = vm->pLastBucket;
+  size_t heapOverheadSize = 0;
+  if (pLastBucket) {
+    CODE_COVERAGE(629); // Hit
+    TsBucket* b;
+    for (b = pLastBucket; b; b = b->prev) {
+      r->fragmentCount++;
+      heapOverheadSize += sizeof (TsBucket); // Extra space for bucket header
+    }
+    r->virtualHeapUsed = getHeapSize(vm) - VM_HEAP_START(vm);
+    if (r->virtualHeapUsed > r->virtualHeapHighWaterMark)
+      r->virtualHeapHighWaterMark = r->virtualHeapUsed;
+    r->virtualHeapAllocatedCapacity = pLastBucket->offsetStart - VM_HEAP_START(vm) + (uint16_t)(uintptr_t)vm->pLastBucketEndCapacity - (uint16_t)(uintptr_t)getBucketDataBegin(pLastBucket);
+  }
+
+  #if MVM_USE_HEAP_ARENA
+  // The arena is allocated whether or not the heap is using it
+  if (!pLastBucket) r->fragmentCount++;
+  heapOverheadSize = HEAP_ARENA_SIZE - r->virtualHeapAllocatedCapacity;
+  #endif
+
+  // Collection stats
+  r->gcCount = vm->gcCount;
+  r->minorGCCount = vm->minorGCCount;
+  r->lastGCBytesCopied = vm->lastGCBytesCopied;
+  r->totalGCBytesCopied = vm->totalGCBytesCopied;
+  r->lastGCPauseTime = vm->lastGCPauseTime;
+  r->totalGCPauseTime = vm->totalGCPauseTime;
+  r->maxGCPauseTime = vm->maxGCPauseTime;
+  #if MVM_GC_INCREMENTAL
+  r->lastGCSliceWork = vm->lastGCSliceWork;
+  r->maxGCSliceWork = vm->maxGCSliceWork;
+  #endif
+  r->heapBucketCount = vm->heapBucketCount;
+  r->totalMallocSize = vm->totalMallocSize;
+
+  // Total size
+  r->totalSize =
+    r->coreSize +
+    r->importTableSize +
+    r->globalVariablesSize +
+    r->registersSize +
+    r->stackAllocatedCapacity +
+    r->virtualHeapAllocatedCapacity +
+    heapOverheadSize;
 }
-// Read a 16-bit value from a long pointer, if the target is not 16-bit aligned
-static inline uint16_t LongPtr_read2_unaligned(LongPtr lp) {
+
+void mvm_setHeapGrowthPolicy(VM* vm, const mvm_TsHeapGrowthPolicy* policy) {
+  CODE_COVERAGE_UNTESTED(904); // Not hit
+  mvm_TsHeapGrowthPolicy* p = &vm->heapGrowthPolicy;
+  if (policy) {
+    CODE_COVERAGE_UNTESTED(905); // Not hit
+    *p = *policy;
+  } else {
+    CODE_COVERAGE_UNTESTED(906); // Not hit
+    memset(p, 0, sizeof *p);
+    p->minBucketSize = MVM_ALLOCATION_BUCKET_SIZE;
+    p->maxBucketSize = MVM_ALLOCATION_BUCKET_SIZE;
+  }
+  if (p->maxBucketSize > MVM_MAX_HEAP_SIZE) p->maxBucketSize = MVM_MAX_HEAP_SIZE;
+  if (p->minBucketSize > p->maxBucketSize) p->minBucketSize = p->maxBucketSize;
+  if (p->targetLivePercent > 100) p->targetLivePercent = 100;
+}
+
+// Size of the next bucket that mvm_allocate creates, according to the heap
+// growth policy
+static uint16_t gc_nextBucketSize(VM* vm) {
+  CODE_COVERAGE_UNTESTED(907); // Not hit
+  const mvm_TsHeapGrowthPolicy* policy = &vm->heapGrowthPolicy;
+  uint32_t size = (uint32_t)(getHeapSize(vm) - VM_HEAP_START(vm)) * policy->bucketGrowthPercent / 100;
+  if (size > policy->maxBucketSize) size = policy->maxBucketSize;
+  if (size < policy->minBucketSize) size = policy->minBucketSize;
+  return (uint16_t)size;
+}
+
+// True if a heap of `newUsedSize` bytes would have less than the policy's
+// target percentage of live data, so it's worth collecting before growing
+static bool gc_isPastTargetLiveRatio(VM* vm, uint16_t newUsedSize) {
+  CODE_COVERAGE_UNTESTED(908); // Not hit
+  uint8_t targetLivePercent = vm->heapGrowthPolicy.targetLivePercent;
+  if (!targetLivePercent) {
+    CODE_COVERAGE_UNTESTED(909); // Not hit
+    return false;
+  }
+  #if MVM_GC_INCREMENTAL
+  // An incremental collection is paced by MVM_GC_INCREMENTAL_START instead
+  if (vm->pIncrementalGC) {
+    CODE_COVERAGE_UNTESTED(910); // Not hit
+    return false;
+  }
+  #endif
+  CODE_COVERAGE_UNTESTED(911); // Not hit
+  // The live data is at least the smallest bucket, so that a nearly-empty heap
+  // doesn't collect every time it grows
+  uint32_t liveSize = vm->heapSizeUsedAfterLastGC;
+  if (liveSize < vm->heapGrowthPolicy.minBucketSize)
+    liveSize = vm->heapGrowthPolicy.minBucketSize;
+  return liveSize * 100 < (uint32_t)newUsedSize * targetLivePercent;
+}
+
+#if !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA
+/**
+ * Adds a bucket to the index that makes ShortPtr_decode and ShortPtr_encode
+ * constant-time, rather than searching the bucket list.
+ *
+ * For decoding, each chunk of heap offset space points to the bucket that
+ * contains the start of the chunk, so a heap offset is in that bucket or one
+ * of the (usually zero) buckets that start later in the same chunk. Buckets
+ * are only ever added at the end of the heap, so entries past the end of the
+ * heap can be stale without harm. With MVM_GC_INCREMENTAL, the chunks wrap
+ * around the table (see BUCKET_INDEX_OFFSET_SLOT), which is big enough that
+ * the chunks of the heap never share an entry.
+ *
+ * For encoding, each chunk of address space that the bucket covers is hashed
+ * to an entry that points to the bucket. A collision just means that
+ * ShortPtr_encode falls back to searching the list, but entries must not point
+ * to freed buckets, so the index is rebuilt whenever buckets are freed.
+ *
+ * @param pEndCapacity The end of the space that can be allocated in the bucket
+ */
+static void vm_indexBucket(VM* vm, TsBucket* bucket, uint16_t* pEndCapacity) {
+  CODE_COVERAGE_UNTESTED(912); // Not hit
+  uint16_t* pDataBegin = getBucketDataBegin(bucket);
+  uint32_t offsetStart = bucket->offsetStart;
+  uint32_t offsetEnd = offsetStart + (uint32_t)((intptr_t)pEndCapacity - (intptr_t)pDataBegin);
+
+  // The first bucket also covers the part of its chunk before the heap starts
+  uint32_t chunk = bucket->prev
+    ? (offsetStart + (1 << BUCKET_INDEX_CHUNK_SHIFT) - 1) >> BUCKET_INDEX_CHUNK_SHIFT
+    : offsetStart >> BUCKET_INDEX_CHUNK_SHIFT;
+  for (; (chunk << BUCKET_INDEX_CHUNK_SHIFT) < offsetEnd; chunk++) {
+    if (BUCKET_INDEX_OFFSET_SLOT(chunk) >= BUCKET_INDEX_OFFSET_CHUNKS) {
+      CODE_COVERAGE_UNTESTED(913); // Not hit
+      break;
+    }
+    vm->bucketOffsetIndex[BUCKET_INDEX_OFFSET_SLOT(chunk)] = bucket;
+  }
+
+  // Note: a pointer may be at the end of the used space, so the last chunk is
+  // inclusive
+  uintptr_t addressChunk = (uintptr_t)bucket >> BUCKET_INDEX_CHUNK_SHIFT;
+  uintptr_t addressChunkEnd = (uintptr_t)pEndCapacity >> BUCKET_INDEX_CHUNK_SHIFT;
+  if (addressChunkEnd - addressChunk >= BUCKET_INDEX_ADDRESS_CHUNKS) {
+    CODE_COVERAGE_UNTESTED(914); // Not hit
+    addressChunkEnd = addressChunk + BUCKET_INDEX_ADDRESS_CHUNKS - 1;
+  }
+  for (; addressChunk <= addressChunkEnd; addressChunk++)
+    vm->bucketAddressIndex[addressChunk & (BUCKET_INDEX_ADDRESS_CHUNKS - 1)] = bucket;
+}
+
+// Rebuilds the bucket index after buckets are freed or the bucket list is
+// replaced by a collection
+static void vm_rebuildBucketIndex(VM* vm) {
+  CODE_COVERAGE_UNTESTED(915); // Not hit
+  memset(vm->bucketAddressIndex, 0, sizeof vm->bucketAddressIndex);
+  TsBucket* bucket = vm->pLastBucket;
+  if (!bucket) {
+    CODE_COVERAGE_UNTESTED(916); // Not hit
+    return;
+  }
+  while (bucket->prev)
+    bucket = bucket->prev;
+  // Only the last bucket has spare capacity that can still be allocated
+  for (; bucket; bucket = bucket->next)
+    vm_indexBucket(vm, bucket, bucket->next ? bucket->pEndOfUsedSpace : vm->pLastBucketEndCapacity);
+}
+#else // MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE || MVM_USE_HEAP_ARENA
+// ShortPtr is the native pointer (or its low bits, or an offset into the heap
+// arena) on these platforms, so there is no index to maintain
+static void vm_indexBucket(VM* vm, TsBucket* bucket, uint16_t* pEndCapacity) {}
+static void vm_rebuildBucketIndex(VM* vm) {}
+#endif // MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE || MVM_USE_HEAP_ARENA
+
+/**
+ * Expand the VM heap by allocating a new "bucket" of memory from the host.
+ *
+ * @param bucketSize The ideal size of the contents of the new bucket
+ * @param minBucketSize The smallest the bucketSize can be reduced and still be valid
+ */
+static void gc_createNextBucket(VM* vm, uint16_t bucketSize, uint16_t minBucketSize) {
+  CODE_COVERAGE(7); // Hit
+  uint16_t heapSize = getHeapSize(vm);
+
+  if (bucketSize < minBucketSize) {
+    CODE_COVERAGE_UNTESTED(196); // Not hit
+    bucketSize = minBucketSize;
+  }
+
+  VM_ASSERT(vm, minBucketSize <= bucketSize);
+
+  // The part of the heap that counts towards MVM_MAX_HEAP_SIZE
+  uint16_t usedSize = heapSize - VM_HEAP_START(vm);
+
+  #if MVM_GC_INCREMENTAL
+  gc_TsGCCollectionState* gc = vm->pIncrementalGC;
+  if (gc || (usedSize + bucketSize > MVM_GC_INCREMENTAL_START)) {
+    CODE_COVERAGE_UNTESTED(882); // Not hit
+    if (gc && (gc->fromSpaceSize + gc->allocatedSize + bucketSize > MVM_MAX_HEAP_SIZE)) {
+      CODE_COVERAGE_UNTESTED(883); // Not hit
+      // The program has used up the space it's allowed while the collection is
+      // in progress, so the collection has to catch up now
+      uint32_t startTime = MVM_GC_TIMER();
+      gc_finishIncremental(vm);
+      gc_recordPause(vm, startTime);
+    } else {
+      CODE_COVERAGE_UNTESTED(884); // Not hit
+      // The new bucket will also need to be scanned, so the collection only
+      // gains on the program by MVM_GC_INCREMENTAL_SLICE_SIZE
+      mvm_runGCSlice(vm, bucketSize + MVM_GC_INCREMENTAL_SLICE_SIZE);
+    }
+    heapSize = getHeapSize(vm);
+    gc = vm->pIncrementalGC;
+    // While the collection is in progress, fromspace still counts towards the
+    // heap size, but tospace only counts the new allocations, since anything
+    // copied into it is already counted in fromspace
+    usedSize = gc
+      ? gc->fromSpaceSize + gc->allocatedSize
+      : heapSize - VM_HEAP_START(vm);
+  }
+  #endif // MVM_GC_INCREMENTAL
+
+  // If this tips us over the top of the heap, or past the target ratio of live
+  // data, then we run a collection
+  if ((usedSize + bucketSize > MVM_MAX_HEAP_SIZE) || gc_isPastTargetLiveRatio(vm, usedSize + bucketSize)) {
+    CODE_COVERAGE_UNTESTED(197); // Hit
+    mvm_runGC(vm, false);
+    heapSize = getHeapSize(vm);
+    usedSize = heapSize;
+    #if MVM_GC_INCREMENTAL
+    gc = NULL;
+    #endif
+  }
+
+  // Can't fit?
+  if (usedSize + minBucketSize > MVM_MAX_HEAP_SIZE) {
+    CODE_COVERAGE_ERROR_PATH(5); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_OUT_OF_MEMORY);
+  }
+
+  // Can fit, but only by chopping the end off the new bucket?
+  if (usedSize + bucketSize > MVM_MAX_HEAP_SIZE) {
+    CODE_COVERAGE_UNTESTED(6); // Not hit
+    bucketSize = MVM_MAX_HEAP_SIZE - usedSize;
+  }
+
+  #if MVM_GC_INCREMENTAL
+  if (gc) {
+    CODE_COVERAGE_UNTESTED(885); // Not hit
+    gc->allocatedSize += bucketSize;
+  }
+  #endif
+
+  #if MVM_USE_HEAP_ARENA
+  // The heap is contiguous in the arena, so the next bucket is just more
+  // capacity at the end of the last one
+  if (vm->pLastBucket) {
+    CODE_COVERAGE_UNTESTED(918); // Not hit
+    vm->pLastBucketEndCapacity = (uint16_t*)((intptr_t)vm->pLastBucket->pEndOfUsedSpace + bucketSize);
+    return;
+  }
+  CODE_COVERAGE_UNTESTED(919); // Not hit
+  size_t allocSize = sizeof (TsBucket) + bucketSize;
+  TsBucket* bucket = (TsBucket*)vm->pHeapArena;
+  #else
+  size_t allocSize = sizeof (TsBucket) + bucketSize;
+  TsBucket* bucket = vm_malloc(vm, allocSize);
+  if (!bucket) {
+    CODE_COVERAGE_ERROR_PATH(198); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+  }
+  vm->heapBucketCount++;
+  #endif
+  #if MVM_SAFE_MODE
+    memset(bucket, 0x7E, allocSize);
+  #endif
+  bucket->prev = vm->pLastBucket;
+  bucket->next = NULL;
+  bucket->pEndOfUsedSpace = getBucketDataBegin(bucket);
+
+  TABLE_COVERAGE(bucket->prev ? 1 : 0, 2, 11); // Hit 2/2
+
+  // Note: we start the next bucket at the allocation cursor, not at what we
+  // previously called the end of the previous bucket
+  bucket->offsetStart = heapSize;
+  vm->pLastBucketEndCapacity = (uint16_t*)((intptr_t)bucket->pEndOfUsedSpace + bucketSize);
+  if (vm->pLastBucket) {
+    CODE_COVERAGE(199); // Hit
+    vm->pLastBucket->next = bucket;
+  } else {
+    CODE_COVERAGE(200); // Hit
+  }
+  vm->pLastBucket = bucket;
+  vm_indexBucket(vm, bucket, vm->pLastBucketEndCapacity);
+}
+
+static void gc_freeGCMemory(VM* vm) {
+  CODE_COVERAGE(10); // Hit
+  TABLE_COVERAGE(vm->pLastBucket ? 1 : 0, 2, 201); // Hit 2/2
+  #if MVM_USE_HEAP_ARENA
+  // The buckets are in the arena
+  vm_free(vm, vm->pHeapArena);
+  vm->pHeapArena = NULL;
+  vm->pLastBucket = NULL;
+  #else
+  while (vm->pLastBucket) {
+    CODE_COVERAGE(169); // Hit
+    TsBucket* prev = vm->pLastBucket->prev;
+    vm_free(vm, vm->pLastBucket);
+    TABLE_COVERAGE(prev ? 1 : 0, 2, 202); // Hit 1/2
+    vm->pLastBucket = prev;
+  }
+  #endif
+  vm->pLastBucketEndCapacity = NULL;
+  vm_rebuildBucketIndex(vm);
+  #if MVM_GC_INCREMENTAL
+  // Note: the buckets of an incremental collection in progress are part of
+  // the VM's bucket list, so they're already freed
+  vm_free(vm, vm->pIncrementalGC);
+  vm->pIncrementalGC = NULL;
+  vm->gcScanOffset = 0xFFFF;
+  vm->heapStart = 0;
+  #endif
+}
+
+#if MVM_INCLUDE_SNAPSHOT_CAPABILITY || (!MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA)
+/**
+ * Given a pointer `ptr` into the heap, this returns the equivalent offset from
+ * the start of the heap (0 meaning that `ptr` points to the beginning of the
+ * heap).
+ *
+ * This is used in 2 places:
+ *
+ *   1. On a 32-bit machine, this is used to get a 16-bit equivalent encoding for ShortPtr
+ *   2. On any machine, this is used in serializePtr for creating snapshots
+ */
+static uint16_t pointerOffsetInHeap(VM* vm, TsBucket* pLastBucket, void* ptr) {
+  CODE_COVERAGE(203); // Hit
+  /*
+   * This algorithm iterates through the buckets in the heap backwards. Although
+   * this is technically linear cost, in reality I expect that the pointer will
+   * be found in the very first searched bucket almost all the time. This is
+   * because the GC compacts everything into a single bucket, and because the
+   * most recently bucket is also likely to be the most frequently accessed.
+   *
+   * See ShortPtr_decode for more description
+   */
+  TsBucket* bucket = pLastBucket;
+  while (bucket) {
+    // Note: using `<=` here because the pointer is permitted to point to the
+    // end of the heap.
+    if ((ptr >= (void*)bucket) && (ptr <= (void*)bucket->pEndOfUsedSpace)) {
+      CODE_COVERAGE(204); // Hit
+      uint16_t offsetInBucket = (uint16_t)((intptr_t)ptr - (intptr_t)getBucketDataBegin(bucket));
+      VM_ASSERT(vm, offsetInBucket < 0x8000);
+      uint16_t offsetInHeap = bucket->offsetStart + offsetInBucket;
+
+      // It isn't strictly necessary that all short pointers are 2-byte aligned,
+      // but it probably indicates a mistake somewhere if a short pointer is not
+      // 2-byte aligned, since `Value` cannot be a `ShortPtr` unless it's 2-byte
+      // aligned.
+      VM_ASSERT(vm, (offsetInHeap & 1) == 0);
+
+      VM_ASSERT(vm, offsetInHeap < getHeapSize(vm));
+
+      return offsetInHeap;
+    } else {
+      CODE_COVERAGE(205); // Hit
+    }
+
+    bucket = bucket->prev;
+  }
+
+  // A failure here means we're trying to encode a pointer that doesn't map
+  // to something in GC memory, which is a mistake.
+  MVM_FATAL_ERROR(vm, MVM_E_UNEXPECTED);
+  return 0;
+}
+#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY || (!MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA)
+
+// Encodes a bytecode offset as a Value
+static inline Value vm_encodeBytecodeOffsetAsPointer(VM* vm, uint16_t offset) {
+  // Only offsets with 4-byte alignment can be represented as VM values
+  VM_ASSERT(vm, offset & 0xFFFC);
+  // Bytecode pointers end in binary 01
+  return offset | 1;
+}
+
+#if MVM_NATIVE_POINTER_IS_16_BIT
+  static inline void* ShortPtr_decode(VM* vm, ShortPtr ptr) {
+    return (void*)ptr;
+  }
+  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
+    return (ShortPtr)ptr;
+  }
+  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
+    return (ShortPtr)ptr;
+  }
+#elif MVM_USE_SINGLE_RAM_PAGE
+  static inline void* ShortPtr_decode(VM* vm, ShortPtr ptr) {
+    /**
+     * Minor performance note:
+     *
+     * I think I recall that the ARM instruction set can inline 16-bit literal
+     * values but not 32-bit values. This is one of the reasons why this uses
+     * the "high bits" and not just some arbitrary pointer addition. Basically,
+     * I'm trying to make this as efficient as possible, since pointers are used
+     * everywhere
+     */
+    return (void*)(((intptr_t)MVM_RAM_PAGE_ADDR) | ptr);
+  }
+  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
+    VM_ASSERT(vm, ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR) <= 0xFFFF);
+    return (ShortPtr)(uintptr_t)ptr;
+  }
+  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
+    VM_ASSERT(gc->vm, ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR) <= 0xFFFF);
+    return (ShortPtr)(uintptr_t)ptr;
+  }
+#elif MVM_USE_HEAP_ARENA
+  // The heap is one bucket in the arena, so the ShortPtr is just the offset
+  // into it (see MVM_USE_HEAP_ARENA)
+  static inline void* ShortPtr_decode(VM* vm, ShortPtr ptr) {
+    VM_ASSERT(vm, (ptr & 1) == 0);
+    VM_ASSERT(vm, ptr < getHeapSize(vm));
+    return (void*)((intptr_t)getBucketDataBegin(vm->pLastBucket) + ptr);
+  }
+  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
+    ShortPtr result = (ShortPtr)((intptr_t)ptr - (intptr_t)getBucketDataBegin(vm->pLastBucket));
+    VM_ASSERT(vm, result <= getHeapSize(vm));
+    return result;
+  }
+  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
+    return (ShortPtr)((intptr_t)ptr - (intptr_t)getBucketDataBegin(gc->lastBucket));
+  }
+#else // !MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE && !MVM_USE_HEAP_ARENA
+  static void* ShortPtr_decode(VM* vm, ShortPtr shortPtr) {
+    // It isn't strictly necessary that all short pointers are 2-byte aligned,
+    // but it probably indicates a mistake somewhere if a short pointer is not
+    // 2-byte aligned, since `Value` cannot be a `ShortPtr` unless it's 2-byte
+    // aligned. Among other things, this catches VM_VALUE_NULL.
+    VM_ASSERT(vm, (shortPtr & 1) == 0);
+
+    // The shortPtr is treated as an offset into the heap
+    uint16_t offsetInHeap = shortPtr;
+    VM_ASSERT(vm, offsetInHeap < getHeapSize(vm));
+
+    /*
+    The bucket index gives the bucket containing the start of the chunk of heap
+    that the offset is in. The offset may be in a later bucket if one starts
+    part way through the chunk, which is rare when buckets are bigger than a
+    chunk (see vm_indexBucket).
+    */
+    VM_ASSERT(vm, BUCKET_INDEX_OFFSET_SLOT(offsetInHeap >> BUCKET_INDEX_CHUNK_SHIFT) < BUCKET_INDEX_OFFSET_CHUNKS);
+    TsBucket* bucket = vm->bucketOffsetIndex[BUCKET_INDEX_OFFSET_SLOT(offsetInHeap >> BUCKET_INDEX_CHUNK_SHIFT)];
+    // All short pointers must map to some memory in a bucket, otherwise the pointer is corrupt
+    VM_ASSERT(vm, bucket != NULL);
+    VM_ASSERT(vm, offsetInHeap >= bucket->offsetStart);
+    while (bucket->next && (offsetInHeap >= bucket->next->offsetStart))
+      bucket = bucket->next;
+
+    uint16_t offsetInBucket = offsetInHeap - bucket->offsetStart;
+    void* result = (void*)((intptr_t)getBucketDataBegin(bucket) + offsetInBucket);
+    #if MVM_GC_INCREMENTAL
+    // Read barrier: the program must only ever see pointers into tospace,
+    // so allocations that the incremental collection hasn't scanned yet
+    // are scanned when they're accessed.
+    if (offsetInHeap >= vm->gcScanOffset) {
+      CODE_COVERAGE_UNTESTED(886); // Not hit
+      gc_scanOnAccess(vm, offsetInHeap, result);
+    }
+    #endif
+    return result;
+  }
+
+  /**
+   * Like ShortPtr_encode except conducted against an arbitrary bucket list.
+   *
+   * Used internally by ShortPtr_encode and ShortPtr_encodeInToSpace.
+   */
+  static inline ShortPtr ShortPtr_encode_generic(VM* vm, TsBucket* pLastBucket, void* ptr) {
+    return pointerOffsetInHeap(vm, pLastBucket, ptr);
+  }
+
+  // Encodes a pointer as pointing to a value in the current heap
+  static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr) {
+    // See vm_indexBucket. The search is only needed if the entry was
+    // overwritten by another bucket in a chunk that hashes the same.
+    TsBucket* bucket = vm->bucketAddressIndex[((uintptr_t)ptr >> BUCKET_INDEX_CHUNK_SHIFT) & (BUCKET_INDEX_ADDRESS_CHUNKS - 1)];
+    if (bucket && (ptr >= (void*)bucket) && (ptr <= (void*)bucket->pEndOfUsedSpace)) {
+      uint16_t offsetInHeap = bucket->offsetStart + (uint16_t)((intptr_t)ptr - (intptr_t)getBucketDataBegin(bucket));
+      VM_ASSERT(vm, (offsetInHeap & 1) == 0);
+      VM_ASSERT(vm, offsetInHeap < getHeapSize(vm));
+      return offsetInHeap;
+    }
+    return ShortPtr_encode_generic(vm, vm->pLastBucket, ptr);
+  }
+
+  // Encodes a pointer as pointing to a value in the _new_ heap (tospace) during
+  // an ongoing garbage collection.
+  static inline ShortPtr ShortPtr_encodeInToSpace(gc_TsGCCollectionState* gc, void* ptr) {
+    #if MVM_GC_INCREMENTAL
+    // The tospace of an incremental collection is part of the VM heap, so it's
+    // in the bucket index
+    if (gc->toSpaceStart) {
+      return ShortPtr_encode(gc->vm, ptr);
+    }
+    #endif
+    return ShortPtr_encode_generic(gc->vm, gc->lastBucket, ptr);
+  }
+#endif
+
+static LongPtr BytecodeMappedPtr_decode_long(VM* vm, BytecodeMappedPtr ptr) {
+  CODE_COVERAGE(214); // Hit
+
+  // BytecodeMappedPtr values are treated as offsets into a bytecode image if
+  // you zero the lowest 2 bits
+  uint16_t offsetInBytecode = ptr & 0xFFFC;
+
+  LongPtr lpBytecode = vm->lpBytecode;
+
+  // A BytecodeMappedPtr can either point to ROM or via a global variable to
+  // RAM. Here to discriminate the two, we're assuming the handles section comes
+  // first
+  VM_ASSERT(vm, BCS_ROM < BCS_GLOBALS);
+  uint16_t globalsOffset = getSectionOffset(lpBytecode, BCS_GLOBALS);
+
+  if (offsetInBytecode < globalsOffset) { // Points to ROM section?
+    CODE_COVERAGE(215); // Hit
+    VM_ASSERT(vm, offsetInBytecode >= getSectionOffset(lpBytecode, BCS_ROM));
+    VM_ASSERT(vm, offsetInBytecode < getSectionOffset(lpBytecode, vm_sectionAfter(vm, BCS_ROM)));
+    VM_ASSERT(vm, (offsetInBytecode & 3) == 0);
+
+    // The pointer just references ROM
+    return LongPtr_add(lpBytecode, offsetInBytecode);
+  } else { // Else, must point to RAM via a global variable
+    CODE_COVERAGE(216); // Hit
+    VM_ASSERT(vm, offsetInBytecode >= getSectionOffset(lpBytecode, BCS_GLOBALS));
+    VM_ASSERT(vm, offsetInBytecode < getSectionOffset(lpBytecode, vm_sectionAfter(vm, BCS_GLOBALS)));
+    VM_ASSERT(vm, (offsetInBytecode & 3) == 0);
+
+    uint16_t offsetInGlobals = offsetInBytecode - globalsOffset;
+    Value handleValue = *(Value*)((intptr_t)vm->globals + offsetInGlobals);
+
+    // Note: handle values can't be null, because handles are used to point from
+    // ROM to RAM and ROM will never change. So if the value in ROM was null
+    // then it will always be null and not need a handle. And if the value in
+    // ROM points to an allocation in RAM then that allocation is permanently
+    // reachable.
+    VM_ASSERT(vm, Value_isShortPtr(handleValue));
+
+    return LongPtr_new(ShortPtr_decode(vm, handleValue));
+  }
+}
+
+static LongPtr DynamicPtr_decode_long(VM* vm, DynamicPtr ptr) {
+  CODE_COVERAGE(217); // Hit
+
+  if (Value_isShortPtr(ptr))  {
+    CODE_COVERAGE(218); // Hit
+    return LongPtr_new(ShortPtr_decode(vm, ptr));
+  }
+
+  if (ptr == VM_VALUE_NULL || ptr == VM_VALUE_UNDEFINED) {
+    CODE_COVERAGE(219); // Hit
+    return LongPtr_new(NULL);
+  }
+  CODE_COVERAGE(242); // Hit
+
+  // This function is for decoding pointers, so if this isn't a pointer then
+  // there's a problem.
+  VM_ASSERT(vm, !Value_isVirtualInt14(ptr));
+
+  // At this point, it's not a short pointer, so it must be a bytecode-mapped
+  // pointer
+  VM_ASSERT(vm, Value_encodesBytecodeMappedPtr(ptr));
+
+  // I'm expecting this to be inlined by the compiler
+  return BytecodeMappedPtr_decode_long(vm, ptr);
+}
+
+/*
+ * Decode a DynamicPtr when the target is known to live in natively-addressable
+ * memory (i.e. heap memory). If the target might be in ROM, use
+ * DynamicPtr_decode_long.
+ */
+static void* DynamicPtr_decode_native(VM* vm, DynamicPtr ptr) {
+  CODE_COVERAGE(253); // Hit
+  LongPtr lp = DynamicPtr_decode_long(vm, ptr);
+  void* p = LongPtr_truncate(vm, lp);
+  // Assert that the resulting native pointer is equivalent to the long pointer.
+  // I.e. that we didn't lose anything in the truncation (i.e. that it doesn't
+  // point to ROM).
+  VM_ASSERT(vm, LongPtr_new(p) == lp);
+  return p;
+}
+
+// I'm using inline wrappers around the port macros because I want to add a
+// layer of type safety.
+static inline LongPtr LongPtr_new(void* p) {
+  CODE_COVERAGE(284); // Hit
+  return MVM_LONG_PTR_NEW(p);
+}
+static inline void* LongPtr_truncate(VM* vm, LongPtr lp) {
+  CODE_COVERAGE(332); // Hit
+  void* result = MVM_LONG_PTR_TRUNCATE(lp);
+  VM_ASSERT(vm, lp == LongPtr_new(result));
+  return result;
+}
+static inline LongPtr LongPtr_add(LongPtr lp, int16_t offset) {
+  CODE_COVERAGE(333); // Hit
+  return MVM_LONG_PTR_ADD(lp, offset);
+}
+static inline int16_t LongPtr_sub(LongPtr lp1, LongPtr lp2) {
+  CODE_COVERAGE(334); // Hit
+  return (int16_t)(MVM_LONG_PTR_SUB(lp1, lp2));
+}
+static inline uint8_t LongPtr_read1(LongPtr lp) {
+  CODE_COVERAGE(335); // Hit
+  return (uint8_t)(MVM_READ_LONG_PTR_1(lp));
+}
+// Read a 16-bit value from a long pointer, if the target is 16-bit aligned
+static inline uint16_t LongPtr_read2_aligned(LongPtr lp) {
+  CODE_COVERAGE(336); // Hit
+  // Expect an even boundary. Weird things happen on some platforms if you try
+  // to read unaligned memory through aligned instructions.
+  VM_ASSERT(0, ((uint16_t)(uintptr_t)lp & 1) == 0);
+  return (uint16_t)(MVM_READ_LONG_PTR_2(lp));
+}
+// Read a 16-bit value from a long pointer, if the target is not 16-bit aligned
+static inline uint16_t LongPtr_read2_unaligned(LongPtr lp) {
   CODE_COVERAGE(626); // Hit
   return (uint32_t)(MVM_READ_LONG_PTR_1(lp)) |
     ((uint32_t)(MVM_READ_LONG_PTR_1((MVM_LONG_PTR_ADD(lp, 1)))) << 8);
 }
-static inline uint32_t LongPtr_read4(LongPtr lp) {
-  // We don't often read 4 bytes, since the word size for microvium is 2 bytes.
-  // When we do need to, I think it's safer to just read it as 2 separate words
-  // since we don't know for sure that we're not executing on a 32 bit machine
-  // that can't do unaligned access. All memory in microvium is at least 16-bit
-  // aligned, with the exception of bytecode instructions, but those do not
-  // contain 32-bit literals.
-  CODE_COVERAGE(337); // Hit
-  return (uint32_t)(MVM_READ_LONG_PTR_2(lp)) |
-    ((uint32_t)(MVM_READ_LONG_PTR_2((MVM_LONG_PTR_ADD(lp, 2)))) << 16);
+static inline uint32_t LongPtr_read4(LongPtr lp) {
+  // We don't often read 4 bytes, since the word size for microvium is 2 bytes.
+  // When we do need to, I think it's safer to just read it as 2 separate words
+  // since we don't know for sure that we're not executing on a 32 bit machine
+  // that can't do unaligned access. All memory in microvium is at least 16-bit
+  // aligned, with the exception of bytecode instructions, but those do not
+  // contain 32-bit literals.
+  CODE_COVERAGE(337); // Hit
+  return (uint32_t)(MVM_READ_LONG_PTR_2(lp)) |
+    ((uint32_t)(MVM_READ_LONG_PTR_2((MVM_LONG_PTR_ADD(lp, 2)))) << 16);
+}
+
+static uint16_t getBucketOffsetEnd(TsBucket* bucket) {
+  CODE_COVERAGE(338); // Hit
+  return bucket->offsetStart + (uint16_t)(uintptr_t)bucket->pEndOfUsedSpace - (uint16_t)(uintptr_t)getBucketDataBegin(bucket);
+}
+
+static uint16_t gc_getHeapSize(gc_TsGCCollectionState* gc) {
+  CODE_COVERAGE(351); // Hit
+  TsBucket* pLastBucket = gc->lastBucket;
+  if (pLastBucket) {
+    CODE_COVERAGE(352); // Hit
+    return getBucketOffsetEnd(pLastBucket);
+  } else {
+    CODE_COVERAGE(355); // Hit
+    // A minor collection appends the survivors after the old generation
+    return gc->nurseryStart;
+  }
+}
+
+static void gc_newBucket(gc_TsGCCollectionState* gc, uint16_t newSpaceSize, uint16_t minNewSpaceSize) {
+  CODE_COVERAGE(356); // Hit
+  uint16_t heapSize = gc_getHeapSize(gc);
+
+  if (newSpaceSize < minNewSpaceSize) {
+    CODE_COVERAGE_UNTESTED(357); // Not hit
+    newSpaceSize = minNewSpaceSize;
+  } else {
+    CODE_COVERAGE(358); // Hit
+  }
+
+  #if MVM_GC_INCREMENTAL
+  uint16_t usedSize = heapSize - gc->toSpaceStart;
+  #else
+  uint16_t usedSize = heapSize;
+  #endif
+
+  // Since this is during a GC, it should be impossible for us to need more heap
+  // than is allowed, since the original heap should never have exceeded the
+  // MVM_MAX_HEAP_SIZE.
+  VM_ASSERT(NULL, usedSize + minNewSpaceSize <= MVM_MAX_HEAP_SIZE);
+
+  // Can fit, but only by chopping the end off the new bucket?
+  if (usedSize + newSpaceSize > MVM_MAX_HEAP_SIZE) {
+    CODE_COVERAGE_UNTESTED(8); // Not hit
+    newSpaceSize = MVM_MAX_HEAP_SIZE - usedSize;
+  } else {
+    CODE_COVERAGE(360); // Hit
+  }
+
+  #if MVM_USE_HEAP_ARENA
+  // Tospace is the half of the arena that fromspace isn't in, and like the VM
+  // heap (see gc_createNextBucket) it grows by extending its one bucket
+  if (gc->lastBucket) {
+    CODE_COVERAGE_UNTESTED(920); // Not hit
+    gc->lastBucketEndCapacity = (uint16_t*)((intptr_t)gc->lastBucket->pEndOfUsedSpace + newSpaceSize);
+    return;
+  }
+  CODE_COVERAGE_UNTESTED(921); // Not hit
+  VM* vm = gc->vm;
+  TsBucket* pBucket = (TsBucket*)vm->pHeapArena;
+  if (vm->pLastBucket == pBucket) {
+    pBucket = (TsBucket*)((intptr_t)vm->pHeapArena + HEAP_ARENA_SEMISPACE_SIZE);
+  }
+  #else
+  TsBucket* pBucket = (TsBucket*)vm_malloc(gc->vm, sizeof (TsBucket) + newSpaceSize);
+  if (!pBucket) {
+    CODE_COVERAGE_ERROR_PATH(376); // Not hit
+    MVM_FATAL_ERROR(NULL, MVM_E_MALLOC_FAIL);
+    return;
+  }
+  gc->vm->heapBucketCount++;
+  #endif
+  pBucket->next = NULL;
+  uint16_t* pDataInBucket = (uint16_t*)(pBucket + 1);
+  if (((intptr_t)pDataInBucket) & 1) {
+    CODE_COVERAGE_ERROR_PATH(377); // Not hit
+    MVM_FATAL_ERROR(NULL, MVM_E_MALLOC_MUST_RETURN_POINTER_TO_EVEN_BOUNDARY);
+    return;
+  }
+  pBucket->offsetStart = heapSize;
+  pBucket->prev = gc->lastBucket;
+  pBucket->pEndOfUsedSpace = getBucketDataBegin(pBucket);
+  if (!gc->firstBucket) {
+    CODE_COVERAGE(392); // Hit
+    gc->firstBucket = pBucket;
+  } else {
+    CODE_COVERAGE(393); // Hit
+  }
+  if (gc->lastBucket) {
+    CODE_COVERAGE(394); // Hit
+    gc->lastBucket->next = pBucket;
+  } else {
+    CODE_COVERAGE(395); // Hit
+  }
+  gc->lastBucket = pBucket;
+  gc->lastBucketEndCapacity = (uint16_t*)((intptr_t)pDataInBucket + newSpaceSize);
+  #if MVM_GC_INCREMENTAL
+  // The tospace of an incremental collection is also the end of the VM heap
+  if (gc->toSpaceStart) {
+    CODE_COVERAGE_UNTESTED(903); // Not hit
+    gc->vm->pLastBucket = pBucket;
+    gc->vm->pLastBucketEndCapacity = gc->lastBucketEndCapacity;
+    vm_indexBucket(gc->vm, pBucket, gc->lastBucketEndCapacity);
+  }
+  #endif
+}
+
+static void gc_processShortPtrValue(gc_TsGCCollectionState* gc, Value* pValue) {
+  CODE_COVERAGE(407); // Hit
+
+  uint16_t* writePtr;
+  const Value spSrc = *pValue;
+  VM* const vm = gc->vm;
+
+  uint16_t* const pSrc = (uint16_t*)ShortPtr_decode(vm, spSrc);
+  // ShortPtr is defined as not encoding null
+  VM_ASSERT(vm, pSrc != NULL);
+
+  const uint16_t headerWord = pSrc[-1];
+
+  // If there's a tombstone, then we've already collected this allocation
+  if (headerWord == TOMBSTONE_HEADER) {
+    CODE_COVERAGE(464); // Hit
+    *pValue = pSrc[0];
+    return;
+  } else {
+    CODE_COVERAGE(465); // Hit
+    // Tombstones always have exactly the header `TOMBSTONE_HEADER`. If it has
+    // the type-code of TC_REF_TOMBSTONE but is not a tombstone then it's likely
+    // a corrupt header or pValue does not point to a legitimate allocation.
+    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(headerWord) != TC_REF_TOMBSTONE);
+  }
+  // Otherwise, we need to move the allocation
+
+SUB_MOVE_ALLOCATION:
+  // Note: the variables before this point are `const` because an allocation
+  // movement can be aborted half way and tried again (in particular, see the
+  // property list compaction). It's only right at the end of this function
+  // where the writePtr is "committed" to the gc structure.
+
+  VM_ASSERT(vm, gc->lastBucket != NULL);
+  writePtr = gc->lastBucket->pEndOfUsedSpace;
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+  uint16_t words = (size + 3) / 2; // Rounded up, including header
+
+  // Check we have space
+  if (writePtr + words > gc->lastBucketEndCapacity) {
+    CODE_COVERAGE(466); // Hit
+    uint16_t minRequiredSpace = words * 2;
+    gc_newBucket(gc, MVM_ALLOCATION_BUCKET_SIZE, minRequiredSpace);
+
+    goto SUB_MOVE_ALLOCATION;
+  } else {
+    CODE_COVERAGE(467); // Hit
+  }
+
+  // Write the header
+  *writePtr++ = headerWord;
+  words--;
+
+  uint16_t* pOld = pSrc;
+  uint16_t* pNew = writePtr;
+
+  // Copy the allocation body
+  uint16_t* readPtr = pSrc;
+  while (words--)
+    *writePtr++ = *readPtr++;
+
+  // Dynamic arrays and property lists are compacted here
+  TeTypeCode tc = vm_getTypeCodeFromHeaderWord(headerWord);
+  if (tc == TC_REF_ARRAY) {
+    CODE_COVERAGE(468); // Hit
+    TsArray* arr = (TsArray*)pNew;
+    DynamicPtr dpData = arr->dpData;
+    // Note: in a minor collection, the data of a young array can't be in the
+    // old generation, since it was allocated after the array. The check is
+    // just for robustness, since old allocations must not be modified.
+    if ((dpData != VM_VALUE_NULL) && (dpData >= gc->nurseryStart)) {
+      CODE_COVERAGE(469); // Hit
+      VM_ASSERT(vm, Value_isShortPtr(dpData));
+
+      // Note: this decodes the pointer against fromspace
+      TsFixedLengthArray* pData = ShortPtr_decode(vm, dpData);
+
+      uint16_t len = VirtualInt14_decode(vm, arr->viLength);
+      #if MVM_SAFE_MODE
+        uint16_t headerWord = readAllocationHeaderWord(pData);
+        uint16_t dataTC = vm_getTypeCodeFromHeaderWord(headerWord);
+        // Note: because dpData is a unique pointer, we can be sure that it
+        // hasn't already been moved in response to some other reference to
+        // it (it's not a tombstone yet).
+        VM_ASSERT(vm, dataTC == TC_REF_FIXED_LENGTH_ARRAY);
+        uint16_t dataSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+        uint16_t capacity = dataSize / 2;
+        VM_ASSERT(vm, len <= capacity);
+      #endif
+
+      if (len > 0) {
+        CODE_COVERAGE(470); // Hit
+        // We just truncate the fixed-length-array to match the programmed
+        // length of the dynamic array, which is necessarily equal or less than
+        // its previous value. The GC will copy the data later and update the
+        // data pointer as it would normally do when following pointers.
+        setHeaderWord(vm, pData, TC_REF_FIXED_LENGTH_ARRAY, len * 2);
+      } else {
+        CODE_COVERAGE_UNTESTED(472); // Not hit
+        // Or if there's no length, we can remove the data altogether.
+        arr->dpData = VM_VALUE_NULL;
+      }
+    } else {
+      CODE_COVERAGE(473); // Hit
+    }
+  } else if (tc == TC_REF_PROPERTY_LIST) {
+    CODE_COVERAGE(474); // Hit
+    TsPropertyList* props = (TsPropertyList*)pNew;
+
+    Value dpNext = props->dpNext;
+
+    // If the object has children (detached extensions to the main
+    // allocation), we take this opportunity to compact them into the parent
+    // allocation to save space and improve access performance.
+    if (dpNext != VM_VALUE_NULL) {
+      CODE_COVERAGE(478); // Hit
+      // Note: The "root" property list counts towards the total but its
+      // fields do not need to be copied because it's already copied, above
+      uint16_t headerWord = readAllocationHeaderWord(props);
+      uint16_t allocationSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+      uint16_t totalPropCount = (allocationSize - sizeof(TsPropertyList)) / 4;
+
+      do {
+        // Note: while `next` is not strictly a ShortPtr in general, when used
+        // within GC allocations it will never point to an allocation in ROM
+        // or data memory, since it's only used to extend objects with new
+        // properties.
+        VM_ASSERT(vm, Value_isShortPtr(dpNext));
+        TsPropertyList* child = (TsPropertyList*)ShortPtr_decode(vm, dpNext);
+
+        uint16_t headerWord = readAllocationHeaderWord(child);
+        uint16_t allocationSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+        uint16_t childPropCount = (allocationSize - sizeof(TsPropertyList)) / 4;
+        totalPropCount += childPropCount;
+
+        uint16_t* end = writePtr + childPropCount * 2; // Key and value per property
+        // Check we have space for the new properties
+        if (end > gc->lastBucketEndCapacity) {
+          CODE_COVERAGE(479); // Hit
+          // If we don't have space, we need to revert and try again. The
+          // "revert" isn't explict. It depends on the fact that the gc.writePtr
+          // hasn't been committed yet, and no mutations have been applied to
+          // the source memory (i.e. the tombstone hasn't been written yet).
+          uint16_t minRequiredSpace = sizeof (TsPropertyList) + totalPropCount * 4;
+          gc_newBucket(gc, MVM_ALLOCATION_BUCKET_SIZE, minRequiredSpace);
+          goto SUB_MOVE_ALLOCATION;
+        } else {
+          CODE_COVERAGE(480); // Hit
+        }
+
+        uint16_t* pField = (uint16_t*)(child + 1);
+
+        // Copy the child fields directly into the parent
+        while (childPropCount--) {
+          *writePtr++ = *pField++; // key
+          *writePtr++ = *pField++; // value
+        }
+        dpNext = child->dpNext;
+        TABLE_COVERAGE(dpNext ? 1 : 0, 2, 490); // Hit 1/2
+      } while (dpNext != VM_VALUE_NULL);
+
+      // We've collapsed all the lists into one, so let's adjust the header
+      uint16_t newSize = sizeof (TsPropertyList) + totalPropCount * 4;
+      if (newSize > MAX_ALLOCATION_SIZE) {
+        CODE_COVERAGE_ERROR_PATH(491); // Not hit
+        MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
+        return;
+      }
+
+      setHeaderWord(vm, props, TC_REF_PROPERTY_LIST, newSize);
+      props->dpNext = VM_VALUE_NULL;
+    }
+  #if MVM_OBJECT_SHAPES
+  } else if (tc == TC_REF_SHAPED_OBJECT) {
+    CODE_COVERAGE(796); // Not hit
+    TsShapedObject* pObject = (TsShapedObject*)pNew;
+
+    Value dpNext = pObject->dpNext;
+
+    // As with property lists, appended values are compacted into the head
+    // allocation. The shape doesn't change.
+    if (dpNext != VM_VALUE_NULL) {
+      uint16_t allocationSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+      uint16_t totalValueCount = (allocationSize - sizeof (TsShapedObject)) / 2;
+
+      do {
+        VM_ASSERT(vm, Value_isShortPtr(dpNext));
+        TsShapedObject* child = (TsShapedObject*)ShortPtr_decode(vm, dpNext);
+
+        uint16_t childValueCount = (vm_getAllocationSize(child) - sizeof (TsShapedObject)) / 2;
+        totalValueCount += childValueCount;
+
+        uint16_t* end = writePtr + childValueCount;
+        // Check we have space for the new values, otherwise revert and try
+        // again (see the property list compaction above)
+        if (end > gc->lastBucketEndCapacity) {
+          uint16_t minRequiredSpace = sizeof (TsShapedObject) + totalValueCount * 2;
+          gc_newBucket(gc, MVM_ALLOCATION_BUCKET_SIZE, minRequiredSpace);
+          goto SUB_MOVE_ALLOCATION;
+        }
+
+        uint16_t* pField = (uint16_t*)(child + 1);
+        while (childValueCount--) {
+          *writePtr++ = *pField++;
+        }
+        dpNext = child->dpNext;
+      } while (dpNext != VM_VALUE_NULL);
+
+      uint16_t newSize = sizeof (TsShapedObject) + totalValueCount * 2;
+      if (newSize > MAX_ALLOCATION_SIZE) {
+        MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
+        return;
+      }
+
+      setHeaderWord(vm, pObject, TC_REF_SHAPED_OBJECT, newSize);
+      pObject->dpNext = VM_VALUE_NULL;
+    }
+  #endif // MVM_OBJECT_SHAPES
+  } else {
+    CODE_COVERAGE(492); // Hit
+  }
+
+  // Commit the move (grow the target heap and add the tombstone)
+
+  gc->lastBucket->pEndOfUsedSpace = writePtr;
+
+  ShortPtr spNew = ShortPtr_encodeInToSpace(gc, pNew);
+
+  pOld[-1] = TOMBSTONE_HEADER;
+  pOld[0] = spNew; // Forwarding pointer
+
+  *pValue = spNew;
+}
+
+static inline void gc_processValue(gc_TsGCCollectionState* gc, Value* pValue) {
+  // Note: only short pointer values are allowed to point to GC memory,
+  // and we only need to follow references that go to GC memory.
+  #if MVM_GC_NURSERY
+  // A minor collection leaves the old generation in place
+  if (Value_isShortPtr(*pValue) && (*pValue >= gc->nurseryStart)) {
+  #elif MVM_GC_INCREMENTAL
+  // During an incremental collection, allocations that haven't been scanned
+  // can also point into tospace (which is never 0, since fromspace is before it)
+  if (Value_isShortPtr(*pValue) && ((*pValue < gc->toSpaceStart) || !gc->toSpaceStart)) {
+  #else
+  if (Value_isShortPtr(*pValue)) {
+  #endif
+    CODE_COVERAGE(446); // Hit
+    gc_processShortPtrValue(gc, pValue);
+  } else {
+    CODE_COVERAGE(463); // Hit
+  }
 }
 
-static uint16_t getBucketOffsetEnd(TsBucket* bucket) {
-  CODE_COVERAGE(338); // Hit
-  return bucket->offsetStart + (uint16_t)(uintptr_t)bucket->pEndOfUsedSpace - (uint16_t)(uintptr_t)getBucketDataBegin(bucket);
-}
+// Process the GC roots: globals, handles, registers and the call stack
+static void gc_processRoots(gc_TsGCCollectionState* gc) {
+  VM* vm = gc->vm;
+  uint16_t n;
+  uint16_t* p;
+
+  // Roots in global variables (including indirection handles)
+  // Note: Interned strings are referenced from a handle and so will be GC'd here
+  // TODO: It would actually be good to have a test case showing that the string interning table is handled properly during GC
+  uint16_t globalsSize = getSectionSize(vm, BCS_GLOBALS);
+  p = vm->globals;
+  n = globalsSize / 2;
+  TABLE_COVERAGE(n ? 1 : 0, 2, 495); // Hit 1/2
+  while (n--)
+    gc_processValue(gc, p++);
+
+  // Roots in gc_handles
+  mvm_Handle* handle = vm->gc_handles;
+  TABLE_COVERAGE(handle ? 1 : 0, 2, 496); // Hit 2/2
+  while (handle) {
+    gc_processValue(gc, &handle->_value);
+    TABLE_COVERAGE(handle->_next ? 1 : 0, 2, 497); // Hit 2/2
+    handle = handle->_next;
+  }
+
+  #if MVM_OBJECT_SHAPES
+  // Root of the shape tree
+  gc_processValue(gc, &vm->shapeRoots);
+  #endif
+
+  // Roots on the stack or registers
+  vm_TsStack* stack = vm->stack;
+  if (stack) {
+    CODE_COVERAGE(498); // Hit
+    vm_TsRegisters* reg = &stack->reg;
+    VM_ASSERT(vm, reg->usingCachedRegisters == false);
+
+    // Roots in registers
+    gc_processValue(gc, &reg->closure);
+    gc_processValue(gc, &reg->cpsCallback);
+    gc_processValue(gc, &reg->jobQueue);
+
+    // Roots on call stack
+    uint16_t* beginningOfStack = getBottomOfStack(stack);
+    uint16_t* beginningOfFrame = reg->pFrameBase;
+    uint16_t* endOfFrame = reg->pStackPointer;
+
+    while (true) {
+      VM_ASSERT(vm, beginningOfFrame >= beginningOfStack);
+
+      // Loop through words in frame
+      p = beginningOfFrame;
+      while (p != endOfFrame) {
+        VM_ASSERT(vm, p < endOfFrame);
+        // TODO: It would be an interesting exercise to see if the GC can be written into a single function so that we don't need to pass around the &gc struct everywhere
+        gc_processValue(gc, p++);
+      }
+
+      if (beginningOfFrame == beginningOfStack) {
+        break;
+      }
+      VM_ASSERT(vm, beginningOfFrame >= beginningOfStack);
+
+      // The following statements assume a particular stack shape
+      VM_ASSERT(vm, VM_FRAME_BOUNDARY_VERSION == 2);
+
+      // Skip over the registers that are saved during a CALL instruction
+      endOfFrame = beginningOfFrame - 4;
 
-static uint16_t gc_getHeapSize(gc_TsGCCollectionState* gc) {
-  CODE_COVERAGE(351); // Hit
-  TsBucket* pLastBucket = gc->lastBucket;
-  if (pLastBucket) {
-    CODE_COVERAGE(352); // Hit
-    return getBucketOffsetEnd(pLastBucket);
+      // The saved scope pointer
+      Value* pScope = endOfFrame + 1;
+      gc_processValue(gc, pScope);
+
+      // The first thing saved during a CALL is the size of the preceding frame
+      beginningOfFrame = (uint16_t*)((uint8_t*)endOfFrame - *endOfFrame);
+
+      TABLE_COVERAGE(beginningOfFrame == beginningOfStack ? 1 : 0, 2, 499); // Hit 2/2
+    }
   } else {
-    CODE_COVERAGE(355); // Hit
-    return 0;
+    CODE_COVERAGE(500); // Hit
   }
 }
 
-static void gc_newBucket(gc_TsGCCollectionState* gc, uint16_t newSpaceSize, uint16_t minNewSpaceSize) {
-  CODE_COVERAGE(356); // Hit
-  uint16_t heapSize = gc_getHeapSize(gc);
+// Processes the pointers in the allocation with its header at `p`, and returns
+// the header of the next allocation
+static inline uint16_t* gc_scanAllocation(gc_TsGCCollectionState* gc, uint16_t* p) {
+  uint16_t header = *p++;
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
 
-  if (newSpaceSize < minNewSpaceSize) {
-    CODE_COVERAGE_UNTESTED(357); // Not hit
-    newSpaceSize = minNewSpaceSize;
-  } else {
-    CODE_COVERAGE(358); // Hit
+  uint16_t* next = p + ((size + 1) >> 1); // round up
+
+  // Note: we're comparing the header words here to compare the type code.
+  // The RHS here is constant
+  if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
+    CODE_COVERAGE(502); // Hit
+    return next;
+  } else { // Else, container types
+    CODE_COVERAGE(505); // Hit
+
+    // Note: we round down in calculating the number of words in the container
+    // that may contain a valid pointer. In particular this allows zero-length
+    // containers to have a size of 1 byte, which is rounded up to a 2-byte
+    // allocation (the minimum size large enough for the tombstone) but rounded
+    // down to zer when treated as the container dimension.
+    uint16_t words = size >> 1; // round down
+    while (words--) { // Hot loop
+      if (Value_isShortPtr(*p))
+        gc_processValue(gc, p);
+      p++;
+    }
+    return next;
   }
+}
 
-  // Since this is during a GC, it should be impossible for us to need more heap
-  // than is allowed, since the original heap should never have exceeded the
-  // MVM_MAX_HEAP_SIZE.
-  VM_ASSERT(NULL, heapSize + minNewSpaceSize <= MVM_MAX_HEAP_SIZE);
+// Cheney scan: process the pointers in allocations already moved to tospace,
+// which moves the allocations they refer to (appending them to tospace)
+static void gc_processToSpace(gc_TsGCCollectionState* gc) {
+  TsBucket* bucket = gc->firstBucket;
+  TABLE_COVERAGE(bucket ? 1 : 0, 2, 501); // Hit 1/2
+  // Loop through buckets
+  while (bucket) {
+    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
 
-  // Can fit, but only by chopping the end off the new bucket?
-  if (heapSize + newSpaceSize > MVM_MAX_HEAP_SIZE) {
-    CODE_COVERAGE_UNTESTED(8); // Not hit
-    newSpaceSize = MVM_MAX_HEAP_SIZE - heapSize;
-  } else {
-    CODE_COVERAGE(360); // Hit
+    // Loop through allocations in bucket. Note that this loop will hit exactly
+    // the end of the bucket even when there are multiple buckets, because empty
+    // space in a bucket is truncated when a new one is created (in
+    // gc_processValue)
+    while (p != bucket->pEndOfUsedSpace) { // Hot loop
+      VM_ASSERT(gc->vm, p < bucket->pEndOfUsedSpace);
+      p = gc_scanAllocation(gc, p);
+    }
+
+    // Go to next bucket
+    bucket = bucket->next;
+    TABLE_COVERAGE(bucket ? 1 : 0, 2, 506); // Hit 2/2
   }
+}
 
-  TsBucket* pBucket = (TsBucket*)vm_malloc(gc->vm, sizeof (TsBucket) + newSpaceSize);
-  if (!pBucket) {
-    CODE_COVERAGE_ERROR_PATH(376); // Not hit
-    MVM_FATAL_ERROR(NULL, MVM_E_MALLOC_FAIL);
-    return;
+// Updates the pause statistics in mvm_TsMemoryStats at the end of a collection
+// (or of a slice of an incremental collection)
+static void gc_recordPause(VM* vm, uint32_t startTime) {
+  CODE_COVERAGE(887); // Hit
+  uint32_t pauseTime = MVM_GC_TIMER() - startTime;
+  vm->lastGCPauseTime = pauseTime;
+  vm->totalGCPauseTime += pauseTime;
+  if (pauseTime > vm->maxGCPauseTime)
+    vm->maxGCPauseTime = pauseTime;
+}
+
+// Updates the statistics in mvm_TsMemoryStats at the end of a collection
+static void gc_recordCollection(VM* vm, uint16_t bytesCopied) {
+  CODE_COVERAGE(864); // Hit
+  vm->gcCount++;
+  vm->lastGCBytesCopied = bytesCopied;
+  vm->totalGCBytesCopied += bytesCopied;
+}
+
+#if MVM_GC_NURSERY
+/**
+ * Slow path of the write barrier, for when `*pSlot` is a pointer into the
+ * nursery. If the slot is in the old generation, it's added to the remembered
+ * set so that the next minor collection treats it as a root.
+ */
+static void gc_rememberSlot(VM* vm, Value* pSlot) {
+  CODE_COVERAGE_UNTESTED(865); // Not hit
+  uint16_t nurseryStart = vm->nurseryStart;
+
+  // Slots in the nursery don't need to be remembered since the whole nursery
+  // is scanned anyway. The nursery is at the end of the heap, so only the last
+  // few buckets need to be checked.
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket && (getBucketOffsetEnd(bucket) > nurseryStart)) {
+    uint16_t* pBegin = (uint16_t*)getBucketDataBegin(bucket);
+    if ((pSlot >= pBegin) && (pSlot < bucket->pEndOfUsedSpace)) {
+      uint16_t offset = bucket->offsetStart + (uint16_t)((intptr_t)pSlot - (intptr_t)pBegin);
+      if (offset >= nurseryStart) {
+        CODE_COVERAGE_UNTESTED(866); // Not hit
+        return;
+      }
+      break;
+    }
+    bucket = bucket->prev;
   }
-  pBucket->next = NULL;
-  uint16_t* pDataInBucket = (uint16_t*)(pBucket + 1);
-  if (((intptr_t)pDataInBucket) & 1) {
-    CODE_COVERAGE_ERROR_PATH(377); // Not hit
-    MVM_FATAL_ERROR(NULL, MVM_E_MALLOC_MUST_RETURN_POINTER_TO_EVEN_BOUNDARY);
+
+  if (vm->rememberedSetOverflowed) {
+    CODE_COVERAGE_UNTESTED(867); // Not hit
     return;
   }
-  pBucket->offsetStart = heapSize;
-  pBucket->prev = gc->lastBucket;
-  pBucket->pEndOfUsedSpace = getBucketDataBegin(pBucket);
-  if (!gc->firstBucket) {
-    CODE_COVERAGE(392); // Hit
-    gc->firstBucket = pBucket;
-  } else {
-    CODE_COVERAGE(393); // Hit
+
+  uint16_t count = vm->rememberedCount;
+  for (uint16_t i = 0; i < count; i++) {
+    if (vm->rememberedSet[i] == pSlot) {
+      CODE_COVERAGE_UNTESTED(868); // Not hit
+      return;
+    }
   }
-  if (gc->lastBucket) {
-    CODE_COVERAGE(394); // Hit
-    gc->lastBucket->next = pBucket;
-  } else {
-    CODE_COVERAGE(395); // Hit
+
+  if (count == MVM_GC_REMEMBERED_SET_SIZE) {
+    CODE_COVERAGE_UNTESTED(869); // Not hit
+    // The next minor collection will need to search the old generation
+    vm->rememberedSetOverflowed = true;
+    return;
   }
-  gc->lastBucket = pBucket;
-  gc->lastBucketEndCapacity = (uint16_t*)((intptr_t)pDataInBucket + newSpaceSize);
+
+  vm->rememberedSet[count] = pSlot;
+  vm->rememberedCount = count + 1;
 }
 
-static void gc_processShortPtrValue(gc_TsGCCollectionState* gc, Value* pValue) {
-  CODE_COVERAGE(407); // Hit
+/**
+ * Calls `gc_processValue` on every pointer from the old generation into the
+ * nursery, by parsing the whole old generation. This is used instead of the
+ * remembered set when it has overflowed, and is still much cheaper than a full
+ * collection since the old generation is only read and not copied.
+ *
+ * If `gc` is NULL, this instead checks that the pointers are all in the
+ * remembered set (see MVM_VERY_EXPENSIVE_MEMORY_CHECKS).
+ */
+static void gc_processOldGeneration(VM* vm, gc_TsGCCollectionState* gc) {
+  CODE_COVERAGE_UNTESTED(877); // Not hit
+  uint16_t nurseryStart = vm->nurseryStart;
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket && bucket->prev) {
+    bucket = bucket->prev;
+  }
 
-  uint16_t* writePtr;
-  const Value spSrc = *pValue;
-  VM* const vm = gc->vm;
+  for (; bucket && (bucket->offsetStart < nurseryStart); bucket = bucket->next) {
+    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
+    uint16_t* end = bucket->pEndOfUsedSpace;
+    // The nursery may start part way through the bucket
+    if (getBucketOffsetEnd(bucket) > nurseryStart) {
+      end = p + (nurseryStart - bucket->offsetStart) / 2;
+    }
+    while (p < end) {
+      uint16_t header = *p++;
+      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+      uint16_t* next = p + ((size + 1) >> 1);
+      if (header >= (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) {
+        uint16_t words = size >> 1;
+        for (; words--; p++) {
+          if (!Value_isShortPtr(*p) || (*p < nurseryStart)) continue;
+          if (gc) {
+            gc_processValue(gc, p);
+          } else {
+            uint16_t i = 0;
+            while ((i < vm->rememberedCount) && (vm->rememberedSet[i] != p)) {
+              i++;
+            }
+            VM_ASSERT(vm, i < vm->rememberedCount);
+          }
+        }
+      }
+      p = next;
+    }
+  }
+}
 
-  uint16_t* const pSrc = (uint16_t*)ShortPtr_decode(vm, spSrc);
-  // ShortPtr is defined as not encoding null
-  VM_ASSERT(vm, pSrc != NULL);
+/**
+ * Minor collection: moves the reachable allocations in the nursery to a new
+ * bucket at the end of the old generation, and frees the rest of the nursery.
+ *
+ * This uses the same Cheney algorithm as mvm_runGC, except that pointers into
+ * the old generation are not followed, and the old generation is not moved.
+ * Instead, the slots in the remembered set are treated as additional roots
+ * (or all of the old generation, if the remembered set overflowed).
+ */
+static void gc_collectNursery(VM* vm) {
+  CODE_COVERAGE_UNTESTED(870); // Not hit
 
-  const uint16_t headerWord = pSrc[-1];
+  uint16_t nurseryStart = vm->nurseryStart;
+  uint16_t heapSize = getHeapSize(vm);
 
-  // If there's a tombstone, then we've already collected this allocation
-  if (headerWord == TOMBSTONE_HEADER) {
-    CODE_COVERAGE(464); // Hit
-    *pValue = pSrc[0];
+  // Garbage in the old generation is only reclaimed by a full collection,
+  // which we do once the old generation has doubled since the last one (and
+  // by at least MVM_GC_NURSERY_SIZE).
+  uint16_t promotedSize = nurseryStart - vm->heapSizeUsedAfterLastGC;
+  if ((promotedSize >= MVM_GC_NURSERY_SIZE) && (promotedSize >= vm->heapSizeUsedAfterLastGC)) {
+    CODE_COVERAGE_UNTESTED(871); // Not hit
+    mvm_runGC(vm, false);
     return;
-  } else {
-    CODE_COVERAGE(465); // Hit
-    // Tombstones always have exactly the header `TOMBSTONE_HEADER`. If it has
-    // the type-code of TC_REF_TOMBSTONE but is not a tombstone then it's likely
-    // a corrupt header or pValue does not point to a legitimate allocation.
-    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(headerWord) != TC_REF_TOMBSTONE);
   }
-  // Otherwise, we need to move the allocation
 
-SUB_MOVE_ALLOCATION:
-  // Note: the variables before this point are `const` because an allocation
-  // movement can be aborted half way and tried again (in particular, see the
-  // property list compaction). It's only right at the end of this function
-  // where the writePtr is "committed" to the gc structure.
+  if (heapSize == nurseryStart) {
+    CODE_COVERAGE_UNTESTED(872); // Not hit
+    return;
+  }
 
-  VM_ASSERT(vm, gc->lastBucket != NULL);
-  writePtr = gc->lastBucket->pEndOfUsedSpace;
-  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-  uint16_t words = (size + 3) / 2; // Rounded up, including header
+  uint32_t startTime = MVM_GC_TIMER();
 
-  // Check we have space
-  if (writePtr + words > gc->lastBucketEndCapacity) {
-    CODE_COVERAGE(466); // Hit
-    uint16_t minRequiredSpace = words * 2;
-    gc_newBucket(gc, MVM_ALLOCATION_BUCKET_SIZE, minRequiredSpace);
+  if (heapSize > vm->heapHighWaterMark)
+    vm->heapHighWaterMark = heapSize;
 
-    goto SUB_MOVE_ALLOCATION;
+  #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+  if (!vm->rememberedSetOverflowed) {
+    gc_processOldGeneration(vm, NULL);
+  }
+  #endif
+
+  #if MVM_INLINE_CACHE
+  vm_inlineCacheClear(vm);
+  #endif
+
+  #if MVM_SCOPE_CACHE
+  memset(vm->scopeCache, 0, sizeof vm->scopeCache);
+  #endif
+
+  gc_TsGCCollectionState gc;
+  memset(&gc, 0, sizeof gc);
+  gc.vm = vm;
+  gc.nurseryStart = nurseryStart;
+
+  // The survivors can't take more space than the nursery itself
+  gc_newBucket(&gc, heapSize - nurseryStart, 0);
+
+  // Roots in the old generation
+  if (vm->rememberedSetOverflowed) {
+    CODE_COVERAGE_UNTESTED(878); // Not hit
+    gc_processOldGeneration(vm, &gc);
   } else {
-    CODE_COVERAGE(467); // Hit
+    CODE_COVERAGE_UNTESTED(879); // Not hit
+    uint16_t count = vm->rememberedCount;
+    for (uint16_t i = 0; i < count; i++) {
+      gc_processValue(&gc, vm->rememberedSet[i]);
+    }
   }
 
-  // Write the header
-  *writePtr++ = headerWord;
-  words--;
+  gc_processRoots(&gc);
+  gc_processToSpace(&gc);
 
-  uint16_t* pOld = pSrc;
-  uint16_t* pNew = writePtr;
+  // Release the nursery. It may start part way through a bucket, in which case
+  // the bucket is truncated.
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket && (bucket->offsetStart >= nurseryStart)) {
+    TsBucket* prev = bucket->prev;
+    vm_free(vm, bucket);
+    bucket = prev;
+  }
+  if (bucket) {
+    CODE_COVERAGE_UNTESTED(873); // Not hit
+    bucket->pEndOfUsedSpace = (uint16_t*)((intptr_t)getBucketDataBegin(bucket) + (nurseryStart - bucket->offsetStart));
+    bucket->next = gc.firstBucket;
+    gc.firstBucket->prev = bucket;
+  } else {
+    CODE_COVERAGE_UNTESTED(874); // Not hit
+  }
 
-  // Copy the allocation body
-  uint16_t* readPtr = pSrc;
-  while (words--)
-    *writePtr++ = *readPtr++;
+  // Adopt the survivors as the end of the old generation
+  vm->pLastBucket = gc.lastBucket;
+  vm->pLastBucketEndCapacity = gc.lastBucketEndCapacity;
+  vm_rebuildBucketIndex(vm);
 
-  // Dynamic arrays and property lists are compacted here
-  TeTypeCode tc = vm_getTypeCodeFromHeaderWord(headerWord);
-  if (tc == TC_REF_ARRAY) {
-    CODE_COVERAGE(468); // Hit
-    TsArray* arr = (TsArray*)pNew;
-    DynamicPtr dpData = arr->dpData;
-    if (dpData != VM_VALUE_NULL) {
-      CODE_COVERAGE(469); // Hit
-      VM_ASSERT(vm, Value_isShortPtr(dpData));
+  uint16_t finalUsedSize = getHeapSize(vm);
+  vm->nurseryStart = finalUsedSize;
+  vm->rememberedCount = 0;
+  vm->rememberedSetOverflowed = false;
+  vm->minorGCCount++;
 
-      // Note: this decodes the pointer against fromspace
-      TsFixedLengthArray* pData = ShortPtr_decode(vm, dpData);
+  gc_recordCollection(vm, finalUsedSize - nurseryStart);
+  gc_recordPause(vm, startTime);
+}
 
-      uint16_t len = VirtualInt14_decode(vm, arr->viLength);
-      #if MVM_SAFE_MODE
-        uint16_t headerWord = readAllocationHeaderWord(pData);
-        uint16_t dataTC = vm_getTypeCodeFromHeaderWord(headerWord);
-        // Note: because dpData is a unique pointer, we can be sure that it
-        // hasn't already been moved in response to some other reference to
-        // it (it's not a tombstone yet).
-        VM_ASSERT(vm, dataTC == TC_REF_FIXED_LENGTH_ARRAY);
-        uint16_t dataSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-        uint16_t capacity = dataSize / 2;
-        VM_ASSERT(vm, len <= capacity);
-      #endif
+void mvm_runMinorGC(VM* vm) {
+  CODE_COVERAGE_UNTESTED(875); // Not hit
+  gc_collectNursery(vm);
+}
+#endif // MVM_GC_NURSERY
 
-      if (len > 0) {
-        CODE_COVERAGE(470); // Hit
-        // We just truncate the fixed-length-array to match the programmed
-        // length of the dynamic array, which is necessarily equal or less than
-        // its previous value. The GC will copy the data later and update the
-        // data pointer as it would normally do when following pointers.
-        setHeaderWord(vm, pData, TC_REF_FIXED_LENGTH_ARRAY, len * 2);
-      } else {
-        CODE_COVERAGE_UNTESTED(472); // Not hit
-        // Or if there's no length, we can remove the data altogether.
-        arr->dpData = VM_VALUE_NULL;
+#if MVM_GC_INCREMENTAL
+/*
+An incremental collection is the same Cheney copy as mvm_runGC, except that the
+program runs between the slices of work (Baker's algorithm). To make this work:
+
+  1. Tospace is placed after fromspace in the heap offset space, and both are
+     in the VM's bucket list, so that pointers into either can be decoded.
+  2. The roots are all moved at the start, so the program only has pointers
+     into tospace. Allocations in tospace that haven't been scanned yet can
+     still contain pointers into fromspace, so ShortPtr_decode scans them when
+     the program accesses them (the read barrier).
+  3. The program allocates at the end of tospace, so its new allocations are
+     scanned along with everything else. They hold only tospace pointers.
+
+When the scan catches up with the end of tospace, fromspace is released. The
+heap then starts at a non-zero offset, until the next full collection.
+*/
+
+// A new container may be scanned by the collection before the program has
+// initialized it, so it can't contain garbage
+static void gc_clearNewAllocation(uint16_t* p) {
+  CODE_COVERAGE_UNTESTED(888); // Not hit
+  uint16_t header = p[-1];
+  if (header >= (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) {
+    uint16_t words = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header) >> 1;
+    while (words--)
+      *p++ = VM_VALUE_UNDEFINED;
+  }
+}
+
+// Between slices, the end of tospace is the end of the VM heap, where the
+// program allocates. These hand it between the program and the collection.
+static void gc_resumeIncremental(gc_TsGCCollectionState* gc) {
+  gc->lastBucket = gc->vm->pLastBucket;
+  gc->lastBucketEndCapacity = gc->vm->pLastBucketEndCapacity;
+}
+
+static void gc_suspendIncremental(gc_TsGCCollectionState* gc) {
+  VM* vm = gc->vm;
+  vm->pLastBucket = gc->lastBucket;
+  vm->pLastBucketEndCapacity = gc->lastBucketEndCapacity;
+  TsBucket* scanBucket = gc->scanBucket;
+  vm->gcScanOffset = scanBucket->offsetStart + (uint16_t)((intptr_t)gc->scanAllocation - (intptr_t)getBucketDataBegin(scanBucket));
+}
+
+static void gc_startIncremental(VM* vm) {
+  CODE_COVERAGE_UNTESTED(889); // Not hit
+
+  #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+  mvm_checkHeap(vm);
+  #endif
+
+  uint16_t heapSize = getHeapSize(vm);
+  if (heapSize - vm->heapStart > vm->heapHighWaterMark)
+    vm->heapHighWaterMark = heapSize - vm->heapStart;
+
+  #if MVM_INLINE_CACHE
+  // The inline caches refer to allocations that are about to move
+  vm_inlineCacheClear(vm);
+  #endif
+
+  #if MVM_SCOPE_CACHE
+  memset(vm->scopeCache, 0, sizeof vm->scopeCache);
+  #endif
+
+  // One bit for each word of tospace, which is at most MVM_MAX_HEAP_SIZE
+  size_t bitmapSize = (MVM_MAX_HEAP_SIZE + 15) / 16;
+  gc_TsGCCollectionState* gc = vm_malloc(vm, sizeof (gc_TsGCCollectionState) + bitmapSize);
+  if (!gc) {
+    CODE_COVERAGE_ERROR_PATH(890); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+    return;
+  }
+  memset(gc, 0, sizeof (gc_TsGCCollectionState) + bitmapSize);
+  gc->vm = vm;
+  gc->scannedOnAccess = (uint8_t*)(gc + 1);
+  gc->toSpaceStart = heapSize;
+  gc->fromSpaceSize = heapSize - vm->heapStart;
+
+  // Tospace is appended to the VM's bucket list
+  gc->lastBucket = vm->pLastBucket;
+  uint16_t estimatedSize = vm->heapSizeUsedAfterLastGC;
+  if (!estimatedSize) {
+    CODE_COVERAGE_UNTESTED(891); // Not hit
+    estimatedSize = 64;
+  }
+  gc_newBucket(gc, estimatedSize, 0);
+  gc->scanBucket = gc->firstBucket;
+  gc->scanPtr = getBucketDataBegin(gc->firstBucket);
+  gc->scanSlotsEnd = gc->scanPtr;
+  gc->scanNext = gc->scanPtr;
+  gc->scanAllocation = gc->scanPtr;
+
+  gc_processRoots(gc);
+
+  vm->pIncrementalGC = gc;
+  gc_suspendIncremental(gc);
+}
+
+// Continues the Cheney scan of tospace until about `workBudget` bytes have been
+// scanned or copied, and completes the collection if the scan reaches the end.
+// `*pWork` is the work already done in this slice, and is updated to include
+// the work done here. Returns true if it's complete.
+static bool gc_continueIncremental(VM* vm, uint16_t workBudget, uint16_t* pWork) {
+  CODE_COVERAGE_UNTESTED(892); // Not hit
+  gc_TsGCCollectionState* gc = vm->pIncrementalGC;
+  VM_ASSERT(vm, gc != NULL);
+  gc_resumeIncremental(gc);
+
+  // Anything added to the end of tospace during the slice has been copied
+  uint16_t toSpaceEnd = gc_getHeapSize(gc);
+  uint16_t scanned = *pWork;
+
+  TsBucket* bucket = gc->scanBucket;
+  uint16_t* p = gc->scanPtr;
+  uint16_t* slotsEnd = gc->scanSlotsEnd;
+  uint16_t* next = gc->scanNext;
+  uint16_t* allocation = gc->scanAllocation;
+  while (true) {
+    if ((uint32_t)scanned + (uint16_t)(gc_getHeapSize(gc) - toSpaceEnd) >= workBudget) {
+      CODE_COVERAGE_UNTESTED(894); // Not hit
+      gc->scanBucket = bucket;
+      gc->scanPtr = p;
+      gc->scanSlotsEnd = slotsEnd;
+      gc->scanNext = next;
+      gc->scanAllocation = allocation;
+      *pWork = scanned + (uint16_t)(gc_getHeapSize(gc) - toSpaceEnd);
+      gc_suspendIncremental(gc);
+      return false;
+    }
+    scanned += 2;
+
+    // Next slot in the container being scanned
+    if (p != slotsEnd) {
+      if (Value_isShortPtr(*p))
+        gc_processValue(gc, p);
+      p++;
+      continue;
+    }
+
+    // Next allocation
+    p = next;
+    if (p == bucket->pEndOfUsedSpace) {
+      if (!bucket->next) {
+        CODE_COVERAGE_UNTESTED(893); // Not hit
+        break;
       }
+      bucket = bucket->next;
+      p = getBucketDataBegin(bucket);
+      slotsEnd = p;
+      next = p;
+      allocation = p;
+      continue;
+    }
+    VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
+    allocation = p;
+    uint16_t header = *p++;
+    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+    next = p + ((size + 1) >> 1); // round up
+    if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
+      slotsEnd = p = next;
+      allocation = next;
     } else {
-      CODE_COVERAGE(473); // Hit
+      slotsEnd = p + (size >> 1); // round down (see gc_processToSpace)
+      // The read barrier scans the whole allocation if it's accessed before the
+      // slice that finishes it
+      allocation = p;
     }
-  } else if (tc == TC_REF_PROPERTY_LIST) {
-    CODE_COVERAGE(474); // Hit
-    TsPropertyList* props = (TsPropertyList*)pNew;
-
-    Value dpNext = props->dpNext;
+  }
 
-    // If the object has children (detached extensions to the main
-    // allocation), we take this opportunity to compact them into the parent
-    // allocation to save space and improve access performance.
-    if (dpNext != VM_VALUE_NULL) {
-      CODE_COVERAGE(478); // Hit
-      // Note: The "root" property list counts towards the total but its
-      // fields do not need to be copied because it's already copied, above
-      uint16_t headerWord = readAllocationHeaderWord(props);
-      uint16_t allocationSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-      uint16_t totalPropCount = (allocationSize - sizeof(TsPropertyList)) / 4;
+  *pWork = scanned + (uint16_t)(gc_getHeapSize(gc) - toSpaceEnd);
 
-      do {
-        // Note: while `next` is not strictly a ShortPtr in general, when used
-        // within GC allocations it will never point to an allocation in ROM
-        // or data memory, since it's only used to extend objects with new
-        // properties.
-        VM_ASSERT(vm, Value_isShortPtr(dpNext));
-        TsPropertyList* child = (TsPropertyList*)ShortPtr_decode(vm, dpNext);
+  // Everything reachable is in tospace now, so fromspace can be released
+  TsBucket* oldBucket = gc->firstBucket->prev;
+  gc->firstBucket->prev = NULL;
+  while (oldBucket) {
+    TsBucket* prev = oldBucket->prev;
+    vm_free(vm, oldBucket);
+    oldBucket = prev;
+  }
 
-        uint16_t headerWord = readAllocationHeaderWord(child);
-        uint16_t allocationSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-        uint16_t childPropCount = (allocationSize - sizeof(TsPropertyList)) / 4;
-        totalPropCount += childPropCount;
+  vm->pLastBucket = gc->lastBucket;
+  vm->pLastBucketEndCapacity = gc->lastBucketEndCapacity;
+  vm_rebuildBucketIndex(vm);
+  vm->heapStart = gc->toSpaceStart;
+  vm->gcScanOffset = 0xFFFF;
+  vm->pIncrementalGC = NULL;
+  vm_free(vm, gc);
 
-        uint16_t* end = writePtr + childPropCount;
-        // Check we have space for the new properties
-        if (end > gc->lastBucketEndCapacity) {
-          CODE_COVERAGE(479); // Hit
-          // If we don't have space, we need to revert and try again. The
-          // "revert" isn't explict. It depends on the fact that the gc.writePtr
-          // hasn't been committed yet, and no mutations have been applied to
-          // the source memory (i.e. the tombstone hasn't been written yet).
-          uint16_t minRequiredSpace = sizeof (TsPropertyList) + totalPropCount * 4;
-          gc_newBucket(gc, MVM_ALLOCATION_BUCKET_SIZE, minRequiredSpace);
-          goto SUB_MOVE_ALLOCATION;
-        } else {
-          CODE_COVERAGE(480); // Hit
-        }
+  // Note: this includes the allocations made during the collection
+  uint16_t finalUsedSize = getHeapSize(vm) - vm->heapStart;
+  vm->heapSizeUsedAfterLastGC = finalUsedSize;
+  gc_recordCollection(vm, finalUsedSize);
 
-        uint16_t* pField = (uint16_t*)(child + 1);
+  #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+  mvm_checkHeap(vm);
+  #endif
 
-        // Copy the child fields directly into the parent
-        while (childPropCount--) {
-          *writePtr++ = *pField++; // key
-          *writePtr++ = *pField++; // value
-        }
-        dpNext = child->dpNext;
-        TABLE_COVERAGE(dpNext ? 1 : 0, 2, 490); // Hit 1/2
-      } while (dpNext != VM_VALUE_NULL);
+  return true;
+}
 
-      // We've collapsed all the lists into one, so let's adjust the header
-      uint16_t newSize = sizeof (TsPropertyList) + totalPropCount * 4;
-      if (newSize > MAX_ALLOCATION_SIZE) {
-        CODE_COVERAGE_ERROR_PATH(491); // Not hit
-        MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
-        return;
-      }
+// Completes the incremental collection in progress, if there is one
+static void gc_finishIncremental(VM* vm) {
+  CODE_COVERAGE_UNTESTED(895); // Not hit
+  uint16_t work = 0;
+  while (vm->pIncrementalGC && !gc_continueIncremental(vm, 0xFFFF, &work)) {
+    CODE_COVERAGE_UNTESTED(896); // Not hit
+  }
+}
 
-      setHeaderWord(vm, props, TC_REF_PROPERTY_LIST, newSize);
-      props->dpNext = VM_VALUE_NULL;
-    }
-  } else {
-    CODE_COVERAGE(492); // Hit
+/**
+ * Slow path of the read barrier in ShortPtr_decode, for an allocation at or
+ * after the position of the Cheney scan. Its pointers into fromspace are
+ * processed now, ahead of the scan, so that the program doesn't see them.
+ * Each allocation only needs this once, which is recorded in a bitmap.
+ */
+static void gc_scanOnAccess(VM* vm, uint16_t offsetInHeap, uint16_t* p) {
+  CODE_COVERAGE_UNTESTED(897); // Not hit
+  gc_TsGCCollectionState* gc = vm->pIncrementalGC;
+  VM_ASSERT(vm, gc != NULL);
+  uint16_t word = (offsetInHeap - gc->toSpaceStart) >> 1;
+  VM_ASSERT(vm, word < MVM_MAX_HEAP_SIZE / 2);
+  uint8_t* pBits = &gc->scannedOnAccess[word >> 3];
+  uint8_t mask = 1 << (word & 7);
+  if (*pBits & mask) {
+    CODE_COVERAGE_UNTESTED(898); // Not hit
+    return;
   }
+  *pBits |= mask;
 
-  // Commit the move (grow the target heap and add the tombstone)
+  gc_resumeIncremental(gc);
+  gc_scanAllocation(gc, p - 1);
+  gc_suspendIncremental(gc);
+}
 
-  gc->lastBucket->pEndOfUsedSpace = writePtr;
+bool mvm_runGCSlice(VM* vm, uint16_t workBudget) {
+  CODE_COVERAGE_UNTESTED(899); // Not hit
 
-  ShortPtr spNew = ShortPtr_encodeInToSpace(gc, pNew);
+  if (!vm->pIncrementalGC) {
+    uint16_t heapSize = getHeapSize(vm);
+    if (heapSize == vm->heapStart) {
+      CODE_COVERAGE_UNTESTED(900); // Not hit
+      // Nothing to collect
+      return true;
+    }
+    // Tospace must fit in the ShortPtr range after fromspace. Otherwise, a full
+    // collection moves the heap back to the start of the range.
+    if (heapSize > 0xFFFE - MVM_MAX_HEAP_SIZE) {
+      CODE_COVERAGE_UNTESTED(901); // Not hit
+      mvm_runGC(vm, false);
+      return true;
+    }
+  }
 
-  pOld[-1] = TOMBSTONE_HEADER;
-  pOld[0] = spNew; // Forwarding pointer
+  uint32_t startTime = MVM_GC_TIMER();
+  uint16_t work = 0;
+  if (!vm->pIncrementalGC) {
+    uint16_t heapSize = getHeapSize(vm);
+    gc_startIncremental(vm);
+    // Copying the roots is part of the first slice
+    work = getHeapSize(vm) - heapSize;
+  }
+  bool complete = gc_continueIncremental(vm, workBudget, &work);
+  gc_recordPause(vm, startTime);
 
-  *pValue = spNew;
-}
+  vm->lastGCSliceWork = work;
+  if (work > vm->maxGCSliceWork)
+    vm->maxGCSliceWork = work;
 
-static inline void gc_processValue(gc_TsGCCollectionState* gc, Value* pValue) {
-  // Note: only short pointer values are allowed to point to GC memory,
-  // and we only need to follow references that go to GC memory.
-  if (Value_isShortPtr(*pValue)) {
-    CODE_COVERAGE(446); // Hit
-    gc_processShortPtrValue(gc, pValue);
-  } else {
-    CODE_COVERAGE(463); // Hit
-  }
+  return complete;
 }
+#endif // MVM_GC_INCREMENTAL
 
 void mvm_runGC(VM* vm, bool squeeze) {
   CODE_COVERAGE(593); // Hit
@@ -6466,17 +10124,38 @@ void mvm_runGC(VM* vm, bool squeeze) {
   processed allocations always reference _tospace_.
   */
 
+  uint32_t startTime = MVM_GC_TIMER();
+
+  #if MVM_GC_INCREMENTAL
+  // The tombstones of an incremental collection point into its tospace, so it
+  // needs to be finished first
+  gc_finishIncremental(vm);
+  #endif
+
   #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
   mvm_checkHeap(vm);
   #endif
 
-  uint16_t n;
-  uint16_t* p;
+  // A squeeze is a request to use as little memory as possible, so a resident
+  // stack is released if the VM is idle. It's allocated again on the next call.
+  if (squeeze) {
+    CODE_COVERAGE_UNTESTED(812); // Not hit
+    vm_releaseIdleStack(vm);
+  }
 
-  uint16_t heapSize = getHeapSize(vm);
+  uint16_t heapSize = getHeapSize(vm) - VM_HEAP_START(vm);
   if (heapSize > vm->heapHighWaterMark)
     vm->heapHighWaterMark = heapSize;
 
+  #if MVM_INLINE_CACHE
+  // The inline caches refer to allocations that are about to move
+  vm_inlineCacheClear(vm);
+  #endif
+
+  #if MVM_SCOPE_CACHE
+  memset(vm->scopeCache, 0, sizeof vm->scopeCache);
+  #endif
+
   // A collection of variables shared by GC routines
   gc_TsGCCollectionState gc;
   memset(&gc, 0, sizeof gc);
@@ -6517,127 +10196,15 @@ void mvm_runGC(VM* vm, bool squeeze) {
   }
   gc_newBucket(&gc, estimatedSize, 0);
 
-  // Roots in global variables (including indirection handles)
-  // Note: Interned strings are referenced from a handle and so will be GC'd here
-  // TODO: It would actually be good to have a test case showing that the string interning table is handled properly during GC
-  uint16_t globalsSize = getSectionSize(vm, BCS_GLOBALS);
-  p = vm->globals;
-  n = globalsSize / 2;
-  TABLE_COVERAGE(n ? 1 : 0, 2, 495); // Hit 1/2
-  while (n--)
-    gc_processValue(&gc, p++);
-
-  // Roots in gc_handles
-  mvm_Handle* handle = vm->gc_handles;
-  TABLE_COVERAGE(handle ? 1 : 0, 2, 496); // Hit 2/2
-  while (handle) {
-    gc_processValue(&gc, &handle->_value);
-    TABLE_COVERAGE(handle->_next ? 1 : 0, 2, 497); // Hit 2/2
-    handle = handle->_next;
-  }
-
-  // Roots on the stack or registers
-  vm_TsStack* stack = vm->stack;
-  if (stack) {
-    CODE_COVERAGE(498); // Hit
-    vm_TsRegisters* reg = &stack->reg;
-    VM_ASSERT(vm, reg->usingCachedRegisters == false);
-
-    // Roots in registers
-    gc_processValue(&gc, &reg->closure);
-    gc_processValue(&gc, &reg->cpsCallback);
-    gc_processValue(&gc, &reg->jobQueue);
-
-    // Roots on call stack
-    uint16_t* beginningOfStack = getBottomOfStack(stack);
-    uint16_t* beginningOfFrame = reg->pFrameBase;
-    uint16_t* endOfFrame = reg->pStackPointer;
-
-    while (true) {
-      VM_ASSERT(vm, beginningOfFrame >= beginningOfStack);
-
-      // Loop through words in frame
-      p = beginningOfFrame;
-      while (p != endOfFrame) {
-        VM_ASSERT(vm, p < endOfFrame);
-        // TODO: It would be an interesting exercise to see if the GC can be written into a single function so that we don't need to pass around the &gc struct everywhere
-        gc_processValue(&gc, p++);
-      }
-
-      if (beginningOfFrame == beginningOfStack) {
-        break;
-      }
-      VM_ASSERT(vm, beginningOfFrame >= beginningOfStack);
-
-      // The following statements assume a particular stack shape
-      VM_ASSERT(vm, VM_FRAME_BOUNDARY_VERSION == 2);
-
-      // Skip over the registers that are saved during a CALL instruction
-      endOfFrame = beginningOfFrame - 4;
-
-      // The saved scope pointer
-      Value* pScope = endOfFrame + 1;
-      gc_processValue(&gc, pScope);
-
-      // The first thing saved during a CALL is the size of the preceding frame
-      beginningOfFrame = (uint16_t*)((uint8_t*)endOfFrame - *endOfFrame);
-
-      TABLE_COVERAGE(beginningOfFrame == beginningOfStack ? 1 : 0, 2, 499); // Hit 2/2
-    }
-  } else {
-    CODE_COVERAGE(500); // Hit
-  }
+  gc_processRoots(&gc);
 
   // Now we process moved allocations to make sure objects they point to are
   // also moved, and to update pointers to reference the new space
+  gc_processToSpace(&gc);
 
-  TsBucket* bucket = gc.firstBucket;
-  TABLE_COVERAGE(bucket ? 1 : 0, 2, 501); // Hit 1/2
-  // Loop through buckets
-  while (bucket) {
-    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
-
-    // Loop through allocations in bucket. Note that this loop will hit exactly
-    // the end of the bucket even when there are multiple buckets, because empty
-    // space in a bucket is truncated when a new one is created (in
-    // gc_processValue)
-    while (p != bucket->pEndOfUsedSpace) { // Hot loop
-      VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
-      uint16_t header = *p++;
-      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-
-      uint16_t* next = p + ((size + 1) >> 1); // round up
-
-      // Note: we're comparing the header words here to compare the type code.
-      // The RHS here is constant
-      if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
-        CODE_COVERAGE(502); // Hit
-        p = next;
-        continue;
-      } else { // Else, container types
-        CODE_COVERAGE(505); // Hit
-
-        // Note: we round down in calculating the number of words in the container
-        // that may contain a valid pointer. In particular this allows zero-length
-        // containers to have a size of 1 byte, which is rounded up to a 2-byte
-        // allocation (the minimum size large enough for the tombstone) but rounded
-        // down to zer when treated as the container dimension.
-        uint16_t words = size >> 1; // round down
-        while (words--) { // Hot loop
-          if (Value_isShortPtr(*p))
-            gc_processValue(&gc, p);
-          p++;
-        }
-        p = next;
-      }
-    }
-
-    // Go to next bucket
-    bucket = bucket->next;
-    TABLE_COVERAGE(bucket ? 1 : 0, 2, 506); // Hit 2/2
-  }
-
-  // Release old heap
+  // Release old heap (the half of the arena it was in is just reused by the
+  // next collection)
+  #if !MVM_USE_HEAP_ARENA
   TsBucket* oldBucket = vm->pLastBucket;
   TABLE_COVERAGE(oldBucket ? 1 : 0, 2, 507); // Hit 2/2
   while (oldBucket) {
@@ -6645,15 +10212,32 @@ void mvm_runGC(VM* vm, bool squeeze) {
     vm_free(vm, oldBucket);
     oldBucket = prev;
   }
+  #endif
 
   // Adopt new heap
   vm->pLastBucket = gc.lastBucket;
   vm->pLastBucketEndCapacity = gc.lastBucketEndCapacity;
+  vm_rebuildBucketIndex(vm);
 
   uint16_t finalUsedSize = getHeapSize(vm);
   vm->heapSizeUsedAfterLastGC = finalUsedSize;
 
-  if (squeeze && (finalUsedSize != estimatedSize)) {
+  #if MVM_GC_NURSERY
+  // Everything that survived is in the old generation now
+  vm->nurseryStart = finalUsedSize;
+  vm->rememberedCount = 0;
+  vm->rememberedSetOverflowed = false;
+  #endif // MVM_GC_NURSERY
+
+  #if MVM_GC_INCREMENTAL
+  vm->heapStart = 0;
+  #endif
+
+  gc_recordCollection(vm, finalUsedSize);
+  gc_recordPause(vm, startTime);
+
+  // Note: the heap arena is allocated in full anyway, so there's nothing to squeeze
+  if (squeeze && !MVM_USE_HEAP_ARENA && (finalUsedSize != estimatedSize)) {
     CODE_COVERAGE(508); // Hit
     /*
     Note: The most efficient way to calculate the exact size needed for the heap
@@ -6696,7 +10280,7 @@ void mvm_runGC(VM* vm, bool squeeze) {
  */
 TeError vm_createStackAndRegisters(VM* vm) {
   CODE_COVERAGE(225); // Hit
-  // This is freed again at the end of mvm_call. Note: the allocated
+  // This is freed again at the end of vm_call. Note: the allocated
   // memory includes the registers, which are part of the vm_TsStack
   // structure
   vm_TsStack* stack = vm_malloc(vm, sizeof (vm_TsStack) + MVM_STACK_SIZE);
@@ -6704,7 +10288,20 @@ TeError vm_createStackAndRegisters(VM* vm) {
     CODE_COVERAGE_ERROR_PATH(231); // Not hit
     return vm_newError(vm, MVM_E_MALLOC_FAIL);
   }
+  stack->capacity = MVM_STACK_SIZE;
+  stack->pCheckedLimit = getBottomOfStack(stack);
   vm->stack = stack;
+  vm->stackAllocationCount++;
+  vm_initRegisters(vm, stack);
+
+  return MVM_E_SUCCESS;
+}
+
+/**
+ * Reset the registers of the given stack to the state of an empty stack
+ */
+static void vm_initRegisters(VM* vm, vm_TsStack* stack) {
+  CODE_COVERAGE_UNTESTED(807); // Not hit
   vm_TsRegisters* reg = &stack->reg;
   memset(reg, 0, sizeof *reg);
   // The stack grows upward. The bottom is the lowest address.
@@ -6718,8 +10315,32 @@ TeError vm_createStackAndRegisters(VM* vm) {
   reg->cpsCallback = VM_VALUE_DELETED;
   reg->jobQueue = VM_VALUE_UNDEFINED;
   VM_ASSERT(vm, reg->pArgs == 0);
+}
 
-  return MVM_E_SUCCESS;
+/**
+ * Free the stack if it's allocated but no call is active. Returns true if the
+ * stack was freed.
+ */
+static bool vm_releaseIdleStack(VM* vm) {
+  CODE_COVERAGE_UNTESTED(808); // Not hit
+  vm_TsStack* stack = vm->stack;
+  if (!stack || (stack->reg.pStackPointer != getBottomOfStack(stack))) {
+    CODE_COVERAGE_UNTESTED(809); // Not hit
+    return false;
+  }
+  VM_ASSERT(vm, !stack->reg.usingCachedRegisters);
+  vm_free(vm, stack);
+  vm->stack = NULL;
+  return true;
+}
+
+void mvm_setStackResident(VM* vm, bool resident) {
+  CODE_COVERAGE_UNTESTED(810); // Not hit
+  vm->stackResident = resident;
+  if (!resident) {
+    CODE_COVERAGE_UNTESTED(811); // Not hit
+    vm_releaseIdleStack(vm);
+  }
 }
 
 // Lowest address on stack
@@ -6731,7 +10352,7 @@ static inline uint16_t* getBottomOfStack(vm_TsStack* stack) {
 // Highest possible address on stack (+1) before overflow
 static inline uint16_t* getTopOfStackSpace(vm_TsStack* stack) {
   CODE_COVERAGE(511); // Hit
-  return getBottomOfStack(stack) + MVM_STACK_SIZE / 2;
+  return getBottomOfStack(stack) + stack->capacity / 2;
 }
 
 #if MVM_DEBUG
@@ -6755,21 +10376,9 @@ static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t si
   uint16_t* pStackHighWaterMark = pStackPointer + ((intptr_t)sizeRequiredInWords);
   if (pStackHighWaterMark > getTopOfStackSpace(vm->stack)) {
     CODE_COVERAGE_ERROR_PATH(233); // Not hit
-
-    // TODO(low): Since we know the max stack depth for the function, we could
-    // actually grow the stack dynamically rather than allocate it fixed size.
-    // Actually, it seems likely that we could allocate the VM stack on the C
-    // stack, since it's a fixed-size structure anyway.
-    //
-    // (A way to do the allocation on the stack would be to perform a nested
-    // call to mvm_call, and the allocation can be at the beginning of
-    // mvm_call). Otherwise we could just malloc, which has the advantage of
-    // simplicity and we can grow the stack at any time.
-    //
-    // Rather than a segmented stack, it might also be simpler to just grow the
-    // stack size and copy across old data. This has the advantage of keeping
-    // the GC simple.
-    return vm_newError(vm, MVM_E_STACK_OVERFLOW);
+    // Note: the registers must not be cached here if the stack may grow
+    VM_ASSERT(vm, pStackPointer == vm->stack->reg.pStackPointer);
+    return vm_growStack(vm, sizeRequiredInWords);
   }
 
   // Stack high-water mark
@@ -6777,8 +10386,87 @@ static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t si
   if (stackHighWaterMark > vm->stackHighWaterMark) {
     vm->stackHighWaterMark = stackHighWaterMark;
   }
+  if (pStackHighWaterMark > vm->stack->pCheckedLimit) {
+    vm->stack->pCheckedLimit = pStackHighWaterMark;
+  }
+
+  return MVM_E_SUCCESS;
+}
+
+/**
+ * Grows the stack so that there is space for the given number of words above
+ * the stack pointer. The stack grows geometrically (doubling) up to
+ * `vm->maxStackSize`. Growing moves the stack, so the registers must not be
+ * cached, and any other pointers into the stack need to be calculated again.
+ *
+ * All the pointers into the stack that are kept in the stack itself are
+ * relative (frame sizes and catch target offsets), so only the registers need
+ * to be adjusted.
+ */
+static TeError vm_growStack(VM* vm, uint16_t sizeRequiredInWords) {
+  CODE_COVERAGE_UNTESTED(814); // Not hit
+  vm_TsStack* oldStack = vm->stack;
+  VM_ASSERT(vm, oldStack && !oldStack->reg.usingCachedRegisters);
+
+  uint16_t* pStackPointer = oldStack->reg.pStackPointer;
+  uint16_t usedSize = (uint16_t)((uint8_t*)pStackPointer - (uint8_t*)getBottomOfStack(oldStack));
+  uint32_t requiredSize = (uint32_t)usedSize + (uint32_t)sizeRequiredInWords * 2;
+
+  if (requiredSize <= oldStack->capacity) {
+    CODE_COVERAGE_UNTESTED(815); // Not hit
+    return vm_requireStackSpace(vm, pStackPointer, sizeRequiredInWords);
+  }
+
+  // The host holds pointers into the stack (the arguments and result slot of a
+  // host function call), so it can't be moved
+  if ((requiredSize > vm->maxStackSize) || vm->activeHostCallCount) {
+    CODE_COVERAGE_ERROR_PATH(816); // Not hit
+    return vm_newError(vm, MVM_E_STACK_OVERFLOW);
+  }
+
+  uint32_t newCapacity = (uint32_t)oldStack->capacity * 2;
+  if (newCapacity < requiredSize) newCapacity = requiredSize;
+  if (newCapacity > vm->maxStackSize) newCapacity = vm->maxStackSize;
+  newCapacity &= ~1u; // Whole words
+
+  vm_TsStack* newStack = vm_malloc(vm, sizeof (vm_TsStack) + newCapacity);
+  if (!newStack) {
+    CODE_COVERAGE_ERROR_PATH(817); // Not hit
+    return vm_newError(vm, MVM_E_MALLOC_FAIL);
+  }
 
-  return MVM_E_SUCCESS;
+  // Only the used part of the stack needs to be copied
+  memcpy(newStack, oldStack, sizeof (vm_TsStack) + usedSize);
+  newStack->capacity = (uint16_t)newCapacity;
+  newStack->pCheckedLimit = getBottomOfStack(newStack) + (oldStack->pCheckedLimit - getBottomOfStack(oldStack));
+  vm_rebaseRegisters(&newStack->reg, oldStack, newStack);
+  vm_free(vm, oldStack);
+  vm->stack = newStack;
+
+  return vm_requireStackSpace(vm, newStack->reg.pStackPointer, sizeRequiredInWords);
+}
+
+/**
+ * Adjusts the pointers in the given registers from pointing into `oldStack` to
+ * pointing into `newStack`. Note that `oldStack` may already be freed, so it's
+ * only used for its address.
+ */
+static void vm_rebaseRegisters(vm_TsRegisters* reg, vm_TsStack* oldStack, vm_TsStack* newStack) {
+  CODE_COVERAGE_UNTESTED(818); // Not hit
+  intptr_t delta = (intptr_t)newStack - (intptr_t)oldStack;
+  #define VM_REBASE(p) if (p) p = (void*)((intptr_t)(p) + delta)
+  VM_REBASE(reg->pFrameBase);
+  VM_REBASE(reg->pStackPointer);
+  VM_REBASE(reg->pArgs);
+  VM_REBASE(reg->pCatchTarget);
+  #undef VM_REBASE
+}
+
+void mvm_setMaxStackSize(VM* vm, uint16_t maxStackSize) {
+  CODE_COVERAGE_UNTESTED(819); // Not hit
+  if (maxStackSize > MVM_MAX_STACK_SIZE) maxStackSize = MVM_MAX_STACK_SIZE;
+  if (maxStackSize < MVM_STACK_SIZE) maxStackSize = MVM_STACK_SIZE;
+  vm->maxStackSize = maxStackSize;
 }
 
 TeError vm_resolveExport(VM* vm, mvm_VMExportID id, Value* result) {
@@ -6955,7 +10643,8 @@ static Value vm_convertToString(VM* vm, Value value) {
       CODE_COVERAGE(250); // Hit
       return value;
     }
-    case TC_REF_PROPERTY_LIST: {
+    case TC_REF_PROPERTY_LIST:
+    case TC_REF_SHAPED_OBJECT: {
       CODE_COVERAGE_UNTESTED(251); // Not hit
       constStr = "[Object]";
       break;
@@ -7238,11 +10927,9 @@ bool mvm_toBool(VM* vm, Value value) {
       return MVM_E_FATAL_ERROR_MUST_KILL_VM;
 
     }
-    case TC_REF_RESERVED_1: {
+    case TC_REF_SHAPED_OBJECT: {
       CODE_COVERAGE_UNTESTED(610); // Not hit
-      VM_RESERVED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
-
+      return true;
     }
     case TC_VAL_UNDEFINED: {
       CODE_COVERAGE(315); // Hit
@@ -7330,6 +11017,108 @@ static inline mvm_HostFunctionID vm_getHostFunctionId(VM* vm, uint16_t hostFunct
   return LongPtr_read2_aligned(lpImportTableEntry);
 }
 
+// Calls the resolved import at the given index. The registers must be flushed.
+static inline TeError vm_callHostFunction(VM* vm, uint16_t importIndex, Value* pResult, Value* pArgs, uint8_t argCount) {
+  mvm_TfHostFunction hostFunction = vm_getResolvedImports(vm)[importIndex];
+  mvm_HostFunctionID hostFunctionID = vm_getHostFunctionId(vm, importIndex);
+  #if MVM_HOST_FUNCTION_SIGNATURES
+  const char* signature = vm->pImportSignatures[importIndex];
+  if (signature) {
+    CODE_COVERAGE_UNTESTED(827); // Not hit
+    // The resolved import table holds the typed function for these imports
+    return vm_callTypedHostFunction(vm, (mvm_TfTypedHostFunction)(void (*)(void))hostFunction,
+      signature, hostFunctionID, pResult, pArgs, argCount);
+  }
+  #endif // MVM_HOST_FUNCTION_SIGNATURES
+  return hostFunction(vm, hostFunctionID, pResult, pArgs, argCount);
+}
+
+#if MVM_HOST_FUNCTION_SIGNATURES
+static bool vm_isValidHostSignature(const char* signature) {
+  CODE_COVERAGE_UNTESTED(828); // Not hit
+  size_t count = 0;
+  for (const char* p = signature; *p; p++) {
+    switch (*p) {
+      case 'i': case 'b': case 'S': case 'v':
+      #if MVM_SUPPORT_FLOAT
+      case 'f':
+      #endif
+        break;
+      default:
+        CODE_COVERAGE_ERROR_PATH(829); // Not hit
+        return false;
+    }
+    count++;
+  }
+  return count <= MVM_HOST_SIGNATURE_MAX_ARGS;
+}
+
+/**
+ * Calls a host function that was resolved with a signature, converting each
+ * argument to the native type given by the signature.
+ */
+static TeError vm_callTypedHostFunction(VM* vm, mvm_TfTypedHostFunction hostFunction, const char* signature, mvm_HostFunctionID hostFunctionID, Value* pResult, Value* pArgs, uint8_t argCount) {
+  CODE_COVERAGE_UNTESTED(830); // Not hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  mvm_TuHostArg args[MVM_HOST_SIGNATURE_MAX_ARGS];
+  const char* p;
+  uint8_t i;
+
+  // Converting a non-string to a string may allocate, and so collect garbage,
+  // which would invalidate any string pointers and `v` values already
+  // converted. So the strings are converted first, in place (the arguments
+  // are on the VM stack, so the GC keeps them up to date).
+  for (p = signature, i = 0; *p && (i < argCount); p++, i++) {
+    if (*p == 'S') {
+      CODE_COVERAGE_UNTESTED(831); // Not hit
+      pArgs[i] = vm_convertToString(vm, pArgs[i]);
+    }
+  }
+
+  for (p = signature, i = 0; *p; p++, i++) {
+    Value arg = (i < argCount) ? pArgs[i] : VM_VALUE_UNDEFINED;
+    mvm_TuHostArg* pArg = &args[i];
+    switch (*p) {
+      case 'i': {
+        CODE_COVERAGE_UNTESTED(832); // Not hit
+        // Small integers are by far the most common case
+        if (Value_isVirtualInt14(arg)) {
+          pArg->int32 = VirtualInt14_decode(vm, arg);
+        } else {
+          pArg->int32 = mvm_toInt32(vm, arg);
+        }
+        break;
+      }
+      case 'b': {
+        CODE_COVERAGE_UNTESTED(833); // Not hit
+        pArg->boolean = mvm_toBool(vm, arg);
+        break;
+      }
+      case 'S': {
+        CODE_COVERAGE_UNTESTED(834); // Not hit
+        pArg->str = mvm_toStringUtf8(vm, arg, NULL);
+        break;
+      }
+      case 'v': {
+        CODE_COVERAGE_UNTESTED(835); // Not hit
+        pArg->value = arg;
+        break;
+      }
+      #if MVM_SUPPORT_FLOAT
+      case 'f': {
+        CODE_COVERAGE_UNTESTED(836); // Not hit
+        pArg->float64 = mvm_toFloat64(vm, arg);
+        break;
+      }
+      #endif
+      default: VM_ASSERT_UNREACHABLE(vm); // Checked by vm_isValidHostSignature
+    }
+  }
+
+  return hostFunction(vm, hostFunctionID, pResult, args);
+}
+#endif // MVM_HOST_FUNCTION_SIGNATURES
+
 mvm_TeType mvm_typeOf(VM* vm, Value value) {
   TeTypeCode tc = deepTypeOf(vm, value);
   VM_ASSERT(vm, tc < sizeof typeByTC);
@@ -7596,6 +11385,7 @@ static void setSlot_long(VM* vm, LongPtr lpSlot, Value value) {
     (lpSlot >= LongPtr_add(vm->lpBytecode, getBytecodeSize(vm))));
 
   *pSlot = value;
+  VM_WRITE_BARRIER(vm, pSlot);
 }
 
 static void setBuiltin(VM* vm, mvm_TeBuiltins builtinID, Value value) {
@@ -7605,6 +11395,386 @@ static void setBuiltin(VM* vm, mvm_TeBuiltins builtinID, Value value) {
   setSlot_long(vm, lpBuiltin, value);
 }
 
+#if MVM_OBJECT_SHAPES
+// Number of keys in the given shape
+static inline uint16_t vm_shapeKeyCount(Value* pShape) {
+  return vm_getAllocationSize(pShape) / 2 - VM_SHAPE_KEYS;
+}
+
+// Index of the given key in the shape, or -1 if the shape doesn't have it
+static int16_t vm_shapeFindKey(Value* pShape, Value key) {
+  uint16_t keyCount = vm_shapeKeyCount(pShape);
+  Value* pKey = &pShape[VM_SHAPE_KEYS];
+  for (uint16_t i = 0; i < keyCount; i++) {
+    if (*pKey++ == key) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// The slot holding the value at the given index of a shaped object, following
+// the chain of cells that have been appended to it
+static Value* vm_shapedObjectSlot(VM* vm, TsShapedObject* pObject, uint16_t index) {
+  while (true) {
+    uint16_t valueCount = (vm_getAllocationSize(pObject) - sizeof (TsShapedObject)) / 2;
+    if (index < valueCount) {
+      return &((Value*)(pObject + 1))[index];
+    }
+    index -= valueCount;
+    VM_ASSERT(vm, pObject->dpNext != VM_VALUE_NULL);
+    pObject = DynamicPtr_decode_native(vm, pObject->dpNext);
+  }
+}
+
+// Finds the root shape (the shape with no keys) for the given prototype, or
+// returns VM_VALUE_NULL if there isn't one yet
+static Value vm_findRootShape(VM* vm, Value proto) {
+  Value shape = vm->shapeRoots;
+  while (shape != VM_VALUE_NULL) {
+    Value* pShape = ShortPtr_decode(vm, shape);
+    if (pShape[VM_SHAPE_PROTO] == proto) {
+      return shape;
+    }
+    shape = pShape[VM_SHAPE_NEXT_SIBLING];
+  }
+  return VM_VALUE_NULL;
+}
+
+/**
+ * Allocates an empty shaped object with the prototype at `*pProto`. Objects
+ * with the same prototype start with the same (root) shape.
+ *
+ * Note: this may trigger a GC cycle, so `pProto` must point to a GC-reachable
+ * slot (or a value that isn't a pointer to GC memory).
+ */
+static Value vm_newShapedObject(VM* vm, Value* pProto) {
+  if (vm_findRootShape(vm, *pProto) == VM_VALUE_NULL) {
+    CODE_COVERAGE(799); // Not hit
+    // Root shapes are always linked into the shape tree, so the number of them
+    // is the number of distinct prototypes of shaped objects
+    Value* pShape = mvm_allocate(vm, VM_SHAPE_KEYS * 2, TC_REF_FIXED_LENGTH_ARRAY);
+    pShape[VM_SHAPE_PROTO] = *pProto;
+    pShape[VM_SHAPE_FIRST_CHILD] = VM_VALUE_NULL;
+    pShape[VM_SHAPE_NEXT_SIBLING] = vm->shapeRoots;
+    vm->shapeRoots = ShortPtr_encode(vm, pShape);
+  }
+
+  TsShapedObject* pObject = GC_ALLOCATE_TYPE(vm, TsShapedObject, TC_REF_SHAPED_OBJECT);
+  pObject->dpNext = VM_VALUE_NULL;
+  // Note: the root shape can't be collected, but may have been moved by the
+  // allocation
+  pObject->spShape = vm_findRootShape(vm, *pProto);
+  VM_ASSERT(vm, pObject->spShape != VM_VALUE_NULL);
+  return ShortPtr_encode(vm, pObject);
+}
+
+/**
+ * Changes the shape of the object at `*pObject` to one that has the additional
+ * key `*pKey`, following an existing transition from the current shape if
+ * there is one.
+ *
+ * New shapes are linked into the shape tree (so that later objects can share
+ * them) until there are MVM_SHARED_SHAPE_LIMIT of them. After that, new shapes
+ * are private to the object and are collected with it.
+ *
+ * Note: this may trigger a GC cycle, so the pointers must be to GC-reachable
+ * slots.
+ */
+static void vm_shapedObjectAddKey(VM* vm, Value* pObject, Value* pKey) {
+  TsShapedObject* pShapedObject = DynamicPtr_decode_native(vm, *pObject);
+  Value* pParent = ShortPtr_decode(vm, pShapedObject->spShape);
+  uint16_t parentSize = vm_getAllocationSize(pParent);
+  // The new key is in the slot after the last slot of the parent
+  uint16_t keySlot = parentSize / 2;
+
+  Value child = pParent[VM_SHAPE_FIRST_CHILD];
+  if (child != VM_VALUE_DELETED) {
+    while (child != VM_VALUE_NULL) {
+      Value* pChild = ShortPtr_decode(vm, child);
+      if (pChild[keySlot] == *pKey) {
+        CODE_COVERAGE(797); // Not hit
+        pShapedObject->spShape = child;
+        VM_WRITE_BARRIER(vm, &pShapedObject->spShape);
+        return;
+      }
+      child = pChild[VM_SHAPE_NEXT_SIBLING];
+    }
+  }
+  CODE_COVERAGE(798); // Not hit
+
+  Value* pChild = mvm_allocate(vm, parentSize + 2, TC_REF_FIXED_LENGTH_ARRAY);
+  // Invalidated by potential GC collection
+  pShapedObject = DynamicPtr_decode_native(vm, *pObject);
+  pParent = ShortPtr_decode(vm, pShapedObject->spShape);
+
+  memcpy(pChild, pParent, parentSize);
+  pChild[keySlot] = *pKey;
+  // A shape that isn't in the tree is marked with VM_VALUE_DELETED in place of
+  // the list of transitions, and so are all the shapes derived from it
+  if ((pParent[VM_SHAPE_FIRST_CHILD] != VM_VALUE_DELETED) &&
+    (vm->sharedShapeCount < MVM_SHARED_SHAPE_LIMIT)
+  ) {
+    vm->sharedShapeCount++;
+    pChild[VM_SHAPE_FIRST_CHILD] = VM_VALUE_NULL;
+    pChild[VM_SHAPE_NEXT_SIBLING] = pParent[VM_SHAPE_FIRST_CHILD];
+    pParent[VM_SHAPE_FIRST_CHILD] = ShortPtr_encode(vm, pChild);
+    VM_WRITE_BARRIER(vm, &pParent[VM_SHAPE_FIRST_CHILD]);
+  } else {
+    pChild[VM_SHAPE_FIRST_CHILD] = VM_VALUE_DELETED;
+    pChild[VM_SHAPE_NEXT_SIBLING] = VM_VALUE_NULL;
+  }
+  pShapedObject->spShape = ShortPtr_encode(vm, pChild);
+  VM_WRITE_BARRIER(vm, &pShapedObject->spShape);
+}
+#endif // MVM_OBJECT_SHAPES
+
+#if MVM_INLINE_CACHE
+static void vm_inlineCacheClear(VM* vm) {
+  CODE_COVERAGE(780); // Not hit
+  if (vm->pInlineCache) {
+    memset(vm->pInlineCache, 0, MVM_INLINE_CACHE_SIZE * sizeof (vm_TsInlineCacheEntry));
+  }
+}
+
+// Returns the inline cache entry to use for the given site, or NULL if the
+// cache can't be allocated
+static vm_TsInlineCacheEntry* vm_inlineCacheEntry(VM* vm, uint16_t site) {
+  if (!vm->pInlineCache) {
+    CODE_COVERAGE(781); // Not hit
+    vm->pInlineCache = vm_malloc(vm, MVM_INLINE_CACHE_SIZE * sizeof (vm_TsInlineCacheEntry));
+    if (!vm->pInlineCache) return NULL;
+    vm_inlineCacheClear(vm);
+  }
+  return &vm->pInlineCache[site & (MVM_INLINE_CACHE_SIZE - 1)];
+}
+
+// Searches a single object (not its prototypes) for the given property
+static bool vm_findOwnPropertySlot(VM* vm, LongPtr lpPropertyList, Value propertyName, LongPtr* out_lpSlot) {
+  while (true) {
+    uint16_t headerWord = readAllocationHeaderWord_long(lpPropertyList);
+    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+    uint16_t propCount = (size - sizeof (TsPropertyList)) / 4;
+
+    LongPtr p = LongPtr_add(lpPropertyList, sizeof (TsPropertyList));
+    while (propCount--) {
+      if (LongPtr_read2_aligned(p) == propertyName) {
+        *out_lpSlot = LongPtr_add(p, 2);
+        return true;
+      }
+      p = LongPtr_add(p, 4);
+    }
+
+    DynamicPtr dpNext = READ_FIELD_2(lpPropertyList, TsPropertyList, dpNext);
+    if (dpNext == VM_VALUE_NULL) {
+      return false;
+    }
+    lpPropertyList = DynamicPtr_decode_long(vm, dpNext);
+  }
+}
+
+// True if the given value is already in the form that `toPropertyName` would
+// convert it to, so that it can be compared directly with property keys. The
+// `__proto__` key is excluded because it isn't stored as a property.
+static bool vm_isCanonicalPropertyName(VM* vm, Value propertyName) {
+  if (Value_isVirtualInt14(propertyName)) {
+    return VirtualInt14_decode(vm, propertyName) >= 0;
+  }
+  return (propertyName == VM_VALUE_STR_LENGTH) ||
+    (deepTypeOf(vm, propertyName) == TC_REF_INTERNED_STRING);
+}
+
+/**
+ * Fast path for reading a property of an ordinary object (TC_REF_PROPERTY_LIST)
+ * at the given site. Returns false if the access must go through `getProperty`
+ * instead. Unlike `getProperty`, this never triggers a GC cycle.
+ *
+ * Each site remembers the slot where it last found the property. For an own
+ * property, the cached slot is used if the object is the same one. For an
+ * inherited property, it's used if the object has the same prototype and
+ * doesn't have the property itself, which skips the search of the prototype
+ * chain. Prototypes in ROM can't gain properties, but if the chain passes
+ * through RAM then the entry is also invalidated by any property addition.
+ */
+static bool vm_inlineCacheGet(VM* vm, uint16_t site, Value objectValue, Value propertyName, Value* out_value) {
+  LongPtr lpObject;
+  LongPtr lpSlot;
+  vm_TsInlineCacheEntry* pEntry = vm_inlineCacheEntry(vm, site);
+  if (!pEntry) return false;
+
+  if ((pEntry->site == site) && (pEntry->propertyName == propertyName)) {
+    if (!(pEntry->flags & VM_IC_INHERITED)) {
+      if (pEntry->object == objectValue) {
+        CODE_COVERAGE(782); // Not hit
+        *out_value = LongPtr_read2_aligned(pEntry->lpSlot);
+        return true;
+      }
+      #if MVM_OBJECT_SHAPES
+      if ((pEntry->flags & VM_IC_SHAPE) && (deepTypeOf(vm, objectValue) == TC_REF_SHAPED_OBJECT)) {
+        TsShapedObject* pObject = DynamicPtr_decode_native(vm, objectValue);
+        if (pObject->spShape == pEntry->shape) {
+          CODE_COVERAGE(801); // Not hit
+          // Same shape, so the value is at the same index
+          pEntry->object = objectValue;
+          pEntry->lpSlot = LongPtr_new(vm_shapedObjectSlot(vm, pObject, pEntry->index));
+          *out_value = LongPtr_read2_aligned(pEntry->lpSlot);
+          return true;
+        }
+      }
+      #endif // MVM_OBJECT_SHAPES
+    } else if (deepTypeOf(vm, objectValue) == TC_REF_PROPERTY_LIST) {
+      lpObject = DynamicPtr_decode_long(vm, objectValue);
+      if ((READ_FIELD_2(lpObject, TsPropertyList, dpProto) == pEntry->object) &&
+        (!(pEntry->flags & VM_IC_CHECK_EPOCH) || (pEntry->epoch == vm->inlineCacheEpoch)) &&
+        !vm_findOwnPropertySlot(vm, lpObject, propertyName, &lpSlot)
+      ) {
+        CODE_COVERAGE(783); // Not hit
+        *out_value = LongPtr_read2_aligned(pEntry->lpSlot);
+        return true;
+      }
+    }
+  }
+  CODE_COVERAGE(784); // Not hit
+
+  // Cache miss. Do the lookup and remember where the property was found.
+  #if MVM_OBJECT_SHAPES
+  if (deepTypeOf(vm, objectValue) == TC_REF_SHAPED_OBJECT) {
+    // Only own properties of shaped objects are cached
+    if (!vm_isCanonicalPropertyName(vm, propertyName)) return false;
+    TsShapedObject* pObject = DynamicPtr_decode_native(vm, objectValue);
+    int16_t index = vm_shapeFindKey(ShortPtr_decode(vm, pObject->spShape), propertyName);
+    if (index < 0) return false;
+    pEntry->site = site;
+    pEntry->propertyName = propertyName;
+    pEntry->object = objectValue;
+    pEntry->flags = VM_IC_SHAPE;
+    pEntry->index = index;
+    pEntry->shape = pObject->spShape;
+    pEntry->lpSlot = LongPtr_new(vm_shapedObjectSlot(vm, pObject, index));
+    *out_value = LongPtr_read2_aligned(pEntry->lpSlot);
+    return true;
+  }
+  #endif // MVM_OBJECT_SHAPES
+  if (deepTypeOf(vm, objectValue) != TC_REF_PROPERTY_LIST) return false;
+  if (!vm_isCanonicalPropertyName(vm, propertyName)) return false;
+
+  lpObject = DynamicPtr_decode_long(vm, objectValue);
+  uint8_t flags = 0;
+  Value object = objectValue;
+  if (!vm_findOwnPropertySlot(vm, lpObject, propertyName, &lpSlot)) {
+    flags = VM_IC_INHERITED;
+    object = READ_FIELD_2(lpObject, TsPropertyList, dpProto);
+    uint16_t globalsOffset = getSectionOffset(vm->lpBytecode, BCS_GLOBALS);
+    DynamicPtr dpProto = object;
+    while (true) {
+      if (dpProto == VM_VALUE_NULL) {
+        // Not found. Leave it to `getProperty`, which has the same result.
+        return false;
+      }
+      // In RAM if it's a short pointer or a handle in the globals section
+      if (Value_isShortPtr(dpProto) || ((dpProto & 0xFFFE) >= globalsOffset)) {
+        flags |= VM_IC_CHECK_EPOCH;
+      }
+      #if MVM_OBJECT_SHAPES
+      // Prototype chains through shaped objects are left to `getProperty`
+      if (deepTypeOf(vm, dpProto) != TC_REF_PROPERTY_LIST) return false;
+      #endif
+      LongPtr lpProto = DynamicPtr_decode_long(vm, dpProto);
+      if (vm_findOwnPropertySlot(vm, lpProto, propertyName, &lpSlot)) {
+        break;
+      }
+      dpProto = READ_FIELD_2(lpProto, TsPropertyList, dpProto);
+    }
+  }
+
+  pEntry->site = site;
+  pEntry->propertyName = propertyName;
+  pEntry->object = object;
+  pEntry->epoch = vm->inlineCacheEpoch;
+  pEntry->flags = flags;
+  pEntry->lpSlot = lpSlot;
+
+  *out_value = LongPtr_read2_aligned(lpSlot);
+  return true;
+}
+
+/**
+ * Fast path for assigning an existing own property of an ordinary object in
+ * RAM, at the given site. Returns false if the assignment must go through
+ * `setProperty` instead (including when the property needs to be added).
+ */
+static bool vm_inlineCacheSet(VM* vm, uint16_t site, Value objectValue, Value propertyName, Value value) {
+  LongPtr lpSlot;
+  vm_TsInlineCacheEntry* pEntry = vm_inlineCacheEntry(vm, site);
+  if (!pEntry) return false;
+
+  if ((pEntry->site == site) && (pEntry->propertyName == propertyName)) {
+    if (pEntry->object == objectValue) {
+      CODE_COVERAGE(785); // Not hit
+      VM_ASSERT(vm, !(pEntry->flags & VM_IC_INHERITED));
+      Value* pSlot = (Value*)LongPtr_truncate(vm, pEntry->lpSlot);
+      *pSlot = value;
+      VM_WRITE_BARRIER(vm, pSlot);
+      return true;
+    }
+    #if MVM_OBJECT_SHAPES
+    if ((pEntry->flags & VM_IC_SHAPE) && (deepTypeOf(vm, objectValue) == TC_REF_SHAPED_OBJECT)) {
+      TsShapedObject* pObject = DynamicPtr_decode_native(vm, objectValue);
+      if (pObject->spShape == pEntry->shape) {
+        CODE_COVERAGE(802); // Not hit
+        // Same shape, so the value is at the same index
+        pEntry->object = objectValue;
+        pEntry->lpSlot = LongPtr_new(vm_shapedObjectSlot(vm, pObject, pEntry->index));
+        Value* pSlot = (Value*)LongPtr_truncate(vm, pEntry->lpSlot);
+        *pSlot = value;
+        VM_WRITE_BARRIER(vm, pSlot);
+        return true;
+      }
+    }
+    #endif // MVM_OBJECT_SHAPES
+  }
+  CODE_COVERAGE(786); // Not hit
+
+  // Objects that are written to must be in RAM. Objects referenced through a
+  // handle are left to `setProperty`.
+  if (!Value_isShortPtr(objectValue)) return false;
+  #if MVM_OBJECT_SHAPES
+  if (deepTypeOf(vm, objectValue) == TC_REF_SHAPED_OBJECT) {
+    // Existing own properties only. Adding a property changes the shape.
+    if (!vm_isCanonicalPropertyName(vm, propertyName)) return false;
+    TsShapedObject* pObject = ShortPtr_decode(vm, objectValue);
+    int16_t index = vm_shapeFindKey(ShortPtr_decode(vm, pObject->spShape), propertyName);
+    if (index < 0) return false;
+    pEntry->site = site;
+    pEntry->propertyName = propertyName;
+    pEntry->object = objectValue;
+    pEntry->flags = VM_IC_SHAPE;
+    pEntry->index = index;
+    pEntry->shape = pObject->spShape;
+    pEntry->lpSlot = LongPtr_new(vm_shapedObjectSlot(vm, pObject, index));
+    Value* pSlot = (Value*)LongPtr_truncate(vm, pEntry->lpSlot);
+    *pSlot = value;
+    VM_WRITE_BARRIER(vm, pSlot);
+    return true;
+  }
+  #endif // MVM_OBJECT_SHAPES
+  if (deepTypeOf(vm, objectValue) != TC_REF_PROPERTY_LIST) return false;
+  if (!vm_isCanonicalPropertyName(vm, propertyName)) return false;
+  if (!vm_findOwnPropertySlot(vm, DynamicPtr_decode_long(vm, objectValue), propertyName, &lpSlot)) return false;
+
+  pEntry->site = site;
+  pEntry->propertyName = propertyName;
+  pEntry->object = objectValue;
+  pEntry->flags = 0;
+  pEntry->lpSlot = lpSlot;
+
+  Value* pSlot = (Value*)LongPtr_truncate(vm, lpSlot);
+  *pSlot = value;
+  VM_WRITE_BARRIER(vm, pSlot);
+  return true;
+}
+#endif // MVM_INLINE_CACHE
+
 // Warning: this function trashes the word at pObjectValue, which happens when
 // traversing the prototype chain.
 //
@@ -7712,6 +11882,13 @@ SUB_GET_PROPERTY:
           lpPropertyList = DynamicPtr_decode_long(vm, dpProto);
           if (lpPropertyList) {
             CODE_COVERAGE(538); // Hit
+            #if MVM_OBJECT_SHAPES
+            if (deepTypeOf(vm, dpProto) == TC_REF_SHAPED_OBJECT) {
+              CODE_COVERAGE_UNTESTED(792); // Not hit
+              *pObjectValue = dpProto;
+              goto SUB_GET_PROPERTY;
+            }
+            #endif
             dpProto = READ_FIELD_2(lpPropertyList, TsPropertyList, dpProto);
           } else {
             CODE_COVERAGE(539); // Hit
@@ -7724,6 +11901,36 @@ SUB_GET_PROPERTY:
       return MVM_E_SUCCESS;
     }
 
+    #if MVM_OBJECT_SHAPES
+    case TC_REF_SHAPED_OBJECT: {
+      TsShapedObject* pObject = DynamicPtr_decode_native(vm, objectValue);
+      Value* pShape = ShortPtr_decode(vm, pObject->spShape);
+
+      if (propertyName == VM_VALUE_STR_PROTO) {
+        CODE_COVERAGE_UNIMPLEMENTED(791); // Not hit
+        *out_propertyValue = pShape[VM_SHAPE_PROTO];
+        return MVM_E_SUCCESS;
+      }
+
+      int16_t index = vm_shapeFindKey(pShape, propertyName);
+      if (index >= 0) {
+        CODE_COVERAGE(790); // Not hit
+        VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+        *out_propertyValue = *vm_shapedObjectSlot(vm, pObject, index);
+        return MVM_E_SUCCESS;
+      }
+
+      // Otherwise try read from the prototype
+      *pObjectValue = pShape[VM_SHAPE_PROTO];
+      if (*pObjectValue != VM_VALUE_NULL) {
+        CODE_COVERAGE_UNTESTED(787); // Not hit
+        goto SUB_GET_PROPERTY;
+      }
+      *out_propertyValue = VM_VALUE_UNDEFINED;
+      return MVM_E_SUCCESS;
+    }
+    #endif // MVM_OBJECT_SHAPES
+
     case TC_REF_ARRAY: {
       CODE_COVERAGE(363); // Hit
 
@@ -7866,6 +12073,7 @@ static void growArray(VM* vm, Value* pvArr, uint16_t newLength, uint16_t newCapa
     *p++ = VM_VALUE_DELETED;
   }
   arr->dpData = ShortPtr_encode(vm, pNewData);
+  VM_WRITE_BARRIER(vm, &arr->dpData);
   arr->viLength = VirtualInt14_encode(vm, newLength);
 }
 
@@ -7892,6 +12100,22 @@ SUB_OBJECT_KEYS:
   }
   CODE_COVERAGE(638); // Hit
 
+  #if MVM_OBJECT_SHAPES
+  if (tc == TC_REF_SHAPED_OBJECT) {
+    CODE_COVERAGE(795); // Not hit
+    // The keys are already in the shape. Shaped objects don't have internal
+    // properties.
+    TsShapedObject* pObject = DynamicPtr_decode_native(vm, obj);
+    uint16_t keyCount = vm_shapeKeyCount(ShortPtr_decode(vm, pObject->spShape));
+    // An empty allocation is illegal (see below)
+    Value* pArr = mvm_allocate(vm, keyCount ? keyCount * 2 : 1, TC_REF_FIXED_LENGTH_ARRAY);
+    pObject = DynamicPtr_decode_native(vm, *inout_slot); // Invalidated by potential GC collection
+    memcpy(pArr, &((Value*)ShortPtr_decode(vm, pObject->spShape))[VM_SHAPE_KEYS], keyCount * 2);
+    *inout_slot = ShortPtr_encode(vm, pArr);
+    return MVM_E_SUCCESS;
+  }
+  #endif // MVM_OBJECT_SHAPES
+
   if (tc != TC_REF_PROPERTY_LIST) {
     CODE_COVERAGE_ERROR_PATH(639); // Not hit
     return MVM_E_OBJECT_KEYS_ON_NON_OBJECT;
@@ -8072,6 +12296,7 @@ SUB_SET_PROPERTY:
           if (key == MVM_GET_LOCAL(vPropertyName)) {
             CODE_COVERAGE(368); // Hit
             *p = MVM_GET_LOCAL(vPropertyValue);
+            VM_WRITE_BARRIER(vm, p);
             VM_EXEC_SAFE_MODE(*pObject = VM_VALUE_NULL);
             return MVM_E_SUCCESS;
           } else {
@@ -8133,9 +12358,62 @@ SUB_SET_PROPERTY:
       // Note: `pPropertyList` currently points to the last property list in
       // the chain.
       MVM_GET_LOCAL(pPropertyList)->dpNext = spNewCell;
+      VM_WRITE_BARRIER(vm, &MVM_GET_LOCAL(pPropertyList)->dpNext);
+
+      #if MVM_INLINE_CACHE
+      // The new property may shadow an inherited property that's been cached
+      vm->inlineCacheEpoch++;
+      if (!vm->inlineCacheEpoch) {
+        CODE_COVERAGE_UNTESTED(779); // Not hit
+        vm_inlineCacheClear(vm);
+      }
+      #endif
+
       VM_EXEC_SAFE_MODE(*pObject = VM_VALUE_NULL);
       return MVM_E_SUCCESS;
     }
+
+    #if MVM_OBJECT_SHAPES
+    case TC_REF_SHAPED_OBJECT: {
+      if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_PROTO) {
+        CODE_COVERAGE_UNIMPLEMENTED(800); // Not hit
+        VM_NOT_IMPLEMENTED(vm);
+        return MVM_E_FATAL_ERROR_MUST_KILL_VM;
+      }
+
+      TsShapedObject* pShapedObject = DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue));
+      int16_t index = vm_shapeFindKey(ShortPtr_decode(vm, pShapedObject->spShape), MVM_GET_LOCAL(vPropertyName));
+      if (index >= 0) {
+        CODE_COVERAGE(793); // Not hit
+        Value* pSlot = vm_shapedObjectSlot(vm, pShapedObject, index);
+        *pSlot = MVM_GET_LOCAL(vPropertyValue);
+        VM_WRITE_BARRIER(vm, pSlot);
+        VM_EXEC_SAFE_MODE(*pObject = VM_VALUE_NULL);
+        return MVM_E_SUCCESS;
+      }
+      CODE_COVERAGE(794); // Not hit
+
+      // A new property. The value is appended in a new cell and then the object
+      // transitions to a shape with the new key. Both steps may trigger a GC
+      // cycle, after which the chain may have been compacted.
+      TsShapedObject* pNewCell = mvm_allocate(vm, sizeof (TsShapedObject) + 2, TC_REF_SHAPED_OBJECT);
+      pShapedObject = DynamicPtr_decode_native(vm, *pObject);
+      while (pShapedObject->dpNext != VM_VALUE_NULL) {
+        pShapedObject = DynamicPtr_decode_native(vm, pShapedObject->dpNext);
+      }
+      pNewCell->dpNext = VM_VALUE_NULL;
+      pNewCell->spShape = VM_VALUE_NULL; // Not used because this is a child cell
+      *(Value*)(pNewCell + 1) = *pPropertyValue;
+      pShapedObject->dpNext = ShortPtr_encode(vm, pNewCell);
+      VM_WRITE_BARRIER(vm, &pShapedObject->dpNext);
+
+      vm_shapedObjectAddKey(vm, pObject, pPropertyName);
+
+      VM_EXEC_SAFE_MODE(*pObject = VM_VALUE_NULL);
+      return MVM_E_SUCCESS;
+    }
+    #endif // MVM_OBJECT_SHAPES
+
     case TC_REF_ARRAY: {
       CODE_COVERAGE(370); // Hit
 
@@ -8246,6 +12524,7 @@ SUB_SET_PROPERTY:
 
         // Write the item to memory
         MVM_GET_LOCAL(pData)[(uint16_t)index] = MVM_GET_LOCAL(vPropertyValue);
+        VM_WRITE_BARRIER(vm, &MVM_GET_LOCAL(pData)[(uint16_t)index]);
 
         VM_EXEC_SAFE_MODE(*pObject = VM_VALUE_NULL);
         return MVM_E_SUCCESS;
@@ -8647,6 +12926,10 @@ TeError toInt32Internal(mvm_VM* vm, mvm_Value value, int32_t* out_result) {
       CODE_COVERAGE(405); // Hit
       return MVM_E_NAN;
     }
+    MVM_CASE(TC_REF_SHAPED_OBJECT): {
+      CODE_COVERAGE_UNTESTED(803); // Not hit
+      return MVM_E_NAN;
+    }
     MVM_CASE(TC_REF_ARRAY): {
       CODE_COVERAGE_UNTESTED(406); // Not hit
       return MVM_E_NAN;
@@ -8793,7 +13076,7 @@ static const TeEqualityAlgorithm equalityAlgorithmByTypeCode[TC_END] = {
   EA_COMPARE_REFERENCE,          // TC_REF_SYMBOL             = 0x8
   EA_NONE,                       // TC_REF_CLASS              = 0x9
   EA_NONE,                       // TC_REF_VIRTUAL            = 0xA
-  EA_NONE,                       // TC_REF_RESERVED_1         = 0xB
+  EA_COMPARE_REFERENCE,          // TC_REF_SHAPED_OBJECT      = 0xB
   EA_COMPARE_REFERENCE,          // TC_REF_PROPERTY_LIST      = 0xC
   EA_COMPARE_REFERENCE,          // TC_REF_ARRAY              = 0xD
   EA_COMPARE_REFERENCE,          // TC_REF_FIXED_LENGTH_ARRAY = 0xE
@@ -9022,6 +13305,22 @@ void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size) {
   if (out_size)
     *out_size = 0;
 
+  #if MVM_FUSE_INSTRUCTIONS && MVM_FUSE_IN_PLACE
+  // The original code has been overwritten (see MVM_FUSE_IN_PLACE)
+  if (vm->fusedInstructionCount) {
+    CODE_COVERAGE_ERROR_PATH(924); // Not hit
+    return NULL;
+  }
+  #endif
+
+  #if MVM_GC_INCREMENTAL
+  // The heap in the snapshot must start at offset 0
+  if (vm->pIncrementalGC || vm->heapStart) {
+    CODE_COVERAGE_UNTESTED(902); // Not hit
+    mvm_runGC(vm, false);
+  }
+  #endif
+
   uint16_t heapOffset = getSectionOffset(vm->lpBytecode, BCS_HEAP);
   uint16_t heapSize = getHeapSize(vm);
 
@@ -9048,7 +13347,12 @@ void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size) {
 
   // The first part of the snapshot doesn't change between executions (except
   // some header fields, which we'll update later).
+  #if MVM_FUSE_INSTRUCTIONS
+  // Fused instructions are not part of the bytecode format
+  memcpy_long(pNewBytecode, vm->lpOriginalBytecode, sizeOfConstantPart);
+  #else
   memcpy_long(pNewBytecode, vm->lpBytecode, sizeOfConstantPart);
+  #endif
 
   // Snapshot the globals memory
   uint16_t sizeOfGlobals = getSectionSize(vm, BCS_GLOBALS);
@@ -9110,36 +13414,61 @@ void mvm_dbg_setBreakpoint(VM* vm, int bytecodeAddress) {
   VM_ASSERT(vm, (bytecodeAddress == - 1) || (bytecodeAddress >= getSectionOffset(vm->lpBytecode, BCS_ROM)));
   VM_ASSERT(vm, (bytecodeAddress == -1) || (bytecodeAddress < getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_ROM))));
 
-  mvm_dbg_removeBreakpoint(vm, bytecodeAddress);
-  TsBreakpoint* breakpoint = vm_malloc(vm, sizeof (TsBreakpoint));
-  if (!breakpoint) {
-    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+  if ((bytecodeAddress != -1) && ((bytecodeAddress < 0) || (bytecodeAddress >= getBytecodeSize(vm)))) {
+    return;
+  }
+
+  if (!vm->pBreakpointBitmap) {
+    // One bit per byte of bytecode
+    uint16_t bitmapSize = (getBytecodeSize(vm) + 7) / 8;
+    vm->pBreakpointBitmap = vm_malloc(vm, bitmapSize);
+    if (!vm->pBreakpointBitmap) {
+      MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+      return;
+    }
+    memset(vm->pBreakpointBitmap, 0, bitmapSize);
+  }
+
+  if (bytecodeAddress == -1) {
+    vm->breakOnEveryInstruction = true;
     return;
   }
-  breakpoint->bytecodeAddress = bytecodeAddress;
-  // Add to linked-list
-  breakpoint->next = vm->pBreakpoints;
-  vm->pBreakpoints = breakpoint;
+
+  uint8_t mask = (uint8_t)(1 << (bytecodeAddress & 7));
+  uint8_t* pBits = &vm->pBreakpointBitmap[bytecodeAddress >> 3];
+  if (!(*pBits & mask)) {
+    *pBits |= mask;
+    vm->breakpointCount++;
+  }
 }
 
 void mvm_dbg_removeBreakpoint(VM* vm, uint16_t bytecodeAddress) {
   CODE_COVERAGE_UNTESTED(589); // Not hit
 
-  TsBreakpoint** ppBreakpoint = &vm->pBreakpoints;
-  TsBreakpoint* pBreakpoint = *ppBreakpoint;
-  while (pBreakpoint) {
-    if (pBreakpoint->bytecodeAddress == bytecodeAddress) {
+  if (!vm->pBreakpointBitmap) {
+    CODE_COVERAGE_UNTESTED(591); // Not hit
+    return;
+  }
+
+  // Address -1 as passed to mvm_dbg_setBreakpoint
+  if (bytecodeAddress == 0xFFFF) {
+    vm->breakOnEveryInstruction = false;
+  } else if (bytecodeAddress < getBytecodeSize(vm)) {
+    uint8_t mask = (uint8_t)(1 << (bytecodeAddress & 7));
+    uint8_t* pBits = &vm->pBreakpointBitmap[bytecodeAddress >> 3];
+    if (*pBits & mask) {
       CODE_COVERAGE_UNTESTED(590); // Not hit
-      // Remove from linked list
-      *ppBreakpoint = pBreakpoint->next;
-      vm_free(vm, pBreakpoint);
-      pBreakpoint = *ppBreakpoint;
-    } else {
-      CODE_COVERAGE_UNTESTED(591); // Not hit
-      ppBreakpoint = &pBreakpoint->next;
-      pBreakpoint = *ppBreakpoint;
+      *pBits &= ~mask;
+      vm->breakpointCount--;
     }
   }
+
+  // Free the bitmap when there are no breakpoints left so that the interpreter
+  // doesn't need to check it
+  if (!vm->breakpointCount && !vm->breakOnEveryInstruction) {
+    vm_free(vm, vm->pBreakpointBitmap);
+    vm->pBreakpointBitmap = NULL;
+  }
 }
 
 void mvm_dbg_setBreakpointCallback(mvm_VM* vm, mvm_TfBreakpointCallback cb) {
@@ -9264,6 +13593,7 @@ static TeError vm_newError(VM* vm, TeError err) {
 
 static void* vm_malloc(VM* vm, size_t size) {
   void* result = MVM_CONTEXTUAL_MALLOC(size, vm->context);
+  vm->totalMallocSize += (uint32_t)size;
 
   #if MVM_SAFE_MODE && MVM_USE_SINGLE_RAM_PAGE
     // See comment on MVM_RAM_PAGE_ADDR in microvium_port_example.h
@@ -9364,7 +13694,9 @@ static mvm_Value vm_asyncStartUnsafe(mvm_VM* vm, mvm_Value* out_result) {
   VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
 
   #if MVM_SAFE_MODE
-    if (!vm || !vm->stack) MVM_FATAL_ERROR(vm, MVM_E_REQUIRES_ACTIVE_VM);
+    if (!vm || !vm->stack || (vm->stack->reg.pStackPointer == getBottomOfStack(vm->stack))) {
+      MVM_FATAL_ERROR(vm, MVM_E_REQUIRES_ACTIVE_VM);
+    }
   #endif
   vm_TsRegisters* reg = &vm->stack->reg;
 
@@ -9466,6 +13798,9 @@ static Value vm_objectCreate(VM* vm, Value prototype, int internalSlotCount) {
 
 // Same as vm_asyncStartUnsafe but adds an additional wrapper closure
 mvm_Value mvm_asyncStart(mvm_VM* vm, mvm_Value* out_result) {
+  #if MVM_LEAF_HOST_FUNCTIONS && MVM_SAFE_MODE
+  VM_ASSERT(vm, !vm->inLeafHostFunction);
+  #endif
   mvm_Value callbackOrPromise = vm_asyncStartUnsafe(vm, out_result);
 
   if (callbackOrPromise == VM_VALUE_NO_OP_FUNC) {
@@ -9497,6 +13832,144 @@ mvm_Value mvm_asyncStart(mvm_VM* vm, mvm_Value* out_result) {
   return closureValue;
 }
 
+#if MVM_HOST_CALL_BATCHING
+// Gets the items and length of an array, returning false if the value is not
+// an array. The items are only valid until the next allocation.
+static bool vm_getArrayItems(VM* vm, Value value, LongPtr* out_lpItems, uint16_t* out_length) {
+  CODE_COVERAGE_UNTESTED(838); // Not hit
+  if (deepTypeOf(vm, value) != TC_REF_ARRAY) {
+    CODE_COVERAGE_ERROR_PATH(839); // Not hit
+    return false;
+  }
+  LongPtr lpArr = DynamicPtr_decode_long(vm, value);
+  Value viLength = READ_FIELD_2(lpArr, TsArray, viLength);
+  *out_length = VirtualInt14_decode(vm, viLength);
+  *out_lpItems = *out_length
+    ? DynamicPtr_decode_long(vm, READ_FIELD_2(lpArr, TsArray, dpData))
+    : LongPtr_new(NULL);
+  return true;
+}
+
+// Finds the index in the import table of the given host function ID
+static bool vm_findImportIndex(VM* vm, mvm_HostFunctionID hostFunctionID, uint16_t* out_index) {
+  CODE_COVERAGE_UNTESTED(840); // Not hit
+  LongPtr lpImportTable = getBytecodeSection(vm, BCS_IMPORT_TABLE, NULL);
+  uint16_t importCount = getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry);
+  for (uint16_t i = 0; i < importCount; i++) {
+    LongPtr lpEntry = LongPtr_add(lpImportTable, i * sizeof (vm_TsImportTableEntry));
+    if (READ_FIELD_2(lpEntry, vm_TsImportTableEntry, hostFunctionID) == hostFunctionID) {
+      *out_index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+mvm_TeError mvm_hostBatch(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+  CODE_COVERAGE_UNTESTED(841); // Not hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  (void)hostFunctionID;
+
+  LongPtr lpRecords;
+  uint16_t recordCount;
+  if ((argCount < 1) || !vm_getArrayItems(vm, args[0], &lpRecords, &recordCount)) {
+    CODE_COVERAGE_ERROR_PATH(842); // Not hit
+    return MVM_E_INVALID_ARGUMENTS;
+  }
+
+  vm_TsRegisters* reg = &vm->stack->reg;
+  uint16_t* pStackPointerAtEntry = reg->pStackPointer;
+  TeError err = MVM_E_SUCCESS;
+
+  for (uint16_t i = 0; i < recordCount; i++) {
+    // The records are re-read on each iteration because the previous host
+    // call may have collected garbage, moving them
+    vm_getArrayItems(vm, args[0], &lpRecords, &recordCount);
+    if (i >= recordCount) break;
+    Value record = LongPtr_read2_aligned(LongPtr_add(lpRecords, i * 2));
+
+    LongPtr lpRecord;
+    uint16_t recordLength;
+    if (!vm_getArrayItems(vm, record, &lpRecord, &recordLength) || (recordLength < 1)) {
+      CODE_COVERAGE_ERROR_PATH(843); // Not hit
+      err = MVM_E_INVALID_ARGUMENTS;
+      break;
+    }
+
+    // Resolve the target to an index in the import table
+    Value target = LongPtr_read2_aligned(lpRecord);
+    uint16_t importIndex;
+    if (Value_isVirtualInt14(target)) {
+      CODE_COVERAGE_UNTESTED(844); // Not hit
+      if (!vm_findImportIndex(vm, (mvm_HostFunctionID)VirtualInt14_decode(vm, target), &importIndex)) {
+        CODE_COVERAGE_ERROR_PATH(845); // Not hit
+        err = MVM_E_UNRESOLVED_IMPORT;
+        break;
+      }
+    } else if (deepTypeOf(vm, target) == TC_REF_HOST_FUNC) {
+      CODE_COVERAGE_UNTESTED(846); // Not hit
+      importIndex = READ_FIELD_2(DynamicPtr_decode_long(vm, target), TsHostFunc, indexInImportTable);
+    } else {
+      CODE_COVERAGE_ERROR_PATH(847); // Not hit
+      err = MVM_E_TYPE_ERROR_TARGET_IS_NOT_CALLABLE;
+      break;
+    }
+
+    // The arguments are copied onto the VM stack so that they're GC roots and
+    // don't move during the call, followed by the result slot. The stack can't
+    // grow during a host call, so this is limited to the remaining capacity.
+    // Host functions take at most 255 arguments.
+    if (recordLength - 1 > 255) {
+      CODE_COVERAGE_ERROR_PATH(925); // Not hit
+      err = MVM_E_INVALID_ARGUMENTS;
+      break;
+    }
+    uint8_t recordArgCount = (uint8_t)(recordLength - 1);
+    if (reg->pStackPointer + recordArgCount + 1 > getTopOfStackSpace(vm->stack)) {
+      CODE_COVERAGE_ERROR_PATH(848); // Not hit
+      err = MVM_E_STACK_OVERFLOW;
+      break;
+    }
+    Value* pArgs = reg->pStackPointer;
+    memcpy_long(pArgs, LongPtr_add(lpRecord, 2), recordArgCount * 2);
+    Value* pResult = pArgs + recordArgCount;
+    *pResult = VM_VALUE_UNDEFINED;
+    reg->pStackPointer = pResult + 1;
+
+    err = vm_callHostFunction(vm, importIndex, pResult, pArgs, recordArgCount);
+
+    Value recordResult = *pResult;
+    reg->pStackPointer = pStackPointerAtEntry;
+
+    if (err != MVM_E_SUCCESS) {
+      CODE_COVERAGE_ERROR_PATH(849); // Not hit
+      // Pass on the exception, if any
+      *result = recordResult;
+      break;
+    }
+
+    // Write the result if there's room for it in the results array
+    LongPtr lpResults;
+    uint16_t resultsLength;
+    if ((argCount >= 2) && vm_getArrayItems(vm, args[1], &lpResults, &resultsLength) && (i < resultsLength)) {
+      CODE_COVERAGE_UNTESTED(850); // Not hit
+      // Arrays in ROM can't be written to (arrays in GC memory have their items
+      // in GC memory as well)
+      if (Value_isShortPtr(args[1])) {
+        Value* pSlot = &((Value*)LongPtr_truncate(vm, lpResults))[i];
+        *pSlot = recordResult;
+        VM_WRITE_BARRIER(vm, pSlot);
+      }
+    }
+  }
+
+  if (err == MVM_E_SUCCESS) {
+    *result = mvm_newInt32(vm, recordCount);
+  }
+  return err;
+}
+#endif // MVM_HOST_CALL_BATCHING
+
 static mvm_Value* vm_push(mvm_VM* vm, mvm_Value value) {
   VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
   VM_ASSERT(vm, vm && vm->stack);
@@ -9596,6 +14069,8 @@ static void vm_enqueueJob(VM* vm, Value jobClosure) {
   newNode[2] = firstNodeRef; // next
   lastNode[2] = newNodeRef;  // last.next
   firstNode[0] = newNodeRef; // first.prev
+  VM_WRITE_BARRIER(vm, &lastNode[2]);
+  VM_WRITE_BARRIER(vm, &firstNode[0]);
 }
 
 /**
@@ -9654,6 +14129,8 @@ static Value vm_dequeueJob(VM* vm) {
     Value* second = ShortPtr_decode(vm, first[2]);
     last[2] /* next */ = first[2] /* next */;
     second[0] /* prev */ = first[0] /* prev */;
+    VM_WRITE_BARRIER(vm, &last[2]);
+    VM_WRITE_BARRIER(vm, &second[0]);
     reg->jobQueue = first[2];
     return result;
   }
@@ -9808,7 +14285,8 @@ mvm_TsCallStackFrame* mvm_readCallStack(VM* vm, int* out_frameCount) {
   static int allocatedFramesCount = 0;
 
   vm_TsStack* stack = vm->stack;
-  if (!stack) {
+  // The stack may be resident while the VM is idle (see mvm_setStackResident)
+  if (!stack || (stack->reg.pStackPointer == getBottomOfStack(stack))) {
     if (out_frameCount) {
       *out_frameCount = 0;
     }
@@ -10009,6 +14487,12 @@ int32_t mvm_getInstructionCountRemaining(mvm_VM* vm) {
 }
 #endif // MVM_GAS_COUNTER
 
+#if MVM_FUSE_INSTRUCTIONS
+uint16_t mvm_getFusedInstructionCount(mvm_VM* vm) {
+  return vm->fusedInstructionCount;
+}
+#endif // MVM_FUSE_INSTRUCTIONS
+
 /**
  * Subscribe a callback to a promise.
  */
@@ -10034,6 +14518,7 @@ MVM_HIDDEN void mvm_subscribeToPromise(VM* vm, Value vPromise, Value vCallback)
       CODE_COVERAGE(715); // Hit
       // No subscribers yet (hot path)
       pPromise[VM_OIS_PROMISE_OUT] = vCallback;
+      VM_WRITE_BARRIER(vm, &pPromise[VM_OIS_PROMISE_OUT]);
     } else {
       CODE_COVERAGE(716); // Hit
 
@@ -10057,6 +14542,7 @@ MVM_HIDDEN void mvm_subscribeToPromise(VM* vm, Value vPromise, Value vCallback)
         vNewArray = vm_pop(vm);
         pPromise = ShortPtr_decode(vm, *pvPromise); // May have moved
         pPromise[VM_OIS_PROMISE_OUT] = vNewArray;
+        VM_WRITE_BARRIER(vm, &pPromise[VM_OIS_PROMISE_OUT]);
         *pvSubscribers = vNewArray;
       } else { // Already an array -- nothing to do
         CODE_COVERAGE(718); // Hit
@@ -81,6 +81,7 @@ typedef enum mvm_TeError {
   /* 55 */ MVM_E_TYPE_ERROR_AWAIT_NON_PROMISE, // Can only await a promise in Microvium
   /* 56 */ MVM_E_HEAP_CORRUPT, // Microvium's internal heap is not in a consistent state
   /* 57 */ MVM_E_CLASS_PROTOTYPE_MUST_BE_NULL_OR_OBJECT, // The prototype property of a class must be null or a plain object
+  /* 58 */ MVM_E_INVALID_HOST_FUNCTION_SIGNATURE, // The signature passed back by the import resolver is not valid (see mvm_TsHostFunctionInfo)
 } mvm_TeError;
 
 typedef enum mvm_TeType {
@@ -124,6 +125,57 @@ typedef mvm_TeError (*mvm_TfHostFunction)(mvm_VM* vm, mvm_HostFunctionID hostFun
 
 typedef mvm_TeError (*mvm_TfResolveImport)(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out_hostFunction);
 
+typedef enum mvm_TeHostFunctionFlags {
+  /**
+   * The host function is a "leaf": it doesn't call back into the VM (through
+   * `mvm_call` or `mvm_asyncStart`) and doesn't change the VM state other than
+   * allocating values (e.g. `mvm_newString`) and reading its arguments. The VM
+   * calls leaf host functions with less bookkeeping than other host functions
+   * (see MVM_LEAF_HOST_FUNCTIONS).
+   */
+  MVM_HOST_FUNCTION_LEAF = 1 << 0,
+} mvm_TeHostFunctionFlags;
+
+// An argument passed to a host function that has a signature, converted by the
+// VM to the type given by the corresponding character in the signature
+typedef union mvm_TuHostArg {
+  int32_t int32; // 'i': as if by mvm_toInt32
+  bool boolean; // 'b': as if by mvm_toBool
+  const char* str; // 'S': as if by mvm_toStringUtf8
+  mvm_Value value; // 'v': the value itself
+  #if MVM_SUPPORT_FLOAT
+  MVM_FLOAT64 float64; // 'f': as if by mvm_toFloat64
+  #endif
+} mvm_TuHostArg;
+
+typedef mvm_TeError (*mvm_TfTypedHostFunction)(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, const mvm_TuHostArg* args);
+
+typedef struct mvm_TsHostFunctionInfo {
+  mvm_TfHostFunction hostFunction;
+  uint8_t flags; // mvm_TeHostFunctionFlags
+
+  /**
+   * Optional signature of the host function, with one character per argument,
+   * such as "iiS" for a function taking 2 integers and a string (see
+   * mvm_TuHostArg for the characters). If not NULL, the VM calls
+   * `typedHostFunction` instead of `hostFunction`, with the arguments already
+   * converted. Missing arguments are converted from `undefined`, and extra
+   * arguments are ignored.
+   *
+   * The signature must stay in memory as long as the VM, and can have up to
+   * MVM_HOST_SIGNATURE_MAX_ARGS characters. Requires
+   * MVM_HOST_FUNCTION_SIGNATURES.
+   */
+  const char* signature;
+  mvm_TfTypedHostFunction typedHostFunction;
+} mvm_TsHostFunctionInfo;
+
+/**
+ * Like mvm_TfResolveImport, but also passes back flags describing the host
+ * function. The VM zero-initializes `out_info` before the call.
+ */
+typedef mvm_TeError (*mvm_TfResolveImportEx)(mvm_HostFunctionID hostFunctionID, void* context, mvm_TsHostFunctionInfo* out_info);
+
 typedef void (*mvm_TfBreakpointCallback)(mvm_VM* vm, uint16_t bytecodeAddress);
 
 typedef struct mvm_TsMemoryStats {
@@ -142,8 +194,9 @@ typedef struct mvm_TsMemoryStats {
   // RAM allocated to global variables in RAM
   size_t globalVariablesSize;
 
-  // If the machine registers are allocated (if a call is active), this says how
-  // much RAM these consume. Otherwise zero if there is no active stack.
+  // If the machine registers are allocated (if a call is active, or the stack
+  // is resident), this says how much RAM these consume. Otherwise zero if there
+  // is no allocated stack.
   size_t registersSize;
 
   // Virtual stack size (bytes) currently allocated (if a call is active), or
@@ -151,11 +204,16 @@ typedef struct mvm_TsMemoryStats {
   // malloc'd, not allocated on the C stack.
   size_t stackHeight;
 
-  // Virtual stack space capacity if a call is active, otherwise zero.
+  // Virtual stack space capacity if the stack is allocated, otherwise zero.
   size_t stackAllocatedCapacity;
 
+  // Number of times the virtual stack has been allocated over the lifetime of
+  // the VM. Without a resident stack (see `mvm_setStackResident`), this is
+  // the number of calls from the host that found the VM idle.
+  size_t stackAllocationCount;
+
   // Maximum stack size over the lifetime of the VM. This value can be used to
-  // tune the MVM_STACK_SIZE port definition
+  // tune the MVM_STACK_SIZE and MVM_MAX_STACK_SIZE port definitions
   size_t stackHighWaterMark;
 
   // Amount of virtual heap that the VM is currently using
@@ -167,8 +225,58 @@ typedef struct mvm_TsMemoryStats {
   // Current total size of virtual heap (will expand as needed up to a max of MVM_MAX_HEAP_SIZE)
   size_t virtualHeapAllocatedCapacity;
 
+  // Number of garbage collections over the lifetime of the VM, and how many of
+  // those were minor collections of the nursery (see MVM_GC_NURSERY)
+  size_t gcCount;
+  size_t minorGCCount;
+
+  // Bytes of heap copied by the last collection, and over the lifetime of the VM
+  size_t lastGCBytesCopied;
+  size_t totalGCBytesCopied;
+
+  // Duration of the last collection (or slice of an incremental collection),
+  // the total over the lifetime of the VM, and the longest, in units of
+  // MVM_GC_TIMER
+  size_t lastGCPauseTime;
+  size_t totalGCPauseTime;
+  size_t maxGCPauseTime;
+
+  // Bytes scanned or copied by the last slice of an incremental collection
+  // (see mvm_runGCSlice), and the most by any slice. A slice does up to about
+  // its work budget, plus one allocation, or more if it's the first slice of a
+  // collection and the roots don't fit in the budget.
+  size_t lastGCSliceWork;
+  size_t maxGCSliceWork;
+
+  // Number of heap buckets that have been allocated over the lifetime of the
+  // VM, including those allocated by the collector (see mvm_setHeapGrowthPolicy)
+  size_t heapBucketCount;
+
+  // Total bytes the VM has malloc'd from the host over its lifetime
+  size_t totalMallocSize;
+
 } mvm_TsMemoryStats;
 
+/**
+ * Controls how the VM heap grows (see mvm_setHeapGrowthPolicy).
+ */
+typedef struct mvm_TsHeapGrowthPolicy {
+  // Size in bytes of each new heap bucket is this percentage of the heap size,
+  // clamped to the range `minBucketSize` to `maxBucketSize`. Buckets that grow
+  // with the heap mean fewer buckets and mallocs for allocation-heavy scripts.
+  uint16_t bucketGrowthPercent;
+  uint16_t minBucketSize;
+  uint16_t maxBucketSize;
+
+  // If non-zero, a collection is run before the heap grows to the point where
+  // the live data (the heap size after the last collection) would be less than
+  // this percentage of it. If zero, the heap only collects when it would
+  // otherwise exceed MVM_MAX_HEAP_SIZE. The range is 0 to 100, and larger
+  // values are treated as 100 (collect whenever the heap would grow past the
+  // live data).
+  uint8_t targetLivePercent;
+} mvm_TsHeapGrowthPolicy;
+
 /**
  * A handle holds a value that must not be garbage collected.
  *
@@ -203,6 +311,13 @@ extern "C" {
  */
 MVM_EXPORT mvm_TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE snapshotBytecode, size_t bytecodeSize, void* context, mvm_TfResolveImport resolveImport);
 
+/**
+ * Same as mvm_restore, but uses a resolver that can pass back extra
+ * information about each host function, such as whether it is a leaf function
+ * (see mvm_TeHostFunctionFlags).
+ */
+MVM_EXPORT mvm_TeError mvm_restoreEx(mvm_VM** result, MVM_LONG_PTR_TYPE snapshotBytecode, size_t bytecodeSize, void* context, mvm_TfResolveImportEx resolveImport);
+
 /**
  * Free all memory associated with a VM. The VM must not be used again after freeing.
  */
@@ -223,6 +338,44 @@ MVM_EXPORT void mvm_free(mvm_VM* vm);
  */
 MVM_EXPORT mvm_TeError mvm_call(mvm_VM* vm, mvm_Value func, mvm_Value* out_result, mvm_Value* args, uint8_t argCount);
 
+/**
+ * A call prepared with `mvm_prepareCall`. The fields are for internal use.
+ */
+typedef struct mvm_TsPreparedCall {
+  mvm_Value target;
+  uint16_t functionOffset;
+  uint8_t argCount;
+} mvm_TsPreparedCall;
+
+/**
+ * Prepares for calling `func` repeatedly with `argCount` arguments using
+ * `mvm_callPrepared`, which is cheaper per call than `mvm_call` because the
+ * target is resolved and checked only once.
+ *
+ * What `mvm_callPrepared` saves per call is the argument count check and, if
+ * `func` is a function in the bytecode, resolving `func` and dispatching on its
+ * type (e.g. to check whether it's a class or a closure). Everything else is
+ * the same as `mvm_call`: allocating the stack if it isn't resident, saving
+ * the registers, checking stack space, pushing the arguments and setting up
+ * the frame.
+ *
+ * The prepared call is valid as long as `func` is. As with `mvm_call`, if
+ * `func` isn't a function in the bytecode (e.g. if it's a closure), the host
+ * needs to keep it alive with a handle, and prepare the call again if the
+ * handle value changes.
+ *
+ * For the lowest per-call cost, also keep the stack allocated between calls
+ * with `mvm_setStackResident`.
+ */
+MVM_EXPORT mvm_TeError mvm_prepareCall(mvm_VM* vm, mvm_Value func, uint8_t argCount, mvm_TsPreparedCall* out_call);
+
+/**
+ * Calls a function prepared with `mvm_prepareCall`. `args` must have the
+ * number of arguments given to `mvm_prepareCall`. Otherwise the same as
+ * `mvm_call`.
+ */
+MVM_EXPORT mvm_TeError mvm_callPrepared(mvm_VM* vm, const mvm_TsPreparedCall* call, mvm_Value* out_result, mvm_Value* args);
+
 MVM_EXPORT void* mvm_getContext(mvm_VM* vm);
 
 /**
@@ -392,6 +545,33 @@ MVM_EXPORT mvm_TeError mvm_resolveExports(mvm_VM* vm, const mvm_VMExportID* ids,
  */
 MVM_EXPORT void mvm_runGC(mvm_VM* vm, bool squeeze);
 
+#if MVM_GC_NURSERY
+/**
+ * Run a minor garbage collection, which only collects the allocations made
+ * since the last collection (see MVM_GC_NURSERY). This runs a full collection
+ * instead if enough of the heap has been promoted since the last full
+ * collection.
+ *
+ * Minor collections also happen automatically as the nursery fills up.
+ */
+MVM_EXPORT void mvm_runMinorGC(mvm_VM* vm);
+#endif // MVM_GC_NURSERY
+
+#if MVM_GC_INCREMENTAL
+/**
+ * Do part of an incremental garbage collection (see MVM_GC_INCREMENTAL),
+ * starting a new one if there isn't one in progress. This scans roughly
+ * `workBudget` bytes of the heap before returning, so the host can spread the
+ * cost of a collection over idle time, e.g. between frames.
+ *
+ * Returns true once the collection is complete. Calling it again after that
+ * starts another collection.
+ *
+ * `mvm_runGC` finishes any collection in progress before doing a full one.
+ */
+MVM_EXPORT bool mvm_runGCSlice(mvm_VM* vm, uint16_t workBudget);
+#endif // MVM_GC_INCREMENTAL
+
 /**
  * Compares two values for equality. The same semantics as JavaScript `===`
  */
@@ -411,6 +591,36 @@ MVM_EXPORT uint16_t mvm_getCurrentAddress(mvm_VM* vm);
  */
 MVM_EXPORT void mvm_getMemoryStats(mvm_VM* vm, mvm_TsMemoryStats* out_stats);
 
+/**
+ * By default, the VM stack is allocated when the host calls into an idle VM
+ * and freed again when the call returns. If `resident` is true, the stack is
+ * instead kept allocated between calls, which saves a malloc and free on each
+ * call at the cost of keeping the stack (at least MVM_STACK_SIZE bytes, plus
+ * the registers) allocated while the VM is idle.
+ *
+ * A resident stack is released by `mvm_free`, by `mvm_runGC` with `squeeze`
+ * (it's allocated again on the next call), or by calling this function with
+ * `resident` false while the VM is idle.
+ */
+MVM_EXPORT void mvm_setStackResident(mvm_VM* vm, bool resident);
+
+/**
+ * Sets the size in bytes that the VM stack may grow to for this VM, which is
+ * MVM_MAX_STACK_SIZE by default. The value is clamped to the range
+ * MVM_STACK_SIZE to MVM_MAX_STACK_SIZE. If a call needs more stack than this,
+ * it fails with MVM_E_STACK_OVERFLOW.
+ */
+MVM_EXPORT void mvm_setMaxStackSize(mvm_VM* vm, uint16_t maxStackSize);
+
+/**
+ * Sets how the heap grows for this VM (see mvm_TsHeapGrowthPolicy), or restores
+ * the default if `policy` is NULL. The default is a fixed bucket size of
+ * MVM_ALLOCATION_BUCKET_SIZE, and collecting only when the heap is full.
+ * Bucket sizes are clamped to at most MVM_MAX_HEAP_SIZE, and
+ * `targetLivePercent` to at most 100.
+ */
+MVM_EXPORT void mvm_setHeapGrowthPolicy(mvm_VM* vm, const mvm_TsHeapGrowthPolicy* policy);
+
 
 /**
  * Call this at the beginning of an asynchronous host function. It accepts a
@@ -448,6 +658,41 @@ MVM_EXPORT void mvm_getMemoryStats(mvm_VM* vm, mvm_TsMemoryStats* out_stats);
  */
 mvm_Value mvm_asyncStart(mvm_VM* vm, mvm_Value* out_result);
 
+#if MVM_HOST_CALL_BATCHING
+/**
+ * A host function that runs a batch of calls to other host functions, so that
+ * a script can make many host calls in one call to the host. To use it, return
+ * it from the import resolver for an ID of your choosing, e.g. `batch`:
+ *
+ *     const batch = vmImport(BATCH_ID);
+ *     batch([[drawStr, 0, 10, 'Hello'], [DELAY_MS_ID, 100]], results);
+ *
+ * The first argument is an array of records. Each record is an array whose
+ * first element is the host function to call, either as an imported function
+ * value or as its host function ID (the ID must also be imported somewhere in
+ * the script), and whose remaining elements are the arguments.
+ *
+ * The optional second argument is an array to receive the results. The result
+ * of record `i` is written to index `i` if the array is at least that long.
+ *
+ * The batch stops at the first record that fails, and returns the error of
+ * that record (including exceptions thrown by the host). On success, the
+ * result is the number of records run.
+ *
+ * Never register this function with MVM_HOST_FUNCTION_LEAF. The functions it
+ * calls may call back into the VM and grow the VM stack. On the leaf path, the
+ * VM doesn't know that the batch holds pointers into the stack. Growing the
+ * stack would then free the memory that holds the batch's arguments and
+ * result. The VM ignores the flag for this function.
+ *
+ * Host functions that use `mvm_asyncStart` aren't supported in a batch. The
+ * records are called within the call to the batch function, so
+ * `mvm_asyncStart` sees the batch's own call flags (`argCountAndFlags`)
+ * rather than those of the record.
+ */
+MVM_EXPORT mvm_TeError mvm_hostBatch(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, mvm_Value* args, uint8_t argCount);
+#endif // MVM_HOST_CALL_BATCHING
+
 
 #if MVM_INCLUDE_SNAPSHOT_CAPABILITY
 /**
@@ -467,7 +712,8 @@ mvm_Value mvm_asyncStart(mvm_VM* vm, mvm_Value* out_result);
  * the heap and global variable states.
  *
  * Note: The result is malloc'd on the host heap, and so needs to be freed with
- * a call to *free*.
+ * a call to *free*. Returns NULL if there isn't enough memory, or if the image
+ * has been modified by MVM_FUSE_IN_PLACE.
  */
 MVM_EXPORT void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size);
 #endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
@@ -495,7 +741,8 @@ MVM_EXPORT void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size);
 MVM_EXPORT void mvm_dbg_setBreakpoint(mvm_VM* vm, int bytecodeAddress);
 
 /**
- * Remove a breakpoint added by mvm_dbg_setBreakpoint
+ * Remove a breakpoint added by mvm_dbg_setBreakpoint. Use (uint16_t)-1 to
+ * remove the breakpoint that breaks on every instruction.
  */
 MVM_EXPORT void mvm_dbg_removeBreakpoint(mvm_VM* vm, uint16_t bytecodeAddress);
 
@@ -555,6 +802,18 @@ MVM_EXPORT void mvm_stopAfterNInstructions(mvm_VM* vm, int32_t n);
 MVM_EXPORT int32_t mvm_getInstructionCountRemaining(mvm_VM* vm);
 #endif // MVM_GAS_COUNTER
 
+#if MVM_FUSE_INSTRUCTIONS
+/**
+ * mvm_getFusedInstructionCount
+ *
+ * Returns the number of instruction sequences that have been replaced with
+ * fused instructions so far (see MVM_FUSE_INSTRUCTIONS). Functions that are
+ * only verified when first called are fused at that point, so the count can
+ * grow while the VM runs.
+ */
+MVM_EXPORT uint16_t mvm_getFusedInstructionCount(mvm_VM* vm);
+#endif // MVM_FUSE_INSTRUCTIONS
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -25,12 +25,20 @@ fixes and improvement from the original github or npm repository.
 #define MVM_PORT_VERSION 1
 
 /**
- * Number of bytes to use for the stack.
+ * Number of bytes to initially allocate for the stack.
  *
- * Note: the that stack is fixed-size, even though the heap grows dynamically
- * as-needed.
+ * If a call needs more stack than is allocated, the stack is reallocated at
+ * double the size (or as much as is needed, if more), up to a maximum of
+ * MVM_MAX_STACK_SIZE bytes (which can be lowered for each VM using
+ * `mvm_setMaxStackSize`). Set MVM_MAX_STACK_SIZE to the same as MVM_STACK_SIZE
+ * for a fixed-size stack.
+ *
+ * Note: the stack can't grow while the VM is calling a host function (e.g. if
+ * the host calls back into the VM), since the host has pointers into the
+ * stack. Such reentrant calls are limited to the stack already allocated.
  */
 #define MVM_STACK_SIZE 256
+#define MVM_MAX_STACK_SIZE 1024
 
 /**
  * When more space is needed for the VM heap, the VM will malloc blocks with a
@@ -55,6 +63,15 @@ fixes and improvement from the original github or npm repository.
  * allocations in the VM), not the physical space malloc'd from the host, the
  * latter of which can peak at roughly twice the virtual space during a garbage
  * collection cycle in the worst case.
+ *
+ * Unless MVM_NATIVE_POINTER_IS_16_BIT, MVM_USE_SINGLE_RAM_PAGE or
+ * MVM_USE_HEAP_ARENA is set, the VM also keeps an index of its heap buckets
+ * in the `mvm_VM` struct, sized from this. The index is 1 pointer per 256
+ * bytes of heap plus 1, and a hash table of about 2 to 4 times that many
+ * pointers: 21 pointers (84 bytes with 32-bit pointers) for a 1 KB heap, and
+ * at most 768 pointers. MVM_GC_INCREMENTAL about doubles this, since the
+ * heap spans twice the space during a collection (80 pointers for a 1 KB
+ * heap).
  */
 #define MVM_MAX_HEAP_SIZE 1024
 
@@ -113,6 +130,167 @@ fixes and improvement from the original github or npm repository.
  */
 #define MVM_DONT_TRUST_BYTECODE 1
 
+/**
+ * Set to `1` to have `mvm_restore` verify the bytecode functions once when the
+ * VM is loaded, instead of checking the program counter on every instruction.
+ *
+ * The verifier follows the control flow of each function and checks that
+ * every instruction is valid and within the ROM section, that branch and catch
+ * targets are in range, that import, global, short-call and small-literal
+ * indexes are in range, and that the stack height never exceeds the height
+ * declared in the function header. Functions that are not reachable from the
+ * bytecode roots at load time (e.g. only referenced by the initial heap) are
+ * verified the first time they're called. A VM with bytecode that fails
+ * verification will not load (MVM_E_INVALID_BYTECODE).
+ *
+ * When enabled, the per-instruction checks of MVM_DONT_TRUST_BYTECODE that are
+ * covered by the verifier are compiled out of the interpreter loop. Checks that
+ * depend on runtime state (e.g. the number of arguments passed) remain.
+ */
+#define MVM_VERIFY_BYTECODE 1
+
+/**
+ * Set to `1` to have the verifier (MVM_VERIFY_BYTECODE) replace some common
+ * instruction sequences with single fused instructions, so that the
+ * interpreter loop dispatches fewer instructions:
+ *
+ *   - Adding a small integer literal to a local variable (`x + 1`)
+ *   - Reading a property with a literal key from an argument (`arg.prop`)
+ *   - Comparing with `<` and branching on the result
+ *
+ * A sequence is only fused if no branch targets the middle of it. Since the
+ * bytecode is normally in ROM, the fusion is done in a RAM copy of the
+ * constant part of the image (everything before the globals), so this costs
+ * roughly as much RAM as the size of the bytecode. If the copy can't be
+ * allocated, the VM runs the original bytecode without fusion. Snapshots
+ * always contain the original bytecode.
+ *
+ * Requires MVM_VERIFY_BYTECODE.
+ */
+#define MVM_FUSE_INSTRUCTIONS 1
+
+/**
+ * Set to `1` if the host passes the bytecode image to `mvm_restore` in a
+ * writable RAM buffer that lives as long as the VM, so that
+ * MVM_FUSE_INSTRUCTIONS fuses instructions in the image itself instead of in a
+ * copy. This saves the RAM of the copy, but the image is modified:
+ *
+ *   - It can't be restored again (it no longer matches its CRC).
+ *   - `mvm_createSnapshot` fails (returns NULL) once any instruction has been
+ *     fused, since the snapshot would contain the fused code. A host that
+ *     needs snapshots must keep the original image and leave this off.
+ *
+ * This is on in this port because js.c reads each script into a malloc'd
+ * buffer, which it restores once and frees after the VM.
+ *
+ * Can't be used with MVM_CODE_CACHE, which verifies code again after it has
+ * been fused.
+ */
+#define MVM_FUSE_IN_PLACE 1
+
+/**
+ * Set to `1` to give property reads and writes (`obj.prop` and `obj.prop = x`)
+ * an inline cache. Each access site remembers where it last found the
+ * property on an ordinary object, so that repeated accesses to the same
+ * object, or to an inherited property (e.g. a method) of objects with the same
+ * prototype, don't need to search the object's properties and prototype chain
+ * again. The caches are cleared by each garbage collection cycle.
+ *
+ * The cache is a table of MVM_INLINE_CACHE_SIZE entries (a power of 2), indexed
+ * by the address of the access in the bytecode, so sites that share an entry
+ * evict each other. Each entry is 16 bytes on a 32-bit machine (20 bytes with
+ * MVM_OBJECT_SHAPES).
+ */
+#define MVM_INLINE_CACHE 1
+#define MVM_INLINE_CACHE_SIZE 16
+
+/**
+ * Set to `1` to cache the decoded headers of called functions, so that
+ * repeated calls to the same function don't need to read its header (and
+ * resolve the header of the containing function for a continuation) to find
+ * the stack space it needs.
+ *
+ * The cache is a table of MVM_CALL_TARGET_CACHE_SIZE entries (a power of 2)
+ * indexed by the address of the function, so functions that share an entry
+ * evict each other. Each entry is 4 bytes, and is part of the VM structure.
+ */
+#define MVM_CALL_TARGET_CACHE 1
+#define MVM_CALL_TARGET_CACHE_SIZE 8
+
+/**
+ * Set to `1` to cache where variables of outer scopes were found, so that
+ * accessing a variable captured from an enclosing function (e.g. in a nested
+ * callback) doesn't need to walk the chain of parent scopes each time.
+ *
+ * The cache is a table of MVM_SCOPE_CACHE_SIZE entries (a power of 2) indexed
+ * by the current closure and the variable index, and is cleared by each garbage
+ * collection cycle. Each entry is 8 bytes on a 32-bit machine, and is part of
+ * the VM structure.
+ */
+#define MVM_SCOPE_CACHE 1
+#define MVM_SCOPE_CACHE_SIZE 8
+
+/**
+ * Set to `1` to make calls from bytecode to bytecode functions proper tail
+ * calls when the call is directly followed by a return (`return f(x)`). The
+ * callee then reuses the stack space of the caller's frame rather than
+ * pushing a new frame, so tail-recursive loops run in constant stack space.
+ *
+ * Frames replaced by tail calls don't appear in `mvm_readCallStack`. Tail
+ * calls are not used while any breakpoints are set.
+ */
+#define MVM_TAIL_CALLS 1
+
+/**
+ * Set to `1` to call host functions marked as leaf functions
+ * (MVM_HOST_FUNCTION_LEAF, passed back by a resolver given to `mvm_restoreEx`)
+ * through a shorter path. The VM skips the state it otherwise saves and checks
+ * so that the host can call back into the VM, so a leaf function must not call
+ * back into the VM.
+ *
+ * Costs 1 byte of RAM per import. In safe mode, calling back into the VM from
+ * a leaf function is reported as an assertion failure.
+ */
+#define MVM_LEAF_HOST_FUNCTIONS 1
+
+/**
+ * Set to `1` to support host functions declared with a signature (see
+ * `mvm_TsHostFunctionInfo::signature`), for which the VM converts the
+ * arguments to native C values before the call.
+ *
+ * Costs 1 pointer of RAM per import, and MVM_HOST_SIGNATURE_MAX_ARGS
+ * `mvm_TuHostArg`s of C stack during calls to these host functions.
+ */
+#define MVM_HOST_FUNCTION_SIGNATURES 1
+#define MVM_HOST_SIGNATURE_MAX_ARGS 8
+
+/**
+ * Set to `1` to include `mvm_hostBatch`, a host function that the import
+ * resolver can expose to scripts for running many host calls per call to the
+ * host (e.g. all the drawing operations for a frame).
+ */
+#define MVM_HOST_CALL_BATCHING 1
+
+/**
+ * Set to `1` to represent objects created at runtime (object literals, and
+ * instances of classes) using hidden classes ("shapes"). Objects that are
+ * created with the same prototype and have the same properties added in the
+ * same order share a shape holding the property keys, so each object only
+ * stores its property values. This roughly halves the size of small objects,
+ * and lets the inline cache (MVM_INLINE_CACHE) recognize objects by shape.
+ *
+ * Shapes are shared through a tree of transitions that is kept for the life
+ * of the VM. MVM_SHARED_SHAPE_LIMIT limits the number of shapes in the tree
+ * (besides one root shape per prototype). Once it's reached, objects that add
+ * new combinations of properties get shapes of their own, which are collected
+ * along with the objects.
+ *
+ * Note: snapshots taken with this enabled can only be restored by an engine
+ * that also has it enabled.
+ */
+#define MVM_OBJECT_SHAPES 0
+#define MVM_SHARED_SHAPE_LIMIT 64
+
 /**
  * Not recommended!
  *
@@ -124,6 +302,66 @@ fixes and improvement from the original github or npm repository.
  */
 #define MVM_VERY_EXPENSIVE_MEMORY_CHECKS 0
 
+/**
+ * Set to 1 to collect the heap in two generations. Allocations made since the
+ * last collection are the nursery (young generation). When the nursery reaches
+ * MVM_GC_NURSERY_SIZE bytes, a minor collection copies just the reachable
+ * nursery allocations and leaves the rest of the heap where it is, so that a
+ * script holding a large amount of long-lived state doesn't pay to copy all of
+ * it whenever a few temporary values die. The survivors are promoted to the old
+ * generation. `mvm_runGC` still performs a full collection.
+ *
+ * Pointers from the old generation into the nursery are found through a write
+ * barrier, which records up to MVM_GC_REMEMBERED_SET_SIZE such slots between
+ * collections. If more are needed, the next minor collection searches the whole
+ * old generation for them instead. Garbage in the old generation is reclaimed
+ * by a full collection once the old generation has doubled in size (and grown
+ * by at least MVM_GC_NURSERY_SIZE) since the last full collection.
+ *
+ * Requires a port where MVM_NATIVE_POINTER_IS_16_BIT and
+ * MVM_USE_SINGLE_RAM_PAGE are both 0.
+ */
+#define MVM_GC_NURSERY 0
+#define MVM_GC_NURSERY_SIZE 256
+#define MVM_GC_REMEMBERED_SET_SIZE 16
+
+/**
+ * Set to 1 to allow garbage collections to be done in slices, so that a
+ * collection doesn't need to run to completion inside whatever call happened to
+ * trigger it. An incremental collection starts when the heap grows past
+ * MVM_GC_INCREMENTAL_START bytes, and then each time the heap grows again the
+ * collector scans as much as the heap grew by, plus about
+ * MVM_GC_INCREMENTAL_SLICE_SIZE bytes, before letting the program continue.
+ * The host can also do the work in idle time by calling `mvm_runGCSlice`.
+ *
+ * The program uses the new copy of the heap while the collection is in
+ * progress, so the old copy can only be released once the collection
+ * finishes. New allocations in the meantime are limited so that the two copies
+ * together don't exceed MVM_MAX_HEAP_SIZE. If the program uses up that space
+ * before the collection is done, the rest of it is done in a single pause.
+ *
+ * An incremental collection needs an extra MVM_MAX_HEAP_SIZE / 16 bytes while
+ * it's in progress. Not compatible with MVM_GC_NURSERY. Requires a port where
+ * MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE are both 0.
+ */
+#define MVM_GC_INCREMENTAL 0
+#define MVM_GC_INCREMENTAL_START (MVM_MAX_HEAP_SIZE / 2)
+#define MVM_GC_INCREMENTAL_SLICE_SIZE 256
+
+/**
+ * Returns a 32-bit timestamp used to measure how long each garbage collection
+ * takes (see `mvm_TsMemoryStats`). The build can name a host function
+ * `uint32_t f(void)` that reads a free-running counter with
+ * `-DMVM_GC_TIMER_FUNCTION=f`. This app uses the Cortex-M cycle counter (see
+ * js_gc_timer in js.c). Otherwise, the times are not measured and are 0.
+ */
+#ifdef MVM_GC_TIMER_FUNCTION
+uint32_t MVM_GC_TIMER_FUNCTION(void);
+#define MVM_GC_TIMER() MVM_GC_TIMER_FUNCTION()
+#else
+#define MVM_GC_TIMER() 0
+#endif
+
 /**
  * A long pointer is a type that can refer to either ROM or RAM. It is not size
  * restricted.
@@ -216,8 +454,49 @@ extern void fatalError(void* vm, int e);
  */
 #define MVM_ALL_ERRORS_FATAL 0
 
+/**
+ * Set to 1 to dispatch bytecode instructions in `mvm_call` through jump tables
+ * of label addresses (the GCC "labels as values" extension, also supported by
+ * Clang) rather than through `switch` statements. Each instruction handler then
+ * jumps directly to the handler of the next instruction without going through
+ * the switch range check, and the compiler is free to replicate the indirect
+ * jump at the end of every handler, which helps the CPU's branch predictor.
+ *
+ * This requires MVM_CASE to emit a label for each case, as below.
+ */
+#define MVM_COMPUTED_GOTO_DISPATCH 0
+
+#if MVM_COMPUTED_GOTO_DISPATCH
+#define MVM_SWITCH(tag, upper) switch (tag)
+#define MVM_CASE(value) MVM_COMPUTED_GOTO_CASE(value)
+#else
 #define MVM_SWITCH(tag, upper) switch (tag)
 #define MVM_CASE(value) case value
+#endif
+
+/**
+ * Set to 1 to keep a cache of pre-decoded bytecode functions in RAM. The first
+ * time a function is called, `mvm_call` allocates an array with a slot for each
+ * byte of the function's code. Each instruction is decoded into its slot the
+ * first time it's executed (the handler address and the operand for the
+ * secondary opcode), so that subsequent executions jump straight to the
+ * instruction handler without re-reading and re-dispatching the opcode bytes.
+ *
+ * Each slot is 2 pointers in size, so a cached function takes about 8 bytes of
+ * RAM per byte of bytecode on a 32-bit machine. The cache is limited to
+ * MVM_CODE_CACHE_BUDGET bytes, evicting the least recently called functions
+ * to make room for new ones. Functions that are too large for the budget are
+ * executed directly from the bytecode.
+ *
+ * Requires MVM_COMPUTED_GOTO_DISPATCH and MVM_VERIFY_BYTECODE.
+ */
+#define MVM_CODE_CACHE 0
+
+/**
+ * The maximum number of bytes of RAM to use for the code cache (MVM_CODE_CACHE)
+ * in each VM.
+ */
+#define MVM_CODE_CACHE_BUDGET 2048
 
 /**
  * Macro that evaluates to true if the CRC of the given data matches the
@@ -265,6 +544,24 @@ extern void fatalError(void* vm, int e);
 #define MVM_RAM_PAGE_ADDR 0x12340000
 #endif
 
+/**
+ * Set to `1` to reserve the VM heap as one contiguous arena when the VM is
+ * restored, rather than growing it in buckets that are malloc'd as needed. A
+ * pointer into the heap is then just an offset from the start of the arena,
+ * like MVM_USE_SINGLE_RAM_PAGE but without needing a fixed address, so pointers
+ * are encoded and decoded without looking up the bucket, and the heap never
+ * calls MVM_CONTEXTUAL_MALLOC as it grows.
+ *
+ * The arena is allocated with MVM_CONTEXTUAL_MALLOC and has room for 2 copies
+ * of MVM_MAX_HEAP_SIZE (the collector copies the live allocations from one to
+ * the other), which stays allocated until `mvm_free`. The heap growth policy
+ * (see `mvm_setHeapGrowthPolicy`) still decides when to collect.
+ *
+ * Not compatible with MVM_GC_NURSERY or MVM_GC_INCREMENTAL, and requires
+ * MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE to be 0.
+ */
+#define MVM_USE_HEAP_ARENA 0
+
 /**
  * Implementation of malloc and free to use.
  *
@@ -284,3 +581,16 @@ extern void fatalError(void* vm, int e);
  * `mvm_getInstructionCountRemaining`.
  */
 #define MVM_GAS_COUNTER
+
+/**
+ * Set to `1` to charge the gas counter (MVM_GAS_COUNTER) in bulk at branches,
+ * jumps, calls and returns, rather than decrementing it on every instruction.
+ *
+ * The number of instructions in each straight-line block is approximated by the
+ * size of the block in bytes, so `mvm_stopAfterNInstructions` and
+ * `mvm_getInstructionCountRemaining` become approximate, and the VM may run
+ * past the limit by up to one block before stopping. Every loop and recursion
+ * passes through a branch, jump or call, so the counter still works as a
+ * watchdog for run-away scripts.
+ */
+#define MVM_GAS_COUNTER_AMORTIZED 1
@@ -0,0 +1,154 @@
+/*
+ * Checks mvm_hostBatch (MVM_HOST_CALL_BATCHING) with the app's
+ * microvium_port.h as is, using the fixture test/fixtures/batch.mvm-bc:
+ *
+ *   export 1: batch3(a, b, c) = batch([[2, a, 1], [2, b, 2], [2, c, 3]], results)
+ *             where results = [0, 0, 0] is kept in global 0
+ *   export 2: bigRecord(n) = batch([[2, undefined, ...]]), with n arguments
+ *             in the record
+ *   export 3: result(k) = global0[k]
+ *
+ * Host function 1 is mvm_hostBatch, and host function 2 is `hostSum`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "microvium.h"
+
+#define EXPORT_BATCH3 1
+#define EXPORT_BIG_RECORD 2
+#define EXPORT_RESULT 3
+
+#define HOST_BATCH 1
+#define HOST_SUM 2
+
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+// Number of calls to hostSum
+static int sumCallCount;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Returns the sum of the arguments, or fails if any of them is -1
+static mvm_TeError hostSum(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+  sumCallCount++;
+  int32_t sum = 0;
+  for (uint8_t i = 0; i < argCount; i++) {
+    int32_t arg = mvm_toInt32(vm, args[i]);
+    if (arg == -1) {
+      return MVM_E_INVALID_ARGUMENTS;
+    }
+    sum += arg;
+  }
+  *result = mvm_newInt32(vm, sum);
+  return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  if (hostFunctionID == HOST_BATCH) {
+    *out = mvm_hostBatch;
+    return MVM_E_SUCCESS;
+  } else if (hostFunctionID == HOST_SUM) {
+    *out = hostSum;
+    return MVM_E_SUCCESS;
+  }
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static mvm_TeError call(mvm_VM* vm, mvm_VMExportID exportID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+  mvm_Value function;
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  return mvm_call(vm, function, result, args, argCount);
+}
+
+static mvm_TeError batch3(mvm_VM* vm, int32_t a, int32_t b, int32_t c, int32_t* result) {
+  mvm_Value args[3] = { mvm_newInt32(vm, a), mvm_newInt32(vm, b), mvm_newInt32(vm, c) };
+  mvm_Value resultValue;
+  sumCallCount = 0;
+  mvm_TeError err = call(vm, EXPORT_BATCH3, &resultValue, args, 3);
+  *result = err == MVM_E_SUCCESS ? mvm_toInt32(vm, resultValue) : 0;
+  return err;
+}
+
+// The result of record k in the last batch3
+static int32_t recordResult(mvm_VM* vm, int32_t k) {
+  mvm_Value arg = mvm_newInt32(vm, k);
+  mvm_Value result;
+  if (call(vm, EXPORT_RESULT, &result, &arg, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not read result %d\n", (int)k);
+    exit(1);
+  }
+  return mvm_toInt32(vm, result);
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/batch.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+
+  mvm_TeError err;
+  int32_t result;
+
+  // Each record is run, and its result written to the results array
+  err = batch3(vm, 10, 20, 30, &result);
+  check(err == MVM_E_SUCCESS && result == 3, "the batch returns the number of records run");
+  check(sumCallCount == 3, "each record calls the host function");
+  check(recordResult(vm, 0) == 11, "results[0] is 10 + 1");
+  check(recordResult(vm, 1) == 22, "results[1] is 20 + 2");
+  check(recordResult(vm, 2) == 33, "results[2] is 30 + 3");
+
+  // The batch stops at the first record that fails, and returns its error
+  err = batch3(vm, 10, -1, 30, &result);
+  check(err == MVM_E_INVALID_ARGUMENTS, "the batch returns the error of the failing record");
+  check(sumCallCount == 2, "the records after the failing record aren't run");
+  check(recordResult(vm, 0) == 11, "the result of the record before the failing record is written");
+  check(recordResult(vm, 1) == 0, "the result of the failing record isn't written");
+  check(recordResult(vm, 2) == 0, "the result of the record after the failing record isn't written");
+
+  // A host function can't take more than 255 arguments
+  mvm_Value arg = mvm_newInt32(vm, 256);
+  mvm_Value resultValue;
+  sumCallCount = 0;
+  err = call(vm, EXPORT_BIG_RECORD, &resultValue, &arg, 1);
+  check(err == MVM_E_INVALID_ARGUMENTS, "a record with 256 arguments returns MVM_E_INVALID_ARGUMENTS");
+  check(sumCallCount == 0, "a record with 256 arguments isn't run");
+
+  // The VM can be called again after an error
+  err = batch3(vm, 1, 2, 3, &result);
+  check(err == MVM_E_SUCCESS && result == 3, "a batch succeeds after an error");
+  check(recordResult(vm, 2) == 6, "results[2] is 3 + 3");
+
+  mvm_free(vm);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
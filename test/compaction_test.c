@@ -0,0 +1,102 @@
+/*
+ * Regression test for the compaction of property lists by the collector, using
+ * the fixture test/fixtures/compact.mvm-bc:
+ *
+ *   export 1: compact(n, m) keeps n empty objects in global 0, followed by an
+ *             object with the properties 0 to m - 1, each added separately
+ *   export 2: prop(n, k) = global0[n][k]
+ *
+ * Each property added to an existing object is a child property list, which a
+ * collection copies into the object's new allocation. The empty objects move
+ * the object to a different position in tospace for each n, including near
+ * the end of a bucket, where the copy needs a new bucket. The test is built
+ * with AddressSanitizer, which reports a copy that runs past its bucket.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_COMPACT 1
+#define EXPORT_PROP 2
+
+static uint8_t image[4096];
+static size_t bytecodeSize;
+// The port fuses instructions in the bytecode passed to mvm_restore
+// (MVM_FUSE_IN_PLACE), so each VM is restored from a fresh copy of the image
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static mvm_Value call(mvm_VM* vm, mvm_VMExportID exportID, int32_t arg1, int32_t arg2) {
+  mvm_Value function;
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  mvm_Value args[2] = { mvm_newInt32(vm, arg1), mvm_newInt32(vm, arg2) };
+  mvm_Value result;
+  mvm_TeError err = mvm_call(vm, function, &result, args, 2);
+  if (err != MVM_E_SUCCESS) {
+    printf("FAIL: call to export %d returned error %d\n", exportID, err);
+    exit(1);
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/compact.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  bytecodeSize = fread(image, 1, sizeof image, f);
+  fclose(f);
+
+  int checked = 0;
+  for (int32_t n = 0; n < 64; n++) {
+    for (int32_t m = 2; m <= 8; m++) {
+      mvm_VM* vm;
+      memcpy(bytecode, image, bytecodeSize);
+      if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+        printf("FAIL: could not restore %s\n", path);
+        return 1;
+      }
+
+      call(vm, EXPORT_COMPACT, n, m);
+      // The second collection compacts an object that is already compact
+      for (int gc = 0; gc < 2; gc++) {
+        mvm_runGC(vm, false);
+        for (int32_t k = 0; k < m; k++) {
+          int32_t actual = mvm_toInt32(vm, call(vm, EXPORT_PROP, n, k));
+          if (actual != k) {
+            printf("FAIL: compact(%d, %d): property %d is %d after %d collection(s)\n",
+              (int)n, (int)m, (int)k, (int)actual, gc + 1);
+            failures++;
+          }
+          checked++;
+        }
+      }
+
+      mvm_free(vm);
+    }
+  }
+
+  printf("%d properties checked\n", checked);
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
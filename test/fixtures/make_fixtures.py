@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+# Generates the bytecode fixtures used by the host-side tests.
+#
+# The fixtures are hand-assembled (rather than compiled with the microvium CLI)
+# so that each test exercises an exact instruction sequence, such as a CALL
+# directly followed by RETURN, regardless of what the compiler emits.
+#
+# Usage: python3 make_fixtures.py (writes the *.mvm-bc files next to this script)
+
+import os
+import struct
+
+BYTECODE_VERSION = 8
+HEADER_SIZE = 12 + 8 * 2
+TC_REF_FUNCTION = 5
+
+
+def crc16_ccitt(data):
+    # Same as default_crc16 in microvium.c
+    r = 0xFFFF
+    for b in data:
+        r = ((r >> 8) | (r << 8)) & 0xFFFF
+        r ^= b
+        r ^= (r & 0xFF) >> 4
+        r ^= (r << 12) & 0xFFFF
+        r ^= ((r & 0xFF) << 5) & 0xFFFF
+    return r
+
+
+class Fn:
+    def __init__(self, name, max_stack_depth, code):
+        self.name = name
+        self.max_stack_depth = max_stack_depth
+        # A list of raw bytes and references:
+        #   ('label', name)  marks a position in the function
+        #   ('rel8', label)  8-bit branch offset to a label
+        #   ('rel16', label) 16-bit branch offset to a label
+        #   ('fn16', name)   address of a function (for CALL_5 and TAIL_CALL)
+        self.code = code
+
+
+def assemble(fn, start, fn_addresses):
+    # Two passes, so that forward branches see the label addresses
+    labels = {}
+    for _ in range(2):
+        out = bytearray()
+        pc = start
+        for item in fn.code:
+            if isinstance(item, bytes):
+                out += item
+                pc += len(item)
+            elif item[0] == 'label':
+                labels[item[1]] = pc
+            elif item[0] == 'rel8':
+                out += struct.pack('<b', labels.get(item[1], pc + 1) - (pc + 1))
+                pc += 1
+            elif item[0] == 'rel16':
+                out += struct.pack('<h', labels.get(item[1], pc + 2) - (pc + 2))
+                pc += 2
+            elif item[0] == 'fn16':
+                out += struct.pack('<H', fn_addresses.get(item[1], 0))
+                pc += 2
+    return bytes(out)
+
+
+def build(fns, exports, imports, globals=()):
+    import_table = b''.join(struct.pack('<H', i) for i in imports)
+    builtins = b''.join(struct.pack('<H', 1) for _ in range(7)) # All undefined
+    fn_addresses = {}
+    # Function addresses feed back into the export table and call sites, so
+    # lay out until they settle
+    for _ in range(3):
+        export_table = b''.join(struct.pack('<HH', id, fn_addresses.get(name, 0) | 1) for id, name in exports)
+        sections = []
+        offset = HEADER_SIZE
+        for section in (import_table, export_table, b'', builtins):
+            sections.append(offset)
+            offset += len(section)
+        # Empty string table, padded so that the ROM section is 4-byte aligned
+        sections.append(offset)
+        padding = b'\0' * (-offset % 4)
+        offset += len(padding)
+        rom_start = offset
+        rom = bytearray()
+        addresses = {}
+        for fn in fns:
+            # Function header at 4n+2 so that the code is at 4n+4
+            while (rom_start + len(rom)) % 4 != 2:
+                rom += b'\0'
+            rom += struct.pack('<H', (TC_REF_FUNCTION << 12) | fn.max_stack_depth)
+            addresses[fn.name] = rom_start + len(rom)
+            rom += assemble(fn, addresses[fn.name], fn_addresses)
+        if len(rom) % 2:
+            rom += b'\0'
+        fn_addresses = addresses
+        sections.append(rom_start) # ROM
+        global_table = b''.join(struct.pack('<H', v) for v in globals)
+        sections.append(rom_start + len(rom)) # Globals
+        sections.append(rom_start + len(rom) + len(global_table)) # Heap (empty)
+    body = import_table + export_table + builtins + padding + bytes(rom) + global_table
+    size = HEADER_SIZE + len(body)
+    header_tail = struct.pack('<I8H', 0, *sections)
+    crc = crc16_ccitt(header_tail + body)
+    header = struct.pack('<BBBBHH', BYTECODE_VERSION, HEADER_SIZE, 0, 0, size, crc)
+    return header + header_tail + body
+
+
+def B(*xs):
+    return bytes(xs)
+
+
+def L(name):
+    return ('label', name)
+
+
+# rec(n) = n < 1 ? 0 : n + rec(n - 1)
+rec = Fn('rec', 6, [
+    B(0x31, 0x07, 0xE0, 0x70), ('rel8', 'base'), # if (n < 1) goto base
+    B(0x31, 0x01, 0x31, 0x07, 0xE5, 0x92), ('fn16', 'rec'), # rec(n - 1)
+    B(0xE4, 0x60), # return n + ...
+    L('base'), B(0x06, 0x60), # return 0
+])
+
+# trec(n, acc) = n < 1 ? acc : trec(n - 1, acc + n)
+trec = Fn('trec', 6, [
+    B(0x31, 0x07, 0xE0, 0x70), ('rel8', 'base'),
+    B(0x01, 0x31, 0x07, 0xE5, 0x32, 0x31, 0xE4, 0x93), ('fn16', 'trec'), # CALL_5 + RETURN
+    B(0x60),
+    L('base'), B(0x32, 0x60), # return acc
+])
+
+# tstart(n) = trec(n, 0)
+tstart = Fn('tstart', 6, [
+    B(0x01, 0x31, 0x06, 0x93), ('fn16', 'trec'),
+    B(0x60),
+])
+
+# Loops over i with each comparison followed by a conditional branch, which
+# MVM_FUSE_INSTRUCTIONS fuses into one instruction. Each returns the sum of i.
+
+# lt(n): i = 0; acc = 0; while (i < n) { acc += i; i++ } (LESS_THAN + BRANCH_1)
+lt = Fn('lt', 4, [
+    B(0x06, 0x06),
+    L('top'), B(0x11, 0x31, 0xE0, 0x70), ('rel8', 'body'),
+    B(0x10, 0x60),
+    L('body'), B(0x10, 0x12, 0xE4, 0xA0, 0x11, 0x07, 0xE4, 0xA1, 0x76), ('rel8', 'top'),
+])
+
+# le(n): i = 0; acc = 0; while (i <= n) { acc += i; i++ } (LESS_EQUAL + BRANCH_1)
+le = Fn('le', 4, [
+    B(0x06, 0x06),
+    L('top'), B(0x11, 0x31, 0xE2, 0x70), ('rel8', 'body'),
+    B(0x10, 0x60),
+    L('body'), B(0x10, 0x12, 0xE4, 0xA0, 0x11, 0x07, 0xE4, 0xA1, 0x76), ('rel8', 'top'),
+])
+
+# gt(n): i = n; acc = 0; while (i > -1) { acc += i; i-- } (GREATER_THAN + BRANCH_1)
+gt = Fn('gt', 4, [
+    B(0x31, 0x06),
+    L('top'), B(0x11, 0x05, 0xE1, 0x70), ('rel8', 'body'),
+    B(0x10, 0x60),
+    L('body'), B(0x10, 0x12, 0xE4, 0xA0, 0x11, 0x07, 0xE5, 0xA1, 0x76), ('rel8', 'top'),
+])
+
+# ge(n): i = n; acc = 0; while (i >= 1) { acc += i; i-- } (GREATER_EQUAL + BRANCH_2)
+ge = Fn('ge', 4, [
+    B(0x31, 0x06),
+    L('top'), B(0x11, 0x07, 0xE3, 0x8B), ('rel16', 'body'),
+    B(0x10, 0x60),
+    L('body'), B(0x10, 0x12, 0xE4, 0xA0, 0x11, 0x07, 0xE5, 0xA1, 0x76), ('rel8', 'top'),
+])
+
+# Allocation loops that keep their last few objects in global 0, so that there
+# is live data between calls:
+#
+#   keep = <new container>; acc = 0
+#   for (i = 0; i < n; i++) { keep[i & mask] = { 1: i }; acc += keep[i & mask][1] }
+#   global0 = keep
+#   return acc
+def churn(name, new_container, mask):
+    mask = B(0x88) + struct.pack('<H', (mask << 2) | 3) + B(0xF4) # LOAD_LITERAL mask, AND
+    return Fn(name, 10, [
+        new_container, B(0x06, 0x06),
+        L('top'), B(0x10, 0x31, 0xE0, 0x70), ('rel8', 'body'),
+        B(0x12, 0x8C, 0x00, 0x00, 0x11, 0x60), # global0 = keep; return acc
+        L('body'),
+        B(0x69, 0x10, 0x88, 0x07, 0x00, 0x13, 0x6F, # o = { 1: i }
+          0x13, 0x12) + mask + B(0x12, 0x6F, # keep[i & mask] = o
+          0x13, 0x12) + mask + B(0x6B, 0x88, 0x07, 0x00, 0x6B, 0x13, 0xE4, 0xA2, 0x67, # acc += keep[i & mask][1]
+          0x10, 0x07, 0xE4, 0xA0, 0x76), ('rel8', 'top'), # i++
+    ])
+
+# kept(k) = global0[k][1]
+kept = Fn('kept', 4, [B(0x89, 0x00, 0x00, 0x31, 0x6B, 0x88, 0x07, 0x00, 0x6B, 0x60)])
+
+# makeOld(n): global0 = []; global0[n - 1] = 0
+make_old = Fn('makeOld', 6, [
+    B(0x7E, 0x01, 0x10, 0x31, 0x07, 0xE5, 0x06, 0x6F), # keep[n - 1] = 0
+    B(0x10, 0x8C, 0x00, 0x00, 0x01, 0x60), # global0 = keep; return undefined
+])
+
+# put(k, v): global0[k] = { 1: v }
+put = Fn('put', 6, [
+    B(0x69, 0x10, 0x88, 0x07, 0x00, 0x32, 0x6F), # o = { 1: v }
+    B(0x89, 0x00, 0x00, 0x31, 0x12, 0x6F), # global0[k] = o
+    B(0x01, 0x60),
+])
+
+# Objects whose properties are added one at a time, so each has a chain of
+# child property lists that the collector compacts into one allocation:
+#
+#   keep = []
+#   for (i = 0; i < n; i++) keep[i] = {}
+#   o = {}
+#   for (j = 0; j < m; j++) o[j] = j
+#   keep[n] = o; global0 = keep
+compact = Fn('compact', 10, [
+    B(0x7E, 0x01, 0x06),
+    L('fill'), B(0x10, 0x31, 0xE0, 0x70), ('rel8', 'fillBody'),
+    B(0x76), ('rel8', 'props'),
+    L('fillBody'), B(0x11, 0x11, 0x69, 0x6F, # keep[i] = {}
+      0x10, 0x07, 0xE4, 0xA0, 0x76), ('rel8', 'fill'), # i++
+    L('props'), B(0x69, 0x06),
+    L('prop'), B(0x10, 0x32, 0xE0, 0x70), ('rel8', 'propBody'),
+    B(0x76), ('rel8', 'done'),
+    L('propBody'), B(0x11, 0x11, 0x10, 0x6F, # o[j] = j
+      0x10, 0x07, 0xE4, 0xA0, 0x76), ('rel8', 'prop'), # j++
+    L('done'), B(0x13, 0x31, 0x13, 0x6F, # keep[n] = o
+      0x13, 0x8C, 0x00, 0x00, 0x01, 0x60), # global0 = keep
+])
+
+# prop(n, k) = global0[n][k]
+prop = Fn('prop', 4, [B(0x89, 0x00, 0x00, 0x31, 0x6B, 0x32, 0x6B, 0x60)])
+
+# name(a, b, ...) = import(a, b, ...), with `arg_count` arguments, where
+# `import` is the import at the given index
+def call_host(name, import_index, arg_count):
+    args = B(*[0x31 + i for i in range(arg_count)])
+    return Fn(name, 2 + arg_count, [B(0x01) + args + B(0x77, 1 + arg_count, import_index, 0x60)])
+
+# A small integer literal
+def lit(v):
+    return {0: B(0x06), 1: B(0x07)}.get(v) or B(0x88) + struct.pack('<H', ((v << 2) | 3) & 0xFFFF)
+
+# batch3(a, b, c): global0 = results = [0, 0, 0] and returns
+# batch([[2, a, 1], [2, b, 2], [2, c, 3]], results), where 2 is the ID of the
+# host function to call and batch is import 0
+def make_record(i, arg, k):
+    return (B(0x11) + lit(i) + B(0x7E, 0x03) + # records[i] = r = []
+        B(0x10) + lit(0) + lit(2) + B(0x6F) + # r[0] = 2
+        B(0x10) + lit(1) + B(0x31 + arg) + B(0x6F) + # r[1] = arg
+        B(0x10) + lit(2) + lit(k) + B(0x6F) + # r[2] = k
+        B(0x6F))
+batch3 = Fn('batch3', 10, [
+    B(0x7E, 0x03, 0x7E, 0x03) + # records = [], results = []
+    make_record(0, 0, 1) + make_record(1, 1, 2) + make_record(2, 2, 3) +
+    B(0x10) + lit(2) + B(0x06, 0x6F) + # results[2] = 0
+    B(0x10, 0x8C, 0x00, 0x00) + # global0 = results
+    B(0x01, 0x12, 0x12, 0x77, 0x03, 0x00, 0x60), # return batch(records, results)
+])
+
+# bigRecord(n) = batch([r]), where r = [2, undefined, ...] has n arguments
+big_record = Fn('bigRecord', 8, [
+    B(0x7E, 0x01, 0x10, 0x31, 0x06, 0x6F) + # r = []; r[n] = 0
+    B(0x10, 0x06) + lit(2) + B(0x6F) + # r[0] = 2
+    B(0x7E, 0x01, 0x10, 0x06, 0x13, 0x6F) + # records = [r]
+    B(0x01, 0x11, 0x77, 0x02, 0x00, 0x60), # return batch(records)
+])
+
+# result(k) = global0[k]
+result = Fn('result', 4, [B(0x89, 0x00, 0x00, 0x31, 0x6B, 0x60)])
+
+FIXTURES = {
+    'tail_call.mvm-bc': lambda: build(
+        [rec, tstart, trec],
+        exports=[(1, 'rec'), (2, 'tstart')],
+        imports=[]),
+    'loops.mvm-bc': lambda: build(
+        [lt, le, gt, ge],
+        exports=[(1, 'lt'), (2, 'le'), (3, 'gt'), (4, 'ge')],
+        imports=[]),
+    'churn.mvm-bc': lambda: build(
+        [churn('churnArray', B(0x7E, 0x08), 7), churn('churnObject', B(0x69), 7),
+         churn('churnGrowingArray', B(0x7E, 0x01), 31), kept],
+        exports=[(1, 'churnArray'), (2, 'churnObject'), (3, 'churnGrowingArray'), (4, 'kept')],
+        imports=[],
+        globals=[1]), # undefined
+    'compact.mvm-bc': lambda: build(
+        [compact, prop],
+        exports=[(1, 'compact'), (2, 'prop')],
+        imports=[],
+        globals=[1]),
+    'host_calls.mvm-bc': lambda: build(
+        [call_host('leaf2', 0, 2), call_host('leaf0', 0, 0),
+         call_host('plain2', 1, 2), call_host('plain0', 1, 0),
+         call_host('typed4', 2, 4), call_host('typed1', 2, 1),
+         call_host('typed6', 2, 6), call_host('leafTyped4', 3, 4),
+         call_host('leafTyped1', 3, 1), call_host('leafTyped6', 3, 6)],
+        exports=[(1, 'leaf2'), (2, 'leaf0'), (3, 'plain2'), (4, 'plain0'),
+                 (5, 'typed4'), (6, 'typed1'), (7, 'typed6'),
+                 (8, 'leafTyped4'), (9, 'leafTyped1'), (10, 'leafTyped6')],
+        imports=[1, 2, 3, 4]),
+    'batch.mvm-bc': lambda: build(
+        [batch3, big_record, result],
+        exports=[(1, 'batch3'), (2, 'bigRecord'), (3, 'result')],
+        imports=[1, 2],
+        globals=[1]),
+    'nursery.mvm-bc': lambda: build(
+        [make_old, put, kept],
+        exports=[(1, 'makeOld'), (2, 'put'), (3, 'kept')],
+        imports=[],
+        globals=[1]),
+}
+
+if __name__ == '__main__':
+    here = os.path.dirname(os.path.abspath(__file__))
+    for name, make in FIXTURES.items():
+        with open(os.path.join(here, name), 'wb') as f:
+            f.write(make())
@@ -0,0 +1,109 @@
+/*
+ * Checks that the app's own microvium_port.h fuses each comparison and the
+ * conditional branch after it into one instruction (MVM_FUSE_INSTRUCTIONS with
+ * MVM_FUSE_IN_PLACE), using the fixture test/fixtures/loops.mvm-bc:
+ *
+ *   export 1: lt(n) = 0 + 1 + ... + (n - 1), looping while i < n
+ *   export 2: le(n) = 0 + 1 + ... + n, looping while i <= n
+ *   export 3: gt(n) = n + ... + 1 + 0, looping while i > -1
+ *   export 4: ge(n) = n + ... + 1, looping while i >= 1 (with BRANCH_2)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "microvium.h"
+
+#if !MVM_FUSE_INSTRUCTIONS || !MVM_FUSE_IN_PLACE
+#error The port is expected to fuse instructions in place
+#endif
+
+// One compare-and-branch in each of the 4 loops
+#define EXPECTED_FUSED_COUNT 4
+
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    mvm_VMExportID exportID;
+    const char* name;
+  } loops[] = {
+    { 1, "i < n" },
+    { 2, "i <= n" },
+    { 3, "i > -1" },
+    { 4, "i >= 1" },
+  };
+  static const int32_t counts[] = { 0, 1, 2, 10, 100 };
+
+  const char* path = argc > 1 ? argv[1] : "fixtures/loops.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+
+  uint16_t fusedCount = mvm_getFusedInstructionCount(vm);
+  printf("fused instructions: %d\n", (int)fusedCount);
+  if (fusedCount != EXPECTED_FUSED_COUNT) {
+    printf("FAIL: expected %d fused instructions\n", EXPECTED_FUSED_COUNT);
+    failures++;
+  }
+
+  for (size_t i = 0; i < sizeof loops / sizeof loops[0]; i++) {
+    mvm_VMExportID exportID = loops[i].exportID;
+    mvm_Value function;
+    if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+      printf("FAIL: could not resolve export %d\n", exportID);
+      return 1;
+    }
+    for (size_t c = 0; c < sizeof counts / sizeof counts[0]; c++) {
+      int32_t n = counts[c];
+      int32_t expected = exportID == 1 ? n * (n - 1) / 2 : n * (n + 1) / 2;
+      mvm_Value arg = mvm_newInt32(vm, n);
+      mvm_Value result;
+      mvm_TeError err = mvm_call(vm, function, &result, &arg, 1);
+      if (err != MVM_E_SUCCESS || mvm_toInt32(vm, result) != expected) {
+        printf("FAIL: %s loop with n = %d returned error %d, result %d, expected %d\n",
+          loops[i].name, (int)n, err, err ? 0 : (int)mvm_toInt32(vm, result), (int)expected);
+        failures++;
+      }
+    }
+  }
+
+  // The image now contains fused instructions, which can't be in a snapshot
+  #if MVM_INCLUDE_SNAPSHOT_CAPABILITY
+  size_t snapshotSize;
+  void* snapshot = mvm_createSnapshot(vm, &snapshotSize);
+  if (snapshot) {
+    printf("FAIL: mvm_createSnapshot succeeded after fusing in place\n");
+    free(snapshot);
+    failures++;
+  }
+  #endif
+
+  mvm_free(vm);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
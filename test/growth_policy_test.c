@@ -0,0 +1,138 @@
+/*
+ * Checks the heap growth policy (mvm_setHeapGrowthPolicy) and the counters
+ * that report on it, using the fixture test/fixtures/churn.mvm-bc:
+ *
+ *   export 1: churnArray(n) allocates n small objects, keeps the last 8 in an
+ *             array in global 0, and returns the sum 0 + 1 + ... + (n - 1)
+ *
+ * so most of what it allocates is garbage. The engine is built with a larger
+ * MVM_MAX_HEAP_SIZE than the app's, so that the heap can grow without a
+ * collection, which is then only run early because of the policy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_CHURN_ARRAY 1
+
+// Enough allocations to need several buckets, but less than MVM_MAX_HEAP_SIZE
+#define CHURN_COUNT 200
+
+static uint8_t image[4096];
+static size_t bytecodeSize;
+// The port fuses instructions in the bytecode passed to mvm_restore
+// (MVM_FUSE_IN_PLACE), so each VM is restored from a fresh copy of the image
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Runs churnArray(CHURN_COUNT) on a fresh VM with the given policy (or the
+// default if NULL), and returns the stats after the call
+static mvm_TsMemoryStats churn(const char* name, const mvm_TsHeapGrowthPolicy* policy) {
+  mvm_VM* vm;
+  mvm_VMExportID exportID = EXPORT_CHURN_ARRAY;
+  mvm_Value function;
+
+  memcpy(bytecode, image, bytecodeSize);
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore the fixture\n");
+    exit(1);
+  }
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  mvm_setHeapGrowthPolicy(vm, policy);
+
+  mvm_Value arg = mvm_newInt32(vm, CHURN_COUNT);
+  mvm_Value result;
+  mvm_TeError err = mvm_call(vm, function, &result, &arg, 1);
+  if (err != MVM_E_SUCCESS || mvm_toInt32(vm, result) != CHURN_COUNT * (CHURN_COUNT - 1) / 2) {
+    printf("FAIL: %s: churnArray returned error %d\n", name, err);
+    failures++;
+  }
+
+  mvm_TsMemoryStats stats;
+  mvm_getMemoryStats(vm, &stats);
+  mvm_free(vm);
+
+  printf("%s: %d bucket(s), %d collection(s), heap high water mark %d bytes\n",
+    name, (int)stats.heapBucketCount, (int)stats.gcCount, (int)stats.virtualHeapHighWaterMark);
+  return stats;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/churn.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  bytecodeSize = fread(image, 1, sizeof image, f);
+  fclose(f);
+
+  // The default policy grows the heap in buckets of MVM_ALLOCATION_BUCKET_SIZE,
+  // and only collects when the heap is full
+  mvm_TsMemoryStats byDefault = churn("default", NULL);
+  check(byDefault.gcCount == 0, "the default policy doesn't collect before the heap is full");
+  check(byDefault.heapBucketCount > 1, "the heap grows by more than one bucket");
+  check(byDefault.heapBucketCount * MVM_ALLOCATION_BUCKET_SIZE >= byDefault.virtualHeapHighWaterMark,
+    "the buckets hold the whole heap");
+  check((byDefault.heapBucketCount - 1) * MVM_ALLOCATION_BUCKET_SIZE < byDefault.virtualHeapHighWaterMark,
+    "the heap doesn't allocate more buckets than it needs");
+
+  // Buckets that grow with the heap mean fewer buckets than a fixed size
+  mvm_TsHeapGrowthPolicy fixed = { 0, 64, 64, 0 };
+  mvm_TsHeapGrowthPolicy growing = { 100, 64, 4096, 0 };
+  mvm_TsMemoryStats fixedStats = churn("fixed 64-byte buckets", &fixed);
+  mvm_TsMemoryStats growingStats = churn("growing buckets", &growing);
+  check(fixedStats.gcCount == 0 && growingStats.gcCount == 0, "a policy without a target doesn't collect early");
+  check(growingStats.heapBucketCount < fixedStats.heapBucketCount, "growing buckets mean fewer buckets");
+
+  // With a target percentage of live data, the heap collects before it grows
+  // past it, which keeps the heap smaller
+  mvm_TsHeapGrowthPolicy target = { 0, 64, 64, 50 };
+  mvm_TsMemoryStats targetStats = churn("fixed 64-byte buckets, 50% live target", &target);
+  check(targetStats.gcCount > 0, "the target live percentage collects early");
+  check(targetStats.virtualHeapHighWaterMark < fixedStats.virtualHeapHighWaterMark,
+    "collecting early keeps the heap smaller");
+  // Each collection allocates buckets for tospace as well
+  check(targetStats.heapBucketCount > targetStats.gcCount, "the bucket count includes the collector's buckets");
+
+  // A higher target collects at least as often
+  mvm_TsHeapGrowthPolicy target100 = { 0, 64, 64, 100 };
+  mvm_TsMemoryStats target100Stats = churn("fixed 64-byte buckets, 100% live target", &target100);
+  check(target100Stats.gcCount >= targetStats.gcCount, "a higher target collects at least as often");
+
+  // Targets above 100% are treated as 100%
+  mvm_TsHeapGrowthPolicy target255 = { 0, 64, 64, 255 };
+  mvm_TsMemoryStats target255Stats = churn("fixed 64-byte buckets, 255% live target", &target255);
+  check(target255Stats.gcCount == target100Stats.gcCount &&
+    target255Stats.heapBucketCount == target100Stats.heapBucketCount &&
+    target255Stats.virtualHeapHighWaterMark == target100Stats.virtualHeapHighWaterMark,
+    "a target above 100% is the same as 100%");
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Checks calls from bytecode to host functions, with the app's
+ * microvium_port.h as is, using the fixture test/fixtures/host_calls.mvm-bc:
+ *
+ *   export 1: leaf2(a, b) = host1(a, b)
+ *   export 2: leaf0() = host1()
+ *   export 3: plain2(a, b) = host2(a, b)
+ *   export 4: plain0() = host2()
+ *   export 5: typed4(a, b, c, d) = host3(a, b, c, d)
+ *   export 6: typed1(a) = host3(a)
+ *   export 7: typed6(a, b, c, d, e, f) = host3(a, b, c, d, e, f)
+ *   exports 8 to 10: leafTyped4, leafTyped1 and leafTyped6, the same with
+ *             host4
+ *
+ * Host function 1 is registered as a leaf (MVM_HOST_FUNCTION_LEAF) and host
+ * function 2 isn't. Both are `hostSum`, so the leaf path must pass the same
+ * arguments and return the same results as the normal path. Host functions 3
+ * and 4 are `hostTyped`, with the signature "ibSv", and 4 is also a leaf.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_LEAF2 1
+#define EXPORT_LEAF0 2
+#define EXPORT_PLAIN2 3
+#define EXPORT_PLAIN0 4
+#define EXPORT_TYPED4 5
+#define EXPORT_TYPED1 6
+#define EXPORT_TYPED6 7
+#define EXPORT_LEAF_TYPED4 8
+#define EXPORT_LEAF_TYPED1 9
+#define EXPORT_LEAF_TYPED6 10
+
+#define HOST_LEAF 1
+#define HOST_PLAIN 2
+#define HOST_TYPED 3
+#define HOST_LEAF_TYPED 4
+
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+// What the last call to hostSum received
+static mvm_HostFunctionID lastHostFunctionID;
+static int lastArgCount;
+// What the last call to hostTyped received
+static int32_t lastInt32;
+static bool lastBoolean;
+static char lastStr[16];
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Returns the sum of the arguments, or fails if any of them is -1. The sum is
+// allocated if it doesn't fit in a small integer.
+static mvm_TeError hostSum(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+  lastHostFunctionID = hostFunctionID;
+  lastArgCount = argCount;
+  int32_t sum = 0;
+  for (uint8_t i = 0; i < argCount; i++) {
+    int32_t arg = mvm_toInt32(vm, args[i]);
+    if (arg == -1) {
+      return MVM_E_INVALID_ARGUMENTS;
+    }
+    sum += arg;
+  }
+  *result = mvm_newInt32(vm, sum);
+  return MVM_E_SUCCESS;
+}
+
+// Takes the arguments as "ibSv", and returns the last one
+static mvm_TeError hostTyped(mvm_VM* vm, mvm_HostFunctionID hostFunctionID, mvm_Value* result, const mvm_TuHostArg* args) {
+  lastHostFunctionID = hostFunctionID;
+  lastInt32 = args[0].int32;
+  lastBoolean = args[1].boolean;
+  snprintf(lastStr, sizeof lastStr, "%s", args[2].str);
+  *result = args[3].value;
+  return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TsHostFunctionInfo* out) {
+  if (hostFunctionID == HOST_LEAF) {
+    out->flags = MVM_HOST_FUNCTION_LEAF;
+    out->hostFunction = hostSum;
+    return MVM_E_SUCCESS;
+  } else if (hostFunctionID == HOST_PLAIN) {
+    out->hostFunction = hostSum;
+    return MVM_E_SUCCESS;
+  } else if (hostFunctionID == HOST_TYPED || hostFunctionID == HOST_LEAF_TYPED) {
+    out->flags = hostFunctionID == HOST_LEAF_TYPED ? MVM_HOST_FUNCTION_LEAF : 0;
+    out->signature = "ibSv";
+    out->typedHostFunction = hostTyped;
+    return MVM_E_SUCCESS;
+  }
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static mvm_TeError callExport(mvm_VM* vm, mvm_VMExportID exportID, mvm_Value* result, mvm_Value* args, uint8_t argCount) {
+  mvm_Value function;
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  lastHostFunctionID = 0;
+  lastArgCount = -1;
+  lastInt32 = -1;
+  lastBoolean = false;
+  lastStr[0] = '\0';
+  return mvm_call(vm, function, result, args, argCount);
+}
+
+static mvm_TeError call(mvm_VM* vm, mvm_VMExportID exportID, int32_t a, int32_t b, int32_t* result) {
+  mvm_Value args[2] = { mvm_newInt32(vm, a), mvm_newInt32(vm, b) };
+  mvm_Value resultValue;
+  mvm_TeError err = callExport(vm, exportID, &resultValue, args, 2);
+  *result = err == MVM_E_SUCCESS ? mvm_toInt32(vm, resultValue) : 0;
+  return err;
+}
+
+static bool isString(mvm_VM* vm, mvm_Value value, const char* expected) {
+  if (mvm_typeOf(vm, value) != VM_T_STRING) {
+    return false;
+  }
+  size_t size;
+  const char* str = mvm_toStringUtf8(vm, value, &size);
+  return size == strlen(expected) && memcmp(str, expected, size) == 0;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    const char* name;
+    mvm_VMExportID export2;
+    mvm_VMExportID export0;
+    mvm_HostFunctionID hostFunctionID;
+  } paths[] = {
+    { "leaf", EXPORT_LEAF2, EXPORT_LEAF0, HOST_LEAF },
+    { "plain", EXPORT_PLAIN2, EXPORT_PLAIN0, HOST_PLAIN },
+  };
+  static const struct {
+    const char* name;
+    mvm_VMExportID export4;
+    mvm_VMExportID export1;
+    mvm_VMExportID export6;
+    mvm_HostFunctionID hostFunctionID;
+  } typedPaths[] = {
+    { "typed", EXPORT_TYPED4, EXPORT_TYPED1, EXPORT_TYPED6, HOST_TYPED },
+    { "leaf typed", EXPORT_LEAF_TYPED4, EXPORT_LEAF_TYPED1, EXPORT_LEAF_TYPED6, HOST_LEAF_TYPED },
+  };
+
+  const char* path = argc > 1 ? argv[1] : "fixtures/host_calls.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restoreEx(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+
+  for (size_t i = 0; i < sizeof paths / sizeof paths[0]; i++) {
+    mvm_TeError err;
+    int32_t result;
+    printf("%s host function\n", paths[i].name);
+
+    err = call(vm, paths[i].export2, 3, 4, &result);
+    check(err == MVM_E_SUCCESS && result == 7, "f(3, 4) returns 7");
+    check(lastHostFunctionID == paths[i].hostFunctionID, "the host function gets its ID");
+    check(lastArgCount == 2, "the host function gets 2 arguments, not including `this`");
+
+    err = call(vm, paths[i].export0, 3, 4, &result);
+    check(err == MVM_E_SUCCESS && result == 0, "f() returns 0");
+    check(lastArgCount == 0, "the host function gets no arguments");
+
+    // The result is allocated by the host function
+    err = call(vm, paths[i].export2, 30000, 40000, &result);
+    check(err == MVM_E_SUCCESS && result == 70000, "f(30000, 40000) returns 70000");
+
+    // Errors from the host function are returned by mvm_call
+    err = call(vm, paths[i].export2, 3, -1, &result);
+    check(err == MVM_E_INVALID_ARGUMENTS, "an error from the host function is returned by mvm_call");
+
+    // The VM can be called again after an error
+    err = call(vm, paths[i].export2, 5, 6, &result);
+    check(err == MVM_E_SUCCESS && result == 11, "f(5, 6) returns 11 after an error");
+  }
+
+  for (size_t i = 0; i < sizeof typedPaths / sizeof typedPaths[0]; i++) {
+    mvm_TeError err;
+    mvm_Value result;
+    printf("%s host function\n", typedPaths[i].name);
+
+    // Each argument is converted to the type in the signature
+    mvm_Value args[6] = {
+      mvm_newString(vm, "42", 2),
+      mvm_newInt32(vm, 5),
+      mvm_newInt32(vm, 70000),
+      mvm_newString(vm, "last", 4),
+      mvm_newInt32(vm, 1),
+      mvm_newInt32(vm, 2),
+    };
+    err = callExport(vm, typedPaths[i].export4, &result, args, 4);
+    check(err == MVM_E_SUCCESS, "f(\"42\", 5, 70000, \"last\") succeeds");
+    check(lastHostFunctionID == typedPaths[i].hostFunctionID, "the host function gets its ID");
+    check(lastInt32 == 42, "'i' converts \"42\" to 42");
+    check(lastBoolean, "'b' converts 5 to true");
+    check(strcmp(lastStr, "70000") == 0, "'S' converts 70000 to \"70000\"");
+    check(err == MVM_E_SUCCESS && isString(vm, result, "last"), "'v' passes the value as is");
+
+    // Missing arguments are converted from undefined
+    err = callExport(vm, typedPaths[i].export1, &result, args, 6);
+    check(err == MVM_E_SUCCESS, "f(\"42\") succeeds");
+    check(lastInt32 == 42, "the argument that is passed is converted");
+    check(!lastBoolean, "'b' converts a missing argument to false");
+    check(strcmp(lastStr, "undefined") == 0, "'S' converts a missing argument to \"undefined\"");
+    check(err == MVM_E_SUCCESS && mvm_typeOf(vm, result) == VM_T_UNDEFINED, "'v' passes a missing argument as undefined");
+
+    // Extra arguments are ignored
+    mvm_Value extraArgs[6] = {
+      mvm_newInt32(vm, 7),
+      mvm_newInt32(vm, 0),
+      mvm_newInt32(vm, 8),
+      mvm_newInt32(vm, 9),
+      mvm_newInt32(vm, 10),
+      mvm_newInt32(vm, 11),
+    };
+    err = callExport(vm, typedPaths[i].export6, &result, extraArgs, 6);
+    check(err == MVM_E_SUCCESS, "f(7, 0, 8, 9, 10, 11) succeeds");
+    check(lastInt32 == 7, "'i' converts 7 to 7");
+    check(!lastBoolean, "'b' converts 0 to false");
+    check(strcmp(lastStr, "8") == 0, "'S' converts 8 to \"8\"");
+    check(err == MVM_E_SUCCESS && mvm_toInt32(vm, result) == 9, "the host function gets the first 4 arguments");
+  }
+
+  mvm_free(vm);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Stress test for the incremental collector (MVM_GC_INCREMENTAL), built with
+ * MVM_VERY_EXPENSIVE_MEMORY_CHECKS so that a slice also runs at every potential
+ * GC point inside the VM. Uses test/fixtures/churn.mvm-bc:
+ *
+ *   export 1-3: churn(n) allocates n small objects into an array, an object
+ *               or a growing array, keeps the last few in global 0, and
+ *               returns the sum 0 + 1 + ... + (n - 1)
+ *   export 4:   kept(k) = global0[k][1]
+ *
+ * Between calls, the host runs a few slices of the collection with different
+ * work budgets, so that collections are left in progress while the VM runs,
+ * and then checks that the objects kept in global 0 are intact, and that each
+ * slice stayed within its budget.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "microvium.h"
+
+#define EXPORT_KEPT 4
+
+// A slice stops once it reaches its work budget, so it can only go over by the
+// last step of the scan: one slot (2 bytes), plus the allocation it refers to
+// if that is copied. The largest allocation in churn.mvm-bc is the data of the
+// growing array, whose capacity doubles up to 64 slots (130 bytes with the
+// header).
+#define MAX_SLICE_OVERSHOOT (2 + 130)
+
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+// MVM_GC_TIMER_FUNCTION for this test, in microseconds
+uint32_t test_gcTimer(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint32_t)t.tv_sec * 1000000 + (uint32_t)(t.tv_nsec / 1000);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static mvm_Value resolveExport(mvm_VM* vm, mvm_VMExportID exportID) {
+  mvm_Value function;
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  return function;
+}
+
+static int32_t call(mvm_VM* vm, mvm_Value function, int32_t arg) {
+  mvm_Value argValue = mvm_newInt32(vm, arg);
+  mvm_Value result;
+  mvm_TeError err = mvm_call(vm, function, &result, &argValue, 1);
+  if (err != MVM_E_SUCCESS) {
+    printf("FAIL: call returned error %d\n", err);
+    exit(1);
+  }
+  return mvm_toInt32(vm, result);
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    mvm_VMExportID exportID;
+    const char* name;
+    int32_t mask; // Objects are kept at index `i & mask`
+  } churns[] = {
+    { 1, "array", 7 },
+    { 2, "object", 7 },
+    { 3, "growing array", 31 },
+  };
+  static const uint16_t budgets[] = { 1, 16, 64, 256, 4096 };
+  // Includes sums past the int14 range, which allocate
+  static const int32_t counts[] = { 5, 100, 300 };
+
+  const char* path = argc > 1 ? argv[1] : "fixtures/churn.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+  mvm_Value kept = resolveExport(vm, EXPORT_KEPT);
+
+  int completed = 0;
+  for (size_t b = 0; b < sizeof budgets / sizeof budgets[0]; b++) {
+    for (size_t c = 0; c < sizeof churns / sizeof churns[0]; c++) {
+      mvm_Value churn = resolveExport(vm, churns[c].exportID);
+      for (size_t i = 0; i < sizeof counts / sizeof counts[0]; i++) {
+        int32_t n = counts[i];
+        if (call(vm, churn, n) != n * (n - 1) / 2) {
+          printf("FAIL: %s churn(%d) returned the wrong sum\n", churns[c].name, (int)n);
+          failures++;
+        }
+
+        // A few slices, which may leave the collection in progress for the
+        // next call
+        for (int slice = 0; slice < 3; slice++) {
+          if (mvm_runGCSlice(vm, budgets[b])) {
+            completed++;
+          }
+          mvm_TsMemoryStats stats;
+          mvm_getMemoryStats(vm, &stats);
+          if (stats.lastGCSliceWork > (size_t)budgets[b] + MAX_SLICE_OVERSHOOT) {
+            printf("FAIL: a slice with budget %d did %d bytes of work\n",
+              (int)budgets[b], (int)stats.lastGCSliceWork);
+            failures++;
+          }
+        }
+
+        // Slot k holds the last i below n where (i & mask) == k
+        for (int32_t k = 0; k <= churns[c].mask && k < n; k++) {
+          int32_t expected = ((n - 1 - k) & ~churns[c].mask) + k;
+          int32_t actual = call(vm, kept, k);
+          if (actual != expected) {
+            printf("FAIL: %s churn(%d): kept(%d) is %d, expected %d (budget %d)\n",
+              churns[c].name, (int)n, (int)k, (int)actual, (int)expected, (int)budgets[b]);
+            failures++;
+          }
+        }
+      }
+    }
+  }
+
+  // Finish the collection in progress, if any
+  while (!mvm_runGCSlice(vm, 256)) {}
+  completed++;
+
+  mvm_TsMemoryStats stats;
+  mvm_getMemoryStats(vm, &stats);
+  printf("collections completed between calls: %d, total: %d\n",
+    completed, (int)stats.gcCount);
+  printf("largest slice: %d bytes of work, longest slice: %d us\n",
+    (int)stats.maxGCSliceWork, (int)stats.maxGCPauseTime);
+  if (completed < 2) {
+    printf("FAIL: expected collections to complete between calls\n");
+    failures++;
+  }
+
+  mvm_free(vm);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Times the comparison loops in test/fixtures/loops.mvm-bc, to compare a build
+ * with MVM_FUSE_INSTRUCTIONS (where each comparison and the following branch
+ * run as one fused instruction) against a build without:
+ *
+ *   export 1: lt(n), `i < n` + BRANCH_1
+ *   export 2: le(n), `i <= n` + BRANCH_1
+ *   export 3: gt(n), `i > -1` + BRANCH_1
+ *   export 4: ge(n), `i >= 1` + BRANCH_2
+ *
+ * Each function returns the sum of its loop variable, which is checked so that
+ * the two builds are known to compute the same thing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "microvium.h"
+
+// Small enough that the sums stay in the int14 range, so the loop doesn't
+// allocate
+#define LOOP_COUNT 100
+#define DEFAULT_CALL_COUNT 20000
+// Each loop is timed this many times and the fastest is reported, since the
+// slower runs are mostly noise from the rest of the host
+#define REPEAT_COUNT 5
+
+static uint8_t bytecode[4096];
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    mvm_VMExportID exportID;
+    const char* name;
+    int32_t expected;
+  } loops[] = {
+    { 1, "i < n",  LOOP_COUNT * (LOOP_COUNT - 1) / 2 },
+    { 2, "i <= n", LOOP_COUNT * (LOOP_COUNT + 1) / 2 },
+    { 3, "i > -1", LOOP_COUNT * (LOOP_COUNT + 1) / 2 },
+    { 4, "i >= 1", LOOP_COUNT * (LOOP_COUNT + 1) / 2 },
+  };
+
+  const char* path = argc > 1 ? argv[1] : "fixtures/loops.mvm-bc";
+  int callCount = argc > 2 ? atoi(argv[2]) : DEFAULT_CALL_COUNT;
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+
+  printf("MVM_FUSE_INSTRUCTIONS %d, %d calls of %d iterations\n", MVM_FUSE_INSTRUCTIONS, callCount, LOOP_COUNT);
+  for (size_t i = 0; i < sizeof loops / sizeof loops[0]; i++) {
+    mvm_VMExportID exportID = loops[i].exportID;
+    mvm_Value function;
+    if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+      printf("FAIL: could not resolve export %d\n", exportID);
+      return 1;
+    }
+
+    double seconds = 0;
+    for (int repeat = 0; repeat < REPEAT_COUNT; repeat++) {
+      clock_t start = clock();
+      for (int call = 0; call < callCount; call++) {
+        mvm_Value arg = mvm_newInt32(vm, LOOP_COUNT);
+        mvm_Value result;
+        mvm_TeError err = mvm_call(vm, function, &result, &arg, 1);
+        if (err != MVM_E_SUCCESS || mvm_toInt32(vm, result) != loops[i].expected) {
+          printf("FAIL: %s loop returned error %d, result %d\n", loops[i].name, err, err ? 0 : (int)mvm_toInt32(vm, result));
+          return 1;
+        }
+      }
+      double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+      if (repeat == 0 || elapsed < seconds) {
+        seconds = elapsed;
+      }
+    }
+    printf("  %-7s %7.2f ns/iteration\n", loops[i].name, seconds * 1e9 / ((double)callCount * LOOP_COUNT));
+  }
+
+#if MVM_FUSE_INSTRUCTIONS
+  printf("  fused instructions: %d\n", (int)mvm_getFusedInstructionCount(vm));
+#endif
+
+  mvm_free(vm);
+  return 0;
+}
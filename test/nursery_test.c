@@ -0,0 +1,162 @@
+/*
+ * Checks minor collections of the nursery (MVM_GC_NURSERY), using the fixture
+ * test/fixtures/nursery.mvm-bc:
+ *
+ *   export 1: makeOld(n) sets global 0 to an array of length n
+ *   export 2: put(k, v) stores a new object { 1: v } at global0[k]
+ *   export 3: kept(k) = global0[k][1]
+ *
+ * The array is moved to the old generation by a full collection, so that each
+ * put stores a pointer into the nursery in an old allocation, which only the
+ * write barrier records. A minor collection must keep the new objects alive
+ * through the remembered set, or through a search of the old generation once
+ * more slots are stored than the remembered set holds.
+ *
+ * The test's engine has a small remembered set (MVM_GC_REMEMBERED_SET_SIZE 4),
+ * so that it overflows before the new objects fill the nursery.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "microvium.h"
+
+#define EXPORT_MAKE_OLD 1
+#define EXPORT_PUT 2
+#define EXPORT_KEPT 3
+
+// Enough slots to overflow the remembered set
+#define SLOT_COUNT (MVM_GC_REMEMBERED_SET_SIZE + 4)
+// Few enough slots to fit in the remembered set
+#define REMEMBERED_COUNT (MVM_GC_REMEMBERED_SET_SIZE / 2)
+
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+// MVM_GC_TIMER_FUNCTION for this test, in microseconds
+uint32_t test_gcTimer(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint32_t)t.tv_sec * 1000000 + (uint32_t)(t.tv_nsec / 1000);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+static mvm_Value resolveExport(mvm_VM* vm, mvm_VMExportID exportID) {
+  mvm_Value function;
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  return function;
+}
+
+static mvm_Value call(mvm_VM* vm, mvm_VMExportID exportID, int32_t arg1, int32_t arg2) {
+  mvm_Value args[2] = { mvm_newInt32(vm, arg1), mvm_newInt32(vm, arg2) };
+  mvm_Value result;
+  mvm_TeError err = mvm_call(vm, resolveExport(vm, exportID), &result, args, 2);
+  if (err != MVM_E_SUCCESS) {
+    printf("FAIL: call to export %d returned error %d\n", exportID, err);
+    exit(1);
+  }
+  return result;
+}
+
+// Checks that kept(k) is `first + k` for each k below `count`
+static void checkKept(mvm_VM* vm, int count, int32_t first, const char* when) {
+  for (int k = 0; k < count; k++) {
+    int32_t actual = mvm_toInt32(vm, call(vm, EXPORT_KEPT, k, 0));
+    if (actual != first + k) {
+      printf("FAIL: %s: kept(%d) is %d, expected %d\n", when, k, (int)actual, (int)(first + k));
+      failures++;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/nursery.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  size_t bytecodeSize = fread(bytecode, 1, sizeof bytecode, f);
+  fclose(f);
+
+  mvm_VM* vm;
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore %s\n", path);
+    return 1;
+  }
+
+  mvm_TsMemoryStats stats;
+
+  // The array goes to the old generation
+  call(vm, EXPORT_MAKE_OLD, SLOT_COUNT, 0);
+  mvm_runGC(vm, false);
+
+  // Young objects reachable only through the remembered set
+  for (int k = 0; k < REMEMBERED_COUNT; k++) {
+    call(vm, EXPORT_PUT, k, 100 + k);
+  }
+  mvm_getMemoryStats(vm, &stats);
+  size_t minorGCCount = stats.minorGCCount;
+  mvm_runMinorGC(vm);
+  mvm_getMemoryStats(vm, &stats);
+  check(stats.minorGCCount == minorGCCount + 1, "mvm_runMinorGC runs a minor collection");
+  // Only the new objects are copied, all of the same size
+  size_t rememberedBytesCopied = stats.lastGCBytesCopied;
+  check(rememberedBytesCopied > 0 && rememberedBytesCopied % REMEMBERED_COUNT == 0,
+    "a minor collection copies the objects stored in the old generation");
+  size_t bytesPerObject = rememberedBytesCopied / REMEMBERED_COUNT;
+  checkKept(vm, REMEMBERED_COUNT, 100, "after a minor collection");
+
+  // More young objects stored in the old generation than the remembered set
+  // holds. There's no collection in between, since they fit in the nursery.
+  for (int k = 0; k < SLOT_COUNT; k++) {
+    call(vm, EXPORT_PUT, k, 200 + k);
+  }
+  mvm_getMemoryStats(vm, &stats);
+  check(stats.minorGCCount == minorGCCount + 1, "the objects fit in the nursery");
+  mvm_runMinorGC(vm);
+  mvm_getMemoryStats(vm, &stats);
+  check(stats.minorGCCount == minorGCCount + 2, "mvm_runMinorGC runs a minor collection");
+  check(stats.lastGCBytesCopied == bytesPerObject * SLOT_COUNT,
+    "a minor collection after the remembered set overflows copies all of the new objects");
+  size_t minorPauseTime = stats.lastGCPauseTime;
+  checkKept(vm, SLOT_COUNT, 200, "after the remembered set overflowed");
+
+  // A full collection also copies the old generation
+  mvm_runGC(vm, false);
+  mvm_getMemoryStats(vm, &stats);
+  check(stats.lastGCBytesCopied > bytesPerObject * SLOT_COUNT,
+    "a full collection copies more than a minor collection");
+  checkKept(vm, SLOT_COUNT, 200, "after a full collection");
+
+  printf("minor collection: %d bytes copied in %d us, full collection: %d bytes copied in %d us\n",
+    (int)(bytesPerObject * SLOT_COUNT), (int)minorPauseTime,
+    (int)stats.lastGCBytesCopied, (int)stats.lastGCPauseTime);
+
+  mvm_free(vm);
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Checks that the VM stack grows on demand from MVM_STACK_SIZE up to the limit
+ * set with mvm_setMaxStackSize, and that a call that needs more fails with
+ * MVM_E_STACK_OVERFLOW. Uses the app's microvium_port.h as is, and the
+ * fixture test/fixtures/tail_call.mvm-bc:
+ *
+ *   export 1: rec(n) = n < 1 ? 0 : n + rec(n - 1)
+ *
+ * which uses more stack for each level of recursion. Each call is made on a
+ * freshly restored VM whose stack is kept resident, so that the stack
+ * capacity can be read after the call.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_REC 1
+
+static uint8_t image[4096];
+static size_t bytecodeSize;
+// The port fuses instructions in the bytecode passed to mvm_restore
+// (MVM_FUSE_IN_PLACE), so each VM is restored from a fresh copy of the image
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Calls rec(n) on a fresh VM whose stack may grow to `maxStackSize`. Returns
+// the error, and the stats after the call in `stats`.
+static mvm_TeError callRec(uint16_t maxStackSize, int32_t n, mvm_TsMemoryStats* stats) {
+  mvm_VM* vm;
+  mvm_VMExportID exportID = EXPORT_REC;
+  mvm_Value function;
+
+  memcpy(bytecode, image, bytecodeSize);
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore the fixture\n");
+    exit(1);
+  }
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+  mvm_setStackResident(vm, true);
+  mvm_setMaxStackSize(vm, maxStackSize);
+
+  mvm_Value arg = mvm_newInt32(vm, n);
+  mvm_Value result;
+  mvm_TeError err = mvm_call(vm, function, &result, &arg, 1);
+  if (err == MVM_E_SUCCESS && mvm_toInt32(vm, result) != n * (n + 1) / 2) {
+    printf("FAIL: rec(%d) returned %d\n", (int)n, (int)mvm_toInt32(vm, result));
+    failures++;
+  }
+
+  // The VM can still be called after a stack overflow
+  if (err == MVM_E_STACK_OVERFLOW) {
+    arg = mvm_newInt32(vm, 1);
+    check(mvm_call(vm, function, &result, &arg, 1) == MVM_E_SUCCESS && mvm_toInt32(vm, result) == 1,
+      "rec(1) succeeds after a stack overflow");
+  }
+
+  mvm_getMemoryStats(vm, stats);
+  mvm_free(vm);
+  return err;
+}
+
+// Returns the deepest n for which rec(n) succeeds with the given stack limit,
+// checking that the next level fails with MVM_E_STACK_OVERFLOW
+static int32_t deepestRec(uint16_t maxStackSize, uint16_t expectedLimit) {
+  mvm_TsMemoryStats stats;
+  mvm_TsMemoryStats lastStats;
+  int32_t n = 0;
+  mvm_TeError err;
+  memset(&lastStats, 0, sizeof lastStats);
+  while ((err = callRec(maxStackSize, n, &stats)) == MVM_E_SUCCESS) {
+    lastStats = stats;
+    n++;
+  }
+
+  printf("stack limit %d: rec(%d) uses %d bytes of stack in %d bytes of capacity, rec(%d) returns error %d\n",
+    (int)maxStackSize, (int)(n - 1), (int)lastStats.stackHighWaterMark,
+    (int)lastStats.stackAllocatedCapacity, (int)n, err);
+  check(err == MVM_E_STACK_OVERFLOW, "a call past the stack limit fails with MVM_E_STACK_OVERFLOW");
+  check(lastStats.stackAllocatedCapacity <= expectedLimit, "the stack doesn't grow past the limit");
+  // Each level of rec uses less than 32 bytes, so the stack is nearly full
+  check(lastStats.stackHighWaterMark + 32 > expectedLimit, "the stack grows to the limit");
+  return n - 1;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/tail_call.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  bytecodeSize = fread(image, 1, sizeof image, f);
+  fclose(f);
+
+  mvm_TsMemoryStats stats;
+
+  // A shallow call fits in the initial stack
+  check(callRec(MVM_MAX_STACK_SIZE, 5, &stats) == MVM_E_SUCCESS, "rec(5) succeeds");
+  check(stats.stackAllocatedCapacity == MVM_STACK_SIZE, "rec(5) fits in MVM_STACK_SIZE");
+
+  // Deeper calls grow the stack up to each limit
+  int32_t deepest512 = deepestRec(512, 512);
+  int32_t deepestMax = deepestRec(MVM_MAX_STACK_SIZE, MVM_MAX_STACK_SIZE);
+  check(deepestMax > deepest512, "a higher stack limit allows deeper calls");
+
+  // Limits outside MVM_STACK_SIZE to MVM_MAX_STACK_SIZE are clamped
+  check(deepestRec(10, MVM_STACK_SIZE) > 0, "a limit below MVM_STACK_SIZE is clamped to it");
+  check(deepestRec(0xFFFF, MVM_MAX_STACK_SIZE) == deepestMax, "a limit above MVM_MAX_STACK_SIZE is clamped to it");
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Checks that a tail-recursive bytecode function runs in constant VM stack
+ * space (MVM_TAIL_CALLS), using the fixture test/fixtures/tail_call.mvm-bc:
+ *
+ *   export 1: rec(n) = n < 1 ? 0 : n + rec(n - 1)
+ *   export 2: tstart(n) = trec(n, 0), where
+ *             trec(n, acc) = n < 1 ? acc : trec(n - 1, acc + n)
+ *
+ * Each call is made on a freshly restored VM, so the stack high-water mark is
+ * the peak of that call alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_REC 1
+#define EXPORT_TSTART 2
+
+static uint8_t image[4096];
+static size_t bytecodeSize;
+// The port fuses instructions in the bytecode passed to mvm_restore
+// (MVM_FUSE_IN_PLACE), so each VM is restored from a fresh copy of the image
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Calls the given export with the argument `n` on a fresh VM. Returns the
+// stack high-water mark of the call.
+static size_t measureCall(mvm_VMExportID exportID, int32_t n, mvm_TeError* err, int32_t* result) {
+  mvm_VM* vm;
+  mvm_Value function;
+  mvm_Value arg;
+  mvm_Value resultValue;
+  mvm_TsMemoryStats stats;
+
+  memcpy(bytecode, image, bytecodeSize);
+  if (mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport) != MVM_E_SUCCESS) {
+    printf("FAIL: could not restore the fixture\n");
+    exit(1);
+  }
+  if (mvm_resolveExports(vm, &exportID, &function, 1) != MVM_E_SUCCESS) {
+    printf("FAIL: could not resolve export %d\n", exportID);
+    exit(1);
+  }
+
+  arg = mvm_newInt32(vm, n);
+  *err = mvm_call(vm, function, &resultValue, &arg, 1);
+  *result = *err == MVM_E_SUCCESS ? mvm_toInt32(vm, resultValue) : 0;
+
+  mvm_getMemoryStats(vm, &stats);
+  mvm_free(vm);
+  return stats.stackHighWaterMark;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "fixtures/tail_call.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  bytecodeSize = fread(image, 1, sizeof image, f);
+  fclose(f);
+
+  mvm_TeError err;
+  int32_t result;
+
+  // Control: non-tail recursion uses more stack for deeper calls, so the
+  // high-water mark does measure the recursion
+  size_t recShallow = measureCall(EXPORT_REC, 5, &err, &result);
+  check(err == MVM_E_SUCCESS && result == 15, "rec(5) == 15");
+  size_t recDeep = measureCall(EXPORT_REC, 10, &err, &result);
+  check(err == MVM_E_SUCCESS && result == 55, "rec(10) == 55");
+  check(recDeep > recShallow, "rec(10) uses more stack than rec(5)");
+  printf("rec: depth 5 -> %d bytes, depth 10 -> %d bytes\n", (int)recShallow, (int)recDeep);
+
+  // Tail recursion runs in the same stack space at any depth, including depths
+  // that overflow the stack without tail calls
+  static const int32_t depths[] = { 1, 10, 100, 1000 };
+  size_t expected = 0;
+  for (size_t i = 0; i < sizeof depths / sizeof depths[0]; i++) {
+    int32_t n = depths[i];
+    size_t highWaterMark = measureCall(EXPORT_TSTART, n, &err, &result);
+    printf("tstart: depth %d -> %d bytes\n", (int)n, (int)highWaterMark);
+    check(err == MVM_E_SUCCESS, "tstart returns successfully");
+    check(result == n * (n + 1) / 2, "tstart(n) == n * (n + 1) / 2");
+    if (i == 0) {
+      expected = highWaterMark;
+    } else {
+      check(highWaterMark == expected, "tstart stack high-water mark is the same at every depth");
+    }
+  }
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Checks that mvm_restore rejects a corrupted bytecode image
+ * (MVM_VERIFY_BYTECODE). Each case patches the code of
+ * rec(n) = n < 1 ? 0 : n + rec(n - 1) (export 1 of the fixture
+ * test/fixtures/tail_call.mvm-bc), which starts with
+ *
+ *   LOAD_ARG 1; LOAD_SMALL_LITERAL 1; LESS_THAN; BRANCH_1 <offset>
+ *
+ * and then fixes the CRC, so that the image is only rejected by the verifier.
+ * Uses the app's microvium_port.h as is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "microvium.h"
+
+#define EXPORT_REC 1
+
+static uint8_t image[4096];
+static size_t bytecodeSize;
+static uint8_t bytecode[4096];
+static int failures = 0;
+
+void fatalError(void* vm, int e) {
+  printf("FAIL: fatal error %d\n", e);
+  exit(1);
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID hostFunctionID, void* context, mvm_TfHostFunction* out) {
+  return MVM_E_UNRESOLVED_IMPORT;
+}
+
+// Same as default_crc16 in microvium.c
+static uint16_t crc16(const uint8_t* p, size_t size) {
+  uint16_t r = 0xFFFF;
+  while (size--) {
+    r = (uint16_t)((r >> 8) | (r << 8));
+    r ^= *p++;
+    r ^= (r & 0xFF) >> 4;
+    r ^= (uint16_t)(r << 12);
+    r ^= (uint16_t)((r & 0xFF) << 5);
+  }
+  return r;
+}
+
+static uint16_t read2(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// The CRC covers everything after the first 8 bytes of the header
+static void fixCRC(uint8_t* p) {
+  uint16_t crc = crc16(p + 8, bytecodeSize - 8);
+  p[6] = (uint8_t)crc;
+  p[7] = (uint8_t)(crc >> 8);
+}
+
+// Offset of the code of the function with the given export ID
+static uint16_t findExport(const uint8_t* p, mvm_VMExportID exportID) {
+  // sectionOffsets[1] is the export table, which is followed by the
+  // shortcall table at sectionOffsets[2]
+  uint16_t exportTable = read2(p + 14);
+  uint16_t exportTableEnd = read2(p + 16);
+  for (uint16_t e = exportTable; e < exportTableEnd; e += 4) {
+    if (read2(p + e) == exportID) {
+      return read2(p + e + 2) & 0xFFFE;
+    }
+  }
+  printf("FAIL: export %d not found\n", exportID);
+  exit(1);
+}
+
+static mvm_TeError restore(void) {
+  mvm_VM* vm;
+  mvm_TeError err = mvm_restore(&vm, bytecode, bytecodeSize, NULL, resolveImport);
+  if (err == MVM_E_SUCCESS) {
+    mvm_free(vm);
+  }
+  return err;
+}
+
+int main(int argc, char** argv) {
+  static const struct {
+    const char* name;
+    uint8_t offset; // From the function header, which is 2 bytes before the code
+    uint8_t size;
+    uint8_t bytes[3];
+  } cases[] = {
+    { "stack underflow (POP on an empty stack)", 2, 1, { 0x67 } },
+    { "stack overflow (function header height 1)", 0, 1, { 0x01 } },
+    { "branch past the end of ROM", 6, 1, { 0x7F } },
+    { "invalid small literal", 3, 1, { 0x0C } },
+    { "global index out of range", 2, 3, { 0x89, 0x05, 0x00 } },
+    { "fused instruction in the image", 2, 2, { 0x64, 0x00 } },
+  };
+
+  const char* path = argc > 1 ? argv[1] : "fixtures/tail_call.mvm-bc";
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("FAIL: could not open %s\n", path);
+    return 1;
+  }
+  bytecodeSize = fread(image, 1, sizeof image, f);
+  fclose(f);
+
+  // The function header is the 2 bytes before the code
+  uint16_t header = findExport(image, EXPORT_REC) - 2;
+
+  // Control: the unmodified image is accepted, including with the CRC
+  // recalculated by this test
+  memcpy(bytecode, image, bytecodeSize);
+  fixCRC(bytecode);
+  if (memcmp(bytecode, image, bytecodeSize) != 0 || restore() != MVM_E_SUCCESS) {
+    printf("FAIL: the unmodified image is rejected\n");
+    failures++;
+  }
+
+  // A change without a matching CRC is caught by the CRC
+  memcpy(bytecode, image, bytecodeSize);
+  bytecode[header + 2] ^= 0xFF;
+  mvm_TeError err = restore();
+  if (err != MVM_E_BYTECODE_CRC_FAIL) {
+    printf("FAIL: an image with the wrong CRC returned %d\n", err);
+    failures++;
+  }
+
+  for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+    memcpy(bytecode, image, bytecodeSize);
+    memcpy(&bytecode[header + cases[i].offset], cases[i].bytes, cases[i].size);
+    fixCRC(bytecode);
+    err = restore();
+    printf("%s: error %d\n", cases[i].name, err);
+    if (err != MVM_E_INVALID_BYTECODE) {
+      printf("FAIL: expected MVM_E_INVALID_BYTECODE (%d)\n", MVM_E_INVALID_BYTECODE);
+      failures++;
+    }
+  }
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}